@@ -92,6 +92,21 @@ typedef struct DEVICEIMPL
     unsigned int      timeout
     );
 
+  /**
+   * Waits up to timeout for bytes to arrive and returns only those
+   * already received, without waiting to fill the buffer. NULL if
+   * Read already does so.
+   * @param device The device to read from
+   * @param buffer The buffer to read bytes into
+   * @param length The length of the buffer
+   */
+  int (*ReadQueued)(
+    LPSKYETEK_DEVICE  lpDevice,
+    unsigned char     *buffer,
+    unsigned int      length,
+    unsigned int      timeout
+    );
+
   /** 
    * Timeout value for the device.
    */
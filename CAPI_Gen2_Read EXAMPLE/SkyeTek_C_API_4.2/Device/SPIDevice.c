@@ -228,5 +228,6 @@ DEVICEIMPL SPIDeviceImpl = {
 	SPIDevice_Flush,
 	SPIDevice_Free,
   SPIDevice_SetAdditionalTimeout,
+  NULL,
   0
 };
@@ -671,6 +671,41 @@ SerialDevice_Read(
 	return bytesRead;
 }
 
+/* The Windows reads wait until the buffer is full, so only the first
+   byte is waited for and the rest are read as far as they are queued */
+int 
+SerialDevice_ReadQueued(
+  LPSKYETEK_DEVICE  device, 
+  unsigned char     *buffer, 
+  unsigned int      length,
+  unsigned int      timeout
+  )
+{
+#ifdef WIN32
+  COMSTAT stat;
+  DWORD errors;
+  int r, more;
+
+	if( (device == NULL) || (buffer == NULL) || (length == 0) )
+		return 0;
+  ZeroMemory(&stat, sizeof(COMSTAT));
+  ClearCommError(device->readFD, &errors, &stat);
+  if( stat.cbInQue > 0 )
+    return SerialDevice_Read(device, buffer, min(stat.cbInQue, length), timeout);
+
+  r = SerialDevice_Read(device, buffer, 1, timeout);
+  if( r <= 0 || length == 1 )
+    return r;
+  ClearCommError(device->readFD, &errors, &stat);
+  if( stat.cbInQue == 0 )
+    return r;
+  more = SerialDevice_Read(device, buffer + r, min(stat.cbInQue, length - r), timeout);
+  return (more > 0) ? r + more : r;
+#else
+  return SerialDevice_Read(device, buffer, length, timeout);
+#endif
+}
+
 int 
 SerialDevice_Write(
   LPSKYETEK_DEVICE    device, 
@@ -782,5 +817,6 @@ DEVICEIMPL SerialDeviceImpl = {
 	SerialDevice_Flush,
 	SerialDevice_Free,
   SerialDevice_SetAdditionalTimeout,
+  SerialDevice_ReadQueued,
   0
 };
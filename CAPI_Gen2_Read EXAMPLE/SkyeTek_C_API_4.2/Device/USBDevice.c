@@ -604,6 +604,7 @@ DEVICEIMPL USBDeviceImpl = {
 	USBDevice_Flush,
 	USBDevice_Free,
   USBDevice_SetAdditionalTimeout,
+  NULL,
   0
 };
 #endif
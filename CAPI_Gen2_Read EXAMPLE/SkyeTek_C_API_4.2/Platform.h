@@ -69,6 +69,55 @@
 	#define MUTEX_UNLOCK(m)
 #endif
 
+#if defined(WIN32) || defined(WINCE)
+	#define THREAD(t) HANDLE t
+	#define THREAD_RETURN DWORD WINAPI
+	#define THREAD_CREATE(t,f,a) ((*(t) = CreateThread(NULL, 0, (f), (a), 0, NULL)) != NULL)
+	#define THREAD_JOIN(t) { WaitForSingleObject(*(t), INFINITE); CloseHandle(*(t)); }
+#elif defined(HAVE_PTHREAD)
+	#include <pthread.h>
+	#define THREAD(t) pthread_t t
+	#define THREAD_RETURN void *
+	#define THREAD_CREATE(t,f,a) (pthread_create((t), NULL, (f), (a)) == 0)
+	#define THREAD_JOIN(t) pthread_join(*(t), NULL)
+#else
+	/* No threads; callers run the work on the calling thread */
+	#define THREAD(t) int t
+	#define THREAD_RETURN void *
+	#define THREAD_CREATE(t,f,a) 0
+	#define THREAD_JOIN(t)
+#endif
+
+/* Mutexes with static storage. They need no MUTEX_CREATE; the first
+   lock from any thread creates them. */
+#if defined(WIN32) || defined(WINCE)
+	typedef struct SKYETEK_STATIC_MUTEX
+	{
+		volatile LONG     state;    /* 0 not created, 1 being created, 2 ready */
+		CRITICAL_SECTION  cs;
+	} SKYETEK_STATIC_MUTEX;
+	#define STATIC_MUTEX(m) SKYETEK_STATIC_MUTEX m = { 0 }
+	#define STATIC_MUTEX_LOCK(m) EnterCriticalSection(SKYETEK_StaticMutex(m))
+	#define STATIC_MUTEX_UNLOCK(m) LeaveCriticalSection(&(m)->cs)
+#elif defined(HAVE_PTHREAD)
+	#define STATIC_MUTEX(m) pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER
+	#define STATIC_MUTEX_LOCK(m) pthread_mutex_lock(m)
+	#define STATIC_MUTEX_UNLOCK(m) pthread_mutex_unlock(m)
+#else
+	#define STATIC_MUTEX(m)
+	#define STATIC_MUTEX_LOCK(m)
+	#define STATIC_MUTEX_UNLOCK(m)
+#endif
+
+/* Orders memory accesses between threads that share data without a lock */
+#if defined(WIN32) || defined(WINCE)
+	#define MEMORY_BARRIER() MemoryBarrier()
+#elif defined(__GNUC__)
+	#define MEMORY_BARRIER() __sync_synchronize()
+#else
+	#define MEMORY_BARRIER()
+#endif
+
 #if defined(WIN32) || defined(WINCE)
 typedef unsigned char  UINT8; 
 typedef unsigned short UINT16; 
@@ -124,8 +173,13 @@ extern "C" {
 
 #ifdef WIN32
 #define SKYETEK_Sleep(x) 	Sleep(x)
+#define SKYETEK_GetTickCount()	GetTickCount()
+/* Creates a STATIC_MUTEX once and returns its critical section */
+CRITICAL_SECTION *SKYETEK_StaticMutex(SKYETEK_STATIC_MUTEX *m);
 #else
 #define SKYETEK_Sleep(x)	usleep(x*1000)
+/* Milliseconds from an arbitrary, monotonic starting point */
+unsigned long SKYETEK_GetTickCount(void);
 #endif
 
 
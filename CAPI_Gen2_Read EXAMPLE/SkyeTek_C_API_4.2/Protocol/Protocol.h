@@ -43,6 +43,17 @@ typedef unsigned char
     void  *user
     );
 
+/**
+ * One operation of a batch with the system parameter address
+ * and timeout already resolved by the reader.
+ */
+typedef struct PROTOCOL_BATCH_ITEM
+{
+  LPSKYETEK_BATCH_OPERATION   lpOp;
+  SKYETEK_ADDRESS             addr;
+  unsigned int                timeout;
+} PROTOCOL_BATCH_ITEM, *LPPROTOCOL_BATCH_ITEM;
+
 typedef struct PROTOCOLIMPL 
 {
   /** Protocol version */
@@ -175,6 +186,15 @@ typedef struct PROTOCOLIMPL
     void                                  *user
     );
 
+  SKYETEK_STATUS 
+  (*UploadFirmwareImage)(
+    LPSKYETEK_READER                      lpReader,
+    LPSKYETEK_FIRMWARE_IMAGE              lpImage, 
+    unsigned char                         defaultsOnly,
+    SKYETEK_FIRMWARE_PROGRESS_CALLBACK    callback, 
+    void                                  *user
+    );
+
   SKYETEK_STATUS 
   (*EnterPaymentScanMode)(
     LPSKYETEK_READER     lpReader,
@@ -648,6 +668,27 @@ typedef struct PROTOCOLIMPL
       unsigned int         timeout
       );
 
+  /* Optional: NULL if the protocol cannot pipeline requests */
+  SKYETEK_STATUS 
+  (*ExecuteBatch)(
+      LPSKYETEK_READER        lpReader,
+      LPPROTOCOL_BATCH_ITEM   lpItems,
+      unsigned int            count,
+      SKYETEK_STATUS          *lpStatus
+      );
+
+  /* Optional: NULL if the protocol cannot report inventory tags as they
+     are read. The callback may return 0 to ignore the rest. */
+  SKYETEK_STATUS 
+  (*InventoryTags)(
+      LPSKYETEK_READER             lpReader, 
+      SKYETEK_TAGTYPE              tagType, 
+      LPSKYETEK_ID                 lpTagIdMask,
+      PROTOCOL_TAG_SELECT_CALLBACK callback,
+      void                         *user,
+      unsigned int                 timeout
+      );
+
 } PROTOCOLIMPL, *LPPROTOCOLIMPL;
 
 
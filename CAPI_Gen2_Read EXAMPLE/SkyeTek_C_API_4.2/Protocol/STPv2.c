@@ -1212,7 +1212,7 @@ STPV2_SelectTags(
 	STPV2_REQUEST req;
 	STPV2_RESPONSE resp;
 	SKYETEK_STATUS status;
-  LPSKYETEK_DATA lpd;
+  SKYETEK_DATA data;
   LPREADER_IMPL lpri;
 	int ix = 0, iy = 0;
 
@@ -1270,17 +1270,16 @@ readResponse:
     else
       tagType = (SKYETEK_TAGTYPE)req.tagType;
 
-    lpd = SkyeTek_AllocateData(resp.dataLength);
-    SkyeTek_CopyBuffer(lpd,resp.data,resp.dataLength);
+    /* The callback copies what it keeps, so lend it the response */
+    data.data = resp.data;
+    data.size = resp.dataLength;
   
 		/* Call the callback */
-		if(!callback(tagType, lpd, user))
+		if(!callback(tagType, &data, user))
 		{
-      SkyeTek_FreeData(lpd);
 			STPV2_StopSelectLoop(lpReader,timeout);
       return SKYETEK_SUCCESS;
 		}
-    SkyeTek_FreeData(lpd);
 
 		/* Check for bail */
 		if(!flags.isInventory && !flags.isLoop)
@@ -1548,6 +1547,18 @@ STPV2_UploadFirmware(
   return SKYETEK_NOT_SUPPORTED;
 }
 
+SKYETEK_STATUS 
+STPV2_UploadFirmwareImage(
+    LPSKYETEK_READER                      lpReader,
+    LPSKYETEK_FIRMWARE_IMAGE              lpImage, 
+    unsigned char                         defaultsOnly,
+    SKYETEK_FIRMWARE_PROGRESS_CALLBACK    callback, 
+    void                                  *user
+  )
+{
+  return SKYETEK_NOT_SUPPORTED;
+}
+
 SKYETEK_STATUS 
 STPV2_EnterPaymentScanMode(
   LPSKYETEK_READER     lpReader,
@@ -2358,6 +2369,7 @@ PROTOCOLIMPL STPV2Impl = {
   STPV2_EnableDebug,
   STPV2_DisableDebug,
   STPV2_UploadFirmware,
+  STPV2_UploadFirmwareImage,
   STPV2_EnterPaymentScanMode,
   STPV2_ScanPayments,
   STPV2_SelectTag,
@@ -2415,5 +2427,7 @@ PROTOCOLIMPL STPV2Impl = {
   STPV2_TransportSend,
   STPV2_InitiatePayment,
   STPV2_ComputePayment,
-  STPV2_GetDebugMessages
+  STPV2_GetDebugMessages,
+  NULL,
+  NULL
 };
@@ -16,10 +16,6 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#ifndef WINCE
-#include <sys/types.h>
-#include <sys/stat.h>
-#endif
 
 #pragma warning(disable:4761)       // disable integral size mismatch warning
 
@@ -287,9 +283,6 @@ SKYETEK_API SKYETEK_STATUS STPV3_WriteRequest(
   unsigned int            timeout
   )
 {
-	unsigned int written = 0, totalWritten = 0;
-	int i = 0;
-	char c = 0;
 	SKYETEK_STATUS status;
   LPDEVICEIMPL pd;
 
@@ -303,6 +296,25 @@ SKYETEK_API SKYETEK_STATUS STPV3_WriteRequest(
   if( (status = STPV3_BuildRequest(req)) != SKYETEK_SUCCESS )
 		return status;
 
+  return STPV3_SendRequest(lpDevice,req,timeout);
+}
+
+SKYETEK_API SKYETEK_STATUS STPV3_SendRequest( 
+  LPSKYETEK_DEVICE        lpDevice, 
+  LPSTPV3_REQUEST         req,
+  unsigned int            timeout
+  )
+{
+	unsigned int written = 0, totalWritten = 0;
+  LPDEVICEIMPL pd;
+
+  if( lpDevice == NULL || req == NULL || req->msgLength == 0 )
+    return SKYETEK_INVALID_PARAMETER;
+
+  pd = (LPDEVICEIMPL)lpDevice->internal;
+  if( pd == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
 	STP_DebugMsg(_T("request"), req->msg, req->msgLength, req->isASCII);
 	SkyeTek_Debug(_T("code: %s\r\n"), STPV3_LookupCommand(req->cmd));
 
@@ -673,141 +685,179 @@ SKYETEK_STATUS STPV3_GetStatus(unsigned int code)
 	return SKYETEK_FAILURE;
 }
 
-
-/* CRC calculation */
-UINT16 crcBL16(UINT8 *dataP, UINT16 nBytes, UINT16 preset)
+static LPSTPV3_SELECTION
+STPV3_GetSelection(
+  LPSKYETEK_READER    lpReader
+  )
 {
-    UINT16 i, j;
-	UINT8 mBits = 8;
-
-  	UINT16 crc_16 = preset;
+  if( lpReader == NULL || lpReader->lpProtocol == NULL )
+    return NULL;
+  return (LPSTPV3_SELECTION)SkyeTekReader_GetPrivate(lpReader->lpProtocol, PRIVATE_SELECTION);
+}
 
-	for( i=0; i<nBytes; i++ )
-	{
-	 	crc_16 ^= *dataP++;
-		
-		for( j=0; j<mBits; j++ )
-		{
-			if( crc_16 & 0x0001 )
-			{
-				crc_16 >>= 1;
-				crc_16 ^= 0x8408;  // Polynomial (x^16 + x^12 + x^5 + 1)
-			}
-		    else
-			{
-				crc_16 >>= 1;
-			}
-		}
-	}
+static void
+STPV3_SetSelection(
+  LPSKYETEK_READER    lpReader,
+  LPSTPV3_REQUEST     req,
+  unsigned short      session
+  )
+{
+  LPSTPV3_SELECTION sel = STPV3_GetSelection(lpReader);
 
-	return( crc_16 );
+  if( req->tidLength == 0 || req->tidLength > sizeof(sel->tid) )
+    return;
+  if( sel == NULL && lpReader->lpProtocol != NULL )
+  {
+    sel = (LPSTPV3_SELECTION)malloc(sizeof(STPV3_SELECTION));
+    if( sel != NULL &&
+        SkyeTekReader_SetPrivate(lpReader->lpProtocol, PRIVATE_SELECTION, sel) != SKYETEK_SUCCESS )
+    {
+      free(sel);
+      sel = NULL;
+    }
+  }
+  if( sel == NULL )
+    return;
+  memset(sel,0,sizeof(STPV3_SELECTION));
+  memcpy(sel->tid,req->tid,req->tidLength);
+  sel->tidLength = req->tidLength;
+  sel->session = session;
 }
 
-UINT16 verifyBLcrc(UINT8 *resp, UINT16 len)
+void 
+STPV3_ClearSelection(
+  LPSKYETEK_READER    lpReader
+  )
 {
-  UINT16 crc_check;
-  
-	crc_check = crcBL16(resp, len-2, 0x0000);
-	if(resp[len-2] == (crc_check >> 8) &&
-     resp[len-1] == (crc_check & 0x00FF))
-		return 1;
-	else
-		return 0;
+  LPSTPV3_SELECTION sel = STPV3_GetSelection(lpReader);
+  if( sel != NULL )
+    memset(sel,0,sizeof(STPV3_SELECTION));
 }
 
-/* Function to send commands to the bootloader */
-UINT16 
-sendBLCommand(
-  LPSKYETEK_DEVICE  lpDevice, 
-  UINT8           commandCode, 
-  UINT8           *commandData, 
-  UINT16          numBytes, 
-  UINT8           *respString 
-  ) 
+/* Commands that must not run twice; they are always sent by ID so a
+   lost session never leaves their outcome in doubt */
+static int
+STPV3_IsIdempotent(
+  unsigned int    cmd
+  )
 {
-  LPDEVICEIMPL pd;
-	union _16Bits crc;
-	union _16Bits len;
-	UINT8 temp;
-  int i = 0, num = 0, bytes = 0, count = 0, totalCount = 0;
-
-  if( lpDevice == NULL )
-    return 0;
-  pd = (LPDEVICEIMPL)lpDevice->internal;
-  if( pd == NULL )
-    return 0;
-
-	crc.w = 0x0000;
-
-	len.w = numBytes + 3;	/* Adjust numbytes for the command code and crc bytes */
-
-	/* Calculate the CRC over the nuber of bytes field */
-	temp = len.b[1];
-	crc.w = crcBL16(&temp, 1, crc.w);
-	temp = len.b[0];
-	crc.w = crcBL16(&temp, 1, crc.w);
-
-	/* Calculate the CRC over the command Code and command Data */
-	crc.w = crcBL16(&commandCode, 1, crc.w);
-	crc.w = crcBL16(commandData, numBytes, crc.w);
-	
-	/* Send the Command to the reader */
-sendcommand:
-	temp = len.b[1];
-	pd->Write(lpDevice, &temp, 1, 100);
-	temp = len.b[0];
-	pd->Write(lpDevice, &temp, 1, 100);
-	pd->Write(lpDevice, &commandCode, 1, 100);
-	pd->Write(lpDevice, commandData, numBytes, 500);
-
-	temp = crc.b[1];
-	pd->Write(lpDevice, &temp, 1, 100);
-	temp = crc.b[0];
-	pd->Write(lpDevice, &temp, 1, 100);
-	
-  pd->Flush(lpDevice);
-
-	/* Wait for the response */
-  if( commandCode == SETUP_BOOTLOADER )
-    SKYETEK_Sleep(3000);
-
-	/* Now get the response back form the reader */
-  count = 0;
-readresponse:
-	num = pd->Read(lpDevice, respString, 2, 500);
-  if( num != 2 )
+  switch( cmd )
   {
-    count++;
-    if( count > 5 )
-      return num;
-    pd->Flush(lpDevice);
-    goto readresponse;
+    case STPV3_CMD_KILL_TAG:
+    case STPV3_CMD_CREDIT_VALUE_FILE:
+    case STPV3_CMD_DEBIT_VALUE_FILE:
+    case STPV3_CMD_LIMITED_CREDIT_VALUE_FILE:
+    case STPV3_CMD_COMMIT_TRANSACTION:
+    case STPV3_CMD_ABORT_TRANSACTION:
+    case STPV3_CMD_WRITE_RECORD:
+    case STPV3_CMD_CHANGE_KEY:
+    case STPV3_CMD_CHANGE_KEY_SETTINGS:
+      return 0;
+    default:
+      return 1;
   }
+}
 
-  bytes = (int)respString[1];
-  num = 2 + pd->Read(lpDevice,respString+2,bytes,500);
+/* Sends the session instead of the ID when lpTag is the selected tag */
+static void
+STPV3_ApplySelection(
+  LPSKYETEK_READER    lpReader,
+  LPSKYETEK_TAG       lpTag,
+  LPSTPV3_REQUEST     req
+  )
+{
+  LPSTPV3_SELECTION sel = STPV3_GetSelection(lpReader);
 
-  /* Verify CRC */
-  if( !verifyBLcrc(respString,num) )
+  if( sel == NULL || sel->tidLength == 0 )
+    return;
+  /* The last command that used it did not get through */
+  if( sel->pending )
   {
-    totalCount++;
-    if( totalCount > 4 )
-      return 0;
-    goto sendcommand;
+    STPV3_ClearSelection(lpReader);
+    return;
   }
-  
-  /* Check command code */
-  if( respString[2] != commandCode )
+  if( !(req->flags & STPV3_TID) )
   {
-    totalCount++;
-    if( totalCount > 4 )
-      return 0;
-    goto sendcommand;
+    /* The tag loses its session once the field drops */
+    if( !(req->flags & STPV3_RF) )
+      STPV3_ClearSelection(lpReader);
+    return;
+  }
+  if( req->tidLength != sel->tidLength || memcmp(req->tid,sel->tid,sel->tidLength) != 0 ||
+      !STPV3_IsIdempotent(req->cmd) )
+  {
+    /* The reader singulates the tag by ID again */
+    STPV3_ClearSelection(lpReader);
+    return;
   }
 
-  return num;
+  /* Address the tag by its session; the ID is not sent again */
+  sel->release = !(req->flags & STPV3_RF);
+  sel->flags = req->flags;
+  sel->reqSession = req->session;
+  req->flags &= ~STPV3_TID;
+  req->flags |= STPV3_SESSION;
+  req->session = sel->session;
+  req->tidLength = 0;
+  sel->pending = 1;
+}
+
+/* Puts the ID back into a request the reader refused for its session;
+   returns 1 if it should be sent again. The reader did not run it, so
+   it is safe to send again. Commands on state the select set up, such
+   as an authentication or a DESFire application, are not sent again
+   since selecting by ID loses that state. */
+static int
+STPV3_RetrySelection(
+  LPSKYETEK_READER    lpReader,
+  LPSTPV3_REQUEST     req,
+  unsigned int        code
+  )
+{
+  LPSTPV3_SELECTION sel = STPV3_GetSelection(lpReader);
+
+  if( sel == NULL || !sel->pending || sel->tidLength == 0 || (req->flags & STPV3_TID) )
+    return 0;
+  if( code != STPV3_RESP_INVALID_SESSION ||
+      (req->cmd >= STPV3_CMD_AUTHENTICATE_TAG && req->cmd <= STPV3_CMD_CHANGE_KEY) )
+  {
+    STPV3_ClearSelection(lpReader);
+    return 0;
+  }
+  req->flags = sel->flags;
+  req->session = sel->reqSession;
+  memcpy(req->tid,sel->tid,sel->tidLength);
+  req->tidLength = sel->tidLength;
+  STPV3_ClearSelection(lpReader);
+  return 1;
+}
+
+/* Called when a request ApplySelection saw got no usable answer; the
+   tag's session is then unknown */
+static void
+STPV3_DropSelection(
+  LPSKYETEK_READER    lpReader
+  )
+{
+  LPSTPV3_SELECTION sel = STPV3_GetSelection(lpReader);
+  if( sel != NULL && sel->pending )
+    STPV3_ClearSelection(lpReader);
 }
 
+/* Called once the reader answered a request ApplySelection saw */
+static void
+STPV3_KeepSelection(
+  LPSKYETEK_READER    lpReader
+  )
+{
+  LPSTPV3_SELECTION sel = STPV3_GetSelection(lpReader);
+  if( sel == NULL )
+    return;
+  if( sel->release )
+    STPV3_ClearSelection(lpReader);
+  else
+    sel->pending = 0;
+}
 
 
 SKYETEK_STATUS 
@@ -840,6 +890,10 @@ STPV3_SendCommand(
     req.flags |= STPV3_RID;
   }
 
+  /* The tag loses its session once the field drops */
+  if( !(req.flags & STPV3_RF) )
+    STPV3_ClearSelection(lpReader);
+
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
@@ -890,6 +944,10 @@ STPV3_SendGetCommand(
     req.flags |= STPV3_RID;
   }
 
+  /* The tag loses its session once the field drops */
+  if( !(req.flags & STPV3_RF) )
+    STPV3_ClearSelection(lpReader);
+
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
@@ -948,6 +1006,10 @@ STPV3_SendSetCommand(
     req.flags |= STPV3_RID;
   }
 
+  /* The tag loses its session once the field drops */
+  if( !(req.flags & STPV3_RF) )
+    STPV3_ClearSelection(lpReader);
+
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
@@ -1003,6 +1065,10 @@ STPV3_SendAddrGetCommand(
     req.flags |= STPV3_RID;
   }
 
+  /* The tag loses its session once the field drops */
+  if( !(req.flags & STPV3_RF) )
+    STPV3_ClearSelection(lpReader);
+
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
@@ -1066,6 +1132,10 @@ STPV3_SendAddrSetCommand(
     req.flags |= STPV3_RID;
   }
 
+  /* The tag loses its session once the field drops */
+  if( !(req.flags & STPV3_RF) )
+    STPV3_ClearSelection(lpReader);
+
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
@@ -1126,23 +1196,35 @@ STPV3_SendTagCommand(
     lpri->CopyRIDToBuffer(lpReader,req.rid);
     req.flags |= STPV3_RID;
   }
+  STPV3_ApplySelection(lpReader,lpTag,&req);
 
 writeCommand:
 	/* Send request */
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 
 	/* Read response */
 	memset(&resp,0,sizeof(STPV3_RESPONSE));
 	status = STPV3_ReadResponse(lpReader->lpDevice, &req, &resp, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
   
   if(resp.code == STPV3_RESP_SELECT_TAG_LOOP_OFF)
     goto writeCommand;
   else if(resp.code != cmd)
+  {
+    if( STPV3_RetrySelection(lpReader,&req,resp.code) )
+      goto writeCommand;
     return STPV3_GetStatus(resp.code);
+  }
+  STPV3_KeepSelection(lpReader);
   
   return SKYETEK_SUCCESS;	
 }
@@ -1190,21 +1272,33 @@ STPV3_SendGetTagCommand(
     lpri->CopyRIDToBuffer(lpReader,req.rid);
     req.flags |= STPV3_RID;
   }
+  STPV3_ApplySelection(lpReader,lpTag,&req);
 
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 
 	memset(&resp,0,sizeof(STPV3_RESPONSE));
 	status = STPV3_ReadResponse(lpReader->lpDevice, &req, &resp, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 	
   if(resp.code == STPV3_RESP_SELECT_TAG_LOOP_OFF)
     goto writeCommand;
   else if(resp.code != cmd)
+  {
+    if( STPV3_RetrySelection(lpReader,&req,resp.code) )
+      goto writeCommand;
     return STPV3_GetStatus(resp.code);
+  }
+  STPV3_KeepSelection(lpReader);
   
   *lpData = SkyeTek_AllocateData(resp.dataLength);
   if( *lpData == NULL )
@@ -1262,21 +1356,33 @@ STPV3_SendSetTagCommand(
     lpri->CopyRIDToBuffer(lpReader,req.rid);
     req.flags |= STPV3_RID;
   }
+  STPV3_ApplySelection(lpReader,lpTag,&req);
 
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 
   memset(&resp,0,sizeof(STPV3_RESPONSE));
 	status = STPV3_ReadResponse(lpReader->lpDevice, &req, &resp, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 	
   if(resp.code == STPV3_RESP_SELECT_TAG_LOOP_OFF)
     goto writeCommand;
   else if(resp.code != cmd)
+  {
+    if( STPV3_RetrySelection(lpReader,&req,resp.code) )
+      goto writeCommand;
     return STPV3_GetStatus(resp.code);
+  }
+  STPV3_KeepSelection(lpReader);
     
   return SKYETEK_SUCCESS; 
 
@@ -1332,21 +1438,33 @@ STPV3_SendGetSetTagCommand(
     lpri->CopyRIDToBuffer(lpReader,req.rid);
     req.flags |= STPV3_RID;
   }
+  STPV3_ApplySelection(lpReader,lpTag,&req);
 
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 
 	memset(&resp,0,sizeof(STPV3_RESPONSE));
 	status = STPV3_ReadResponse(lpReader->lpDevice, &req, &resp, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 	
   if(resp.code == STPV3_RESP_SELECT_TAG_LOOP_OFF)
     goto writeCommand;
   else if(resp.code != cmd)
+  {
+    if( STPV3_RetrySelection(lpReader,&req,resp.code) )
+      goto writeCommand;
     return STPV3_GetStatus(resp.code);
+  }
+  STPV3_KeepSelection(lpReader);
     
   *lpRecvData = SkyeTek_AllocateData(resp.dataLength);
   if( *lpRecvData == NULL )
@@ -1401,21 +1519,33 @@ STPV3_SendAddrGetTagCommand(
     lpri->CopyRIDToBuffer(lpReader,req.rid);
     req.flags |= STPV3_RID;
   }
+  STPV3_ApplySelection(lpReader,lpTag,&req);
 
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 
 	memset(&resp,0,sizeof(STPV3_RESPONSE));
 	status = STPV3_ReadResponse(lpReader->lpDevice, &req, &resp, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 	
   if(resp.code == STPV3_RESP_SELECT_TAG_LOOP_OFF)
     goto writeCommand;
   else if(resp.code != cmd)
+  {
+    if( STPV3_RetrySelection(lpReader,&req,resp.code) )
+      goto writeCommand;
     return STPV3_GetStatus(resp.code);
+  }
+  STPV3_KeepSelection(lpReader);
   
   *lpData = SkyeTek_AllocateData(resp.dataLength);
   if( *lpData == NULL )
@@ -1477,27 +1607,37 @@ STPV3_SendAddrSetTagCommand(
     lpri->CopyRIDToBuffer(lpReader,req.rid);
     req.flags |= STPV3_RID;
   }
+  STPV3_ApplySelection(lpReader,lpTag,&req);
 
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
-		return status;  
+  {
+    STPV3_DropSelection(lpReader);
+		return status;
+  }
 
 	memset(&resp,0,sizeof(STPV3_RESPONSE));
 	status = STPV3_ReadResponse(lpReader->lpDevice, &req, &resp, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
   
   if(resp.code == STPV3_RESP_SELECT_TAG_LOOP_OFF)
     goto writeCommand;
   else if(resp.code != cmd)
   {
+    if( STPV3_RetrySelection(lpReader,&req,resp.code) )
+      goto writeCommand;
 	  // hack around firmware returning same status as inventory done
 	  if( resp.code == STPV3_RESP_SELECT_TAG_INVENTORY_DONE )
 		  return SKYETEK_FAILURE;
 	  else
 		return STPV3_GetStatus(resp.code);
   }
+  STPV3_KeepSelection(lpReader);
   
   return SKYETEK_SUCCESS;	
 }
@@ -1555,21 +1695,33 @@ STPV3_SendAddrGetSetTagCommand(
     lpri->CopyRIDToBuffer(lpReader,req.rid);
     req.flags |= STPV3_RID;
   }
+  STPV3_ApplySelection(lpReader,lpTag,&req);
 
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 
 	memset(&resp,0,sizeof(STPV3_RESPONSE));
 	status = STPV3_ReadResponse(lpReader->lpDevice, &req, &resp, timeout);
 	if( status != SKYETEK_SUCCESS )
+  {
+    STPV3_DropSelection(lpReader);
 		return status;
+  }
 	
   if(resp.code == STPV3_RESP_SELECT_TAG_LOOP_OFF)
     goto writeCommand;
   else if(resp.code != cmd)
+  {
+    if( STPV3_RetrySelection(lpReader,&req,resp.code) )
+      goto writeCommand;
     return STPV3_GetStatus(resp.code);
+  }
+  STPV3_KeepSelection(lpReader);
     
   *lpRecvData = SkyeTek_AllocateData(resp.dataLength);
   if( *lpRecvData == NULL )
@@ -1607,6 +1759,10 @@ STPV3_StopSelectLoop(
   }
 
 	/* Send request */
+  /* The tag loses its session once the field drops */
+  if( !(req.flags & STPV3_RF) )
+    STPV3_ClearSelection(lpReader);
+
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
 		return status;
@@ -1635,7 +1791,7 @@ STPV3_SelectTags(
 	STPV3_REQUEST req;
 	STPV3_RESPONSE resp;
 	SKYETEK_STATUS status;
-  LPSKYETEK_DATA lpd;
+  SKYETEK_DATA data;
   LPREADER_IMPL lpri;
 	int ix = 0, iy = 0;
 
@@ -1643,6 +1799,7 @@ STPV3_SelectTags(
     return SKYETEK_INVALID_PARAMETER;
   if( lpReader->lpDevice == NULL || lpReader->internal == NULL)
     return SKYETEK_INVALID_PARAMETER;
+  STPV3_ClearSelection(lpReader);
 
 	/* Build request */
 	memset(&req,0,sizeof(STPV3_REQUEST));
@@ -1691,17 +1848,16 @@ readResponse:
     else
       tagType = (SKYETEK_TAGTYPE)req.tagType;
 
-    lpd = SkyeTek_AllocateData(resp.dataLength);
-    SkyeTek_CopyBuffer(lpd,resp.data,resp.dataLength);
+    /* The callback copies what it keeps, so lend it the response */
+    data.data = resp.data;
+    data.size = resp.dataLength;
   
 		/* Call the callback */
-		if(!callback(tagType, lpd, user))
+		if(!callback(tagType, &data, user))
 		{
-      SkyeTek_FreeData(lpd);
 			STPV3_StopSelectLoop(lpReader,timeout);
       return SKYETEK_SUCCESS;
 		}
-    SkyeTek_FreeData(lpd);
 
 		/* Check for bail */
 		if(!flags.isInventory && !flags.isLoop)
@@ -1733,6 +1889,7 @@ STPV3_GetTags(
     return SKYETEK_INVALID_PARAMETER;
   if( lpReader->lpDevice == NULL || lpReader->internal == NULL)
     return SKYETEK_INVALID_PARAMETER;
+  STPV3_ClearSelection(lpReader);
 
 	/* Build request */
 	memset(&req,0,sizeof(STPV3_REQUEST));
@@ -1838,6 +1995,7 @@ STPV3_GetTagsWithMask(
     return SKYETEK_INVALID_PARAMETER;
   if( lpReader->lpDevice == NULL || lpReader->internal == NULL)
     return SKYETEK_INVALID_PARAMETER;
+  STPV3_ClearSelection(lpReader);
 
 	/* Build request */
 	memset(&req,0,sizeof(STPV3_REQUEST));
@@ -1930,6 +2088,85 @@ success:
   return SKYETEK_SUCCESS;
 }
 
+SKYETEK_STATUS 
+STPV3_InventoryTags(
+  LPSKYETEK_READER             lpReader, 
+  SKYETEK_TAGTYPE              tagType, 
+  LPSKYETEK_ID                 lpTagIdMask,
+  PROTOCOL_TAG_SELECT_CALLBACK callback,
+  void                         *user,
+  unsigned int                 timeout
+  )
+{
+	STPV3_REQUEST req;
+	STPV3_RESPONSE resp;
+	SKYETEK_STATUS status;
+  SKYETEK_DATA data;
+  LPREADER_IMPL lpri;
+  unsigned char wanted = 1;
+	unsigned int iy = 0;
+
+  if( lpReader == NULL || callback == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  if( lpReader->lpDevice == NULL || lpReader->internal == NULL)
+    return SKYETEK_INVALID_PARAMETER;
+  STPV3_ClearSelection(lpReader);
+
+	/* Build request */
+	memset(&req,0,sizeof(STPV3_REQUEST));
+	req.cmd = STPV3_CMD_SELECT_TAG;
+	req.flags = STPV3_CRC | STPV3_INV;
+	req.tagType = tagType;
+	if( lpTagIdMask != NULL && lpTagIdMask->id != NULL )
+	{
+		req.tidLength = lpTagIdMask->length;
+		for(iy = 0; iy < lpTagIdMask->length && iy < 16; iy++)
+			req.tid[iy] = lpTagIdMask->id[iy];
+		req.flags |= STPV3_TID;
+	}
+  lpri = (LPREADER_IMPL)lpReader->internal;
+  if( lpReader->sendRID || !lpri->DoesRIDMatch(lpReader,genericID) )
+  {
+    lpri->CopyRIDToBuffer(lpReader,req.rid);
+    req.flags |= STPV3_RID;
+  }
+
+	/* Send request */
+	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
+	if( status != SKYETEK_SUCCESS )
+		return status;
+  
+readResponse:
+	memset(&resp,0,sizeof(STPV3_RESPONSE));
+	status = STPV3_ReadResponse(lpReader->lpDevice, &req, &resp, timeout);
+	if( status != SKYETEK_SUCCESS )
+  {
+    /* Masked inventories end without an inventory done response */
+    if( req.flags & STPV3_TID )
+      return SKYETEK_SUCCESS;
+    return status;
+  }
+
+	if( resp.code == STPV3_RESP_SELECT_TAG_FAIL || resp.code == STPV3_RESP_SELECT_TAG_INVENTORY_DONE )
+		return SKYETEK_SUCCESS;
+
+	if( resp.code == STPV3_RESP_SELECT_TAG_PASS )
+	{
+    /* Lend the callback the response; it copies what it keeps */
+    data.data = resp.data;
+    data.size = resp.dataLength;
+    if( wanted )
+      wanted = callback((resp.tagType != 0) ? (SKYETEK_TAGTYPE)resp.tagType : tagType, &data, user);
+
+		/* Keep reading until the inventory is done */
+		goto readResponse;
+	}
+
+  /* Unknown code? */
+  SkyeTek_Debug(_T("Unknown response code: 0x%X\r\n"), resp.code);
+  return SKYETEK_SUCCESS;
+}
+
 
 SKYETEK_STATUS 
 STPV3_StoreKey(
@@ -1970,6 +2207,10 @@ STPV3_StoreKey(
     req.flags |= STPV3_RID;
   }
 
+  /* The tag loses its session once the field drops */
+  if( !(req.flags & STPV3_RF) )
+    STPV3_ClearSelection(lpReader);
+
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
@@ -2020,6 +2261,10 @@ STPV3_LoadKey(
     req.flags |= STPV3_RID;
   }
 
+  /* The tag loses its session once the field drops */
+  if( !(req.flags & STPV3_RF) )
+    STPV3_ClearSelection(lpReader);
+
 writeCommand:
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
@@ -2045,6 +2290,7 @@ STPV3_LoadDefaults(
   unsigned int         timeout
   )
 {
+  STPV3_ClearSelection(lpReader);
   return STPV3_SendCommand(lpReader,STPV3_CMD_LOAD_DEFAULTS,0,timeout);
 }
 
@@ -2054,6 +2300,7 @@ STPV3_ResetDevice(
   unsigned int         timeout
   )
 {
+  STPV3_ClearSelection(lpReader);
   return STPV3_SendCommand(lpReader,STPV3_CMD_RESET_DEVICE,0,timeout);
 }
 
@@ -2063,6 +2310,7 @@ STPV3_Bootload(
   unsigned int         timeout
   )
 {
+  STPV3_ClearSelection(lpReader);
   return STPV3_SendCommand(lpReader,STPV3_CMD_BOOTLOAD,0,timeout);
 }
 
@@ -2149,385 +2397,92 @@ STPV3_GetDebugMessages(
 }
 
 SKYETEK_STATUS 
-STPV3_UploadFirmware(
-    LPSKYETEK_READER                      lpReader,
-    TCHAR                                  *file, 
-    unsigned char                         defaultsOnly,
-    SKYETEK_FIRMWARE_UPLOAD_CALLBACK      callback, 
-    void                                  *user
-  )
+STPV3_EnterPaymentScanMode(LPSKYETEK_READER lpReader,
+                           unsigned int timeout)
 {
-	/* Variable Declarations and Initializations */
-	UINT8 blInitString[9];
-	FILE* shfFile;
-	UINT8 tempBuf[16];
-	UINT8 encryptedDataBuf[512];
-	UINT8 responseBuf[512];
-	union _32Bits dataLen;
-	UINT8 commandCode;
-	UINT32 i, retryCount;
-	union _16Bits structLen;
-	union _16Bits structVer;
-	union _16Bits blockLen;
-	union _32Bits blVer;
-	UINT8 encryptionScheme;
-	UINT16 byteCount;
-	UINT8 sysParamStrLen;
-	UINT8 sysParamBuf[100];
-  UINT8 pr = 0;
-  long minFileSize = 8;
-  size_t nr = 0;
-  unsigned int ver = 0;
-  long st_size = 0;
-
-#ifndef WINCE
-#ifdef WIN32
-  struct _stat stb;
-#else
-  struct stat stb;
-#endif
-#endif
-
-  /* Check inputs */
-  if( lpReader == NULL || callback == NULL || file == NULL )
-    return SKYETEK_INVALID_PARAMETER;
-
-  /* Initialize the byteCount variable */
-	byteCount = 0;
-
-  #ifndef WINCE
-  /* Verify file length */
-  #ifdef WIN32
-  if(_tstat( file, &stb ))
-    return SKYETEK_FIRMWARE_BAD_FILE;
-  #else
-  if(stat( file, &stb ))
-    return SKYETEK_FIRMWARE_BAD_FILE;
-  #endif
-
-  st_size = stb.st_size;
-  #else
-  fseek(file, 0, SEEK_END);
-  st_size = ftell(file);
-  fseek(file, 0, SEEK_SET);
-  #endif
-
-  if( st_size < minFileSize )
-    return SKYETEK_FIRMWARE_BAD_FILE;
-
-	/* Try and open the file */
-	shfFile = _tfopen( file, _T("rb"));
-	if(shfFile == NULL)
-		return SKYETEK_FIRMWARE_BAD_FILE;
-	
-	/* Now start reading from the file and copy everything into different fields */
-
-  /* Some progress bar movement */
-  if( !callback(5,ver,user) )
-  {
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_CANCELED;
-  }
-
-	/* Read the length of the structure from the shf file */
-	nr = fread( tempBuf, 1, 2, shfFile );
-  if( nr < 1)
-	{
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_BAD_FILE;
-	}
-	structLen.b[1] = tempBuf[0];
-	structLen.b[0] = tempBuf[1];
-
-  /* Some progress bar movement */
-  if( !callback(6,ver,user) )
-  {
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_CANCELED;
-  }
-
-	/* Copy the Structure Version */
-	nr = fread( tempBuf, 1, 2, shfFile );
-  if( nr < 1)
-	{
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_BAD_FILE;
-	}
-	structVer.b[1] = tempBuf[0];
-	structVer.b[0] = tempBuf[1];
-	
-	byteCount += 2;
-
-	/* Copy the BL Version */
-	nr = fread( tempBuf, 1, 4, shfFile );
-	if( nr < 1)
-	{
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_BAD_FILE;
-	}
-  blVer.b[3] = tempBuf[0];
-	blVer.b[2] = tempBuf[1];
-	blVer.b[1] = tempBuf[2];
-	blVer.b[0] = tempBuf[3];
-  ver = blVer.l;
-
-  /* update GUI with version */
-  if( !callback(6,ver,user) )
-  {
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_CANCELED;
-  }
-
-	byteCount += 4;
-
-	/* Copy the Encryption Scheme */
-	nr = fread( tempBuf, 1, 1, shfFile );
-	if( nr < 1)
-	{
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_BAD_FILE;
-	}
-  encryptionScheme = tempBuf[0];
-	
-	byteCount += 1;
-
-  /* Some progress bar movement */
-  if( !callback(7,ver,user) )
-  {
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_CANCELED;
-  }
-
-	/* Copy the Bootloader initialization String */
-	nr = fread( &blInitString[0], 1, 1, shfFile );
-  if( nr < 1)
-	{
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_BAD_FILE;
-	}
-
-  /* Check blInitString[0] */
-  /* blInitString can be 0 for non CBC ciphers */
-  if( blInitString[0] > 8 )
-  {
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_BAD_FILE;
-  }
-
-  if(blInitString[0])
-  {
-	/* Make sure we have enough */
-	minFileSize += blInitString[0];
-	if( st_size < minFileSize )
-	{
-  		fclose(shfFile);
-		return SKYETEK_FIRMWARE_BAD_FILE;
-	}  
-	nr = fread( &blInitString[1], 1, blInitString[0], shfFile );
-	if( nr < 1)
-	{
-		fclose(shfFile);
-		return SKYETEK_FIRMWARE_BAD_FILE;
-	}
-	
-	
-	byteCount += blInitString[0];
-  }
-  byteCount += 1;
-	/* Read the Bootloader Version and Make sure that this shf file can be supported by the bootloader */
-	commandCode = QUERY_BOOTLDR_VER;
-	if( sendBLCommand(lpReader->lpDevice, commandCode, tempBuf, 0, responseBuf) == 0 )
-  {
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_READER_ERROR;
-  }
-
-  /* Some progress bar movement */
-  if( !callback(8,ver,user) )
-  {
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_CANCELED;
-  }
-  
-	/* Seek to the encrypted data block portion of the shf file */
-	fseek( shfFile, structLen.w + 2, SEEK_SET );
-
-	/* Copy the Encrypted Block Length from the shf file */
-	/* This is a 4 byte number */
-	nr = fread(tempBuf, 1, 4, shfFile);
-	if( nr < 1)
-	{
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_BAD_FILE;
-	}
-  dataLen.b[3] = tempBuf[0];
-	dataLen.b[2] = tempBuf[1];
-	dataLen.b[1] = tempBuf[2];
-	dataLen.b[0] = tempBuf[3];
+  return STPV3_SendCommand(lpReader,STPV3_CMD_ENTER_PAYMENT_SCAN_MODE,0,timeout);
+}
 
-  /* Make sure we have enough */
-  minFileSize += dataLen.l;
-  if( st_size < minFileSize )
-  {
-  	fclose(shfFile);
-    return SKYETEK_FIRMWARE_BAD_FILE;
-  }
+#define STPV3_LINE_BUFFER_SIZE  1024
+#define STPV3_SCAN_IDLE         100   /* ms between idle callbacks */
 
-	/* Set the Encryption Scheme */
-	commandCode = SELECT_ENCRYPTION_SCHEME;
-	tempBuf[0] = encryptionScheme;	/* Choose the encryption scheme */
-	if( sendBLCommand(lpReader->lpDevice,commandCode, tempBuf, 1, responseBuf) == 0 )
-  {
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_READER_ERROR;
-  }
+/* Bytes read from the device that have not been returned as lines yet */
+typedef struct STPV3_LINE_READER
+{
+  unsigned char   buffer[STPV3_LINE_BUFFER_SIZE];
+  unsigned int    head;
+  unsigned int    tail;
+} STPV3_LINE_READER, *LPSTPV3_LINE_READER;
 
-  /* Some progress bar movement */
-  if( !callback(9,ver,user) )
-  {
-    fclose(shfFile);
-		return SKYETEK_FIRMWARE_CANCELED;
-  }
+/**
+ * Returns the next line, without the line ending. Reads from the
+ * device as many bytes as are available at a time and looks for
+ * the end of the line in what was read. Devices whose Read waits to
+ * fill the buffer are read with ReadQueued.
+ * @return 1 if line holds a line, 0 if the deadline passed first,
+ *         -1 on a device error
+ */
+static int
+STPV3_ReadLine(
+  LPSKYETEK_DEVICE      lpDevice,
+  LPSTPV3_LINE_READER   lpLr,
+  char                  *line,
+  unsigned int          size,
+  unsigned long         deadline
+  )
+{
+  LPDEVICEIMPL pd = (LPDEVICEIMPL)lpDevice->internal;
+  unsigned char *start, *nl;
+  unsigned int len;
+  unsigned long now;
+  int r;
 
-  /* Only setup bootloader if we have data to write */
-  if( (defaultsOnly == 0) && (dataLen.l > 0) )
+  while( 1 )
   {
-	  /* Send the Bootloader Initialization Sequence to the Reader */
-	  commandCode = SETUP_BOOTLOADER;
-	  if( sendBLCommand(lpReader->lpDevice, commandCode, blInitString, 9, responseBuf) == 0 )
+    start = lpLr->buffer + lpLr->head;
+    len = lpLr->tail - lpLr->head;
+    nl = (unsigned char *)memchr(start, '\n', len);
+    if( nl != NULL || len >= size - 1 )
     {
-      fclose(shfFile);
-		  return SKYETEK_FIRMWARE_READER_ERROR;
+      /* Overly long lines are returned in pieces */
+      if( nl != NULL )
+        len = (unsigned int)(nl - start);
+      if( len > size - 1 )
+      {
+        len = size - 1;
+        nl = NULL;
+      }
+      memcpy(line, start, len);
+      lpLr->head += len + (nl != NULL ? 1 : 0);
+      if( len > 0 && line[len-1] == '\r' )
+        len--;
+      line[len] = '\0';
+      if( lpLr->head == lpLr->tail )
+        lpLr->head = lpLr->tail = 0;
+      return 1;
     }
 
-    /* Some progress bar movement */
-    if( !callback(10,ver,user) )
+    /* Make room at the end for the next read */
+    if( lpLr->tail == STPV3_LINE_BUFFER_SIZE )
     {
-      fclose(shfFile);
-		  return SKYETEK_FIRMWARE_CANCELED;
+      memmove(lpLr->buffer, start, len);
+      lpLr->head = 0;
+      lpLr->tail = len;
     }
 
-	  /* Start sending the encrypted blocks of data */	
-	  i = 0;
-	  retryCount = 0;
-	  commandCode = WRITE_DATA;
-	  while(i < dataLen.l)
-	  {
-		  /* Read out the size of the data block first... */
-		  nr = fread(encryptedDataBuf, 1, 2,shfFile);
-
-		  if(nr < 1)
-		  {
-			fclose(shfFile);
-			return SKYETEK_FIRMWARE_BAD_FILE;
-		  }
-
-		  blockLen.b[1] = encryptedDataBuf[0];
-		  blockLen.b[0] = encryptedDataBuf[1];
-		  
-		  /* Read from the shf file -- used to be 270 */
-		  nr = fread((encryptedDataBuf + 2), 1, blockLen.w, shfFile);
-		  
-		  if( nr < 1 )
-	      {
-			fclose(shfFile);
-		    return SKYETEK_FIRMWARE_BAD_FILE;
-	      }
-
-		  /* Send the upgrade command + data to the reader */
-		  /* Account for blockLen */
-		  nr +=2; 
-		  commandCode = WRITE_DATA;
-		  if( sendBLCommand(lpReader->lpDevice, commandCode, encryptedDataBuf, nr, responseBuf) == 0 )
-      {
-        fclose(shfFile);
-		    return SKYETEK_FIRMWARE_READER_ERROR;
-      }
-
-		  /* Update the counter */
-		  i += nr;
-	  
-      /* Some progress bar movement */
-      pr = (10 + (i*84/dataLen.l));
-      if( !callback(pr,ver,user) )
-      {
-        fclose(shfFile);
-		    return SKYETEK_FIRMWARE_CANCELED;
-      }
-	  }
-  } /* Done writing bootloader code */
-	
-  retryCount = 0;
-
-	/* Check if there are any default system parameters to be programmed */
-	if(structLen.w > byteCount )
-	{
-		/* Point to the default system parameter section in the structure in the shf file */
-		fseek( shfFile, byteCount + 2, SEEK_SET );
-
-		/* If there are then first read them out of the shf file and program all the defaults (one at a time) */
-		while( structLen.w > byteCount )
-		{
-			nr = fread( &sysParamStrLen, 1, 1, shfFile );
-      if( nr < 1)
-	    {
-        fclose(shfFile);
-		    return SKYETEK_FIRMWARE_BAD_FILE;
-	    }
-			byteCount += 1;
-
-      if(sysParamStrLen < 1 || sysParamStrLen > 100)
-      {
-        fclose(shfFile);
-		    return SKYETEK_FIRMWARE_BAD_FILE;
-      }
-
-			nr = fread( sysParamBuf, 1, sysParamStrLen, shfFile );
-      if( nr < 1)
-	    {
-        fclose(shfFile);
-		    return SKYETEK_FIRMWARE_BAD_FILE;
-	    }
-			byteCount += sysParamStrLen;
-						
-			/* Send the Command to the reader */
-			commandCode = PROGRAM_DEFAULTS;
-			if( sendBLCommand(lpReader->lpDevice, commandCode, sysParamBuf, sysParamStrLen, responseBuf) == 0 )
-      {
-        fclose(shfFile);
-		    return SKYETEK_FIRMWARE_READER_ERROR;
-      }
-			
-      /* Some progress bar movement */
-      pr = (95 + (byteCount*5/structLen.w));
-      if( !callback(pr,ver,user) )
-      {
-        fclose(shfFile);
-		    return SKYETEK_FIRMWARE_CANCELED;
-      }
-		}
-	}
-
-  /* Now send the Firmware Complete Reset command to the reader */
-	commandCode = UPDATE_COMPLETE_RESET;
-	sendBLCommand(lpReader->lpDevice, commandCode, tempBuf, 0, responseBuf);
-
-  /* Give it time to reset */
-  SKYETEK_Sleep(1000);
-  callback(100,ver,user);
-
-	/* Close the shf file */
-	fclose(shfFile);
-	
-	/* Return from the function */
-	return SKYETEK_SUCCESS;
-}
-
-SKYETEK_STATUS 
-STPV3_EnterPaymentScanMode(LPSKYETEK_READER lpReader,
-                           unsigned int timeout)
-{
-  return STPV3_SendCommand(lpReader,STPV3_CMD_ENTER_PAYMENT_SCAN_MODE,0,timeout);
+    now = SKYETEK_GetTickCount();
+    if( (long)(deadline - now) <= 0 )
+      return 0;
+    if( pd->ReadQueued != NULL )
+      r = pd->ReadQueued(lpDevice, lpLr->buffer + lpLr->tail,
+        STPV3_LINE_BUFFER_SIZE - lpLr->tail, (unsigned int)(deadline - now));
+    else
+      r = pd->Read(lpDevice, lpLr->buffer + lpLr->tail,
+        STPV3_LINE_BUFFER_SIZE - lpLr->tail, (unsigned int)(deadline - now));
+    if( r < 0 )
+      return -1;
+    lpLr->tail += r;
+  }
 }
 
 SKYETEK_STATUS 
@@ -2542,12 +2497,13 @@ STPV3_ScanPayments(
 	STPV3_RESPONSE resp;
 	SKYETEK_STATUS status;
   LPREADER_IMPL lpri;
+  LPSTPV3_LINE_READER lpLr;
   char line[256];
-  char *ptr;
+  unsigned long deadline;
   int r;
-  int count = 0;
 
   if(lpReader == NULL || lpReader->lpDevice == NULL || 
+     lpReader->lpDevice->internal == NULL ||
      lpReader->internal == NULL || callback == NULL )
     return SKYETEK_INVALID_PARAMETER;
   
@@ -2563,6 +2519,10 @@ STPV3_ScanPayments(
   }
 
   /* Send request */
+  /* The tag loses its session once the field drops */
+  if( !(req.flags & STPV3_RF) )
+    STPV3_ClearSelection(lpReader);
+
 	status = STPV3_WriteRequest(lpReader->lpDevice, &req, timeout);
 	if( status != SKYETEK_SUCCESS )
 		return status;
@@ -2573,37 +2533,32 @@ STPV3_ScanPayments(
 	if( status != SKYETEK_SUCCESS )
 		return status;
 
-  /* Loop reading responses */
+  lpLr = (LPSTPV3_LINE_READER)malloc(sizeof(STPV3_LINE_READER));
+  if( lpLr == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  lpLr->head = lpLr->tail = 0;
+
+  /* Loop reading lines; the callback gets NULL when idle */
+  deadline = SKYETEK_GetTickCount() + STPV3_SCAN_IDLE;
   while( 1 )
   {
-    memset(line,0,256);
-    ptr = line;
-    count = 0;
-    while( 1 )
+    r = STPV3_ReadLine(lpReader->lpDevice, lpLr, line, sizeof(line), deadline);
+    if( r < 0 )
     {
-      r = SkyeTek_ReadDevice(lpReader->lpDevice,(unsigned char *)ptr,1,100);
-      if( r == -1 )
-        return SKYETEK_READER_IO_ERROR;
-      if( r == 0 )
-      {
-        if( !callback(NULL,user) )
-          goto forceExit;
-        continue;
-      }
-      if( *ptr == '\n' )
-      {
-        ptr--;
-        break;
-      }
-      count++;
-      if( count == 255 )
-        break;
-      ptr++;
+      free(lpLr);
+      return SKYETEK_READER_IO_ERROR;
+    }
+    if( r == 0 )
+    {
+      deadline = SKYETEK_GetTickCount() + STPV3_SCAN_IDLE;
+      if( !callback(NULL,user) )
+        goto forceExit;
+      continue;
     }
-    *ptr = '\0';
     
     if( strcmp(line,"--") == 0 )
     {
+      free(lpLr);
       return SKYETEK_SUCCESS;
     }
     else
@@ -2611,10 +2566,11 @@ STPV3_ScanPayments(
       if( !callback(line,user) )
         goto forceExit;
     }
+    deadline = SKYETEK_GetTickCount() + STPV3_SCAN_IDLE;
   }
-  return SKYETEK_FAILURE;
 
 forceExit:
+  free(lpLr);
   // signal cancel with generic command
   STPV3_SendCommand(lpReader,STPV3_CMD_SELECT_TAG,0,timeout);
   return SKYETEK_SUCCESS;
@@ -2639,6 +2595,7 @@ STPV3_SelectTag(
     return SKYETEK_INVALID_PARAMETER;
   if( lpReader->lpDevice == NULL || lpReader->internal == NULL)
     return SKYETEK_INVALID_PARAMETER;
+  STPV3_ClearSelection(lpReader);
   
 	/* Build request */
 	memset(&req,0,sizeof(STPV3_REQUEST));
@@ -2693,6 +2650,9 @@ writeCommand:
   if(req.flags & STPV3_TID)
 	{
 		lpTag->session = resp.data[0];
+    /* Without the field on the tag drops its session after the select */
+    if( resp.dataLength > 0 && (req.flags & STPV3_RF) )
+      STPV3_SetSelection(lpReader,&req,resp.data[0]);
 	}
 	else
   {
@@ -2868,12 +2828,15 @@ STPV3_KillTag(
     unsigned int         timeout
     )
 {
+  SKYETEK_STATUS status;
   unsigned int flags = 0;
   if( lpTag->id != NULL && lpTag->id->id != NULL && lpTag->id->length > 0 )
     flags |= STPV3_TID;
   flags |= (lpTag->rf > 0 ? STPV3_RF : 0);
 	flags |= (lpTag->session > 0 ? STPV3_SESSION : 0);
-  return STPV3_SendSetTagCommand(lpReader,lpTag,STPV3_CMD_KILL_TAG,flags,lpData,timeout);
+  status = STPV3_SendSetTagCommand(lpReader,lpTag,STPV3_CMD_KILL_TAG,flags,lpData,timeout);
+  STPV3_ClearSelection(lpReader);
+  return status;
 }
 
 SKYETEK_STATUS 
@@ -2928,12 +2891,15 @@ STPV3_DeselectTag(
     unsigned int         timeout
     )
 {
+  SKYETEK_STATUS status;
   unsigned int flags = 0;
   if( lpTag->id != NULL && lpTag->id->id != NULL && lpTag->id->length > 0 )
     flags |= STPV3_TID;
   flags |= (lpTag->rf > 0 ? STPV3_RF : 0);
 	flags |= STPV3_SESSION;
-  return STPV3_SendTagCommand(lpReader,lpTag,STPV3_CMD_DESELECT_TAG,flags,timeout);
+  status = STPV3_SendTagCommand(lpReader,lpTag,STPV3_CMD_DESELECT_TAG,flags,timeout);
+  STPV3_ClearSelection(lpReader);
+  return status;
 }
 
 SKYETEK_STATUS 
@@ -3616,6 +3582,7 @@ PROTOCOLIMPL STPV3Impl = {
   STPV3_EnableDebug,
   STPV3_DisableDebug,
   STPV3_UploadFirmware,
+  STPV3_UploadFirmwareImage,
   STPV3_EnterPaymentScanMode,
   STPV3_ScanPayments,
   STPV3_SelectTag,
@@ -3673,5 +3640,7 @@ PROTOCOLIMPL STPV3Impl = {
   STPV3_TransportSend,
   STPV3_InitiatePayment,
   STPV3_ComputePayment,
-  STPV3_GetDebugMessages
+  STPV3_GetDebugMessages,
+  STPV3_ExecuteBatch,
+  STPV3_InventoryTags
 };
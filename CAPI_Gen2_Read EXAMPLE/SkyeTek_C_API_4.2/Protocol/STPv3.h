@@ -12,6 +12,7 @@ extern "C" {
 #endif
 
 #include "../SkyeTekAPI.h"
+#include "Protocol.h"
 
 /**
  * SkytekProtocol command flags
@@ -902,6 +903,50 @@ STPV3_SendAddrGetSetTagCommand(
     unsigned int          retries
     );
 
+SKYETEK_STATUS
+STPV3_UploadFirmware(
+    LPSKYETEK_READER                      lpReader,
+    TCHAR                                 *file,
+    unsigned char                         defaultsOnly,
+    SKYETEK_FIRMWARE_UPLOAD_CALLBACK      callback,
+    void                                  *user
+  );
+
+SKYETEK_STATUS
+STPV3_UploadFirmwareImage(
+    LPSKYETEK_READER                      lpReader,
+    LPSKYETEK_FIRMWARE_IMAGE              lpImage,
+    unsigned char                         defaultsOnly,
+    SKYETEK_FIRMWARE_PROGRESS_CALLBACK    callback,
+    void                                  *user
+  );
+
+SKYETEK_STATUS
+STPV3_ExecuteBatch(
+  LPSKYETEK_READER        lpReader,
+  LPPROTOCOL_BATCH_ITEM   lpItems,
+  unsigned int            count,
+  SKYETEK_STATUS          *lpStatus
+  );
+
+/* The tag the reader last selected by ID; kept as the protocol's
+   PRIVATE_SELECTION state */
+typedef struct STPV3_SELECTION
+{
+  unsigned char   tid[16];
+  unsigned short  tidLength;    /* 0 if nothing is selected */
+  unsigned short  session;      /* session byte the select returned */
+  unsigned char   pending;      /* a command that used it has not been answered */
+  unsigned char   release;      /* that command lets the field drop */
+  unsigned int    flags;        /* flags of that command before the ID was dropped */
+  unsigned short  reqSession;   /* and its session */
+} STPV3_SELECTION, *LPSTPV3_SELECTION;
+
+void 
+STPV3_ClearSelection(
+  LPSKYETEK_READER    lpReader
+  );
+
 SKYETEK_STATUS 
 STPV3_GetStatus(
   unsigned int code
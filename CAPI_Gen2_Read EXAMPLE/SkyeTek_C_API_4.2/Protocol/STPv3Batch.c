@@ -0,0 +1,303 @@
+/**
+ * STPv3Batch.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Pipelined execution of a batch of SkyeTek Protocol version 3
+ * requests. The next request is built while the reader works on
+ * the current one and is written before the current response is
+ * parsed and its result allocated.
+ */
+#include "../SkyeTekAPI.h"
+#include "../SkyeTekProtocol.h"
+#include "../Device/Device.h"
+#include "../Reader/Reader.h"
+#include "Protocol.h"
+#include "STPv3.h"
+#include <stdlib.h>
+#include <string.h>
+
+extern unsigned char genericID[];
+
+static void
+STPV3_CopyTagToRequest(
+  LPSKYETEK_TAG     lpTag,
+  LPSTPV3_REQUEST   req
+  )
+{
+  unsigned int iy = 0;
+
+  req->session = lpTag->session;
+  req->afi = lpTag->afi;
+  req->tagType = lpTag->type;
+  if( (req->flags & STPV3_TID) && lpTag->id != NULL && lpTag->id->id != NULL )
+  {
+    req->tidLength = lpTag->id->length;
+    if( req->tidLength > 16 )
+      req->tidLength = 16;
+    for(iy = 0; iy < req->tidLength; iy++)
+      req->tid[iy] = lpTag->id->id[iy];
+  }
+  req->flags |= (lpTag->rf > 0 ? STPV3_RF : 0);
+  req->flags |= (lpTag->session > 0 ? STPV3_SESSION : 0);
+}
+
+static SKYETEK_STATUS
+STPV3_BuildBatchRequest(
+  LPSKYETEK_READER        lpReader,
+  LPPROTOCOL_BATCH_ITEM   lpItem,
+  LPSTPV3_REQUEST         req
+  )
+{
+  LPSKYETEK_BATCH_OPERATION lpOp;
+  LPREADER_IMPL lpri;
+  unsigned int iy = 0;
+
+  lpOp = lpItem->lpOp;
+  if( lpOp == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  memset(req,0,sizeof(STPV3_REQUEST));
+  req->flags = STPV3_CRC;
+  req->address[0] = lpItem->addr.start >> 8;
+  req->address[1] = lpItem->addr.start & 0x00FF;
+  req->numBlocks = lpItem->addr.blocks;
+
+  switch(lpOp->command)
+  {
+    case BATCH_READ_TAG_DATA:
+    case BATCH_WRITE_TAG_DATA:
+    case BATCH_LOCK_TAG_BLOCK:
+      if( lpOp->lpTag == NULL )
+        return SKYETEK_INVALID_PARAMETER;
+      if( lpOp->lpTag->id != NULL && lpOp->lpTag->id->id != NULL && lpOp->lpTag->id->length > 0 )
+        req->flags |= STPV3_TID;
+      if( lpOp->encrypt )
+        req->flags |= STPV3_ENCRYPTION;
+      if( lpOp->hmac )
+        req->flags |= STPV3_HMAC;
+      if( lpOp->command == BATCH_LOCK_TAG_BLOCK )
+        req->flags |= STPV3_LOCK;
+      STPV3_CopyTagToRequest(lpOp->lpTag,req);
+      req->cmd = (lpOp->command == BATCH_READ_TAG_DATA ? STPV3_CMD_READ_TAG : STPV3_CMD_WRITE_TAG);
+      break;
+    case BATCH_GET_TAG_INFO:
+      if( lpOp->lpTag == NULL )
+        return SKYETEK_INVALID_PARAMETER;
+      STPV3_CopyTagToRequest(lpOp->lpTag,req);
+      req->cmd = STPV3_CMD_GET_TAG_INFO;
+      req->address[0] = req->address[1] = 0;
+      req->numBlocks = 0;
+      break;
+    case BATCH_SELECT_APPLICATION:
+    case BATCH_GET_FILE_IDS:
+    case BATCH_GET_FILE_SETTINGS:
+    case BATCH_CREDIT_VALUE_FILE:
+    case BATCH_DEBIT_VALUE_FILE:
+    case BATCH_LIMITED_CREDIT_VALUE_FILE:
+    case BATCH_WRITE_RECORD:
+    case BATCH_COMMIT_TRANSACTION:
+    case BATCH_ABORT_TRANSACTION:
+      if( lpOp->lpTag == NULL )
+        return SKYETEK_INVALID_PARAMETER;
+      STPV3_CopyTagToRequest(lpOp->lpTag,req);
+      req->flags |= STPV3_SESSION;
+      switch(lpOp->command)
+      {
+        case BATCH_SELECT_APPLICATION:
+          req->cmd = STPV3_CMD_SELECT_APPLICATION;
+          break;
+        case BATCH_GET_FILE_IDS:
+          req->cmd = STPV3_CMD_GET_FILE_IDS;
+          break;
+        case BATCH_GET_FILE_SETTINGS:
+          req->cmd = STPV3_CMD_GET_FILE_SETTINGS;
+          break;
+        case BATCH_CREDIT_VALUE_FILE:
+          req->cmd = STPV3_CMD_CREDIT_VALUE_FILE;
+          break;
+        case BATCH_DEBIT_VALUE_FILE:
+          req->cmd = STPV3_CMD_DEBIT_VALUE_FILE;
+          break;
+        case BATCH_LIMITED_CREDIT_VALUE_FILE:
+          req->cmd = STPV3_CMD_LIMITED_CREDIT_VALUE_FILE;
+          break;
+        case BATCH_WRITE_RECORD:
+          req->cmd = STPV3_CMD_WRITE_RECORD;
+          break;
+        case BATCH_COMMIT_TRANSACTION:
+          req->cmd = STPV3_CMD_COMMIT_TRANSACTION;
+          break;
+        default:
+          req->cmd = STPV3_CMD_ABORT_TRANSACTION;
+          break;
+      }
+      req->address[0] = req->address[1] = 0;
+      req->numBlocks = 0;
+      break;
+    case BATCH_ENABLE_EAS:
+    case BATCH_DISABLE_EAS:
+    case BATCH_WRITE_AFI:
+      if( lpOp->lpTag == NULL )
+        return SKYETEK_INVALID_PARAMETER;
+      if( lpOp->lpTag->id != NULL && lpOp->lpTag->id->id != NULL && lpOp->lpTag->id->length > 0 )
+        req->flags |= STPV3_TID;
+      STPV3_CopyTagToRequest(lpOp->lpTag,req);
+      if( lpOp->command == BATCH_ENABLE_EAS )
+        req->cmd = STPV3_CMD_ENABLE_EAS;
+      else if( lpOp->command == BATCH_DISABLE_EAS )
+        req->cmd = STPV3_CMD_DISABLE_EAS;
+      else
+        req->cmd = STPV3_CMD_WRITE_AFI;
+      req->address[0] = req->address[1] = 0;
+      req->numBlocks = 0;
+      break;
+    case BATCH_GET_SYSTEM_PARAMETER:
+      req->cmd = STPV3_CMD_READ_SYSTEM_PARAMETER;
+      break;
+    case BATCH_SET_SYSTEM_PARAMETER:
+      req->cmd = STPV3_CMD_WRITE_SYSTEM_PARAMETER;
+      break;
+    default:
+      return SKYETEK_INVALID_PARAMETER;
+  }
+
+  if( lpOp->command == BATCH_WRITE_TAG_DATA || lpOp->command == BATCH_LOCK_TAG_BLOCK ||
+      lpOp->command == BATCH_SET_SYSTEM_PARAMETER || lpOp->command == BATCH_SELECT_APPLICATION ||
+      lpOp->command == BATCH_CREDIT_VALUE_FILE || lpOp->command == BATCH_DEBIT_VALUE_FILE ||
+      lpOp->command == BATCH_LIMITED_CREDIT_VALUE_FILE || lpOp->command == BATCH_WRITE_RECORD ||
+      lpOp->command == BATCH_WRITE_AFI )
+  {
+    if( lpOp->lpData == NULL || lpOp->lpData->data == NULL || lpOp->lpData->size > 2048 )
+      return SKYETEK_INVALID_PARAMETER;
+    req->flags |= STPV3_DATA;
+    req->dataLength = lpOp->lpData->size;
+    for(iy = 0; iy < req->dataLength; iy++)
+      req->data[iy] = lpOp->lpData->data[iy];
+  }
+  else if( lpOp->command == BATCH_GET_FILE_SETTINGS )
+  {
+    if( lpOp->lpRequest == NULL || lpOp->lpRequest->data == NULL || lpOp->lpRequest->size > 2048 )
+      return SKYETEK_INVALID_PARAMETER;
+    req->flags |= STPV3_DATA;
+    req->dataLength = lpOp->lpRequest->size;
+    for(iy = 0; iy < req->dataLength; iy++)
+      req->data[iy] = lpOp->lpRequest->data[iy];
+  }
+
+  lpri = (LPREADER_IMPL)lpReader->internal;
+  if( lpReader->sendRID || !lpri->DoesRIDMatch(lpReader,genericID) )
+  {
+    lpri->CopyRIDToBuffer(lpReader,req->rid);
+    req->flags |= STPV3_RID;
+  }
+
+  return STPV3_BuildRequest(req);
+}
+
+static SKYETEK_STATUS
+STPV3_ParseBatchResponse(
+  LPPROTOCOL_BATCH_ITEM   lpItem,
+  LPSTPV3_REQUEST         req,
+  LPSTPV3_RESPONSE        resp
+  )
+{
+  LPSKYETEK_BATCH_OPERATION lpOp = lpItem->lpOp;
+
+  if( resp->code != req->cmd )
+    return STPV3_GetStatus(resp->code);
+
+  switch(lpOp->command)
+  {
+    case BATCH_READ_TAG_DATA:
+    case BATCH_GET_SYSTEM_PARAMETER:
+    case BATCH_GET_FILE_IDS:
+    case BATCH_GET_FILE_SETTINGS:
+      lpOp->lpData = SkyeTek_AllocateData(resp->dataLength);
+      if( lpOp->lpData == NULL )
+        return SKYETEK_OUT_OF_MEMORY;
+      return SkyeTek_CopyBuffer(lpOp->lpData,resp->data,resp->dataLength);
+    case BATCH_GET_TAG_INFO:
+      if( resp->dataLength < 6 )
+        return SKYETEK_READER_PROTOCOL_ERROR;
+      lpOp->memory.startBlock = (resp->data[0] << 8) | resp->data[1];
+      lpOp->memory.maxBlock = (resp->data[2] << 8) | resp->data[3];
+      lpOp->memory.bytesPerBlock = (resp->data[4] << 8) | resp->data[5];
+      return SKYETEK_SUCCESS;
+    default:
+      return SKYETEK_SUCCESS;
+  }
+}
+
+SKYETEK_STATUS
+STPV3_ExecuteBatch(
+  LPSKYETEK_READER        lpReader,
+  LPPROTOCOL_BATCH_ITEM   lpItems,
+  unsigned int            count,
+  SKYETEK_STATUS          *lpStatus
+  )
+{
+  LPSTPV3_REQUEST reqs = NULL, cur, next, tmp;
+  LPSTPV3_RESPONSE resp = NULL;
+  unsigned int ix = 0;
+
+  if( lpReader == NULL || lpItems == NULL || lpStatus == NULL || count == 0 )
+    return SKYETEK_INVALID_PARAMETER;
+  if( lpReader->lpDevice == NULL || lpReader->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  /* Two request slots: the one on the wire and the one being built */
+  reqs = (LPSTPV3_REQUEST)malloc(2*sizeof(STPV3_REQUEST));
+  resp = (LPSTPV3_RESPONSE)malloc(sizeof(STPV3_RESPONSE));
+  if( reqs == NULL || resp == NULL )
+  {
+    if( reqs != NULL )
+      free(reqs);
+    if( resp != NULL )
+      free(resp);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  cur = &reqs[0];
+  next = &reqs[1];
+
+  /* Batched requests carry the ID; the reader may singulate other tags */
+  STPV3_ClearSelection(lpReader);
+
+  lpStatus[0] = STPV3_BuildBatchRequest(lpReader,&lpItems[0],cur);
+  if( lpStatus[0] == SKYETEK_SUCCESS )
+    lpStatus[0] = STPV3_SendRequest(lpReader->lpDevice,cur,lpItems[0].timeout);
+
+  for(ix = 0; ix < count; ix++)
+  {
+    /* Build the next frame while the reader executes this one */
+    if( (ix + 1) < count )
+      lpStatus[ix+1] = STPV3_BuildBatchRequest(lpReader,&lpItems[ix+1],next);
+
+    if( lpStatus[ix] == SKYETEK_SUCCESS )
+    {
+readResponse:
+      memset(resp,0,sizeof(STPV3_RESPONSE));
+      lpStatus[ix] = STPV3_ReadResponse(lpReader->lpDevice,cur,resp,lpItems[ix].timeout);
+      if( lpStatus[ix] == SKYETEK_SUCCESS && resp->code == STPV3_RESP_SELECT_TAG_LOOP_OFF )
+      {
+        lpStatus[ix] = STPV3_SendRequest(lpReader->lpDevice,cur,lpItems[ix].timeout);
+        if( lpStatus[ix] == SKYETEK_SUCCESS )
+          goto readResponse;
+      }
+    }
+
+    /* Put the next frame on the wire before parsing this response */
+    if( (ix + 1) < count && lpStatus[ix+1] == SKYETEK_SUCCESS )
+      lpStatus[ix+1] = STPV3_SendRequest(lpReader->lpDevice,next,lpItems[ix+1].timeout);
+
+    if( lpStatus[ix] == SKYETEK_SUCCESS )
+      lpStatus[ix] = STPV3_ParseBatchResponse(&lpItems[ix],cur,resp);
+
+    tmp = cur;
+    cur = next;
+    next = tmp;
+  }
+
+  free(reqs);
+  free(resp);
+  return SKYETEK_SUCCESS;
+}
@@ -0,0 +1,739 @@
+/**
+ * STPv3Firmware.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Firmware upload through the SkyeTek bootloader. The SkyeTek
+ * Hex File (.shf) is mapped into memory and validated once, then
+ * the blocks are streamed to the bootloader with the next frame
+ * built while the current one is being acknowledged.
+ */
+#include "../SkyeTekAPI.h"
+#include "../Device/Device.h"
+#include "Protocol.h"
+#include "STPv3.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#if !defined(WIN32) && !defined(WINCE)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#define BL_MAX_BLOCK_SIZE     512   /* largest encrypted block incl. length */
+#define BL_MAX_DEFAULT_SIZE   100   /* largest default system parameter record */
+#define BL_MAX_RETRIES        4     /* resends of a frame with a bad ack */
+#define BL_MAX_RESUMES        5     /* resumes after the bootloader times out */
+#define BL_RESUME_DELAY       250   /* ms, multiplied by the resume count */
+#define BL_READ_TIMEOUT       500
+
+/* One payload in the mapped file */
+typedef struct SHF_RECORD
+{
+  unsigned long   offset;
+  unsigned int    length;
+} SHF_RECORD, *LPSHF_RECORD;
+
+/* Parsed layout of a mapped .shf file */
+typedef struct SHF_IMAGE
+{
+  unsigned char   *buffer;
+  unsigned long   size;
+  unsigned char   mapped;
+#if defined(WIN32) && !defined(WINCE)
+  HANDLE          hFile;
+  HANDLE          hMapping;
+#endif
+  unsigned char   encryptionScheme;
+  UINT8           initString[9];
+  LPSHF_RECORD    lpBlocks;
+  unsigned int    blockCount;
+  LPSHF_RECORD    lpDefaults;
+  unsigned int    defaultCount;
+} SHF_IMAGE, *LPSHF_IMAGE;
+
+/* A framed bootloader command ready to be written */
+typedef struct BL_FRAME
+{
+  UINT8           cmd;
+  UINT8           msg[BL_MAX_BLOCK_SIZE + 5];
+  unsigned int    length;
+} BL_FRAME, *LPBL_FRAME;
+
+/* State of an upload in progress */
+typedef struct BL_UPLOAD
+{
+  SKYETEK_FIRMWARE_PROGRESS             progress;
+  SKYETEK_FIRMWARE_PROGRESS_CALLBACK    callback;
+  void                                  *user;
+  unsigned long                         start;
+} BL_UPLOAD, *LPBL_UPLOAD;
+
+/* CRC calculation */
+static UINT16 crcBL16(UINT8 *dataP, UINT16 nBytes, UINT16 preset)
+{
+    UINT16 i, j;
+	UINT8 mBits = 8;
+
+  	UINT16 crc_16 = preset;
+
+	for( i=0; i<nBytes; i++ )
+	{
+	 	crc_16 ^= *dataP++;
+
+		for( j=0; j<mBits; j++ )
+		{
+			if( crc_16 & 0x0001 )
+			{
+				crc_16 >>= 1;
+				crc_16 ^= 0x8408;  // Polynomial (x^16 + x^12 + x^5 + 1)
+			}
+		    else
+			{
+				crc_16 >>= 1;
+			}
+		}
+	}
+
+	return( crc_16 );
+}
+
+static UINT16 verifyBLcrc(UINT8 *resp, UINT16 len)
+{
+  UINT16 crc_check;
+
+  if( len < 3 )
+    return 0;
+	crc_check = crcBL16(resp, len-2, 0x0000);
+	if(resp[len-2] == (crc_check >> 8) &&
+     resp[len-1] == (crc_check & 0x00FF))
+		return 1;
+	else
+		return 0;
+}
+
+static unsigned long
+SHF_GetLong(
+  unsigned char   *p
+  )
+{
+  return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+    ((unsigned long)p[2] << 8) | (unsigned long)p[3];
+}
+
+/**
+ * Frames a bootloader command: length, command code, data and CRC.
+ */
+static void
+BL_BuildFrame(
+  LPBL_FRAME      lpFrame,
+  UINT8           commandCode,
+  UINT8           *commandData,
+  UINT16          numBytes
+  )
+{
+  UINT16 len = numBytes + 3;  /* command code and crc bytes */
+  UINT16 crc;
+
+  lpFrame->cmd = commandCode;
+  lpFrame->msg[0] = len >> 8;
+  lpFrame->msg[1] = len & 0x00FF;
+  lpFrame->msg[2] = commandCode;
+  if( numBytes > 0 )
+    memcpy(lpFrame->msg + 3, commandData, numBytes);
+  crc = crcBL16(lpFrame->msg, numBytes + 3, 0x0000);
+  lpFrame->msg[numBytes + 3] = crc >> 8;
+  lpFrame->msg[numBytes + 4] = crc & 0x00FF;
+  lpFrame->length = numBytes + 5;
+}
+
+static int
+BL_WriteFrame(
+  LPSKYETEK_DEVICE  lpDevice,
+  LPBL_FRAME        lpFrame
+  )
+{
+  LPDEVICEIMPL pd = (LPDEVICEIMPL)lpDevice->internal;
+  unsigned int total = 0;
+  int written = 0;
+
+  while( total < lpFrame->length )
+  {
+    written = pd->Write(lpDevice, lpFrame->msg + total, lpFrame->length - total, BL_READ_TIMEOUT);
+    if( written <= 0 )
+      return 0;
+    total += written;
+  }
+  pd->Flush(lpDevice);
+  return 1;
+}
+
+static int
+BL_ReadFully(
+  LPSKYETEK_DEVICE  lpDevice,
+  UINT8             *buffer,
+  unsigned int      length
+  )
+{
+  LPDEVICEIMPL pd = (LPDEVICEIMPL)lpDevice->internal;
+  unsigned int total = 0;
+  int num = 0;
+
+  while( total < length )
+  {
+    num = pd->Read(lpDevice, buffer + total, length - total, BL_READ_TIMEOUT);
+    if( num <= 0 )
+      break;
+    total += num;
+  }
+  return total;
+}
+
+/**
+ * Reads the bootloader acknowledgement for the frame.
+ * @return Length of the response, 0 if the response is corrupt
+ *         or for another command, -1 if nothing came back
+ */
+static int
+BL_ReadAck(
+  LPSKYETEK_DEVICE  lpDevice,
+  LPBL_FRAME        lpFrame,
+  UINT8             *respString
+  )
+{
+  LPDEVICEIMPL pd = (LPDEVICEIMPL)lpDevice->internal;
+  int num = 0, count = 0;
+
+  while( (num = BL_ReadFully(lpDevice, respString, 2)) != 2 )
+  {
+    count++;
+    if( count > 5 )
+      return -1;
+    pd->Flush(lpDevice);
+  }
+
+  num = 2 + BL_ReadFully(lpDevice, respString + 2, respString[1]);
+
+  if( !verifyBLcrc(respString,num) || respString[2] != lpFrame->cmd )
+    return 0;
+  return num;
+}
+
+/**
+ * Sends one frame and waits for its acknowledgement, resending
+ * it if the acknowledgement is corrupt.
+ */
+static int
+BL_Transact(
+  LPSKYETEK_DEVICE  lpDevice,
+  LPBL_FRAME        lpFrame,
+  UINT8             *respString
+  )
+{
+  int num = 0, count = 0;
+
+  for( count = 0; count <= BL_MAX_RETRIES; count++ )
+  {
+    if( !BL_WriteFrame(lpDevice, lpFrame) )
+      return -1;
+    if( lpFrame->cmd == SETUP_BOOTLOADER )
+      SKYETEK_Sleep(3000);
+    num = BL_ReadAck(lpDevice, lpFrame, respString);
+    if( num != 0 )
+      return num;
+  }
+  return 0;
+}
+
+static int
+sendBLCommand(
+  LPSKYETEK_DEVICE  lpDevice,
+  UINT8             commandCode,
+  UINT8             *commandData,
+  UINT16            numBytes,
+  UINT8             *respString
+  )
+{
+  BL_FRAME frame;
+
+  if( lpDevice == NULL || lpDevice->internal == NULL || numBytes > BL_MAX_BLOCK_SIZE )
+    return 0;
+  BL_BuildFrame(&frame, commandCode, commandData, numBytes);
+  return (BL_Transact(lpDevice, &frame, respString) > 0);
+}
+
+static int
+BL_Report(
+  LPBL_UPLOAD     lpUpload,
+  unsigned int    percent
+  )
+{
+  LPSKYETEK_FIRMWARE_PROGRESS p = &lpUpload->progress;
+  unsigned long elapsed;
+
+  p->percentComplete = percent;
+  if( lpUpload->start != 0 && p->bytesSent > 0 )
+  {
+    elapsed = SKYETEK_GetTickCount() - lpUpload->start;
+    if( elapsed == 0 )
+      elapsed = 1;
+    p->bytesPerSecond = (unsigned long)((double)p->bytesSent * 1000.0 / (double)elapsed);
+    if( p->bytesPerSecond > 0 )
+      p->secondsRemaining = (p->bytesTotal - p->bytesSent) / p->bytesPerSecond;
+  }
+  return lpUpload->callback(p, lpUpload->user);
+}
+
+/**
+ * Streams the records to the bootloader. While the reader works on
+ * one frame the next one is framed. When the bootloader stops
+ * answering the upload resumes from the last acknowledged record.
+ */
+static SKYETEK_STATUS
+BL_SendRecords(
+  LPSKYETEK_DEVICE  lpDevice,
+  LPSHF_IMAGE       lpShf,
+  UINT8             commandCode,
+  LPSHF_RECORD      lpRecords,
+  unsigned int      count,
+  LPBL_UPLOAD       lpUpload
+  )
+{
+  LPDEVICEIMPL pd = (LPDEVICEIMPL)lpDevice->internal;
+  LPSKYETEK_FIRMWARE_PROGRESS p = &lpUpload->progress;
+  BL_FRAME frames[2];
+  LPBL_FRAME cur = &frames[0], next = &frames[1], tmp;
+  UINT8 responseBuf[BL_MAX_BLOCK_SIZE];
+  unsigned int ix = 0, retries = 0, built = 0, pr = 0;
+  int num = 0;
+
+  if( count == 0 )
+    return SKYETEK_SUCCESS;
+
+  BL_BuildFrame(cur, commandCode, lpShf->buffer + lpRecords[0].offset, lpRecords[0].length);
+  while( ix < count )
+  {
+    num = -1;
+    if( BL_WriteFrame(lpDevice, cur) )
+    {
+      /* Frame the next record while this one is acknowledged */
+      if( !built && (ix + 1) < count )
+      {
+        BL_BuildFrame(next, commandCode, lpShf->buffer + lpRecords[ix+1].offset, lpRecords[ix+1].length);
+        built = 1;
+      }
+      num = BL_ReadAck(lpDevice, cur, responseBuf);
+    }
+
+    if( num == 0 )
+    {
+      if( ++retries > BL_MAX_RETRIES )
+        return SKYETEK_FIRMWARE_READER_ERROR;
+      continue;
+    }
+    if( num < 0 )
+    {
+      /* Resume from the last acknowledged record */
+      if( ++p->resumes > BL_MAX_RESUMES )
+        return SKYETEK_FIRMWARE_READER_ERROR;
+      SKYETEK_Sleep(BL_RESUME_DELAY * p->resumes);
+      pd->Flush(lpDevice);
+      continue;
+    }
+
+    retries = 0;
+    if( commandCode == WRITE_DATA )
+    {
+      p->bytesSent += lpRecords[ix].length;
+      p->blocksSent++;
+      pr = 10 + (unsigned int)((double)p->bytesSent * 84.0 / (double)p->bytesTotal);
+    }
+    else
+    {
+      pr = 95 + ((ix + 1) * 5 / count);
+    }
+    ix++;
+    if( !BL_Report(lpUpload, pr) )
+      return SKYETEK_FIRMWARE_CANCELED;
+
+    tmp = cur;
+    cur = next;
+    next = tmp;
+    built = 0;
+  }
+  return SKYETEK_SUCCESS;
+}
+
+static int
+SHF_Map(
+  TCHAR           *file,
+  LPSHF_IMAGE     lpShf
+  )
+{
+#if defined(WIN32) && !defined(WINCE)
+  lpShf->hFile = CreateFile(file, GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if( lpShf->hFile == INVALID_HANDLE_VALUE )
+  {
+    lpShf->hFile = NULL;
+    return 0;
+  }
+  lpShf->size = GetFileSize(lpShf->hFile, NULL);
+  if( lpShf->size == INVALID_FILE_SIZE || lpShf->size == 0 )
+    return 0;
+  lpShf->hMapping = CreateFileMapping(lpShf->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if( lpShf->hMapping == NULL )
+    return 0;
+  lpShf->buffer = (unsigned char *)MapViewOfFile(lpShf->hMapping, FILE_MAP_READ, 0, 0, 0);
+  if( lpShf->buffer == NULL )
+    return 0;
+  lpShf->mapped = 1;
+  return 1;
+#elif defined(WINCE)
+  /* No file mapping available, read the whole file in one go */
+  FILE *fp;
+  long len;
+
+  fp = _tfopen(file, _T("rb"));
+  if( fp == NULL )
+    return 0;
+  fseek(fp, 0, SEEK_END);
+  len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if( len <= 0 || (lpShf->buffer = (unsigned char *)malloc(len)) == NULL )
+  {
+    fclose(fp);
+    return 0;
+  }
+  lpShf->size = (unsigned long)len;
+  if( fread(lpShf->buffer, 1, len, fp) != (size_t)len )
+  {
+    fclose(fp);
+    return 0;
+  }
+  fclose(fp);
+  return 1;
+#else
+  struct stat stb;
+  void *p;
+  int fd;
+
+  fd = open(file, O_RDONLY);
+  if( fd < 0 )
+    return 0;
+  if( fstat(fd, &stb) != 0 || stb.st_size <= 0 )
+  {
+    close(fd);
+    return 0;
+  }
+  p = mmap(NULL, stb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if( p == MAP_FAILED )
+    return 0;
+  lpShf->buffer = (unsigned char *)p;
+  lpShf->size = (unsigned long)stb.st_size;
+  lpShf->mapped = 1;
+  return 1;
+#endif
+}
+
+static void
+SHF_Unmap(
+  LPSHF_IMAGE     lpShf
+  )
+{
+#if defined(WIN32) && !defined(WINCE)
+  if( lpShf->buffer != NULL )
+    UnmapViewOfFile(lpShf->buffer);
+  if( lpShf->hMapping != NULL )
+    CloseHandle(lpShf->hMapping);
+  if( lpShf->hFile != NULL )
+    CloseHandle(lpShf->hFile);
+#elif defined(WINCE)
+  if( lpShf->buffer != NULL )
+    free(lpShf->buffer);
+#else
+  if( lpShf->mapped )
+    munmap(lpShf->buffer, lpShf->size);
+#endif
+  lpShf->buffer = NULL;
+  lpShf->mapped = 0;
+}
+
+static int
+SHF_AddRecord(
+  LPSHF_RECORD    *lpRecords,
+  unsigned int    *count,
+  unsigned int    *alloc,
+  unsigned long   offset,
+  unsigned int    length
+  )
+{
+  LPSHF_RECORD tmp;
+
+  if( *count == *alloc )
+  {
+    *alloc = (*alloc == 0 ? 64 : *alloc * 2);
+    tmp = (LPSHF_RECORD)realloc(*lpRecords, *alloc * sizeof(SHF_RECORD));
+    if( tmp == NULL )
+      return 0;
+    *lpRecords = tmp;
+  }
+  (*lpRecords)[*count].offset = offset;
+  (*lpRecords)[*count].length = length;
+  (*count)++;
+  return 1;
+}
+
+/**
+ * Walks the whole file and records every block and default
+ * system parameter so nothing has to be checked during the upload.
+ * File layout: structure length (2), structure version (2),
+ * bootloader version (4), encryption scheme (1), init string
+ * length (1) and bytes, default system parameters up to the end
+ * of the structure, encrypted data length (4) and the blocks,
+ * each prefixed with its 2 byte length.
+ */
+static SKYETEK_STATUS
+SHF_Validate(
+  LPSKYETEK_FIRMWARE_IMAGE  lpImage,
+  LPSHF_IMAGE               lpShf
+  )
+{
+  unsigned char *buf = lpShf->buffer;
+  unsigned long structEnd, off, consumed;
+  unsigned int initLen, len, alloc = 0;
+
+  if( lpShf->size < 10 )
+    return SKYETEK_FIRMWARE_BAD_FILE;
+
+  structEnd = ((buf[0] << 8) | buf[1]) + 2;
+  lpImage->version = SHF_GetLong(buf + 4);
+  lpShf->encryptionScheme = buf[8];
+
+  /* blInitString can be 0 for non CBC ciphers */
+  initLen = buf[9];
+  if( initLen > 8 || 10 + initLen > structEnd || structEnd + 4 > lpShf->size )
+    return SKYETEK_FIRMWARE_BAD_FILE;
+  memset(lpShf->initString, 0, sizeof(lpShf->initString));
+  lpShf->initString[0] = initLen;
+  memcpy(lpShf->initString + 1, buf + 10, initLen);
+
+  /* Default system parameters */
+  for( off = 10 + initLen; off < structEnd; off += len + 1 )
+  {
+    len = buf[off];
+    if( len < 1 || len > BL_MAX_DEFAULT_SIZE || off + 1 + len > structEnd )
+      return SKYETEK_FIRMWARE_BAD_FILE;
+    if( !SHF_AddRecord(&lpShf->lpDefaults, &lpShf->defaultCount, &alloc, off + 1, len) )
+      return SKYETEK_OUT_OF_MEMORY;
+  }
+
+  /* Encrypted blocks; each is sent along with its length */
+  lpImage->dataLength = SHF_GetLong(buf + structEnd);
+  if( lpImage->dataLength > lpShf->size )
+    return SKYETEK_FIRMWARE_BAD_FILE;
+  alloc = 0;
+  off = structEnd + 4;
+  for( consumed = 0; consumed < lpImage->dataLength; consumed += len )
+  {
+    if( off + 2 > lpShf->size )
+      return SKYETEK_FIRMWARE_BAD_FILE;
+    len = ((buf[off] << 8) | buf[off+1]) + 2;
+    if( len < 3 || len > BL_MAX_BLOCK_SIZE || off + len > lpShf->size )
+      return SKYETEK_FIRMWARE_BAD_FILE;
+    if( !SHF_AddRecord(&lpShf->lpBlocks, &lpShf->blockCount, &alloc, off, len) )
+      return SKYETEK_OUT_OF_MEMORY;
+    off += len;
+  }
+
+  lpImage->size = lpShf->size;
+  lpImage->blocks = lpShf->blockCount;
+  lpImage->defaults = lpShf->defaultCount;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_OpenFirmwareImage(
+  TCHAR                         *file,
+  LPSKYETEK_FIRMWARE_IMAGE      *lpImage
+  )
+{
+  LPSKYETEK_FIRMWARE_IMAGE img;
+  LPSHF_IMAGE shf;
+  SKYETEK_STATUS status;
+
+  if( file == NULL || lpImage == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  *lpImage = NULL;
+
+  img = (LPSKYETEK_FIRMWARE_IMAGE)malloc(sizeof(SKYETEK_FIRMWARE_IMAGE));
+  if( img == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  memset(img,0,sizeof(SKYETEK_FIRMWARE_IMAGE));
+  shf = (LPSHF_IMAGE)malloc(sizeof(SHF_IMAGE));
+  if( shf == NULL )
+  {
+    free(img);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  memset(shf,0,sizeof(SHF_IMAGE));
+  img->internal = shf;
+  _tcsncpy(img->file, file, 255);
+
+  if( !SHF_Map(file, shf) )
+  {
+    SkyeTek_CloseFirmwareImage(img);
+    return SKYETEK_FIRMWARE_BAD_FILE;
+  }
+  status = SHF_Validate(img, shf);
+  if( status != SKYETEK_SUCCESS )
+  {
+    SkyeTek_CloseFirmwareImage(img);
+    return status;
+  }
+
+  *lpImage = img;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API void
+SkyeTek_CloseFirmwareImage(
+  LPSKYETEK_FIRMWARE_IMAGE      lpImage
+  )
+{
+  LPSHF_IMAGE shf;
+
+  if( lpImage == NULL )
+    return;
+  shf = (LPSHF_IMAGE)lpImage->internal;
+  if( shf != NULL )
+  {
+    SHF_Unmap(shf);
+    if( shf->lpBlocks != NULL )
+      free(shf->lpBlocks);
+    if( shf->lpDefaults != NULL )
+      free(shf->lpDefaults);
+    free(shf);
+  }
+  free(lpImage);
+}
+
+SKYETEK_STATUS
+STPV3_UploadFirmwareImage(
+    LPSKYETEK_READER                      lpReader,
+    LPSKYETEK_FIRMWARE_IMAGE              lpImage,
+    unsigned char                         defaultsOnly,
+    SKYETEK_FIRMWARE_PROGRESS_CALLBACK    callback,
+    void                                  *user
+  )
+{
+  BL_UPLOAD upload;
+  LPSHF_IMAGE shf;
+  UINT8 responseBuf[BL_MAX_BLOCK_SIZE];
+  SKYETEK_STATUS status;
+
+  if( lpReader == NULL || lpReader->lpDevice == NULL || lpReader->lpDevice->internal == NULL ||
+      lpImage == NULL || lpImage->internal == NULL || callback == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  shf = (LPSHF_IMAGE)lpImage->internal;
+
+  memset(&upload,0,sizeof(BL_UPLOAD));
+  upload.callback = callback;
+  upload.user = user;
+  upload.progress.version = lpImage->version;
+  if( !defaultsOnly )
+  {
+    upload.progress.bytesTotal = lpImage->dataLength;
+    upload.progress.blocksTotal = shf->blockCount;
+  }
+
+  if( !BL_Report(&upload,5) )
+    return SKYETEK_FIRMWARE_CANCELED;
+
+	/* Read the Bootloader Version and Make sure that this shf file can be supported by the bootloader */
+	if( !sendBLCommand(lpReader->lpDevice, QUERY_BOOTLDR_VER, NULL, 0, responseBuf) )
+		return SKYETEK_FIRMWARE_READER_ERROR;
+  if( !BL_Report(&upload,8) )
+    return SKYETEK_FIRMWARE_CANCELED;
+
+	/* Set the Encryption Scheme */
+	if( !sendBLCommand(lpReader->lpDevice, SELECT_ENCRYPTION_SCHEME, &shf->encryptionScheme, 1, responseBuf) )
+		return SKYETEK_FIRMWARE_READER_ERROR;
+  if( !BL_Report(&upload,9) )
+    return SKYETEK_FIRMWARE_CANCELED;
+
+  /* Only setup bootloader if we have data to write */
+  if( (defaultsOnly == 0) && (shf->blockCount > 0) )
+  {
+	  /* Send the Bootloader Initialization Sequence to the Reader */
+	  if( !sendBLCommand(lpReader->lpDevice, SETUP_BOOTLOADER, shf->initString, 9, responseBuf) )
+		  return SKYETEK_FIRMWARE_READER_ERROR;
+    if( !BL_Report(&upload,10) )
+      return SKYETEK_FIRMWARE_CANCELED;
+
+    upload.start = SKYETEK_GetTickCount();
+    status = BL_SendRecords(lpReader->lpDevice, shf, WRITE_DATA, shf->lpBlocks, shf->blockCount, &upload);
+    if( status != SKYETEK_SUCCESS )
+      return status;
+  }
+
+	/* Program all the defaults */
+  status = BL_SendRecords(lpReader->lpDevice, shf, PROGRAM_DEFAULTS, shf->lpDefaults, shf->defaultCount, &upload);
+  if( status != SKYETEK_SUCCESS )
+    return status;
+
+  /* Now send the Firmware Complete Reset command to the reader */
+	sendBLCommand(lpReader->lpDevice, UPDATE_COMPLETE_RESET, NULL, 0, responseBuf);
+
+  /* Give it time to reset */
+  SKYETEK_Sleep(1000);
+  upload.progress.secondsRemaining = 0;
+  BL_Report(&upload,100);
+	return SKYETEK_SUCCESS;
+}
+
+typedef struct BL_LEGACY_CALLBACK
+{
+  SKYETEK_FIRMWARE_UPLOAD_CALLBACK  callback;
+  void                              *user;
+} BL_LEGACY_CALLBACK, *LPBL_LEGACY_CALLBACK;
+
+static int
+STPV3_LegacyUploadCallback(
+  LPSKYETEK_FIRMWARE_PROGRESS   lpProgress,
+  void                          *user
+  )
+{
+  LPBL_LEGACY_CALLBACK lpLegacy = (LPBL_LEGACY_CALLBACK)user;
+  return lpLegacy->callback(lpProgress->percentComplete, lpProgress->version, lpLegacy->user);
+}
+
+SKYETEK_STATUS
+STPV3_UploadFirmware(
+    LPSKYETEK_READER                      lpReader,
+    TCHAR                                  *file,
+    unsigned char                         defaultsOnly,
+    SKYETEK_FIRMWARE_UPLOAD_CALLBACK      callback,
+    void                                  *user
+  )
+{
+  LPSKYETEK_FIRMWARE_IMAGE lpImage = NULL;
+  BL_LEGACY_CALLBACK legacy;
+  SKYETEK_STATUS status;
+
+  /* Check inputs */
+  if( lpReader == NULL || callback == NULL || file == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  status = SkyeTek_OpenFirmwareImage(file, &lpImage);
+  if( status != SKYETEK_SUCCESS )
+    return status;
+
+  legacy.callback = callback;
+  legacy.user = user;
+  status = STPV3_UploadFirmwareImage(lpReader, lpImage, defaultsOnly, STPV3_LegacyUploadCallback, &legacy);
+  SkyeTek_CloseFirmwareImage(lpImage);
+  return status;
+}
@@ -24,13 +24,20 @@
 
 typedef struct {
   unsigned char allocated;
+  unsigned char growable;
+  unsigned char nomem;  /* a write failed for want of memory */
   int mode;
   unsigned char* data;
   int datalength;
   unsigned char* pos;
   int errors;
+  unsigned char* heap;  /* data once it outgrew the caller's buffer */
 } st_asn1_struct;
 
+/* st_asn1_context_storage must be able to hold a context */
+typedef char st_asn1_storage_check[(sizeof(st_asn1_context_storage) >=
+                                    sizeof(st_asn1_struct)) ? 1 : -1];
+
 int
 st_asn1_allocate_context(st_asn1_context* pContext) {
   void* p;
@@ -46,8 +53,10 @@ st_asn1_allocate_context(st_asn1_context* pContext) {
 
   if (st_asn1_allocate_context_ext(pContext, p, len))
     ((unsigned char*)p)[0] = 1; /* Set allocated flag */
-  else
+  else {
     st_free(p);
+    return 0;
+  }
 
   return 1;
 }
@@ -59,8 +68,8 @@ st_asn1_allocate_context_ext(st_asn1_context* pContext,
   if (bufferSize < st_asn1_get_context_size())
     return 0;
 
-  /* Clear allocated flag */
-  ((unsigned char*)buffer)[0] = 0;
+  /* Clears the allocated flag too */
+  st_memset(buffer, 0, sizeof(st_asn1_struct));
 
   *pContext = buffer;
   return 1;
@@ -71,6 +80,8 @@ st_asn1_free_context(st_asn1_context* pContext) {
   if ((pContext == NULL) || (*pContext == NULL))
     return;
   
+  if (((st_asn1_struct*)*pContext)->heap != NULL)
+    st_free(((st_asn1_struct*)*pContext)->heap);
   if (((unsigned char*)*pContext)[0])
     st_free(*pContext);
   *pContext = NULL;
@@ -88,6 +99,12 @@ st_asn1_init(st_asn1_context context,
              size_t dataLength) {
   st_asn1_struct* ctx = (st_asn1_struct*) context;
 
+  if (ctx->heap != NULL) {
+    st_free(ctx->heap);
+    ctx->heap = NULL;
+  }
+  ctx->growable = 0;
+  ctx->nomem = 0;
   ctx->mode = mode;
   ctx->data = data;
   ctx->datalength = dataLength;
@@ -95,6 +112,33 @@ st_asn1_init(st_asn1_context context,
   ctx->errors = 0;
 }
 
+void
+st_asn1_init_growable(st_asn1_context context,
+                      unsigned char* data,
+                      size_t dataLength) {
+  st_asn1_init(context, ST_ASN1_ENCODE, data, dataLength);
+  ((st_asn1_struct*) context)->growable = 1;
+}
+
+void
+st_asn1_rewind(st_asn1_context context) {
+  st_asn1_struct* ctx = (st_asn1_struct*) context;
+
+  ctx->pos = ctx->data;
+  ctx->errors = 0;
+  ctx->nomem = 0;
+}
+
+unsigned char*
+st_asn1_get_data(st_asn1_context context) {
+  return ((st_asn1_struct*) context)->data;
+}
+
+int
+st_asn1_out_of_memory(st_asn1_context context) {
+  return ((st_asn1_struct*) context)->nomem;
+}
+
 int
 st_asn1_finalize(st_asn1_context context) {
   st_asn1_struct* ctx = (st_asn1_struct*) context;
@@ -128,6 +172,40 @@ _log_base_128(uint64 w) {
   return l;
 }
 
+/* Makes room for length more bytes, moving the data to the heap
+   when the context is growable */
+static int
+_reserve(st_asn1_struct* ctx, uint64 length) {
+  unsigned char* p;
+  uint64 used, size;
+
+  used = ctx->pos - ctx->data;
+  if ((used + length) <= (uint64) ctx->datalength)
+    return 1;
+  if (!ctx->growable)
+    return 0;
+
+  size = ctx->datalength > 0 ? ctx->datalength : 64;
+  while (size < used + length)
+    size *= 2;
+  if (size > 0x7fffffff)
+    return 0;
+
+  p = (unsigned char*) st_alloc((int) size);
+  if (p == NULL) {
+    ctx->nomem = 1;
+    return 0;
+  }
+  st_memcpy(p, ctx->data, (int) used);
+  if (ctx->heap != NULL)
+    st_free(ctx->heap);
+  ctx->heap = p;
+  ctx->data = p;
+  ctx->pos = p + used;
+  ctx->datalength = (int) size;
+  return 1;
+}
+
 static int
 _write_base_128(unsigned char** pos, int remaining, uint64 w) {
   unsigned char* p;
@@ -174,7 +252,7 @@ static int
 _write_base_256(st_asn1_struct* ctx, uint64 w, unsigned char length) {
   unsigned char* p;
   
-  if ((ctx->pos - ctx->data + length) > ctx->datalength)
+  if (!_reserve(ctx, length))
     return 0;
 
   ctx->pos += length;
@@ -195,6 +273,20 @@ _read_base_256(unsigned char** p, uint64* w, unsigned char l) {
     *w = (*w << 8) | *(*p)++;
 }
 
+/* Bytes taken by the identifier and length octets */
+static uint64
+_header_size(uint64 tag, uint64 length) {
+  uint64 size = 1;
+
+  if (tag >= 31)
+    size += _log_base_128(tag);
+  if (length < 0x80)
+    size += 1;
+  else
+    size += 1 + _log_base_256(length);
+  return size;
+}
+
 static int
 _write(st_asn1_struct* ctx,
        unsigned char constructed,
@@ -202,7 +294,8 @@ _write(st_asn1_struct* ctx,
        uint64 tag,
        unsigned char* data,
        uint64 length) {
-  if ((ctx->pos - ctx->data + 2 + length) > ctx->datalength)
+  /* Identifier, length and contents in one go */
+  if (!_reserve(ctx, _header_size(tag, length) + length))
     return 0;
   
   if (tag < 31)
@@ -279,13 +372,15 @@ _peek(st_asn1_struct* ctx,
   return 1;
 }
 
+/* Reads an element and returns where its contents are, without
+   copying them */
 static int
-_read(st_asn1_struct* ctx,
-      unsigned char constructed,
-      unsigned char clazz,
-      uint64 tag,
-      unsigned char* data,
-      size_t* length) {
+_read_view(st_asn1_struct* ctx,
+           unsigned char constructed,
+           unsigned char clazz,
+           uint64 tag,
+           unsigned char** data,
+           uint64* length) {
   unsigned char* p;
   unsigned char b;
   uint64 rtag, rlength;
@@ -320,22 +415,46 @@ _read(st_asn1_struct* ctx,
   } else
     rlength = b & 0x7f;
 
-  if (rlength > *length)
+  if (rlength > (uint64)(ctx->datalength - (p - ctx->data)))
+    return 0;
+
+  *data = p;
+  *length = rlength;
+  ctx->pos = p + rlength;
+
+  return 1;
+}
+
+static int
+_read(st_asn1_struct* ctx,
+      unsigned char constructed,
+      unsigned char clazz,
+      uint64 tag,
+      unsigned char* data,
+      size_t* length) {
+  unsigned char* pos;
+  unsigned char* p;
+  uint64 rlength;
+
+  pos = ctx->pos;
+  if (!_read_view(ctx, constructed, clazz, tag, &p, &rlength))
+    return 0;
+
+  if (rlength > *length) {
+    ctx->pos = pos;
     return 0;
+  }
   *length = (size_t) rlength;
 
   if (rlength > 0)
     st_memcpy(data, p, (int) rlength);
-  p += rlength;
-
-  ctx->pos = p;
 
   return 1;
 }
 
 static int
 _write_end_of_contents(st_asn1_struct* ctx) {
-  if ((ctx->pos - ctx->data + 2) > ctx->datalength)
+  if (!_reserve(ctx, 2))
     return 0;
 
   *ctx->pos++ = 0;
@@ -611,6 +730,21 @@ st_asn1_read_octet_string(st_asn1_context context,
     return 1;
 }
 
+int
+st_asn1_read_octet_string_view(st_asn1_context context,
+                               unsigned char** p,
+                               size_t* length) {
+  st_asn1_struct* ctx = (st_asn1_struct*) context;
+  uint64 l;
+
+  if (!_read_view(ctx, PRIMITIVE, UNIVERSAL, ST_OCTET_STRING, p, &l)) {
+    ctx->errors++;
+    return 0;
+  }
+  *length = (size_t) l;
+  return 1;
+}
+
 int
 st_asn1_read_object_identifier(st_asn1_context context,
                                uint32* id,
@@ -21,6 +21,12 @@
 
 typedef void* st_asn1_context;
 
+/* Room for a context on the stack or in an arena; pass it to
+   st_asn1_allocate_context_ext() to avoid the heap */
+typedef struct {
+  void* reserved[8];
+} st_asn1_context_storage;
+
 int st_asn1_allocate_context(st_asn1_context* pContext);
 
 size_t st_asn1_allocate_context_ext(st_asn1_context* pContext,
@@ -36,8 +42,26 @@ void st_asn1_init(st_asn1_context context,
                   unsigned char* data,
                   size_t dataLength);
 
+/* Encodes into data and moves to the heap only if it runs out of
+   room, so the output is never truncated. The heap buffer is freed
+   with the context. */
+void st_asn1_init_growable(st_asn1_context context,
+                           unsigned char* data,
+                           size_t dataLength);
+
+/* Starts over at the beginning of the data, keeping any heap buffer
+   the context has grown into */
+void st_asn1_rewind(st_asn1_context context);
+
+/* Start of the encoded data; may differ from the buffer given to
+   st_asn1_init_growable() */
+unsigned char* st_asn1_get_data(st_asn1_context context);
+
 int st_asn1_finalize(st_asn1_context context);
 
+/* Non-zero if a write failed because a growable context could not grow */
+int st_asn1_out_of_memory(st_asn1_context context);
+
 /* ASN.1 Common Routines */
 
 int st_asn1_start_sequence(st_asn1_context context);
@@ -60,6 +84,10 @@ int st_asn1_read_integer(st_asn1_context context, int64* w);
 int st_asn1_read_octet_string(st_asn1_context context,
                               unsigned char* p,
                               size_t* length);
+/* Returns the contents in place, without copying them */
+int st_asn1_read_octet_string_view(st_asn1_context context,
+                                   unsigned char** p,
+                                   size_t* length);
 int st_asn1_read_boolean(st_asn1_context context, int* boolean);
 int st_asn1_peek(st_asn1_context context);
 int st_asn1_read_enumerated(st_asn1_context context, int64* w);
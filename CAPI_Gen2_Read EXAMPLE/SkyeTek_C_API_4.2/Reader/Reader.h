@@ -131,6 +131,15 @@ typedef struct READER_IMPL
       void                                  *user
       );
 
+  SKYETEK_STATUS 
+  (*UploadFirmwareImage)(
+      LPSKYETEK_READER                      lpReader, 
+      LPSKYETEK_FIRMWARE_IMAGE              lpImage, 
+      unsigned char                         defaultsOnly,
+      SKYETEK_FIRMWARE_PROGRESS_CALLBACK    callback, 
+      void                                  *user
+      );
+
   SKYETEK_STATUS 
   (*GetDebugMessages)(
       LPSKYETEK_READER     lpReader,
@@ -161,10 +170,152 @@ typedef struct READER_IMPL
     void                          *user
     );
 
+  SKYETEK_STATUS 
+  (*ExecuteBatch)(
+      LPSKYETEK_READER             lpReader,
+      LPSKYETEK_BATCH_OPERATION    lpOps,
+      unsigned int                 count,
+      SKYETEK_STATUS               *lpStatus
+      );
+
+  SKYETEK_STATUS 
+  (*SelectTagViews)(
+      LPSKYETEK_READER            lpReader, 
+      SKYETEK_TAGTYPE             tagType, 
+      SKYETEK_TAG_VIEW_CALLBACK   callback, 
+      unsigned char               inv, 
+      unsigned char               loop, 
+      void                        *user
+      );
+
+  SKYETEK_STATUS 
+  (*GetTagSet)(
+      LPSKYETEK_READER   lpReader, 
+      SKYETEK_TAGTYPE    tagType, 
+      LPSKYETEK_ID       lpTagIdMask,
+      LPSKYETEK_TAG_SET  *lpSet
+      );
+
 } READER_IMPL, *LPREADER_IMPL;
 
 extern READER_IMPL SkyetekReaderImpl;
 
+/* Tag reads collected by SkyeTekReader_Dwell() */
+typedef struct READER_DWELL
+{
+  LPSKYETEK_TAG_READ    reads;        /* grown as needed; free when done */
+  unsigned int          count;
+  unsigned int          capacity;
+  unsigned long         deadline;
+  int                   loop;         /* 0 for a single inventory */
+  int                   full;         /* a read could not be kept */
+} READER_DWELL, *LPREADER_DWELL;
+
+/* Runs an inventory loop for dwell ms, or a single inventory if dwell is 0 */
+SKYETEK_STATUS 
+SkyeTekReader_Dwell(
+    LPSKYETEK_READER   lpReader, 
+    SKYETEK_TAGTYPE    tagType, 
+    unsigned long      dwell,
+    LPREADER_DWELL     lpDwell
+    );
+
+/* System parameter cache; see SkyeTekParameterCache.c. A no-op when
+   the reader has no cache. */
+int 
+SkyeTekReader_GetCachedParameter(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_SYSTEM_PARAMETER      parameter,
+    LPSKYETEK_DATA                *lpData
+    );
+
+void 
+SkyeTekReader_CacheParameter(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_SYSTEM_PARAMETER      parameter,
+    LPSKYETEK_DATA                lpData
+    );
+
+void 
+SkyeTekReader_InvalidateParameter(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_SYSTEM_PARAMETER      parameter
+    );
+
+/* State kept for a reader or its protocol outside the public structs;
+   see SkyeTekPrivate.c. The owner is the struct the state belongs to. */
+#define PRIVATE_SELECTION   1   /* STPv3 selection; owner is the SKYETEK_PROTOCOL */
+#define PRIVATE_PARAMETERS  2   /* parameter cache; owner is the SKYETEK_READER */
+#define PRIVATE_KEYS        3   /* key slot cache; owner is the SKYETEK_READER */
+
+void *
+SkyeTekReader_GetPrivate(
+    const void                    *owner,
+    int                           kind
+    );
+
+SKYETEK_STATUS
+SkyeTekReader_SetPrivate(
+    const void                    *owner,
+    int                           kind,
+    void                          *data
+    );
+
+/* Removes the state and returns it for the caller to free */
+void *
+SkyeTekReader_TakePrivate(
+    const void                    *owner,
+    int                           kind
+    );
+
+/* Key slot cache; see SkyeTekKeyCache.c. The reader layer records what
+   it stores and loads; crypto sessions look here before sending. */
+int 
+SkyeTekReader_IsKeyStored(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_TAGTYPE               type,
+    unsigned char                 number,
+    LPSKYETEK_DATA                lpData
+    );
+
+void 
+SkyeTekReader_KeyStored(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_TAGTYPE               type,
+    unsigned char                 number,
+    LPSKYETEK_DATA                lpData
+    );
+
+int 
+SkyeTekReader_IsKeyLoaded(
+    LPSKYETEK_READER              lpReader,
+    unsigned char                 number
+    );
+
+void 
+SkyeTekReader_KeyLoaded(
+    LPSKYETEK_READER              lpReader,
+    int                           number
+    );
+
+void 
+SkyeTekReader_InvalidateKeys(
+    LPSKYETEK_READER              lpReader
+    );
+
+void 
+SkyeTekReader_FreeKeys(
+    LPSKYETEK_READER              lpReader
+    );
+
+/* Ends a run of commands sent with the field held on; lets the field
+   drop unless lpTag keeps it on */
+void
+SkyeTekReader_ReleaseField(
+    LPSKYETEK_READER              lpReader,
+    LPSKYETEK_TAG                 lpTag
+    );
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,460 @@
+/**
+ * SkyeTekAggregator.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Tag read aggregation. Tags are kept in an open addressing hash
+ * table keyed on tag type and ID; entries are removed as tags depart
+ * so the table follows the number of tags present.
+ */
+#include "../SkyeTekAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AGG_MIN_SIZE    64    /* entries; always a power of two */
+#define AGG_BUCKETS     8     /* sliding window resolution */
+
+typedef struct AGG_ENTRY
+{
+  SKYETEK_TAG_STATS     stats;
+  unsigned int          hash;
+  unsigned char         used;
+  unsigned long         epoch;        /* window or bucket of the last read */
+  unsigned long         buckets[AGG_BUCKETS];
+} AGG_ENTRY, *LPAGG_ENTRY;
+
+typedef struct AGG_TABLE
+{
+  LPAGG_ENTRY                   entries;
+  unsigned int                  size;
+  unsigned int                  count;
+  SKYETEK_WINDOW_MODE           mode;
+  unsigned long                 window;
+  unsigned long                 slice;    /* time between departure checks */
+  unsigned long                 lastAdvance;
+  SKYETEK_TAG_EVENT_CALLBACK    callback;
+  void                          *user;
+  MUTEX(lock);
+} AGG_TABLE, *LPAGG_TABLE;
+
+static unsigned int
+Agg_Hash(
+    SKYETEK_TAGTYPE         type,
+    const unsigned char     *id,
+    unsigned int            length
+    )
+{
+  unsigned int h = 2166136261u;
+  unsigned int ix;
+
+  h = (h ^ (type & 0xFF)) * 16777619u;
+  h = (h ^ ((type >> 8) & 0xFF)) * 16777619u;
+  for( ix = 0; ix < length; ix++ )
+    h = (h ^ id[ix]) * 16777619u;
+  return h;
+}
+
+/* Returns the slot holding the tag or the empty slot where it belongs */
+static unsigned int
+Agg_Find(
+    LPAGG_TABLE             tbl,
+    unsigned int            hash,
+    SKYETEK_TAGTYPE         type,
+    const unsigned char     *id,
+    unsigned int            length
+    )
+{
+  unsigned int mask = tbl->size - 1;
+  unsigned int ix = hash & mask;
+  LPAGG_ENTRY e;
+
+  for(;;)
+  {
+    e = &tbl->entries[ix];
+    if( !e->used )
+      return ix;
+    if( e->hash == hash && e->stats.type == type && e->stats.length == length &&
+        memcmp(e->stats.id, id, length) == 0 )
+      return ix;
+    ix = (ix + 1) & mask;
+  }
+}
+
+static int
+Agg_Resize(
+    LPAGG_TABLE     tbl,
+    unsigned int    size
+    )
+{
+  LPAGG_ENTRY old = tbl->entries;
+  unsigned int oldSize = tbl->size;
+  unsigned int ix, iy;
+
+  tbl->entries = (LPAGG_ENTRY)calloc(size, sizeof(AGG_ENTRY));
+  if( tbl->entries == NULL )
+  {
+    tbl->entries = old;
+    return 0;
+  }
+  tbl->size = size;
+  for( ix = 0; ix < oldSize; ix++ )
+  {
+    if( !old[ix].used )
+      continue;
+    for( iy = old[ix].hash & (size - 1); tbl->entries[iy].used; iy = (iy + 1) & (size - 1) )
+      ;
+    memcpy(&tbl->entries[iy], &old[ix], sizeof(AGG_ENTRY));
+  }
+  free(old);
+  return 1;
+}
+
+/* Deletes without tombstones by shifting the rest of the cluster back */
+static void
+Agg_Remove(
+    LPAGG_TABLE     tbl,
+    unsigned int    ix
+    )
+{
+  unsigned int mask = tbl->size - 1;
+  unsigned int iy = ix, home;
+
+  for(;;)
+  {
+    iy = (iy + 1) & mask;
+    if( !tbl->entries[iy].used )
+      break;
+    home = tbl->entries[iy].hash & mask;
+    if( (ix <= iy) ? (ix < home && home <= iy) : (ix < home || home <= iy) )
+      continue;
+    memcpy(&tbl->entries[ix], &tbl->entries[iy], sizeof(AGG_ENTRY));
+    ix = iy;
+  }
+  tbl->entries[ix].used = 0;
+  tbl->count--;
+}
+
+/* Brings the window counts of an entry up to the given time */
+static void
+Agg_Roll(
+    LPAGG_TABLE     tbl,
+    LPAGG_ENTRY     e,
+    unsigned long   now
+    )
+{
+  unsigned long epoch, ix;
+
+  if( tbl->mode == WINDOW_TUMBLING )
+  {
+    epoch = now / tbl->window;
+    if( (long)(epoch - e->epoch) > 0 )
+    {
+      e->epoch = epoch;
+      e->stats.reads = 0;
+    }
+  }
+  else if( tbl->mode == WINDOW_SLIDING )
+  {
+    epoch = now / tbl->slice;
+    if( epoch == e->epoch )
+      return;
+    if( (long)(epoch - e->epoch) < 0 )
+      return;   /* late read from another reader; count it in the current bucket */
+    if( epoch - e->epoch >= AGG_BUCKETS )
+      memset(e->buckets, 0, sizeof(e->buckets));
+    else
+      for( ix = e->epoch + 1; ix != epoch + 1; ix++ )
+        e->buckets[ix % AGG_BUCKETS] = 0;
+    e->epoch = epoch;
+    e->stats.reads = 0;
+    for( ix = 0; ix < AGG_BUCKETS; ix++ )
+      e->stats.reads += e->buckets[ix];
+  }
+}
+
+static int
+Agg_HasDeparted(
+    LPAGG_TABLE     tbl,
+    LPAGG_ENTRY     e,
+    unsigned long   now
+    )
+{
+  if( (long)(now - e->stats.lastSeen) <= 0 )
+    return 0;
+  if( tbl->mode == WINDOW_TUMBLING )
+    return (now / tbl->window) > (e->stats.lastSeen / tbl->window) + 1;
+  return (now - e->stats.lastSeen) >= tbl->window;
+}
+
+static void
+Agg_Advance(
+    LPSKYETEK_AGGREGATOR  lpAggregator,
+    LPAGG_TABLE           tbl,
+    unsigned long         now
+    )
+{
+  unsigned int ix = 0, size;
+  LPAGG_ENTRY e;
+
+  tbl->lastAdvance = now;
+  while( ix < tbl->size )
+  {
+    e = &tbl->entries[ix];
+    if( !e->used )
+    {
+      ix++;
+      continue;
+    }
+    if( !Agg_HasDeparted(tbl, e, now) )
+    {
+      Agg_Roll(tbl, e, now);
+      ix++;
+      continue;
+    }
+    if( tbl->callback != NULL )
+      tbl->callback(TAG_DEPARTED, &e->stats, tbl->user);
+    /* The slot is refilled from later in the cluster; look at it again */
+    Agg_Remove(tbl, ix);
+  }
+
+  /* Give memory back when the population drops */
+  for( size = tbl->size; size > AGG_MIN_SIZE && tbl->count * 8 < size; size >>= 1 )
+    ;
+  if( size != tbl->size )
+    Agg_Resize(tbl, size);
+  lpAggregator->count = tbl->count;
+}
+
+static SKYETEK_STATUS
+Agg_Add(
+    LPSKYETEK_AGGREGATOR    lpAggregator,
+    LPAGG_TABLE             tbl,
+    LPSKYETEK_READER        lpReader,
+    SKYETEK_TAGTYPE         type,
+    const unsigned char     *id,
+    unsigned int            length,
+    unsigned long           timestamp,
+    unsigned int            antenna,
+    int                     rssi
+    )
+{
+  LPAGG_ENTRY e;
+  unsigned int hash, ix;
+  int arrived = 0;
+
+  if( length > SKYETEK_TAG_READ_ID_SIZE )
+    length = SKYETEK_TAG_READ_ID_SIZE;
+  hash = Agg_Hash(type, id, length);
+  ix = Agg_Find(tbl, hash, type, id, length);
+  e = &tbl->entries[ix];
+
+  if( !e->used )
+  {
+    /* Keep the load under one half */
+    if( (tbl->count + 1) * 2 > tbl->size )
+    {
+      if( !Agg_Resize(tbl, tbl->size * 2) )
+        return SKYETEK_OUT_OF_MEMORY;
+      ix = Agg_Find(tbl, hash, type, id, length);
+      e = &tbl->entries[ix];
+    }
+    memset(e, 0, sizeof(AGG_ENTRY));
+    e->used = 1;
+    e->hash = hash;
+    e->stats.type = type;
+    e->stats.length = length;
+    memcpy(e->stats.id, id, length);
+    e->stats.firstSeen = timestamp;
+    e->epoch = timestamp / (tbl->mode == WINDOW_SLIDING ? tbl->slice : tbl->window);
+    tbl->count++;
+    lpAggregator->count = tbl->count;
+    arrived = 1;
+  }
+
+  Agg_Roll(tbl, e, timestamp);
+  if( tbl->mode == WINDOW_SLIDING )
+    e->buckets[e->epoch % AGG_BUCKETS]++;
+  e->stats.reads++;
+  e->stats.totalReads++;
+  if( (long)(timestamp - e->stats.lastSeen) > 0 || arrived )
+    e->stats.lastSeen = timestamp;
+  e->stats.lpReader = lpReader;
+  e->stats.antenna = antenna;
+  e->stats.rssi = rssi;
+
+  if( arrived && tbl->callback != NULL )
+    tbl->callback(TAG_ARRIVED, &e->stats, tbl->user);
+
+  if( (long)(timestamp - tbl->lastAdvance) >= (long)tbl->slice )
+    Agg_Advance(lpAggregator, tbl, timestamp);
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_CreateAggregator(
+    SKYETEK_WINDOW_MODE           mode,
+    unsigned long                 window,
+    SKYETEK_TAG_EVENT_CALLBACK    callback,
+    void                          *user,
+    LPSKYETEK_AGGREGATOR          *lpAggregator
+    )
+{
+  LPSKYETEK_AGGREGATOR lpAgg;
+  LPAGG_TABLE tbl;
+
+  if( window == 0 || lpAggregator == NULL ||
+      (mode != WINDOW_PRESENCE && mode != WINDOW_TUMBLING && mode != WINDOW_SLIDING) )
+    return SKYETEK_INVALID_PARAMETER;
+
+  lpAgg = (LPSKYETEK_AGGREGATOR)malloc(sizeof(SKYETEK_AGGREGATOR));
+  if( lpAgg == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  tbl = (LPAGG_TABLE)malloc(sizeof(AGG_TABLE));
+  if( tbl == NULL )
+  {
+    free(lpAgg);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  memset(tbl, 0, sizeof(AGG_TABLE));
+  tbl->entries = (LPAGG_ENTRY)calloc(AGG_MIN_SIZE, sizeof(AGG_ENTRY));
+  if( tbl->entries == NULL )
+  {
+    free(tbl);
+    free(lpAgg);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  tbl->size = AGG_MIN_SIZE;
+  tbl->mode = mode;
+  tbl->window = window;
+  tbl->slice = window / AGG_BUCKETS;
+  if( tbl->slice == 0 )
+    tbl->slice = 1;
+  tbl->lastAdvance = SKYETEK_GetTickCount();
+  tbl->callback = callback;
+  tbl->user = user;
+  MUTEX_CREATE(&tbl->lock);
+
+  lpAgg->mode = mode;
+  lpAgg->window = window;
+  lpAgg->count = 0;
+  lpAgg->internal = tbl;
+  *lpAggregator = lpAgg;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_AggregateTag(
+    LPSKYETEK_AGGREGATOR          lpAggregator,
+    LPSKYETEK_READER              lpReader,
+    const SKYETEK_TAG_VIEW        *lpView,
+    unsigned int                  antenna,
+    int                           rssi
+    )
+{
+  LPAGG_TABLE tbl;
+  SKYETEK_STATUS status;
+
+  if( lpAggregator == NULL || lpAggregator->internal == NULL ||
+      lpView == NULL || lpView->id == NULL || lpView->length == 0 )
+    return SKYETEK_INVALID_PARAMETER;
+  tbl = (LPAGG_TABLE)lpAggregator->internal;
+
+  MUTEX_LOCK(&tbl->lock);
+  status = Agg_Add(lpAggregator, tbl, lpReader, lpView->type, lpView->id,
+    lpView->length, lpView->timestamp, antenna, rssi);
+  MUTEX_UNLOCK(&tbl->lock);
+  return status;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_AggregateTagReads(
+    LPSKYETEK_AGGREGATOR          lpAggregator,
+    LPSKYETEK_READER              lpReader,
+    const SKYETEK_TAG_READ        *lpReads,
+    unsigned int                  count
+    )
+{
+  LPAGG_TABLE tbl;
+  SKYETEK_STATUS status = SKYETEK_SUCCESS;
+  unsigned int ix;
+
+  if( lpAggregator == NULL || lpAggregator->internal == NULL ||
+      (lpReads == NULL && count > 0) )
+    return SKYETEK_INVALID_PARAMETER;
+  tbl = (LPAGG_TABLE)lpAggregator->internal;
+
+  MUTEX_LOCK(&tbl->lock);
+  for( ix = 0; ix < count && status == SKYETEK_SUCCESS; ix++ )
+  {
+    if( lpReads[ix].length == 0 )
+      continue;
+    status = Agg_Add(lpAggregator, tbl, lpReader, lpReads[ix].type, lpReads[ix].id,
+      lpReads[ix].length, lpReads[ix].timestamp, 0, SKYETEK_NO_RSSI);
+  }
+  MUTEX_UNLOCK(&tbl->lock);
+  return status;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_AdvanceAggregator(
+    LPSKYETEK_AGGREGATOR          lpAggregator,
+    unsigned long                 now
+    )
+{
+  LPAGG_TABLE tbl;
+
+  if( lpAggregator == NULL || lpAggregator->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  tbl = (LPAGG_TABLE)lpAggregator->internal;
+
+  MUTEX_LOCK(&tbl->lock);
+  Agg_Advance(lpAggregator, tbl, now);
+  MUTEX_UNLOCK(&tbl->lock);
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_GetAggregatedTags(
+    LPSKYETEK_AGGREGATOR          lpAggregator,
+    LPSKYETEK_TAG_STATS           lpStats,
+    unsigned int                  max,
+    unsigned int                  *count
+    )
+{
+  LPAGG_TABLE tbl;
+  unsigned int ix, num = 0;
+
+  if( lpAggregator == NULL || lpAggregator->internal == NULL ||
+      lpStats == NULL || count == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  tbl = (LPAGG_TABLE)lpAggregator->internal;
+
+  MUTEX_LOCK(&tbl->lock);
+  for( ix = 0; ix < tbl->size && num < max; ix++ )
+  {
+    if( tbl->entries[ix].used )
+      memcpy(&lpStats[num++], &tbl->entries[ix].stats, sizeof(SKYETEK_TAG_STATS));
+  }
+  MUTEX_UNLOCK(&tbl->lock);
+  *count = num;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API void
+SkyeTek_FreeAggregator(
+    LPSKYETEK_AGGREGATOR          lpAggregator
+    )
+{
+  LPAGG_TABLE tbl;
+
+  if( lpAggregator == NULL )
+    return;
+  tbl = (LPAGG_TABLE)lpAggregator->internal;
+  if( tbl != NULL )
+  {
+    MUTEX_DESTROY(&tbl->lock);
+    free(tbl->entries);
+    free(tbl);
+  }
+  free(lpAggregator);
+}
@@ -0,0 +1,283 @@
+/**
+ * SkyeTekAntenna.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Antenna multiplexer scheduling. A round is a weighted interleave of
+ * the ports; each dwell runs an inventory loop on one port and the
+ * switch to the next port goes out while the reads are handed over.
+ */
+#include "../SkyeTekAPI.h"
+#include "Reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ANTENNA_STATE
+{
+  READER_DWELL          dwell;        /* reads of the current dwell */
+  unsigned int          *slots;       /* port index of each dwell in the round */
+  unsigned int          maxSlots;
+  long                  *credit;      /* weighted round robin */
+  unsigned char         *active;
+  int                   current;      /* port index on the multiplexer; -1 if unknown */
+} ANTENNA_STATE, *LPANTENNA_STATE;
+
+typedef struct ANTENNA_SWITCH
+{
+  LPSKYETEK_READER      lpReader;
+  unsigned char         port;
+  SKYETEK_STATUS        status;
+} ANTENNA_SWITCH, *LPANTENNA_SWITCH;
+
+static SKYETEK_STATUS
+Antenna_SetPort(
+    LPSKYETEK_READER    lpReader,
+    unsigned char       port
+    )
+{
+  LPSKYETEK_DATA lpData;
+  SKYETEK_STATUS status;
+
+  lpData = SkyeTek_AllocateData(1);
+  if( lpData == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  lpData->data[0] = port;
+  status = SkyeTek_SetSystemParameter(lpReader, SYS_MUX_CONTROL, lpData);
+  SkyeTek_FreeData(lpData);
+  return status;
+}
+
+static THREAD_RETURN
+Antenna_Switch(
+    void      *user
+    )
+{
+  LPANTENNA_SWITCH sw = (LPANTENNA_SWITCH)user;
+  sw->status = Antenna_SetPort(sw->lpReader, sw->port);
+  return 0;
+}
+
+/* Lays out the dwells of the next round; returns how many there are */
+static unsigned int
+Antenna_Plan(
+    LPSKYETEK_ANTENNA_SCHEDULER   lpScheduler,
+    LPANTENNA_STATE               state
+    )
+{
+  LPSKYETEK_ANTENNA_STATS lpStats;
+  unsigned int ix, iy, best, weight, total = 0, active = 0;
+  unsigned int *slots;
+
+  for( ix = 0; ix < lpScheduler->count; ix++ )
+  {
+    lpStats = &lpScheduler->lpStats[ix];
+    state->active[ix] = (lpScheduler->idleSkip == 0 ||
+      lpStats->idleDwells < lpScheduler->idleSkip ||
+      (lpScheduler->rounds % lpScheduler->idleSkip) == 0);
+    if( state->active[ix] )
+      active++;
+  }
+  for( ix = 0; ix < lpScheduler->count; ix++ )
+  {
+    weight = lpScheduler->lpPorts[ix].weight ? lpScheduler->lpPorts[ix].weight : 1;
+    if( active == 0 )
+      state->active[ix] = 1;  /* everything is idle; try every port */
+    if( state->active[ix] )
+      total += weight;
+    else
+      lpScheduler->lpStats[ix].skipped += weight;
+    state->credit[ix] = 0;
+  }
+
+  if( total > state->maxSlots )
+  {
+    slots = (unsigned int *)realloc(state->slots, total * sizeof(unsigned int));
+    if( slots == NULL )
+      return 0;
+    state->slots = slots;
+    state->maxSlots = total;
+  }
+
+  /* Smooth weighted round robin spreads each port over the round */
+  for( iy = 0; iy < total; iy++ )
+  {
+    best = lpScheduler->count;
+    for( ix = 0; ix < lpScheduler->count; ix++ )
+    {
+      if( !state->active[ix] )
+        continue;
+      state->credit[ix] += lpScheduler->lpPorts[ix].weight ? lpScheduler->lpPorts[ix].weight : 1;
+      if( best == lpScheduler->count || state->credit[ix] > state->credit[best] )
+        best = ix;
+    }
+    state->credit[best] -= total;
+    state->slots[iy] = best;
+  }
+  return total;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_CreateAntennaScheduler(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_TAGTYPE               tagType,
+    LPSKYETEK_ANTENNA_PORT        lpPorts,
+    unsigned int                  count,
+    unsigned int                  idleSkip,
+    LPSKYETEK_ANTENNA_SCHEDULER   *lpScheduler
+    )
+{
+  LPSKYETEK_ANTENNA_SCHEDULER lpSched;
+  LPANTENNA_STATE state;
+  unsigned int ix;
+
+  if( lpReader == NULL || lpReader->lpProtocol == NULL ||
+      lpReader->lpProtocol->internal == NULL || lpReader->lpDevice == NULL ||
+      lpPorts == NULL || count == 0 || lpScheduler == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  lpSched = (LPSKYETEK_ANTENNA_SCHEDULER)malloc(sizeof(SKYETEK_ANTENNA_SCHEDULER));
+  if( lpSched == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  memset(lpSched, 0, sizeof(SKYETEK_ANTENNA_SCHEDULER));
+  state = (LPANTENNA_STATE)malloc(sizeof(ANTENNA_STATE));
+  lpSched->lpPorts = (LPSKYETEK_ANTENNA_PORT)malloc(count * sizeof(SKYETEK_ANTENNA_PORT));
+  lpSched->lpStats = (LPSKYETEK_ANTENNA_STATS)malloc(count * sizeof(SKYETEK_ANTENNA_STATS));
+  if( state != NULL )
+  {
+    memset(state, 0, sizeof(ANTENNA_STATE));
+    state->credit = (long *)malloc(count * sizeof(long));
+    state->active = (unsigned char *)malloc(count);
+  }
+  lpSched->internal = state;
+  if( state == NULL || state->credit == NULL || state->active == NULL ||
+      lpSched->lpPorts == NULL || lpSched->lpStats == NULL )
+  {
+    SkyeTek_FreeAntennaScheduler(lpSched);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+
+  memcpy(lpSched->lpPorts, lpPorts, count * sizeof(SKYETEK_ANTENNA_PORT));
+  memset(lpSched->lpStats, 0, count * sizeof(SKYETEK_ANTENNA_STATS));
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpSched->lpStats[ix].port = lpPorts[ix].port;
+    lpSched->lpStats[ix].lastStatus = SKYETEK_SUCCESS;
+  }
+  lpSched->lpReader = lpReader;
+  lpSched->tagType = tagType;
+  lpSched->count = count;
+  lpSched->idleSkip = idleSkip;
+  state->current = -1;
+  *lpScheduler = lpSched;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_RunAntennaRound(
+    LPSKYETEK_ANTENNA_SCHEDULER   lpScheduler,
+    SKYETEK_ANTENNA_READ_CALLBACK callback,
+    void                          *user
+    )
+{
+  LPANTENNA_STATE state;
+  LPSKYETEK_ANTENNA_STATS lpStats;
+  ANTENNA_SWITCH sw;
+  THREAD(thread);
+  SKYETEK_STATUS status, last = SKYETEK_FAILURE;
+  unsigned int total, ix, iy, ir, next, ran = 0;
+  int threaded, stop = 0;
+
+  if( lpScheduler == NULL || lpScheduler->internal == NULL || callback == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  state = (LPANTENNA_STATE)lpScheduler->internal;
+
+  total = Antenna_Plan(lpScheduler, state);
+  if( total == 0 )
+    return SKYETEK_OUT_OF_MEMORY;
+  sw.lpReader = lpScheduler->lpReader;
+
+  for( iy = 0; iy < total && !stop; iy++ )
+  {
+    ix = state->slots[iy];
+    lpStats = &lpScheduler->lpStats[ix];
+    if( state->current != (int)ix )
+    {
+      status = Antenna_SetPort(lpScheduler->lpReader, lpScheduler->lpPorts[ix].port);
+      if( status != SKYETEK_SUCCESS )
+      {
+        lpStats->lastStatus = last = status;
+        state->current = -1;
+        continue;
+      }
+      state->current = (int)ix;
+    }
+
+    status = SkyeTekReader_Dwell(lpScheduler->lpReader, lpScheduler->tagType,
+      lpScheduler->lpPorts[ix].dwell, &state->dwell);
+    lpStats->lastStatus = last = status;
+    lpStats->dwells++;
+    lpStats->reads += state->dwell.count;
+    if( state->dwell.count > 0 )
+    {
+      lpStats->idleDwells = 0;
+      lpStats->lastRead = state->dwell.reads[state->dwell.count - 1].timestamp;
+    }
+    else
+    {
+      lpStats->idleDwells++;
+    }
+    ran++;
+
+    /* Switch to the next port while the reads are handed over */
+    threaded = 0;
+    next = (iy + 1 < total) ? state->slots[iy + 1] : ix;
+    if( next != ix )
+    {
+      sw.port = lpScheduler->lpPorts[next].port;
+      sw.status = SKYETEK_FAILURE;
+      threaded = THREAD_CREATE(&thread, Antenna_Switch, &sw);
+    }
+    for( ir = 0; ir < state->dwell.count && !stop; ir++ )
+      stop = !callback(lpScheduler->lpPorts[ix].port, &state->dwell.reads[ir], user);
+    if( next != ix )
+    {
+      if( threaded )
+        THREAD_JOIN(&thread);
+      else
+        sw.status = Antenna_SetPort(lpScheduler->lpReader, sw.port);
+      state->current = (sw.status == SKYETEK_SUCCESS) ? (int)next : -1;
+    }
+  }
+
+  lpScheduler->rounds++;
+  return ran ? SKYETEK_SUCCESS : last;
+}
+
+SKYETEK_API void
+SkyeTek_FreeAntennaScheduler(
+    LPSKYETEK_ANTENNA_SCHEDULER   lpScheduler
+    )
+{
+  LPANTENNA_STATE state;
+
+  if( lpScheduler == NULL )
+    return;
+  state = (LPANTENNA_STATE)lpScheduler->internal;
+  if( state != NULL )
+  {
+    if( state->dwell.reads != NULL )
+      free(state->dwell.reads);
+    if( state->slots != NULL )
+      free(state->slots);
+    if( state->credit != NULL )
+      free(state->credit);
+    if( state->active != NULL )
+      free(state->active);
+    free(state);
+  }
+  if( lpScheduler->lpPorts != NULL )
+    free(lpScheduler->lpPorts);
+  if( lpScheduler->lpStats != NULL )
+    free(lpScheduler->lpStats);
+  free(lpScheduler);
+}
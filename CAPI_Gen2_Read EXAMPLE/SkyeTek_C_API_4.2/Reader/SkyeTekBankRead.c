@@ -0,0 +1,161 @@
+/**
+ * SkyeTekBankRead.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Gen2 multi-bank reads. The ranges asked for are sorted and merged
+ * into as few reads as possible, and the reads run as one batch with
+ * the RF field held on until the last one.
+ */
+#include "../SkyeTekAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BANK_WORDS    0x1000    /* the word address is the low 12 bits */
+
+typedef struct BANK_SPAN
+{
+  unsigned int          bank;
+  unsigned int          start;
+  unsigned int          end;      /* one past the last word */
+  unsigned int          range;    /* index of the range asked for */
+} BANK_SPAN, *LPBANK_SPAN;
+
+static int
+Bank_Compare(
+    const void    *a,
+    const void    *b
+    )
+{
+  const BANK_SPAN *sa = (const BANK_SPAN *)a;
+  const BANK_SPAN *sb = (const BANK_SPAN *)b;
+
+  if( sa->bank != sb->bank )
+    return (sa->bank < sb->bank) ? -1 : 1;
+  if( sa->start != sb->start )
+    return (sa->start < sb->start) ? -1 : 1;
+  return 0;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_ReadTagBanks(
+    LPSKYETEK_READER        lpReader,
+    LPSKYETEK_TAG           lpTag,
+    LPSKYETEK_BANK_RANGE    lpRanges,
+    unsigned int            count,
+    LPSKYETEK_DATA          *lpData
+    )
+{
+  LPBANK_SPAN spans = NULL, reads = NULL;
+  LPSKYETEK_BATCH_OPERATION ops = NULL;
+  SKYETEK_STATUS *statuses = NULL;
+  unsigned int *readOf = NULL;
+  LPSKYETEK_DATA lpOut = NULL, lpRead;
+  SKYETEK_TAG held;
+  SKYETEK_STATUS status;
+  unsigned int ix, ir, num = 0, total = 0, skip;
+
+  if( lpReader == NULL || lpTag == NULL || lpRanges == NULL || count == 0 || lpData == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( lpRanges[ix].bank > GEN2_BANK_USER || lpRanges[ix].words == 0 ||
+        lpRanges[ix].start >= BANK_WORDS || lpRanges[ix].words > BANK_WORDS - lpRanges[ix].start )
+      return SKYETEK_INVALID_PARAMETER;
+  }
+
+  spans = (LPBANK_SPAN)malloc(count * sizeof(BANK_SPAN));
+  reads = (LPBANK_SPAN)malloc(count * sizeof(BANK_SPAN));
+  readOf = (unsigned int *)malloc(count * sizeof(unsigned int));
+  ops = (LPSKYETEK_BATCH_OPERATION)malloc(count * sizeof(SKYETEK_BATCH_OPERATION));
+  statuses = (SKYETEK_STATUS *)malloc(count * sizeof(SKYETEK_STATUS));
+  if( spans == NULL || reads == NULL || readOf == NULL || ops == NULL || statuses == NULL )
+  {
+    status = SKYETEK_OUT_OF_MEMORY;
+    goto cleanup;
+  }
+  memset(ops, 0, count * sizeof(SKYETEK_BATCH_OPERATION));
+
+  /* Merge the ranges of a bank that touch or overlap into one read */
+  for( ix = 0; ix < count; ix++ )
+  {
+    spans[ix].bank = lpRanges[ix].bank;
+    spans[ix].start = lpRanges[ix].start;
+    spans[ix].end = lpRanges[ix].start + lpRanges[ix].words;
+    spans[ix].range = ix;
+    lpRanges[ix].offset = total;
+    total += lpRanges[ix].words * 2;
+  }
+  qsort(spans, count, sizeof(BANK_SPAN), Bank_Compare);
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( num > 0 && reads[num-1].bank == spans[ix].bank && spans[ix].start <= reads[num-1].end )
+    {
+      if( spans[ix].end > reads[num-1].end )
+        reads[num-1].end = spans[ix].end;
+    }
+    else
+    {
+      memcpy(&reads[num++], &spans[ix], sizeof(BANK_SPAN));
+    }
+    readOf[spans[ix].range] = num - 1;
+  }
+
+  /* Every read but the last leaves the field on so the tag stays selected */
+  memcpy(&held, lpTag, sizeof(SKYETEK_TAG));
+  held.rf = 1;
+  for( ir = 0; ir < num; ir++ )
+  {
+    ops[ir].command = BATCH_READ_TAG_DATA;
+    ops[ir].lpTag = (ir + 1 < num) ? &held : lpTag;
+    ops[ir].address.start = (reads[ir].bank << 12) | reads[ir].start;
+    ops[ir].address.blocks = reads[ir].end - reads[ir].start;
+  }
+  status = SkyeTek_ExecuteBatch(lpReader, ops, num, statuses);
+  if( status != SKYETEK_SUCCESS )
+    goto cleanup;
+
+  lpOut = SkyeTek_AllocateData(total);
+  if( lpOut == NULL )
+  {
+    status = SKYETEK_OUT_OF_MEMORY;
+    goto cleanup;
+  }
+  memset(lpOut->data, 0, total);
+  for( ix = 0; ix < count; ix++ )
+  {
+    ir = readOf[ix];
+    lpRead = ops[ir].lpData;
+    lpRanges[ix].status = statuses[ir];
+    if( statuses[ir] != SKYETEK_SUCCESS )
+      continue;
+    skip = (lpRanges[ix].start - reads[ir].start) * 2;
+    if( lpRead == NULL || lpRead->size < skip + lpRanges[ix].words * 2 )
+    {
+      lpRanges[ix].status = SKYETEK_INVALID_MESSAGE_LENGTH;
+      continue;
+    }
+    memcpy(lpOut->data + lpRanges[ix].offset, lpRead->data + skip, lpRanges[ix].words * 2);
+  }
+  *lpData = lpOut;
+
+cleanup:
+  if( ops != NULL )
+  {
+    for( ir = 0; ir < num; ir++ )
+    {
+      if( ops[ir].lpData != NULL )
+        SkyeTek_FreeData(ops[ir].lpData);
+    }
+    free(ops);
+  }
+  if( statuses != NULL )
+    free(statuses);
+  if( readOf != NULL )
+    free(readOf);
+  if( reads != NULL )
+    free(reads);
+  if( spans != NULL )
+    free(spans);
+  return status;
+}
@@ -0,0 +1,133 @@
+/**
+ * SkyeTekBulk.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Commands on a whole inventoried population, such as disabling EAS
+ * on a basket at checkout. The tags of the set are addressed by ID in
+ * one batch and the results come back as a bitmap. The batch takes one
+ * allocation; the IDs are not copied out of the set.
+ */
+#include "../SkyeTekAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_ApplyToTagSet(
+    LPSKYETEK_READER            lpReader,
+    LPSKYETEK_TAG_SET           lpSet,
+    SKYETEK_BATCH_COMMAND       command,
+    LPSKYETEK_DATA              lpData,
+    unsigned char               *lpBitmap,
+    unsigned int                *lpSucceeded
+    )
+{
+  LPSKYETEK_BATCH_OPERATION ops;
+  LPSKYETEK_TAG tags;
+  LPSKYETEK_ID ids;
+  SKYETEK_STATUS *statuses;
+  SKYETEK_STATUS status;
+  unsigned int ix, count, succeeded = 0;
+
+  if( lpReader == NULL || lpSet == NULL || lpBitmap == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  if( command != BATCH_ENABLE_EAS && command != BATCH_DISABLE_EAS && command != BATCH_WRITE_AFI )
+    return SKYETEK_INVALID_PARAMETER;
+  if( command == BATCH_WRITE_AFI && (lpData == NULL || lpData->data == NULL || lpData->size == 0) )
+    return SKYETEK_INVALID_PARAMETER;
+  count = lpSet->count;
+  if( lpSucceeded != NULL )
+    *lpSucceeded = 0;
+  if( count == 0 )
+    return SKYETEK_SUCCESS;
+  memset(lpBitmap, 0, (count + 7) / 8);
+
+  /* One block for the batch; a tag header per record, whose ID points
+     into the record */
+  ops = (LPSKYETEK_BATCH_OPERATION)malloc(count * (sizeof(SKYETEK_BATCH_OPERATION) +
+    sizeof(SKYETEK_TAG) + sizeof(SKYETEK_ID) + sizeof(SKYETEK_STATUS)));
+  if( ops == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  tags = (LPSKYETEK_TAG)(ops + count);
+  ids = (LPSKYETEK_ID)(tags + count);
+  statuses = (SKYETEK_STATUS *)(ids + count);
+  memset(ops, 0, count * sizeof(SKYETEK_BATCH_OPERATION));
+  memset(tags, 0, count * sizeof(SKYETEK_TAG));
+
+  /* The field stays on so the population stays powered */
+  for( ix = 0; ix < count; ix++ )
+  {
+    ids[ix].id = lpSet->tags[ix].id;
+    ids[ix].length = lpSet->tags[ix].length;
+    tags[ix].type = lpSet->tags[ix].type;
+    tags[ix].id = &ids[ix];
+    tags[ix].rf = (ix + 1 < count) ? 1 : 0;
+    ops[ix].command = command;
+    ops[ix].lpTag = &tags[ix];
+    ops[ix].lpData = (command == BATCH_WRITE_AFI) ? lpData : NULL;
+  }
+  status = SkyeTek_ExecuteBatch(lpReader, ops, count, statuses);
+  if( status != SKYETEK_SUCCESS )
+    goto cleanup;
+
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( statuses[ix] == SKYETEK_SUCCESS )
+    {
+      lpBitmap[ix / 8] |= (unsigned char)(1 << (ix % 8));
+      succeeded++;
+    }
+  }
+  if( lpSucceeded != NULL )
+    *lpSucceeded = succeeded;
+
+cleanup:
+  free(ops);
+  return status;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_ApplyToTags(
+    LPSKYETEK_READER            lpReader,
+    SKYETEK_TAGTYPE             tagType,
+    LPSKYETEK_ID                lpTagIdMask,
+    SKYETEK_BATCH_COMMAND       command,
+    LPSKYETEK_DATA              lpData,
+    LPSKYETEK_TAG_SET           *lpSet,
+    LPSKYETEK_DATA              *lpBitmap,
+    unsigned int                *lpSucceeded
+    )
+{
+  LPSKYETEK_TAG_SET lpTags = NULL;
+  LPSKYETEK_DATA lpBits;
+  SKYETEK_STATUS status;
+
+  if( lpReader == NULL || lpSet == NULL || lpBitmap == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  *lpSet = NULL;
+  *lpBitmap = NULL;
+
+  status = SkyeTek_GetTagSet(lpReader, tagType, lpTagIdMask, &lpTags);
+  if( status != SKYETEK_SUCCESS )
+    return status;
+
+  /* One byte even for an empty set */
+  lpBits = SkyeTek_AllocateData((lpTags->count + 7) / 8 + (lpTags->count == 0));
+  if( lpBits == NULL || lpBits->data == NULL )
+  {
+    SkyeTek_FreeData(lpBits);
+    SkyeTek_FreeTagSet(lpTags);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  memset(lpBits->data, 0, lpBits->size);
+  status = SkyeTek_ApplyToTagSet(lpReader, lpTags, command, lpData, lpBits->data, lpSucceeded);
+  if( status != SKYETEK_SUCCESS )
+  {
+    SkyeTek_FreeData(lpBits);
+    SkyeTek_FreeTagSet(lpTags);
+    return status;
+  }
+  *lpSet = lpTags;
+  *lpBitmap = lpBits;
+  return SKYETEK_SUCCESS;
+}
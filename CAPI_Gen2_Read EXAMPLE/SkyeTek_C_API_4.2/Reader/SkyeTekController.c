@@ -0,0 +1,355 @@
+/**
+ * SkyeTekController.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Adaptive inventory. The controller hill-climbs the reader settings
+ * one step at a time: it measures the yield of the best settings, tries
+ * a neighbour, and keeps the neighbour only if it does better. The best
+ * settings are measured again after every miss so the controller
+ * follows a scene that changes.
+ */
+#include "../SkyeTekAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONTROLLER_SETTINGS   3
+#define CONTROLLER_PROBES     (CONTROLLER_SETTINGS * 2)
+#define CONTROLLER_MARGIN     50    /* a probe must beat the best by 1/50th */
+#define CONTROLLER_SEEN       60000 /* ms a tag counts as seen after its last read */
+
+static const SKYETEK_SYSTEM_PARAMETER controllerParameters[CONTROLLER_SETTINGS] =
+{
+  SYS_TAG_POPULATION, SYS_COMMAND_RETRY, SYS_POWER_LEVEL
+};
+
+typedef struct CONTROLLER_STATE
+{
+  SKYETEK_TUNING_RANGE  ranges[CONTROLLER_SETTINGS];
+  SKYETEK_TUNING        trial;        /* settings for the next cycle */
+  SKYETEK_TUNING        applied;      /* settings on the reader */
+  unsigned char         known[CONTROLLER_SETTINGS];
+  int                   probe;        /* last probe tried */
+  int                   probing;      /* trial is a probe rather than the best settings */
+  int                   measured;     /* bestYield has been measured */
+  LPSKYETEK_AGGREGATOR  lpSeen;       /* tags read within CONTROLLER_SEEN */
+} CONTROLLER_STATE, *LPCONTROLLER_STATE;
+
+static unsigned char *
+Controller_Setting(
+    LPSKYETEK_TUNING    lpTuning,
+    unsigned int        ix
+    )
+{
+  switch( ix )
+  {
+    case 0: return &lpTuning->tagPopulation;
+    case 1: return &lpTuning->commandRetry;
+    default: return &lpTuning->powerLevel;
+  }
+}
+
+/**
+ * Moves a setting one step. Probes alternate up and down for each
+ * setting. Returns 0 if the setting is not tuned or already at the end
+ * of its range.
+ */
+static int
+Controller_Move(
+    LPCONTROLLER_STATE  state,
+    LPSKYETEK_TUNING    lpTuning,
+    int                 probe
+    )
+{
+  LPSKYETEK_TUNING_RANGE lpRange = &state->ranges[probe / 2];
+  unsigned char *val = Controller_Setting(lpTuning, probe / 2);
+  unsigned int next;
+
+  if( lpRange->step == 0 )
+    return 0;
+  if( probe % 2 == 0 )
+  {
+    next = *val + lpRange->step;
+    if( next > lpRange->max )
+      next = lpRange->max;
+  }
+  else
+  {
+    next = (*val > lpRange->min + lpRange->step) ? *val - lpRange->step : lpRange->min;
+  }
+  if( next == *val )
+    return 0;
+  *val = (unsigned char)next;
+  return 1;
+}
+
+/* Sets up the next probe after the given one, or the best settings if there is none */
+static void
+Controller_NextProbe(
+    LPSKYETEK_CONTROLLER  lpController,
+    LPCONTROLLER_STATE    state,
+    int                   after
+    )
+{
+  int ix, probe;
+
+  for( ix = 1; ix <= CONTROLLER_PROBES; ix++ )
+  {
+    probe = (after + ix) % CONTROLLER_PROBES;
+    memcpy(&state->trial, &lpController->best, sizeof(SKYETEK_TUNING));
+    if( Controller_Move(state, &state->trial, probe) )
+    {
+      state->probe = probe;
+      state->probing = 1;
+      return;
+    }
+  }
+  memcpy(&state->trial, &lpController->best, sizeof(SKYETEK_TUNING));
+  state->probing = 0;
+}
+
+static SKYETEK_STATUS
+Controller_Apply(
+    LPSKYETEK_CONTROLLER  lpController,
+    LPCONTROLLER_STATE    state
+    )
+{
+  LPSKYETEK_DATA lpData;
+  SKYETEK_STATUS status;
+  unsigned char val;
+  unsigned int ix;
+
+  for( ix = 0; ix < CONTROLLER_SETTINGS; ix++ )
+  {
+    if( state->ranges[ix].step == 0 )
+      continue;
+    val = *Controller_Setting(&state->trial, ix);
+    if( state->known[ix] && *Controller_Setting(&state->applied, ix) == val )
+      continue;
+    lpData = SkyeTek_AllocateData(1);
+    if( lpData == NULL )
+      return SKYETEK_OUT_OF_MEMORY;
+    lpData->data[0] = val;
+    status = SkyeTek_SetSystemParameter(lpController->lpReader, controllerParameters[ix], lpData);
+    SkyeTek_FreeData(lpData);
+    if( status != SKYETEK_SUCCESS )
+    {
+      state->known[ix] = 0;
+      return status;
+    }
+    *Controller_Setting(&state->applied, ix) = val;
+    state->known[ix] = 1;
+  }
+  return SKYETEK_SUCCESS;
+}
+
+static unsigned int
+Controller_CountNew(
+    LPSKYETEK_CONTROLLER  lpController,
+    LPCONTROLLER_STATE    state,
+    LPSKYETEK_TAG_SET     lpSet
+    )
+{
+  SKYETEK_TAG_VIEW view;
+  unsigned int ix, before;
+
+  /* Tags gone for a window depart first, so the table stays bounded */
+  view.timestamp = SKYETEK_GetTickCount();
+  SkyeTek_AdvanceAggregator(state->lpSeen, view.timestamp);
+  before = state->lpSeen->count;
+  for( ix = 0; ix < lpSet->count; ix++ )
+  {
+    view.type = lpSet->tags[ix].type;
+    view.id = lpSet->tags[ix].id;
+    view.length = lpSet->tags[ix].length;
+    if( view.length > 0 )
+      SkyeTek_AggregateTag(state->lpSeen, lpController->lpReader, &view, 0, SKYETEK_NO_RSSI);
+  }
+  return (state->lpSeen->count > before) ? state->lpSeen->count - before : 0;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_CreateController(
+    LPSKYETEK_READER            lpReader,
+    SKYETEK_TAGTYPE             tagType,
+    LPSKYETEK_TUNING_RANGE      lpPopulation,
+    LPSKYETEK_TUNING_RANGE      lpRetry,
+    LPSKYETEK_TUNING_RANGE      lpPower,
+    LPSKYETEK_CONTROLLER        *lpController
+    )
+{
+  LPSKYETEK_TUNING_RANGE ranges[CONTROLLER_SETTINGS];
+  LPSKYETEK_CONTROLLER lpCtl;
+  LPCONTROLLER_STATE state;
+  LPSKYETEK_DATA lpData;
+  SKYETEK_STATUS status;
+  unsigned char *val;
+  unsigned int ix;
+
+  if( lpReader == NULL || lpReader->internal == NULL || lpController == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  ranges[0] = lpPopulation;
+  ranges[1] = lpRetry;
+  ranges[2] = lpPower;
+  for( ix = 0; ix < CONTROLLER_SETTINGS; ix++ )
+  {
+    if( ranges[ix] != NULL && ranges[ix]->min > ranges[ix]->max )
+      return SKYETEK_INVALID_PARAMETER;
+  }
+
+  lpCtl = (LPSKYETEK_CONTROLLER)malloc(sizeof(SKYETEK_CONTROLLER));
+  if( lpCtl == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  state = (LPCONTROLLER_STATE)malloc(sizeof(CONTROLLER_STATE));
+  if( state == NULL )
+  {
+    free(lpCtl);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  memset(lpCtl, 0, sizeof(SKYETEK_CONTROLLER));
+  memset(state, 0, sizeof(CONTROLLER_STATE));
+  status = SkyeTek_CreateAggregator(WINDOW_PRESENCE, CONTROLLER_SEEN, NULL, NULL, &state->lpSeen);
+  if( status != SKYETEK_SUCCESS )
+  {
+    free(state);
+    free(lpCtl);
+    return status;
+  }
+  lpCtl->lpReader = lpReader;
+  lpCtl->tagType = tagType;
+  lpCtl->internal = state;
+
+  /* Start from what the reader has now, within the ranges */
+  for( ix = 0; ix < CONTROLLER_SETTINGS; ix++ )
+  {
+    if( ranges[ix] == NULL )
+      continue;
+    memcpy(&state->ranges[ix], ranges[ix], sizeof(SKYETEK_TUNING_RANGE));
+    if( state->ranges[ix].step == 0 )
+      continue;
+    val = Controller_Setting(&lpCtl->best, ix);
+    *val = state->ranges[ix].min;
+    lpData = NULL;
+    if( SkyeTek_GetSystemParameter(lpReader, controllerParameters[ix], &lpData) == SKYETEK_SUCCESS &&
+        lpData != NULL && lpData->data != NULL && lpData->size > 0 )
+    {
+      *Controller_Setting(&state->applied, ix) = lpData->data[0];
+      state->known[ix] = 1;
+      *val = lpData->data[0];
+      if( *val < state->ranges[ix].min )
+        *val = state->ranges[ix].min;
+      if( *val > state->ranges[ix].max )
+        *val = state->ranges[ix].max;
+    }
+    if( lpData != NULL )
+      SkyeTek_FreeData(lpData);
+  }
+  memcpy(&state->trial, &lpCtl->best, sizeof(SKYETEK_TUNING));
+  state->probe = CONTROLLER_PROBES - 1;
+
+  *lpController = lpCtl;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_RunControllerCycle(
+    LPSKYETEK_CONTROLLER        lpController,
+    LPSKYETEK_CONTROLLER_CYCLE  lpCycle,
+    LPSKYETEK_TAG_SET           *lpSet
+    )
+{
+  LPCONTROLLER_STATE state;
+  LPSKYETEK_TAG_SET lpTags = NULL;
+  SKYETEK_CONTROLLER_CYCLE cycle;
+  unsigned long start;
+
+  if( lpController == NULL || lpController->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  state = (LPCONTROLLER_STATE)lpController->internal;
+  if( lpSet != NULL )
+    *lpSet = NULL;
+
+  memset(&cycle, 0, sizeof(SKYETEK_CONTROLLER_CYCLE));
+  cycle.status = Controller_Apply(lpController, state);
+  if( cycle.status != SKYETEK_SUCCESS )
+  {
+    /* Fall back to the best settings on the next cycle */
+    memcpy(&state->trial, &lpController->best, sizeof(SKYETEK_TUNING));
+    state->probing = 0;
+    if( lpCycle != NULL )
+      memcpy(lpCycle, &cycle, sizeof(SKYETEK_CONTROLLER_CYCLE));
+    return cycle.status;
+  }
+  memcpy(&cycle.tuning, &state->trial, sizeof(SKYETEK_TUNING));
+
+  start = SKYETEK_GetTickCount();
+  cycle.status = SkyeTek_GetTagSet(lpController->lpReader, lpController->tagType, NULL, &lpTags);
+  cycle.duration = SKYETEK_GetTickCount() - start;
+  if( cycle.duration == 0 )
+    cycle.duration = 1;
+  if( cycle.status == SKYETEK_SUCCESS )
+  {
+    cycle.tags = lpTags->count;
+    cycle.newTags = Controller_CountNew(lpController, state, lpTags);
+    cycle.yield = (unsigned long)((double)cycle.tags * 1000000.0 / cycle.duration);
+  }
+  else if( cycle.status == SKYETEK_TIMEOUT )
+  {
+    lpController->timeouts++;
+  }
+  lpController->cycles++;
+
+  if( !state->probing )
+  {
+    /* The best settings again; average out the noise */
+    if( state->measured )
+      lpController->bestYield = (lpController->bestYield + cycle.yield) / 2;
+    else
+      lpController->bestYield = cycle.yield;
+    state->measured = 1;
+    Controller_NextProbe(lpController, state, state->probe);
+  }
+  else if( cycle.yield > lpController->bestYield + lpController->bestYield / CONTROLLER_MARGIN )
+  {
+    /* Better; keep going the same way */
+    memcpy(&lpController->best, &state->trial, sizeof(SKYETEK_TUNING));
+    lpController->bestYield = cycle.yield;
+    if( !Controller_Move(state, &state->trial, state->probe) )
+      Controller_NextProbe(lpController, state, state->probe);
+  }
+  else
+  {
+    /* No better; measure the best again, then try the next neighbour */
+    memcpy(&state->trial, &lpController->best, sizeof(SKYETEK_TUNING));
+    state->probing = 0;
+  }
+
+  if( lpCycle != NULL )
+    memcpy(lpCycle, &cycle, sizeof(SKYETEK_CONTROLLER_CYCLE));
+  if( lpTags != NULL )
+  {
+    if( lpSet != NULL )
+      *lpSet = lpTags;
+    else
+      SkyeTek_FreeTagSet(lpTags);
+  }
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API void
+SkyeTek_FreeController(
+    LPSKYETEK_CONTROLLER        lpController
+    )
+{
+  LPCONTROLLER_STATE state;
+
+  if( lpController == NULL )
+    return;
+  state = (LPCONTROLLER_STATE)lpController->internal;
+  if( state != NULL )
+  {
+    SkyeTek_FreeAggregator(state->lpSeen);
+    free(state);
+  }
+  free(lpController);
+}
@@ -0,0 +1,255 @@
+/**
+ * SkyeTekCryptoSession.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Crypto sessions for secured reads and writes. The key is stored and
+ * loaded only when the reader's key slot cache says it has to be, and
+ * a tag is authenticated once with the RF field held on after. The
+ * reader holds authentication for one tag only, since addressing
+ * another selects it, so only the last tag authenticated is kept. An
+ * operation that fails on it is sent again once after authenticating
+ * it again.
+ */
+#include "../SkyeTekAPI.h"
+#include "Reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct SESSION_TAG
+{
+  unsigned char         used;
+  SKYETEK_TAGTYPE       type;
+  unsigned int          length;
+  unsigned char         id[SKYETEK_MAX_TAG_LENGTH];
+} SESSION_TAG, *LPSESSION_TAG;
+
+typedef struct SESSION_STATE
+{
+  SKYETEK_KEY           key;        /* authenticates by slot; lpData is NULL */
+  SESSION_TAG           tag;        /* the tag the reader holds authenticated */
+} SESSION_STATE, *LPSESSION_STATE;
+
+static LPSESSION_TAG
+Session_Find(
+    LPSESSION_STATE   state,
+    LPSKYETEK_TAG     lpTag
+    )
+{
+  if( lpTag->id == NULL || lpTag->id->id == NULL || lpTag->id->length == 0 ||
+      lpTag->id->length > SKYETEK_MAX_TAG_LENGTH )
+    return NULL;
+  if( state->tag.used && state->tag.type == lpTag->type &&
+      state->tag.length == lpTag->id->length &&
+      memcmp(state->tag.id, lpTag->id->id, lpTag->id->length) == 0 )
+    return &state->tag;
+  return NULL;
+}
+
+static void
+Session_Remember(
+    LPSESSION_STATE   state,
+    LPSKYETEK_TAG     lpTag
+    )
+{
+  /* Tags without an ID are authenticated before every operation */
+  if( lpTag->id == NULL || lpTag->id->id == NULL || lpTag->id->length == 0 ||
+      lpTag->id->length > SKYETEK_MAX_TAG_LENGTH )
+    return;
+  state->tag.used = 1;
+  state->tag.type = lpTag->type;
+  state->tag.length = lpTag->id->length;
+  memcpy(state->tag.id, lpTag->id->id, lpTag->id->length);
+}
+
+/* Loads the key unless the reader has it loaded already */
+static SKYETEK_STATUS
+Session_LoadKey(
+    LPSKYETEK_CRYPTO_SESSION  lpSession
+    )
+{
+  LPSESSION_STATE state = (LPSESSION_STATE)lpSession->internal;
+
+  if( SkyeTekReader_IsKeyLoaded(lpSession->lpReader, state->key.number) )
+    return SKYETEK_SUCCESS;
+  lpSession->keyLoads++;
+  return SkyeTek_LoadKey(lpSession->lpReader, &state->key);
+}
+
+static SKYETEK_STATUS
+Session_Authenticate(
+    LPSKYETEK_CRYPTO_SESSION  lpSession,
+    LPSKYETEK_TAG             lpHeld
+    )
+{
+  LPSESSION_STATE state = (LPSESSION_STATE)lpSession->internal;
+  SKYETEK_STATUS status;
+  unsigned int loads = lpSession->keyLoads;
+
+  /* Whichever tag was authenticated loses it once another is addressed */
+  memset(&state->tag, 0, sizeof(SESSION_TAG));
+  status = Session_LoadKey(lpSession);
+  if( status != SKYETEK_SUCCESS )
+    return status;
+  lpSession->authentications++;
+  status = SkyeTek_AuthenticateTag(lpSession->lpReader, lpHeld, &state->key);
+
+  /* The reader may have dropped a key the cache thought it had loaded */
+  if( status != SKYETEK_SUCCESS && loads == lpSession->keyLoads )
+  {
+    SkyeTekReader_KeyLoaded(lpSession->lpReader, -1);
+    status = Session_LoadKey(lpSession);
+    if( status != SKYETEK_SUCCESS )
+      return status;
+    lpSession->authentications++;
+    status = SkyeTek_AuthenticateTag(lpSession->lpReader, lpHeld, &state->key);
+  }
+  if( status == SKYETEK_SUCCESS )
+    Session_Remember(state, lpHeld);
+  return status;
+}
+
+static SKYETEK_STATUS
+Session_Run(
+    LPSKYETEK_CRYPTO_SESSION  lpSession,
+    LPSKYETEK_TAG             lpTag,
+    LPSKYETEK_ADDRESS         lpAddr,
+    LPSKYETEK_DATA            *lpRead,
+    LPSKYETEK_DATA            lpWrite
+    )
+{
+  LPSESSION_STATE state = (LPSESSION_STATE)lpSession->internal;
+  SKYETEK_TAG held;
+  SKYETEK_STATUS status;
+  int fresh = 0;
+
+  /* The field stays on so the tag stays authenticated */
+  memcpy(&held, lpTag, sizeof(SKYETEK_TAG));
+  held.rf = 1;
+
+  if( Session_Find(state, &held) == NULL )
+  {
+    status = Session_Authenticate(lpSession, &held);
+    if( status != SKYETEK_SUCCESS )
+      return status;
+    fresh = 1;
+  }
+
+  for( ;; )
+  {
+    if( lpRead != NULL )
+      status = SkyeTek_ReadTagData(lpSession->lpReader, &held, lpAddr,
+        lpSession->encrypt, lpSession->hmac, lpRead);
+    else
+      status = SkyeTek_WriteTagData(lpSession->lpReader, &held, lpAddr,
+        lpSession->encrypt, lpSession->hmac, lpWrite);
+    if( status == SKYETEK_SUCCESS || status == SKYETEK_INVALID_PARAMETER || fresh )
+      return status;
+
+    /* The tag may have lost its authentication; try once more */
+    status = Session_Authenticate(lpSession, &held);
+    if( status != SKYETEK_SUCCESS )
+      return status;
+    lpSession->retries++;
+    fresh = 1;
+  }
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_CreateCryptoSession(
+    LPSKYETEK_READER          lpReader,
+    SKYETEK_TAGTYPE           type,
+    LPSKYETEK_KEY             lpKey,
+    unsigned char             encrypt,
+    unsigned char             hmac,
+    LPSKYETEK_CRYPTO_SESSION  *lpSession
+    )
+{
+  LPSKYETEK_CRYPTO_SESSION lpNew;
+  LPSESSION_STATE state;
+  SKYETEK_STATUS status;
+
+  if( lpReader == NULL || lpKey == NULL || lpSession == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  *lpSession = NULL;
+
+  lpNew = (LPSKYETEK_CRYPTO_SESSION)malloc(sizeof(SKYETEK_CRYPTO_SESSION) + sizeof(SESSION_STATE));
+  if( lpNew == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  memset(lpNew, 0, sizeof(SKYETEK_CRYPTO_SESSION) + sizeof(SESSION_STATE));
+  state = (LPSESSION_STATE)(lpNew + 1);
+  lpNew->lpReader = lpReader;
+  lpNew->encrypt = encrypt;
+  lpNew->hmac = hmac;
+  lpNew->internal = state;
+  memcpy(&state->key, lpKey, sizeof(SKYETEK_KEY));
+  state->key.lpData = NULL;
+
+  /* A key given by value goes in its slot once */
+  if( lpKey->lpData != NULL && lpKey->lpData->data != NULL && lpKey->lpData->size > 0 &&
+      !SkyeTekReader_IsKeyStored(lpReader, type, lpKey->number, lpKey->lpData) )
+  {
+    lpNew->keyStores++;
+    status = SkyeTek_StoreKey(lpReader, type, lpKey);
+    if( status != SKYETEK_SUCCESS )
+    {
+      free(lpNew);
+      return status;
+    }
+  }
+  *lpSession = lpNew;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_CryptoSessionRead(
+    LPSKYETEK_CRYPTO_SESSION  lpSession,
+    LPSKYETEK_TAG             lpTag,
+    LPSKYETEK_ADDRESS         lpAddr,
+    LPSKYETEK_DATA            *lpData
+    )
+{
+  if( lpSession == NULL || lpSession->internal == NULL || lpTag == NULL ||
+      lpAddr == NULL || lpData == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  return Session_Run(lpSession, lpTag, lpAddr, lpData, NULL);
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_CryptoSessionWrite(
+    LPSKYETEK_CRYPTO_SESSION  lpSession,
+    LPSKYETEK_TAG             lpTag,
+    LPSKYETEK_ADDRESS         lpAddr,
+    LPSKYETEK_DATA            lpData
+    )
+{
+  if( lpSession == NULL || lpSession->internal == NULL || lpTag == NULL ||
+      lpAddr == NULL || lpData == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  return Session_Run(lpSession, lpTag, lpAddr, NULL, lpData);
+}
+
+SKYETEK_API void
+SkyeTek_CryptoSessionForgetTag(
+    LPSKYETEK_CRYPTO_SESSION  lpSession,
+    LPSKYETEK_TAG             lpTag
+    )
+{
+  LPSESSION_STATE state;
+
+  if( lpSession == NULL || lpSession->internal == NULL )
+    return;
+  state = (LPSESSION_STATE)lpSession->internal;
+  if( lpTag == NULL || Session_Find(state, lpTag) != NULL )
+    memset(&state->tag, 0, sizeof(SESSION_TAG));
+}
+
+SKYETEK_API void
+SkyeTek_FreeCryptoSession(
+    LPSKYETEK_CRYPTO_SESSION  lpSession
+    )
+{
+  /* The state is in the same block */
+  if( lpSession != NULL )
+    free(lpSession);
+}
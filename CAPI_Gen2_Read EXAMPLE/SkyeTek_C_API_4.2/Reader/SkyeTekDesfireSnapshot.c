@@ -0,0 +1,569 @@
+/**
+ * SkyeTekDesfireSnapshot.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * DESFire card directory snapshots. The applications are selected and
+ * their files listed in one batch, then every file's settings are read
+ * in a second. The snapshot is one allocation, and its serialized form
+ * is compared an application at a time.
+ */
+#include "../SkyeTekAPI.h"
+#include "../Protocol/asn1.h"
+#include "Reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_APP_SIZE   6     /* aid, status, file count */
+#define SNAPSHOT_FILE_SIZE  38    /* id, status, type, comm, access, values */
+
+/* One request per application; an encoded OCTET STRING or INTEGER */
+typedef struct SNAPSHOT_REQUEST
+{
+  SKYETEK_DATA      data;
+  unsigned char     buffer[8];
+} SNAPSHOT_REQUEST, *LPSNAPSHOT_REQUEST;
+
+static void
+Snapshot_EncodeAid(
+    LPSNAPSHOT_REQUEST    lpReq,
+    unsigned char         *aid
+    )
+{
+  st_asn1_context context;
+  st_asn1_context_storage storage;
+
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_ENCODE, lpReq->buffer, sizeof(lpReq->buffer));
+  st_asn1_write_octet_string(context, aid, 3);
+  lpReq->data.data = lpReq->buffer;
+  lpReq->data.size = st_asn1_finalize(context);
+  st_asn1_free_context(&context);
+}
+
+static void
+Snapshot_EncodeFile(
+    LPSNAPSHOT_REQUEST    lpReq,
+    unsigned char         id
+    )
+{
+  st_asn1_context context;
+  st_asn1_context_storage storage;
+  int64 w = id;
+
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_ENCODE, lpReq->buffer, sizeof(lpReq->buffer));
+  st_asn1_write_integer(context, w);
+  lpReq->data.data = lpReq->buffer;
+  lpReq->data.size = st_asn1_finalize(context);
+  st_asn1_free_context(&context);
+}
+
+/* Counts the file IDs of a GetFileIDs response, copying them if ids is not NULL */
+static unsigned int
+Snapshot_FileIDs(
+    LPSKYETEK_DATA    lpData,
+    unsigned char     *ids
+    )
+{
+  st_asn1_context context;
+  st_asn1_context_storage storage;
+  unsigned int num = 0;
+  int64 w;
+
+  if( lpData == NULL || lpData->data == NULL || lpData->size == 0 )
+    return 0;
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_DECODE, lpData->data, lpData->size);
+  st_asn1_start_sequence(context);
+  while( st_asn1_peek(context) == ST_INTEGER )
+  {
+    if( !st_asn1_read_integer(context, &w) )
+      break;
+    if( ids != NULL )
+      ids[num] = (unsigned char)w;
+    num++;
+  }
+  st_asn1_free_context(&context);
+  return num;
+}
+
+/* Decodes a GetFileSettings response */
+static SKYETEK_STATUS
+Snapshot_FileSettings(
+    LPSKYETEK_DATA            lpData,
+    LPSKYETEK_DESFIRE_FILE    lpFile
+    )
+{
+  st_asn1_context context;
+  st_asn1_context_storage storage;
+  SKYETEK_STATUS status = SKYETEK_SUCCESS;
+  int64 w;
+  int typ, b;
+
+  if( lpData == NULL || lpData->data == NULL || lpData->size == 0 )
+    return SKYETEK_READER_PROTOCOL_ERROR;
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_DECODE, lpData->data, lpData->size);
+  st_asn1_start_sequence(context);
+  st_asn1_read_enumerated(context, &w);
+  lpFile->settings.type = (SKYETEK_FILE_TYPE)w;
+  st_asn1_read_enumerated(context, &w);
+  lpFile->settings.comm = (SKYETEK_COMM_SETTINGS)w;
+  st_asn1_start_sequence(context);
+  st_asn1_read_enumerated(context, &w);
+  lpFile->settings.readAccess = (SKYETEK_ACCESS)w;
+  st_asn1_read_enumerated(context, &w);
+  lpFile->settings.writeAccess = (SKYETEK_ACCESS)w;
+  st_asn1_read_enumerated(context, &w);
+  lpFile->settings.readWriteAccess = (SKYETEK_ACCESS)w;
+  st_asn1_read_enumerated(context, &w);
+  lpFile->settings.changeAccess = (SKYETEK_ACCESS)w;
+  st_asn1_finish_sequence(context);
+
+  /*
+  //     dataFile [1], valueFile [2] or recordFile [3]
+  */
+  typ = -st_asn1_peek(context);
+  if( typ < 1 || typ > 3 )
+  {
+    status = SKYETEK_INVALID_FILE_TYPE;
+    goto done;
+  }
+  st_asn1_start_context_specific(context, typ);
+  st_asn1_start_sequence(context);
+  st_asn1_read_integer(context, &w);
+  if( typ == 1 )
+  {
+    lpFile->fileSize = (unsigned int)w;
+  }
+  else if( typ == 2 )
+  {
+    lpFile->lowerLimit = (unsigned int)w;
+    st_asn1_read_integer(context, &w);
+    lpFile->upperLimit = (unsigned int)w;
+    st_asn1_read_integer(context, &w);
+    lpFile->limitedCreditValue = (unsigned int)w;
+    b = 0;
+    st_asn1_read_boolean(context, &b);
+    lpFile->limitedCreditEnabled = (unsigned char)b;
+  }
+  else
+  {
+    lpFile->recordSize = (unsigned int)w;
+    st_asn1_read_integer(context, &w);
+    lpFile->maxRecords = (unsigned int)w;
+    st_asn1_read_integer(context, &w);
+    lpFile->numRecords = (unsigned int)w;
+  }
+  if( st_asn1_finalize(context) < 0 )
+    status = SKYETEK_READER_PROTOCOL_ERROR;
+
+done:
+  st_asn1_free_context(&context);
+  return status;
+}
+
+static void
+Snapshot_FreeOps(
+    LPSKYETEK_BATCH_OPERATION   ops,
+    unsigned int                count
+    )
+{
+  unsigned int ix;
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( ops[ix].command != BATCH_SELECT_APPLICATION && ops[ix].lpData != NULL )
+      SkyeTek_FreeData(ops[ix].lpData);
+  }
+  free(ops);
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_GetDesfireSnapshot(
+    LPSKYETEK_READER              lpReader,
+    LPSKYETEK_TAG                 lpTag,
+    LPSKYETEK_DESFIRE_SNAPSHOT    *lpSnapshot
+    )
+{
+  LPSKYETEK_ID *ids = NULL;
+  LPSKYETEK_BATCH_OPERATION ops = NULL;
+  SKYETEK_STATUS *statuses = NULL;
+  LPSNAPSHOT_REQUEST reqs = NULL, fileReqs = NULL;
+  LPSKYETEK_DESFIRE_SNAPSHOT lpSnap = NULL;
+  LPSKYETEK_DESFIRE_APP lpApp;
+  LPSKYETEK_DESFIRE_FILE lpFile;
+  unsigned char *fileIds = NULL;
+  unsigned int count = 0, ix, iy, num, files = 0, nops = 0, nfile;
+  SKYETEK_TAG held;
+  SKYETEK_STATUS status;
+  int holding = 0;
+
+  if( lpReader == NULL || lpTag == NULL || lpSnapshot == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  *lpSnapshot = NULL;
+
+  status = SkyeTek_GetApplicationIDs(lpReader, lpTag, &ids, &count);
+  if( status != SKYETEK_SUCCESS )
+    return status;
+
+  /* The field stays on between the batches */
+  memcpy(&held, lpTag, sizeof(SKYETEK_TAG));
+  held.rf = 1;
+
+  /* Select each application and list its files */
+  if( count > 0 )
+  {
+    ops = (LPSKYETEK_BATCH_OPERATION)malloc(2 * count * sizeof(SKYETEK_BATCH_OPERATION));
+    statuses = (SKYETEK_STATUS *)malloc(2 * count * sizeof(SKYETEK_STATUS));
+    reqs = (LPSNAPSHOT_REQUEST)malloc(count * sizeof(SNAPSHOT_REQUEST));
+    if( ops == NULL || statuses == NULL || reqs == NULL )
+    {
+      status = SKYETEK_OUT_OF_MEMORY;
+      goto cleanup;
+    }
+    memset(ops, 0, 2 * count * sizeof(SKYETEK_BATCH_OPERATION));
+    for( ix = 0; ix < count; ix++ )
+    {
+      if( ids[ix]->length != 3 )
+      {
+        status = SKYETEK_READER_PROTOCOL_ERROR;
+        goto cleanup;
+      }
+      Snapshot_EncodeAid(&reqs[ix], ids[ix]->id);
+      ops[2*ix].command = BATCH_SELECT_APPLICATION;
+      ops[2*ix].lpTag = &held;
+      ops[2*ix].lpData = &reqs[ix].data;
+      ops[2*ix+1].command = BATCH_GET_FILE_IDS;
+      ops[2*ix+1].lpTag = &held;
+    }
+    nops = 2 * count;
+    holding = 1;
+    status = SkyeTek_ExecuteBatch(lpReader, ops, nops, statuses);
+    if( status != SKYETEK_SUCCESS )
+      goto cleanup;
+    for( ix = 0; ix < count; ix++ )
+    {
+      if( statuses[2*ix] == SKYETEK_SUCCESS && statuses[2*ix+1] == SKYETEK_SUCCESS )
+        files += Snapshot_FileIDs(ops[2*ix+1].lpData, NULL);
+    }
+  }
+
+  /* One allocation for the whole tree */
+  lpSnap = (LPSKYETEK_DESFIRE_SNAPSHOT)malloc(sizeof(SKYETEK_DESFIRE_SNAPSHOT) +
+    count * sizeof(SKYETEK_DESFIRE_APP) + files * sizeof(SKYETEK_DESFIRE_FILE));
+  if( lpSnap == NULL )
+  {
+    status = SKYETEK_OUT_OF_MEMORY;
+    goto cleanup;
+  }
+  memset(lpSnap, 0, sizeof(SKYETEK_DESFIRE_SNAPSHOT) +
+    count * sizeof(SKYETEK_DESFIRE_APP) + files * sizeof(SKYETEK_DESFIRE_FILE));
+  lpSnap->appCount = count;
+  lpSnap->lpApps = (LPSKYETEK_DESFIRE_APP)(lpSnap + 1);
+  lpFile = (LPSKYETEK_DESFIRE_FILE)(lpSnap->lpApps + count);
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpApp = &lpSnap->lpApps[ix];
+    memcpy(lpApp->aid, ids[ix]->id, 3);
+    lpApp->status = (statuses[2*ix] != SKYETEK_SUCCESS) ? statuses[2*ix] : statuses[2*ix+1];
+    lpApp->lpFiles = lpFile;
+    if( lpApp->status == SKYETEK_SUCCESS )
+      lpApp->fileCount = Snapshot_FileIDs(ops[2*ix+1].lpData, NULL);
+    lpFile += lpApp->fileCount;
+  }
+  if( files == 0 )
+  {
+    status = SKYETEK_SUCCESS;
+    goto cleanup;
+  }
+
+  /* Select each application again and get the settings of its files */
+  fileIds = (unsigned char *)malloc(files);
+  fileReqs = (LPSNAPSHOT_REQUEST)malloc(files * sizeof(SNAPSHOT_REQUEST));
+  if( fileIds == NULL || fileReqs == NULL )
+  {
+    status = SKYETEK_OUT_OF_MEMORY;
+    goto cleanup;
+  }
+  nfile = 0;
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpApp = &lpSnap->lpApps[ix];
+    if( lpApp->fileCount == 0 )
+      continue;
+    Snapshot_FileIDs(ops[2*ix+1].lpData, fileIds + nfile);
+    for( iy = 0; iy < lpApp->fileCount; iy++ )
+    {
+      lpApp->lpFiles[iy].id = fileIds[nfile + iy];
+      Snapshot_EncodeFile(&fileReqs[nfile + iy], fileIds[nfile + iy]);
+    }
+    nfile += lpApp->fileCount;
+  }
+
+  Snapshot_FreeOps(ops, nops);
+  free(statuses);
+  num = count + files;
+  ops = (LPSKYETEK_BATCH_OPERATION)malloc(num * sizeof(SKYETEK_BATCH_OPERATION));
+  statuses = (SKYETEK_STATUS *)malloc(num * sizeof(SKYETEK_STATUS));
+  nops = 0;
+  if( ops == NULL || statuses == NULL )
+  {
+    status = SKYETEK_OUT_OF_MEMORY;
+    goto cleanup;
+  }
+  memset(ops, 0, num * sizeof(SKYETEK_BATCH_OPERATION));
+  nfile = 0;
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpApp = &lpSnap->lpApps[ix];
+    if( lpApp->fileCount == 0 )
+      continue;
+    ops[nops].command = BATCH_SELECT_APPLICATION;
+    ops[nops].lpTag = &held;
+    ops[nops].lpData = &reqs[ix].data;
+    nops++;
+    for( iy = 0; iy < lpApp->fileCount; iy++ )
+    {
+      ops[nops].command = BATCH_GET_FILE_SETTINGS;
+      ops[nops].lpTag = &held;
+      ops[nops].lpRequest = &fileReqs[nfile++].data;
+      nops++;
+    }
+  }
+  ops[nops-1].lpTag = lpTag;
+  status = SkyeTek_ExecuteBatch(lpReader, ops, nops, statuses);
+  if( status != SKYETEK_SUCCESS )
+    goto cleanup;
+  holding = 0;
+
+  nops = 0;
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpApp = &lpSnap->lpApps[ix];
+    if( lpApp->fileCount == 0 )
+      continue;
+    if( statuses[nops] != SKYETEK_SUCCESS )
+      lpApp->status = statuses[nops];
+    nops++;
+    for( iy = 0; iy < lpApp->fileCount; iy++, nops++ )
+    {
+      lpApp->lpFiles[iy].status = statuses[nops];
+      if( statuses[nops] == SKYETEK_SUCCESS )
+        lpApp->lpFiles[iy].status = Snapshot_FileSettings(ops[nops].lpData, &lpApp->lpFiles[iy]);
+    }
+  }
+
+cleanup:
+  /* No files to read, or the last batch did not run */
+  if( holding )
+    SkyeTekReader_ReleaseField(lpReader, lpTag);
+  if( ops != NULL )
+    Snapshot_FreeOps(ops, nops);
+  if( statuses != NULL )
+    free(statuses);
+  if( reqs != NULL )
+    free(reqs);
+  if( fileReqs != NULL )
+    free(fileReqs);
+  if( fileIds != NULL )
+    free(fileIds);
+  if( ids != NULL )
+  {
+    for( ix = 0; ix < count; ix++ )
+      SkyeTek_FreeID(ids[ix]);
+    free(ids);
+  }
+  if( status != SKYETEK_SUCCESS )
+  {
+    if( lpSnap != NULL )
+      free(lpSnap);
+    return status;
+  }
+  *lpSnapshot = lpSnap;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API void
+SkyeTek_FreeDesfireSnapshot(
+    LPSKYETEK_DESFIRE_SNAPSHOT    lpSnapshot
+    )
+{
+  if( lpSnapshot != NULL )
+    free(lpSnapshot);
+}
+
+static unsigned char *
+Snapshot_Put(
+    unsigned char   *p,
+    unsigned int    value
+    )
+{
+  p[0] = (unsigned char)(value >> 24);
+  p[1] = (unsigned char)(value >> 16);
+  p[2] = (unsigned char)(value >> 8);
+  p[3] = (unsigned char)value;
+  return p + 4;
+}
+
+/* Writes one application and its files; returns its size */
+static unsigned int
+Snapshot_PutApp(
+    LPSKYETEK_DESFIRE_APP   lpApp,
+    unsigned char           *p
+    )
+{
+  LPSKYETEK_DESFIRE_FILE lpFile;
+  unsigned int ix;
+
+  memcpy(p, lpApp->aid, 3);
+  p[3] = (unsigned char)lpApp->status;
+  p[4] = (unsigned char)(lpApp->fileCount >> 8);
+  p[5] = (unsigned char)lpApp->fileCount;
+  p += SNAPSHOT_APP_SIZE;
+  for( ix = 0; ix < lpApp->fileCount; ix++ )
+  {
+    lpFile = &lpApp->lpFiles[ix];
+    p[0] = lpFile->id;
+    p[1] = (unsigned char)lpFile->status;
+    p[2] = (unsigned char)lpFile->settings.type;
+    p[3] = (unsigned char)lpFile->settings.comm;
+    p[4] = (unsigned char)lpFile->settings.readAccess;
+    p[5] = (unsigned char)lpFile->settings.writeAccess;
+    p[6] = (unsigned char)lpFile->settings.readWriteAccess;
+    p[7] = (unsigned char)lpFile->settings.changeAccess;
+    p = Snapshot_Put(p + 8, lpFile->fileSize);
+    p = Snapshot_Put(p, lpFile->lowerLimit);
+    p = Snapshot_Put(p, lpFile->upperLimit);
+    p = Snapshot_Put(p, lpFile->limitedCreditValue);
+    p = Snapshot_Put(p, lpFile->recordSize);
+    p = Snapshot_Put(p, lpFile->maxRecords);
+    p = Snapshot_Put(p, lpFile->numRecords);
+    p[0] = 0;
+    p[1] = lpFile->limitedCreditEnabled;
+    p += 2;
+  }
+  return SNAPSHOT_APP_SIZE + lpApp->fileCount * SNAPSHOT_FILE_SIZE;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_SerializeDesfireSnapshot(
+    LPSKYETEK_DESFIRE_SNAPSHOT    lpSnapshot,
+    LPSKYETEK_DATA                *lpData
+    )
+{
+  LPSKYETEK_DATA lpOut;
+  unsigned int ix, size = 3, off;
+
+  if( lpSnapshot == NULL || lpData == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  for( ix = 0; ix < lpSnapshot->appCount; ix++ )
+    size += SNAPSHOT_APP_SIZE + lpSnapshot->lpApps[ix].fileCount * SNAPSHOT_FILE_SIZE;
+  lpOut = SkyeTek_AllocateData(size);
+  if( lpOut == NULL || lpOut->data == NULL )
+  {
+    SkyeTek_FreeData(lpOut);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  lpOut->data[0] = SNAPSHOT_VERSION;
+  lpOut->data[1] = (unsigned char)(lpSnapshot->appCount >> 8);
+  lpOut->data[2] = (unsigned char)lpSnapshot->appCount;
+  off = 3;
+  for( ix = 0; ix < lpSnapshot->appCount; ix++ )
+    off += Snapshot_PutApp(&lpSnapshot->lpApps[ix], lpOut->data + off);
+  *lpData = lpOut;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_DiffDesfireSnapshot(
+    LPSKYETEK_DESFIRE_SNAPSHOT    lpSnapshot,
+    LPSKYETEK_DATA                lpPrevious,
+    unsigned int                  *lpChanged
+    )
+{
+  unsigned char *app = NULL, *p, *end;
+  unsigned int *offsets = NULL, *sizes = NULL;
+  unsigned char *seen = NULL;
+  unsigned int ix, iy, prevCount, size, changed = 0;
+  SKYETEK_STATUS status = SKYETEK_SUCCESS;
+
+  if( lpSnapshot == NULL || lpPrevious == NULL || lpPrevious->data == NULL ||
+      lpPrevious->size < 3 || lpPrevious->data[0] != SNAPSHOT_VERSION || lpChanged == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  /* Index the applications of the previous snapshot */
+  prevCount = (lpPrevious->data[1] << 8) | lpPrevious->data[2];
+  offsets = (unsigned int *)malloc((prevCount + 1) * sizeof(unsigned int));
+  sizes = (unsigned int *)malloc((prevCount + 1) * sizeof(unsigned int));
+  seen = (unsigned char *)malloc(prevCount + 1);
+  if( offsets == NULL || sizes == NULL || seen == NULL )
+  {
+    status = SKYETEK_OUT_OF_MEMORY;
+    goto cleanup;
+  }
+  memset(seen, 0, prevCount + 1);
+  p = lpPrevious->data + 3;
+  end = lpPrevious->data + lpPrevious->size;
+  for( ix = 0; ix < prevCount; ix++ )
+  {
+    if( end - p < SNAPSHOT_APP_SIZE )
+    {
+      status = SKYETEK_INVALID_PARAMETER;
+      goto cleanup;
+    }
+    size = SNAPSHOT_APP_SIZE + ((p[4] << 8) | p[5]) * SNAPSHOT_FILE_SIZE;
+    if( (unsigned int)(end - p) < size )
+    {
+      status = SKYETEK_INVALID_PARAMETER;
+      goto cleanup;
+    }
+    offsets[ix] = (unsigned int)(p - lpPrevious->data);
+    sizes[ix] = size;
+    p += size;
+  }
+
+  for( ix = 0; ix < lpSnapshot->appCount; ix++ )
+  {
+    size = SNAPSHOT_APP_SIZE + lpSnapshot->lpApps[ix].fileCount * SNAPSHOT_FILE_SIZE;
+    app = (unsigned char *)malloc(size);
+    if( app == NULL )
+    {
+      status = SKYETEK_OUT_OF_MEMORY;
+      goto cleanup;
+    }
+    Snapshot_PutApp(&lpSnapshot->lpApps[ix], app);
+    for( iy = 0; iy < prevCount; iy++ )
+    {
+      if( !seen[iy] && memcmp(lpPrevious->data + offsets[iy], app, 3) == 0 )
+        break;
+    }
+    if( iy == prevCount )
+    {
+      changed++;
+    }
+    else
+    {
+      seen[iy] = 1;
+      if( sizes[iy] != size || memcmp(lpPrevious->data + offsets[iy], app, size) != 0 )
+        changed++;
+    }
+    free(app);
+  }
+  for( iy = 0; iy < prevCount; iy++ )
+  {
+    if( !seen[iy] )
+      changed++;
+  }
+  *lpChanged = changed;
+
+cleanup:
+  if( offsets != NULL )
+    free(offsets);
+  if( sizes != NULL )
+    free(sizes);
+  if( seen != NULL )
+    free(seen);
+  return status;
+}
@@ -0,0 +1,230 @@
+/**
+ * SkyeTekDesfireTransaction.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * DESFire value and record transactions. The requests of all the
+ * operations are encoded into one buffer and sent as one batch behind
+ * the application select. The pipeline cannot hold back a request once
+ * an earlier one fails, so the commit, or the abort, follows on its own.
+ */
+#include "../SkyeTekAPI.h"
+#include "../Protocol/asn1.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRANSACTION_OVERHEAD  24    /* ASN.1 headers, file id, amount or offset */
+
+/* Encodes one request into lpBuffer; returns its size */
+static unsigned int
+Transaction_Encode(
+    LPSKYETEK_DESFIRE_OPERATION   lpOp,
+    unsigned char                 *lpBuffer,
+    unsigned int                  size
+    )
+{
+  st_asn1_context context;
+  st_asn1_context_storage storage;
+  int64 w;
+  int len;
+
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_ENCODE, lpBuffer, size);
+  st_asn1_start_sequence(context);
+  w = lpOp->fileId;
+  st_asn1_write_integer(context, w);
+  if( lpOp->op == DESFIRE_OP_WRITE_RECORD )
+  {
+    w = lpOp->offset;
+    st_asn1_write_integer(context, w);
+    st_asn1_write_octet_string(context, lpOp->lpData->data, lpOp->lpData->size);
+  }
+  else
+  {
+    w = lpOp->amount;
+    st_asn1_write_integer(context, w);
+  }
+  st_asn1_finish_sequence(context);
+  len = st_asn1_finalize(context);
+  st_asn1_free_context(&context);
+  return (len < 0) ? 0 : (unsigned int)len;
+}
+
+static unsigned int
+Transaction_EncodeAid(
+    LPSKYETEK_ID      lpApp,
+    unsigned char     *lpBuffer,
+    unsigned int      size
+    )
+{
+  st_asn1_context context;
+  st_asn1_context_storage storage;
+  int len;
+
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_ENCODE, lpBuffer, size);
+  st_asn1_write_octet_string(context, lpApp->id, lpApp->length);
+  len = st_asn1_finalize(context);
+  st_asn1_free_context(&context);
+  return (len < 0) ? 0 : (unsigned int)len;
+}
+
+static SKYETEK_BATCH_COMMAND
+Transaction_Command(
+    SKYETEK_DESFIRE_OP    op
+    )
+{
+  switch( op )
+  {
+    case DESFIRE_OP_CREDIT:
+      return BATCH_CREDIT_VALUE_FILE;
+    case DESFIRE_OP_DEBIT:
+      return BATCH_DEBIT_VALUE_FILE;
+    case DESFIRE_OP_LIMITED_CREDIT:
+      return BATCH_LIMITED_CREDIT_VALUE_FILE;
+    default:
+      return BATCH_WRITE_RECORD;
+  }
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_ExecuteDesfireTransaction(
+    LPSKYETEK_READER                lpReader,
+    LPSKYETEK_TAG                   lpTag,
+    LPSKYETEK_ID                    lpApp,
+    LPSKYETEK_DESFIRE_OPERATION     lpOps,
+    unsigned int                    count,
+    LPSKYETEK_DESFIRE_TRANSACTION   lpResult
+    )
+{
+  LPSKYETEK_BATCH_OPERATION ops = NULL;
+  SKYETEK_STATUS *statuses = NULL;
+  LPSKYETEK_DATA reqs = NULL;
+  SKYETEK_BATCH_OPERATION end;
+  SKYETEK_TAG held;
+  SKYETEK_STATUS status, endStatus;
+  unsigned char *lpBuffer = NULL;
+  unsigned int ix, num = 0, first = 0, size, used = 0, len;
+  unsigned long began;
+
+  if( lpReader == NULL || lpTag == NULL || lpOps == NULL || count == 0 || lpResult == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  if( lpApp != NULL && (lpApp->id == NULL || lpApp->length == 0) )
+    return SKYETEK_INVALID_PARAMETER;
+  size = (lpApp != NULL) ? lpApp->length + TRANSACTION_OVERHEAD : 0;
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( lpOps[ix].op < DESFIRE_OP_CREDIT || lpOps[ix].op > DESFIRE_OP_WRITE_RECORD )
+      return SKYETEK_INVALID_PARAMETER;
+    if( lpOps[ix].op == DESFIRE_OP_WRITE_RECORD && (lpOps[ix].lpData == NULL ||
+        lpOps[ix].lpData->data == NULL || lpOps[ix].lpData->size == 0) )
+      return SKYETEK_INVALID_PARAMETER;
+    size += TRANSACTION_OVERHEAD;
+    if( lpOps[ix].op == DESFIRE_OP_WRITE_RECORD )
+      size += lpOps[ix].lpData->size;
+    lpOps[ix].status = SKYETEK_FAILURE;
+  }
+
+  memset(lpResult, 0, sizeof(SKYETEK_DESFIRE_TRANSACTION));
+  lpResult->status = SKYETEK_FAILURE;
+  lpResult->failed = count;
+  lpResult->selectStatus = SKYETEK_SUCCESS;
+  lpResult->commitStatus = SKYETEK_FAILURE;
+  began = SKYETEK_GetTickCount();
+
+  lpBuffer = (unsigned char *)malloc(size);
+  reqs = (LPSKYETEK_DATA)malloc((count + 1) * sizeof(SKYETEK_DATA));
+  ops = (LPSKYETEK_BATCH_OPERATION)malloc((count + 1) * sizeof(SKYETEK_BATCH_OPERATION));
+  statuses = (SKYETEK_STATUS *)malloc((count + 1) * sizeof(SKYETEK_STATUS));
+  if( lpBuffer == NULL || reqs == NULL || ops == NULL || statuses == NULL )
+  {
+    status = SKYETEK_OUT_OF_MEMORY;
+    goto cleanup;
+  }
+  memset(ops, 0, (count + 1) * sizeof(SKYETEK_BATCH_OPERATION));
+
+  /* The field stays on until the commit */
+  memcpy(&held, lpTag, sizeof(SKYETEK_TAG));
+  held.rf = 1;
+
+  /* Every request is encoded before anything is sent */
+  if( lpApp != NULL )
+  {
+    len = Transaction_EncodeAid(lpApp, lpBuffer, size);
+    if( len == 0 )
+    {
+      status = SKYETEK_INVALID_PARAMETER;
+      goto cleanup;
+    }
+    reqs[num].data = lpBuffer;
+    reqs[num].size = len;
+    ops[num].command = BATCH_SELECT_APPLICATION;
+    ops[num].lpTag = &held;
+    ops[num].lpData = &reqs[num];
+    used += len;
+    first = ++num;
+  }
+  for( ix = 0; ix < count; ix++, num++ )
+  {
+    len = Transaction_Encode(&lpOps[ix], lpBuffer + used, size - used);
+    if( len == 0 )
+    {
+      status = SKYETEK_INVALID_PARAMETER;
+      goto cleanup;
+    }
+    reqs[num].data = lpBuffer + used;
+    reqs[num].size = len;
+    ops[num].command = Transaction_Command(lpOps[ix].op);
+    ops[num].lpTag = &held;
+    ops[num].lpData = &reqs[num];
+    used += len;
+  }
+
+  status = SkyeTek_ExecuteBatch(lpReader, ops, num, statuses);
+  if( status != SKYETEK_SUCCESS )
+    goto cleanup;
+
+  if( lpApp != NULL )
+    lpResult->selectStatus = statuses[0];
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpOps[ix].status = statuses[first + ix];
+    if( lpOps[ix].status != SKYETEK_SUCCESS && lpResult->failed == count )
+      lpResult->failed = ix;
+  }
+
+  /* Nothing is kept unless every operation went through */
+  memset(&end, 0, sizeof(SKYETEK_BATCH_OPERATION));
+  end.lpTag = lpTag;
+  if( lpResult->selectStatus == SKYETEK_SUCCESS && lpResult->failed == count )
+    end.command = BATCH_COMMIT_TRANSACTION;
+  else
+    end.command = BATCH_ABORT_TRANSACTION;
+  status = SkyeTek_ExecuteBatch(lpReader, &end, 1, &endStatus);
+  if( status != SKYETEK_SUCCESS )
+    goto cleanup;
+  lpResult->commitStatus = endStatus;
+
+  if( lpResult->selectStatus != SKYETEK_SUCCESS )
+    status = lpResult->selectStatus;
+  else if( lpResult->failed < count )
+    status = lpOps[lpResult->failed].status;
+  else
+  {
+    status = endStatus;
+    lpResult->committed = (endStatus == SKYETEK_SUCCESS);
+  }
+
+cleanup:
+  lpResult->status = status;
+  lpResult->elapsed = SKYETEK_GetTickCount() - began;
+  if( lpBuffer != NULL )
+    free(lpBuffer);
+  if( reqs != NULL )
+    free(reqs);
+  if( ops != NULL )
+    free(ops);
+  if( statuses != NULL )
+    free(statuses);
+  return status;
+}
@@ -0,0 +1,225 @@
+/**
+ * SkyeTekEncoder.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Tag encoding pipeline. Jobs run a window at a time as one batch of
+ * writes and verify reads. Bad blocks are written again in the next
+ * round, and a job that verified is locked in the batch after it.
+ */
+#include "../SkyeTekAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENCODE_WINDOW   8   /* jobs per batch */
+
+typedef struct ENCODE_SLOT
+{
+  unsigned int          job;
+  unsigned int          start;      /* first block still to write */
+  unsigned int          blocks;     /* blocks still to write; 0 once verified */
+  unsigned int          write;      /* its operations in the batch */
+  unsigned int          verify;
+  unsigned long         began;
+  SKYETEK_DATA          data;       /* the part of the payload being written */
+} ENCODE_SLOT, *LPENCODE_SLOT;
+
+static unsigned int
+Encode_BlockSize(
+    LPSKYETEK_ENCODE_JOB    lpJob
+    )
+{
+  return lpJob->lpPayload->size / lpJob->address.blocks;
+}
+
+/* Looks at what a verify read back and narrows the slot to the bad blocks */
+static void
+Encode_Check(
+    LPSKYETEK_ENCODE_JOB      lpJob,
+    LPSKYETEK_ENCODE_RESULT   lpResult,
+    LPENCODE_SLOT             lpSlot,
+    LPSKYETEK_DATA            lpRead
+    )
+{
+  unsigned int size = Encode_BlockSize(lpJob);
+  unsigned int ix, first = lpSlot->blocks, last = 0;
+  unsigned char *want;
+
+  if( lpRead == NULL || lpRead->size < lpSlot->blocks * size )
+  {
+    lpResult->verifyStatus = SKYETEK_INVALID_MESSAGE_LENGTH;
+    return;
+  }
+  want = lpJob->lpPayload->data + lpSlot->start * size;
+  for( ix = 0; ix < lpSlot->blocks; ix++ )
+  {
+    if( memcmp(lpRead->data + ix * size, want + ix * size, size) != 0 )
+    {
+      if( first == lpSlot->blocks )
+        first = ix;
+      last = ix;
+    }
+  }
+  if( first == lpSlot->blocks )
+  {
+    lpResult->verifyStatus = SKYETEK_SUCCESS;
+    lpResult->verified = 1;
+    lpSlot->blocks = 0;
+    return;
+  }
+  lpResult->verifyStatus = SKYETEK_TAG_DATA_INTEGRITY_CHECK_FAILED;
+  lpSlot->start += first;
+  lpSlot->blocks = last - first + 1;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_EncodeTags(
+    LPSKYETEK_READER          lpReader,
+    LPSKYETEK_ENCODE_JOB      lpJobs,
+    unsigned int              count,
+    unsigned int              maxRetries,
+    LPSKYETEK_ENCODE_RESULT   lpResults
+    )
+{
+  SKYETEK_BATCH_OPERATION ops[3*ENCODE_WINDOW];
+  SKYETEK_STATUS statuses[3*ENCODE_WINDOW];
+  ENCODE_SLOT slots[ENCODE_WINDOW];
+  unsigned int locks[ENCODE_WINDOW], lockOps[ENCODE_WINDOW];
+  unsigned long lockBegan[ENCODE_WINDOW];
+  LPSKYETEK_ENCODE_JOB lpJob;
+  LPSKYETEK_ENCODE_RESULT lpResult;
+  LPENCODE_SLOT lpSlot;
+  SKYETEK_STATUS status;
+  unsigned int base, ix, num, round, nops, nlocks = 0, size;
+  unsigned long now;
+
+  if( lpReader == NULL || lpJobs == NULL || count == 0 || lpResults == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpJob = &lpJobs[ix];
+    if( lpJob->lpTag == NULL || lpJob->lpPayload == NULL || lpJob->lpPayload->data == NULL ||
+        lpJob->address.blocks == 0 || lpJob->lpPayload->size == 0 ||
+        (lpJob->lpPayload->size % lpJob->address.blocks) != 0 ||
+        (lpJob->lock && lpJob->lpLockData == NULL) )
+      return SKYETEK_INVALID_PARAMETER;
+  }
+  memset(lpResults, 0, count * sizeof(SKYETEK_ENCODE_RESULT));
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpResults[ix].writeStatus = SKYETEK_FAILURE;
+    lpResults[ix].verifyStatus = SKYETEK_FAILURE;
+    lpResults[ix].lockStatus = SKYETEK_SUCCESS;
+  }
+
+  /* One more pass after the last window sends its locks */
+  for( base = 0; base < count || nlocks > 0; base += ENCODE_WINDOW )
+  {
+    num = (base < count) ? count - base : 0;
+    if( num > ENCODE_WINDOW )
+      num = ENCODE_WINDOW;
+    now = SKYETEK_GetTickCount();
+    for( ix = 0; ix < num; ix++ )
+    {
+      slots[ix].job = base + ix;
+      slots[ix].start = 0;
+      slots[ix].blocks = lpJobs[base + ix].address.blocks;
+      slots[ix].began = now;
+    }
+
+    for( round = 0; round <= maxRetries; round++ )
+    {
+      memset(ops, 0, sizeof(ops));
+      nops = 0;
+
+      /* The jobs of the last window that verified */
+      for( ix = 0; ix < nlocks; ix++ )
+      {
+        lpJob = &lpJobs[locks[ix]];
+        lockOps[ix] = nops;
+        ops[nops].command = BATCH_LOCK_TAG_BLOCK;
+        ops[nops].lpTag = lpJob->lpTag;
+        ops[nops].address = lpJob->address;
+        ops[nops].lpData = lpJob->lpLockData;
+        nops++;
+      }
+
+      for( ix = 0; ix < num; ix++ )
+      {
+        lpSlot = &slots[ix];
+        if( lpSlot->blocks == 0 )
+          continue;
+        lpJob = &lpJobs[lpSlot->job];
+        size = Encode_BlockSize(lpJob);
+        if( round > 0 )
+          lpResults[lpSlot->job].retries += lpSlot->blocks;
+        lpSlot->data.data = lpJob->lpPayload->data + lpSlot->start * size;
+        lpSlot->data.size = lpSlot->blocks * size;
+
+        lpSlot->write = nops;
+        ops[nops].command = BATCH_WRITE_TAG_DATA;
+        ops[nops].lpTag = lpJob->lpTag;
+        ops[nops].address.start = lpJob->address.start + lpSlot->start;
+        ops[nops].address.blocks = lpSlot->blocks;
+        ops[nops].lpData = &lpSlot->data;
+        nops++;
+
+        lpSlot->verify = nops;
+        ops[nops].command = BATCH_READ_TAG_DATA;
+        ops[nops].lpTag = lpJob->lpTag;
+        ops[nops].address = ops[nops-1].address;
+        nops++;
+      }
+      if( nops == 0 )
+        break;
+
+      status = SkyeTek_ExecuteBatch(lpReader, ops, nops, statuses);
+      if( status != SKYETEK_SUCCESS )
+        return status;
+
+      now = SKYETEK_GetTickCount();
+      for( ix = 0; ix < nlocks; ix++ )
+      {
+        lpResult = &lpResults[locks[ix]];
+        lpResult->lockStatus = statuses[lockOps[ix]];
+        lpResult->locked = (lpResult->lockStatus == SKYETEK_SUCCESS);
+        lpResult->elapsed = now - lockBegan[ix];
+      }
+      nlocks = 0;
+
+      for( ix = 0; ix < num; ix++ )
+      {
+        lpSlot = &slots[ix];
+        if( lpSlot->blocks == 0 )
+          continue;
+        lpJob = &lpJobs[lpSlot->job];
+        lpResult = &lpResults[lpSlot->job];
+        lpResult->writeStatus = statuses[lpSlot->write];
+        lpResult->verifyStatus = statuses[lpSlot->verify];
+        if( lpResult->verifyStatus == SKYETEK_SUCCESS )
+          Encode_Check(lpJob, lpResult, lpSlot, ops[lpSlot->verify].lpData);
+        if( ops[lpSlot->verify].lpData != NULL )
+          SkyeTek_FreeData(ops[lpSlot->verify].lpData);
+        if( lpResult->verified )
+        {
+          lpResult->elapsed = now - lpSlot->began;
+          if( lpJob->lock )
+          {
+            lockBegan[nlocks] = lpSlot->began;
+            locks[nlocks++] = lpSlot->job;
+            lpResult->lockStatus = SKYETEK_FAILURE;
+          }
+        }
+      }
+    }
+
+    /* Whatever is left did not verify in time */
+    now = SKYETEK_GetTickCount();
+    for( ix = 0; ix < num; ix++ )
+    {
+      if( slots[ix].blocks != 0 )
+        lpResults[slots[ix].job].elapsed = now - slots[ix].began;
+    }
+  }
+  return SKYETEK_SUCCESS;
+}
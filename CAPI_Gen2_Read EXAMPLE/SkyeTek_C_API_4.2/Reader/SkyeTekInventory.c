@@ -0,0 +1,280 @@
+/**
+ * SkyeTekInventory.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Continuous inventory. A thread per reader runs the select loop and
+ * puts tag reads in a single producer ring; consumers take them in
+ * batches. The reader thread never waits on a consumer.
+ */
+#include "../SkyeTekAPI.h"
+#include "Reader.h"
+#include "../Protocol/Protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INVENTORY_QUEUE_SIZE    1024
+#define INVENTORY_TIMEOUT       100   /* ms the select loop waits before checking for stop */
+#define INVENTORY_RESTART_DELAY 100   /* ms before restarting a select loop that ended */
+#define INVENTORY_WAIT_SLICE    5     /* ms between checks in SkyeTek_WaitInventory() */
+
+typedef struct INVENTORY_ENGINE
+{
+  LPSKYETEK_READER              lpReader;
+  SKYETEK_TAGTYPE               tagType;
+  unsigned char                 inv;
+  LPSKYETEK_TAG_READ            ring;
+  unsigned long                 mask;
+  volatile unsigned long        head;       /* written by consumers only */
+  volatile unsigned long        tail;       /* written by the reader thread only */
+  volatile unsigned long        dropped;
+  volatile unsigned long        restarts;
+  volatile SKYETEK_STATUS       lastStatus;
+  volatile int                  stop;
+  THREAD(thread);
+  MUTEX(lock);                              /* serializes consumers */
+} INVENTORY_ENGINE, *LPINVENTORY_ENGINE;
+
+static unsigned char
+Inventory_Callback(
+    SKYETEK_TAGTYPE   type,
+    LPSKYETEK_DATA    lpData,
+    void              *user
+    )
+{
+  LPINVENTORY_ENGINE eng = (LPINVENTORY_ENGINE)user;
+  LPSKYETEK_TAG_READ lpRead;
+  unsigned long tail;
+
+  if( eng->stop )
+    return 0;
+  if( lpData == NULL || lpData->data == NULL || lpData->size == 0 )
+    return 1;
+
+  tail = eng->tail;
+  if( tail - eng->head > eng->mask )
+  {
+    eng->dropped++;
+    return 1;
+  }
+
+  lpRead = &eng->ring[tail & eng->mask];
+  lpRead->type = type;
+  lpRead->timestamp = SKYETEK_GetTickCount();
+  lpRead->length = lpData->size;
+  if( lpRead->length > SKYETEK_TAG_READ_ID_SIZE )
+    lpRead->length = SKYETEK_TAG_READ_ID_SIZE;
+  memcpy(lpRead->id, lpData->data, lpRead->length);
+
+  /* Publish the record only after it is written */
+  MEMORY_BARRIER();
+  eng->tail = tail + 1;
+  return 1;
+}
+
+static THREAD_RETURN
+Inventory_Worker(
+    void      *user
+    )
+{
+  LPINVENTORY_ENGINE eng = (LPINVENTORY_ENGINE)user;
+  LPPROTOCOLIMPL lppi;
+  PROTOCOL_FLAGS flags;
+  SKYETEK_STATUS status;
+
+  memset(&flags, 0, sizeof(PROTOCOL_FLAGS));
+  flags.isInventory = eng->inv;
+  flags.isLoop = 1;
+  lppi = (LPPROTOCOLIMPL)eng->lpReader->lpProtocol->internal;
+
+  while( !eng->stop )
+  {
+    status = lppi->SelectTags(eng->lpReader, eng->tagType, Inventory_Callback,
+      flags, eng, INVENTORY_TIMEOUT);
+    eng->lastStatus = status;
+    if( eng->stop )
+      break;
+
+    /* The loop ended on its own; the reader reset or the link dropped */
+    eng->restarts++;
+    if( status != SKYETEK_SUCCESS )
+      SKYETEK_Sleep(INVENTORY_RESTART_DELAY);
+  }
+  return 0;
+}
+
+static unsigned int
+Inventory_Drain(
+    LPINVENTORY_ENGINE    eng,
+    LPSKYETEK_TAG_READ    lpReads,
+    unsigned int          max
+    )
+{
+  unsigned long head, avail;
+  unsigned int ix;
+
+  MUTEX_LOCK(&eng->lock);
+  head = eng->head;
+  avail = eng->tail - head;
+  MEMORY_BARRIER();
+  if( avail > max )
+    avail = max;
+  for( ix = 0; ix < avail; ix++ )
+    memcpy(&lpReads[ix], &eng->ring[(head + ix) & eng->mask], sizeof(SKYETEK_TAG_READ));
+
+  /* Hand the slots back only after they are copied */
+  MEMORY_BARRIER();
+  eng->head = head + avail;
+  MUTEX_UNLOCK(&eng->lock);
+  return (unsigned int)avail;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_StartInventory(
+    LPSKYETEK_READER            lpReader,
+    SKYETEK_TAGTYPE             tagType,
+    unsigned char               inv,
+    unsigned int                queueSize,
+    LPSKYETEK_INVENTORY         *lpInventory
+    )
+{
+  LPSKYETEK_INVENTORY lpInv;
+  LPINVENTORY_ENGINE eng;
+  unsigned long size;
+
+  if( lpReader == NULL || lpReader->lpProtocol == NULL ||
+      lpReader->lpProtocol->internal == NULL || lpReader->lpDevice == NULL ||
+      lpInventory == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  if( queueSize == 0 )
+    queueSize = INVENTORY_QUEUE_SIZE;
+  for( size = 1; size < queueSize; size <<= 1 )
+    ;
+
+  lpInv = (LPSKYETEK_INVENTORY)malloc(sizeof(SKYETEK_INVENTORY));
+  if( lpInv == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  eng = (LPINVENTORY_ENGINE)malloc(sizeof(INVENTORY_ENGINE));
+  if( eng == NULL )
+  {
+    free(lpInv);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  memset(eng, 0, sizeof(INVENTORY_ENGINE));
+  eng->ring = (LPSKYETEK_TAG_READ)malloc(size * sizeof(SKYETEK_TAG_READ));
+  if( eng->ring == NULL )
+  {
+    free(eng);
+    free(lpInv);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  eng->lpReader = lpReader;
+  eng->tagType = tagType;
+  eng->inv = inv;
+  eng->mask = size - 1;
+  eng->lastStatus = SKYETEK_SUCCESS;
+  MUTEX_CREATE(&eng->lock);
+
+  if( !THREAD_CREATE(&eng->thread, Inventory_Worker, eng) )
+  {
+    MUTEX_DESTROY(&eng->lock);
+    free(eng->ring);
+    free(eng);
+    free(lpInv);
+    return SKYETEK_NOT_SUPPORTED;
+  }
+
+  lpInv->lpReader = lpReader;
+  lpInv->tagType = tagType;
+  lpInv->queueSize = (unsigned int)size;
+  lpInv->internal = eng;
+  *lpInventory = lpInv;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_PollInventory(
+    LPSKYETEK_INVENTORY         lpInventory,
+    LPSKYETEK_TAG_READ          lpReads,
+    unsigned int                max,
+    unsigned int                *count
+    )
+{
+  if( lpInventory == NULL || lpInventory->internal == NULL ||
+      lpReads == NULL || count == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  *count = Inventory_Drain((LPINVENTORY_ENGINE)lpInventory->internal, lpReads, max);
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_WaitInventory(
+    LPSKYETEK_INVENTORY         lpInventory,
+    LPSKYETEK_TAG_READ          lpReads,
+    unsigned int                max,
+    unsigned int                *count,
+    unsigned int                timeout
+    )
+{
+  LPINVENTORY_ENGINE eng;
+  unsigned long start;
+
+  if( lpInventory == NULL || lpInventory->internal == NULL ||
+      lpReads == NULL || count == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  eng = (LPINVENTORY_ENGINE)lpInventory->internal;
+
+  /* Polls rather than signals so the reader thread never takes a lock */
+  start = SKYETEK_GetTickCount();
+  for(;;)
+  {
+    *count = Inventory_Drain(eng, lpReads, max);
+    if( *count > 0 || max == 0 )
+      return SKYETEK_SUCCESS;
+    if( (SKYETEK_GetTickCount() - start) >= timeout )
+      return SKYETEK_TIMEOUT;
+    SKYETEK_Sleep(INVENTORY_WAIT_SLICE);
+  }
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_GetInventoryStats(
+    LPSKYETEK_INVENTORY         lpInventory,
+    LPSKYETEK_INVENTORY_STATS   lpStats
+    )
+{
+  LPINVENTORY_ENGINE eng;
+
+  if( lpInventory == NULL || lpInventory->internal == NULL || lpStats == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  eng = (LPINVENTORY_ENGINE)lpInventory->internal;
+
+  lpStats->reads = eng->tail;
+  lpStats->dropped = eng->dropped;
+  lpStats->restarts = eng->restarts;
+  lpStats->queued = (unsigned int)(lpStats->reads - eng->head);
+  lpStats->lastStatus = eng->lastStatus;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API void
+SkyeTek_StopInventory(
+    LPSKYETEK_INVENTORY         lpInventory
+    )
+{
+  LPINVENTORY_ENGINE eng;
+
+  if( lpInventory == NULL )
+    return;
+  eng = (LPINVENTORY_ENGINE)lpInventory->internal;
+  if( eng != NULL )
+  {
+    eng->stop = 1;
+    THREAD_JOIN(&eng->thread);
+    MUTEX_DESTROY(&eng->lock);
+    free(eng->ring);
+    free(eng);
+  }
+  free(lpInventory);
+}
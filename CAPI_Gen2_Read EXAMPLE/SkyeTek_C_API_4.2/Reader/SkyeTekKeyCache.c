@@ -0,0 +1,250 @@
+/**
+ * SkyeTekKeyCache.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Reader key slot cache. The reader layer records the keys it stores
+ * and the slot it last loaded, and forgets them when the reader is
+ * reset, so crypto sessions can skip loads and stores the reader
+ * already has. Only a digest of each key is kept, never the key.
+ */
+#include "../SkyeTekAPI.h"
+#include "Reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS_SLOTS      16    /* slots remembered per reader */
+
+typedef struct KEY_SLOT
+{
+  unsigned char         used;
+  unsigned char         number;
+  SKYETEK_TAGTYPE       type;
+  unsigned int          size;
+  unsigned int          digest[2];
+} KEY_SLOT, *LPKEY_SLOT;
+
+typedef struct KEY_CACHE
+{
+  int                   loaded;     /* slot loaded, or -1 if not known */
+  unsigned int          next;       /* slot to replace when full */
+  KEY_SLOT              slots[KEYS_SLOTS];
+} KEY_CACHE, *LPKEY_CACHE;
+
+static STATIC_MUTEX(g_keysLock);
+
+static void
+Keys_Lock(void)
+{
+  STATIC_MUTEX_LOCK(&g_keysLock);
+}
+
+static void
+Keys_Unlock(void)
+{
+  STATIC_MUTEX_UNLOCK(&g_keysLock);
+}
+
+/* Called with the lock held; creates the cache if create is set */
+static LPKEY_CACHE
+Keys_Get(
+    LPSKYETEK_READER    lpReader,
+    int                 create
+    )
+{
+  LPKEY_CACHE cache = (LPKEY_CACHE)SkyeTekReader_GetPrivate(lpReader, PRIVATE_KEYS);
+
+  if( cache == NULL && create )
+  {
+    cache = (LPKEY_CACHE)malloc(sizeof(KEY_CACHE));
+    if( cache != NULL )
+    {
+      memset(cache, 0, sizeof(KEY_CACHE));
+      cache->loaded = -1;
+      if( SkyeTekReader_SetPrivate(lpReader, PRIVATE_KEYS, cache) != SKYETEK_SUCCESS )
+      {
+        free(cache);
+        cache = NULL;
+      }
+    }
+  }
+  return cache;
+}
+
+/* Two FNV-1a hashes of the key, one over each byte order; enough to
+   tell keys apart without keeping them */
+static void
+Keys_Digest(
+    LPSKYETEK_DATA  lpData,
+    unsigned int    *digest
+    )
+{
+  unsigned int ix;
+
+  digest[0] = 0x811C9DC5;
+  digest[1] = 0x811C9DC5 ^ lpData->size;
+  for( ix = 0; ix < lpData->size; ix++ )
+  {
+    digest[0] = (digest[0] ^ lpData->data[ix]) * 0x01000193;
+    digest[1] = (digest[1] ^ lpData->data[lpData->size - 1 - ix]) * 0x01000193;
+  }
+}
+
+static LPKEY_SLOT
+Keys_Find(
+    LPKEY_CACHE     cache,
+    unsigned char   number
+    )
+{
+  unsigned int ix;
+  for( ix = 0; ix < KEYS_SLOTS; ix++ )
+  {
+    if( cache->slots[ix].used && cache->slots[ix].number == number )
+      return &cache->slots[ix];
+  }
+  return NULL;
+}
+
+int
+SkyeTekReader_IsKeyStored(
+    LPSKYETEK_READER    lpReader,
+    SKYETEK_TAGTYPE     type,
+    unsigned char       number,
+    LPSKYETEK_DATA      lpData
+    )
+{
+  LPKEY_CACHE cache;
+  LPKEY_SLOT lpSlot;
+  unsigned int digest[2];
+  int stored = 0;
+
+  if( lpReader == NULL || lpData == NULL || lpData->data == NULL )
+    return 0;
+  Keys_Digest(lpData, digest);
+  Keys_Lock();
+  cache = Keys_Get(lpReader, 0);
+  if( cache != NULL && (lpSlot = Keys_Find(cache, number)) != NULL )
+  {
+    stored = (lpSlot->type == type && lpSlot->size == lpData->size &&
+      lpSlot->digest[0] == digest[0] && lpSlot->digest[1] == digest[1]);
+  }
+  Keys_Unlock();
+  return stored;
+}
+
+void
+SkyeTekReader_KeyStored(
+    LPSKYETEK_READER    lpReader,
+    SKYETEK_TAGTYPE     type,
+    unsigned char       number,
+    LPSKYETEK_DATA      lpData
+    )
+{
+  LPKEY_CACHE cache;
+  LPKEY_SLOT lpSlot;
+
+  if( lpReader == NULL )
+    return;
+  Keys_Lock();
+  cache = Keys_Get(lpReader, lpData != NULL);
+  if( cache != NULL )
+  {
+    /* The loaded key may have come from the slot */
+    if( cache->loaded == number )
+      cache->loaded = -1;
+    lpSlot = Keys_Find(cache, number);
+    if( lpData == NULL || lpData->data == NULL )
+    {
+      if( lpSlot != NULL )
+        memset(lpSlot, 0, sizeof(KEY_SLOT));
+    }
+    else
+    {
+      if( lpSlot == NULL )
+      {
+        lpSlot = &cache->slots[cache->next];
+        cache->next = (cache->next + 1) % KEYS_SLOTS;
+      }
+      lpSlot->used = 1;
+      lpSlot->number = number;
+      lpSlot->type = type;
+      lpSlot->size = lpData->size;
+      Keys_Digest(lpData, lpSlot->digest);
+    }
+  }
+  Keys_Unlock();
+}
+
+int
+SkyeTekReader_IsKeyLoaded(
+    LPSKYETEK_READER    lpReader,
+    unsigned char       number
+    )
+{
+  LPKEY_CACHE cache;
+  int loaded = 0;
+
+  if( lpReader == NULL )
+    return 0;
+  Keys_Lock();
+  cache = Keys_Get(lpReader, 0);
+  if( cache != NULL )
+    loaded = (cache->loaded == number);
+  Keys_Unlock();
+  return loaded;
+}
+
+void
+SkyeTekReader_KeyLoaded(
+    LPSKYETEK_READER    lpReader,
+    int                 number
+    )
+{
+  LPKEY_CACHE cache;
+
+  if( lpReader == NULL )
+    return;
+  Keys_Lock();
+  cache = Keys_Get(lpReader, number >= 0);
+  if( cache != NULL )
+    cache->loaded = number;
+  Keys_Unlock();
+}
+
+void
+SkyeTekReader_InvalidateKeys(
+    LPSKYETEK_READER    lpReader
+    )
+{
+  LPKEY_CACHE cache;
+
+  if( lpReader == NULL )
+    return;
+  Keys_Lock();
+  cache = Keys_Get(lpReader, 0);
+  if( cache != NULL )
+  {
+    memset(cache, 0, sizeof(KEY_CACHE));
+    cache->loaded = -1;
+  }
+  Keys_Unlock();
+}
+
+void
+SkyeTekReader_FreeKeys(
+    LPSKYETEK_READER    lpReader
+    )
+{
+  LPKEY_CACHE cache;
+
+  if( lpReader == NULL )
+    return;
+  Keys_Lock();
+  cache = (LPKEY_CACHE)SkyeTekReader_TakePrivate(lpReader, PRIVATE_KEYS);
+  if( cache != NULL )
+  {
+    memset(cache, 0, sizeof(KEY_CACHE));
+    free(cache);
+  }
+  Keys_Unlock();
+}
@@ -0,0 +1,336 @@
+/**
+ * SkyeTekOrchestrator.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Time-sliced RF coordination. A frame is a weighted interleave of the
+ * reader groups; the readers of a slot's group inventory in parallel
+ * and the others stay quiet so readers near each other do not collide.
+ */
+#include "../SkyeTekAPI.h"
+#include "Reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ORCHESTRATOR_JOB
+{
+  LPSKYETEK_ORCHESTRATOR  lpOrch;
+  unsigned int            member;
+  READER_DWELL            dwell;
+  SKYETEK_STATUS          status;
+  unsigned long           airTime;
+} ORCHESTRATOR_JOB, *LPORCHESTRATOR_JOB;
+
+typedef struct ORCHESTRATOR_STATE
+{
+  LPORCHESTRATOR_JOB    jobs;         /* one per reader */
+  unsigned int          *group;       /* group index of each reader */
+  unsigned int          *used;        /* slots each reader has had this frame */
+  unsigned int          *cursor;      /* next read of each reader to merge */
+  unsigned int          *members;     /* readers of the current slot */
+  unsigned int          numGroups;
+  unsigned int          *weight;      /* slots per frame of each group */
+  long                  *credit;      /* weighted round robin */
+  unsigned int          *slots;       /* group index of each slot in the frame */
+  unsigned int          numSlots;
+} ORCHESTRATOR_STATE, *LPORCHESTRATOR_STATE;
+
+static THREAD_RETURN
+Orchestrator_Worker(
+    void      *user
+    )
+{
+  LPORCHESTRATOR_JOB job = (LPORCHESTRATOR_JOB)user;
+  LPSKYETEK_ORCHESTRATOR_MEMBER lpMember = &job->lpOrch->lpMembers[job->member];
+  unsigned long start;
+
+  start = SKYETEK_GetTickCount();
+  job->status = SkyeTekReader_Dwell(lpMember->lpReader, lpMember->tagType,
+    job->lpOrch->slotTime, &job->dwell);
+  job->airTime = SKYETEK_GetTickCount() - start;
+  return 0;
+}
+
+/* Lays out the slots of a frame; a group gets as many as its highest priority */
+static void
+Orchestrator_Plan(
+    LPSKYETEK_ORCHESTRATOR  lpOrch,
+    LPORCHESTRATOR_STATE    state
+    )
+{
+  unsigned int ix, iy, best, priority;
+
+  state->numSlots = 0;
+  for( ix = 0; ix < state->numGroups; ix++ )
+  {
+    state->weight[ix] = 0;
+    state->credit[ix] = 0;
+  }
+  for( ix = 0; ix < lpOrch->count; ix++ )
+  {
+    priority = lpOrch->lpMembers[ix].priority ? lpOrch->lpMembers[ix].priority : 1;
+    if( priority > state->weight[state->group[ix]] )
+      state->weight[state->group[ix]] = priority;
+  }
+  for( ix = 0; ix < state->numGroups; ix++ )
+    state->numSlots += state->weight[ix];
+
+  /* Smooth weighted round robin spreads each group over the frame */
+  for( iy = 0; iy < state->numSlots; iy++ )
+  {
+    best = 0;
+    for( ix = 0; ix < state->numGroups; ix++ )
+    {
+      state->credit[ix] += state->weight[ix];
+      if( state->credit[ix] > state->credit[best] )
+        best = ix;
+    }
+    state->credit[best] -= state->numSlots;
+    state->slots[iy] = best;
+  }
+}
+
+/* Hands over the reads of a slot, oldest first across its readers */
+static int
+Orchestrator_Merge(
+    LPSKYETEK_ORCHESTRATOR              lpOrch,
+    LPORCHESTRATOR_STATE                state,
+    unsigned int                        num,
+    SKYETEK_ORCHESTRATOR_READ_CALLBACK  callback,
+    void                                *user
+    )
+{
+  LPORCHESTRATOR_JOB job;
+  unsigned int ix, best;
+  unsigned long oldest = 0;
+
+  for( ix = 0; ix < num; ix++ )
+    state->cursor[ix] = 0;
+  for(;;)
+  {
+    best = num;
+    for( ix = 0; ix < num; ix++ )
+    {
+      job = &state->jobs[state->members[ix]];
+      if( state->cursor[ix] >= job->dwell.count )
+        continue;
+      if( best == num || (long)(job->dwell.reads[state->cursor[ix]].timestamp - oldest) < 0 )
+      {
+        best = ix;
+        oldest = job->dwell.reads[state->cursor[ix]].timestamp;
+      }
+    }
+    if( best == num )
+      return 1;
+    job = &state->jobs[state->members[best]];
+    if( !callback(lpOrch->lpMembers[job->member].lpReader, &job->dwell.reads[state->cursor[best]++], user) )
+      return 0;
+  }
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_CreateOrchestrator(
+    LPSKYETEK_ORCHESTRATOR_MEMBER   lpMembers,
+    unsigned int                    count,
+    unsigned long                   slotTime,
+    unsigned long                   guardTime,
+    LPSKYETEK_ORCHESTRATOR          *lpOrchestrator
+    )
+{
+  LPSKYETEK_ORCHESTRATOR lpOrch;
+  LPORCHESTRATOR_STATE state;
+  unsigned int ix, iy, slots = 0;
+
+  if( lpMembers == NULL || count == 0 || slotTime == 0 || lpOrchestrator == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( lpMembers[ix].lpReader == NULL || lpMembers[ix].lpReader->lpProtocol == NULL ||
+        lpMembers[ix].lpReader->lpDevice == NULL )
+      return SKYETEK_INVALID_PARAMETER;
+    slots += lpMembers[ix].priority ? lpMembers[ix].priority : 1;
+  }
+
+  lpOrch = (LPSKYETEK_ORCHESTRATOR)malloc(sizeof(SKYETEK_ORCHESTRATOR));
+  if( lpOrch == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  memset(lpOrch, 0, sizeof(SKYETEK_ORCHESTRATOR));
+  state = (LPORCHESTRATOR_STATE)malloc(sizeof(ORCHESTRATOR_STATE));
+  lpOrch->internal = state;
+  lpOrch->lpMembers = (LPSKYETEK_ORCHESTRATOR_MEMBER)malloc(count * sizeof(SKYETEK_ORCHESTRATOR_MEMBER));
+  lpOrch->lpStats = (LPSKYETEK_READER_THROUGHPUT)malloc(count * sizeof(SKYETEK_READER_THROUGHPUT));
+  if( state != NULL )
+  {
+    memset(state, 0, sizeof(ORCHESTRATOR_STATE));
+    state->jobs = (LPORCHESTRATOR_JOB)malloc(count * sizeof(ORCHESTRATOR_JOB));
+    state->group = (unsigned int *)malloc(count * sizeof(unsigned int));
+    state->used = (unsigned int *)malloc(count * sizeof(unsigned int));
+    state->cursor = (unsigned int *)malloc(count * sizeof(unsigned int));
+    state->members = (unsigned int *)malloc(count * sizeof(unsigned int));
+    state->weight = (unsigned int *)malloc(count * sizeof(unsigned int));
+    state->credit = (long *)malloc(count * sizeof(long));
+    state->slots = (unsigned int *)malloc(slots * sizeof(unsigned int));
+  }
+  if( state == NULL || lpOrch->lpMembers == NULL || lpOrch->lpStats == NULL ||
+      state->jobs == NULL || state->group == NULL || state->used == NULL ||
+      state->cursor == NULL || state->members == NULL || state->weight == NULL ||
+      state->credit == NULL || state->slots == NULL )
+  {
+    SkyeTek_FreeOrchestrator(lpOrch);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+
+  memcpy(lpOrch->lpMembers, lpMembers, count * sizeof(SKYETEK_ORCHESTRATOR_MEMBER));
+  memset(lpOrch->lpStats, 0, count * sizeof(SKYETEK_READER_THROUGHPUT));
+  memset(state->jobs, 0, count * sizeof(ORCHESTRATOR_JOB));
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpOrch->lpStats[ix].lpReader = lpMembers[ix].lpReader;
+    lpOrch->lpStats[ix].lastStatus = SKYETEK_SUCCESS;
+    state->jobs[ix].lpOrch = lpOrch;
+    state->jobs[ix].member = ix;
+
+    /* Number the groups in order of first use */
+    for( iy = 0; iy < ix && lpMembers[iy].group != lpMembers[ix].group; iy++ )
+      ;
+    state->group[ix] = (iy < ix) ? state->group[iy] : state->numGroups++;
+  }
+  lpOrch->count = count;
+  lpOrch->slotTime = slotTime;
+  lpOrch->guardTime = guardTime;
+  *lpOrchestrator = lpOrch;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_RunOrchestratorFrame(
+    LPSKYETEK_ORCHESTRATOR              lpOrchestrator,
+    SKYETEK_ORCHESTRATOR_READ_CALLBACK  callback,
+    void                                *user
+    )
+{
+  LPORCHESTRATOR_STATE state;
+  LPSKYETEK_READER_THROUGHPUT lpStats;
+  LPORCHESTRATOR_JOB job;
+  THREAD(*threads) = NULL;
+  SKYETEK_STATUS last = SKYETEK_FAILURE;
+  unsigned int ix, iy, num, started, priority, ran = 0;
+  unsigned long end;
+  int stop = 0;
+
+  if( lpOrchestrator == NULL || lpOrchestrator->internal == NULL || callback == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  state = (LPORCHESTRATOR_STATE)lpOrchestrator->internal;
+
+  if( lpOrchestrator->count > 1 )
+    threads = malloc((lpOrchestrator->count - 1) * sizeof(*threads));
+  Orchestrator_Plan(lpOrchestrator, state);
+  for( ix = 0; ix < lpOrchestrator->count; ix++ )
+    state->used[ix] = 0;
+
+  for( iy = 0; iy < state->numSlots && !stop; iy++ )
+  {
+    /* The readers of this group that still have slots this frame */
+    num = 0;
+    for( ix = 0; ix < lpOrchestrator->count; ix++ )
+    {
+      priority = lpOrchestrator->lpMembers[ix].priority ? lpOrchestrator->lpMembers[ix].priority : 1;
+      if( state->group[ix] == state->slots[iy] && state->used[ix] < priority )
+      {
+        state->members[num++] = ix;
+        state->used[ix]++;
+      }
+    }
+    if( num == 0 )
+      continue;
+
+    /* The calling thread runs the first reader */
+    started = 0;
+    if( threads != NULL )
+    {
+      for( ix = 1; ix < num; ix++ )
+      {
+        if( !THREAD_CREATE(&threads[started], Orchestrator_Worker, &state->jobs[state->members[ix]]) )
+          break;
+        started++;
+      }
+    }
+    Orchestrator_Worker(&state->jobs[state->members[0]]);
+    for( ix = 0; ix < started; ix++ )
+      THREAD_JOIN(&threads[ix]);
+
+    /* Readers without a thread go after the others, still in this slot */
+    for( ix = started + 1; ix < num; ix++ )
+      Orchestrator_Worker(&state->jobs[state->members[ix]]);
+    end = SKYETEK_GetTickCount();
+
+    for( ix = 0; ix < num; ix++ )
+    {
+      job = &state->jobs[state->members[ix]];
+      lpStats = &lpOrchestrator->lpStats[job->member];
+      lpStats->lastStatus = last = job->status;
+      lpStats->slots++;
+      lpStats->reads += job->dwell.count;
+      lpStats->airTime += job->airTime;
+      if( lpStats->airTime > 0 )
+        lpStats->rate = (unsigned long)((double)lpStats->reads * 1000000.0 / lpStats->airTime);
+      ran++;
+    }
+    stop = !Orchestrator_Merge(lpOrchestrator, state, num, callback, user);
+
+    /* Let the field settle before the next group transmits */
+    if( !stop && iy + 1 < state->numSlots && lpOrchestrator->guardTime > 0 &&
+        (SKYETEK_GetTickCount() - end) < lpOrchestrator->guardTime )
+      SKYETEK_Sleep(lpOrchestrator->guardTime - (SKYETEK_GetTickCount() - end));
+  }
+
+  if( threads != NULL )
+    free(threads);
+  lpOrchestrator->frames++;
+  return ran ? SKYETEK_SUCCESS : last;
+}
+
+SKYETEK_API void
+SkyeTek_FreeOrchestrator(
+    LPSKYETEK_ORCHESTRATOR          lpOrchestrator
+    )
+{
+  LPORCHESTRATOR_STATE state;
+  unsigned int ix;
+
+  if( lpOrchestrator == NULL )
+    return;
+  state = (LPORCHESTRATOR_STATE)lpOrchestrator->internal;
+  if( state != NULL )
+  {
+    if( state->jobs != NULL )
+    {
+      for( ix = 0; ix < lpOrchestrator->count; ix++ )
+      {
+        if( state->jobs[ix].dwell.reads != NULL )
+          free(state->jobs[ix].dwell.reads);
+      }
+      free(state->jobs);
+    }
+    if( state->group != NULL )
+      free(state->group);
+    if( state->used != NULL )
+      free(state->used);
+    if( state->cursor != NULL )
+      free(state->cursor);
+    if( state->members != NULL )
+      free(state->members);
+    if( state->weight != NULL )
+      free(state->weight);
+    if( state->credit != NULL )
+      free(state->credit);
+    if( state->slots != NULL )
+      free(state->slots);
+    free(state);
+  }
+  if( lpOrchestrator->lpMembers != NULL )
+    free(lpOrchestrator->lpMembers);
+  if( lpOrchestrator->lpStats != NULL )
+    free(lpOrchestrator->lpStats);
+  free(lpOrchestrator);
+}
@@ -0,0 +1,359 @@
+/**
+ * SkyeTekParameterCache.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * System parameter cache. Each reader can keep the parameters listed
+ * in SysParmIds with a time to live per parameter; the reader layer
+ * looks here before going to the wire and drops entries the commands
+ * it sends may have changed.
+ */
+#include "../SkyeTekAPI.h"
+#include "Reader.h"
+#include "../Protocol/Protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+SKYETEK_STATUS
+STR_GetSystemAddrForParm(
+  SKYETEK_SYSTEM_PARAMETER  parameter,
+  LPSKYETEK_ADDRESS         lpAddr,
+  unsigned int              version
+  );
+
+typedef struct PARAMETER_ENTRY
+{
+  SKYETEK_SYSTEM_PARAMETER  parameter;
+  unsigned char             supported;  /* has an address in this protocol version */
+  unsigned long             ttl;        /* ms; 0 never to keep */
+  unsigned long             fetched;    /* SKYETEK_GetTickCount() when read */
+  LPSKYETEK_DATA            lpData;     /* NULL when not cached */
+} PARAMETER_ENTRY, *LPPARAMETER_ENTRY;
+
+typedef struct PARAMETER_CACHE
+{
+  PARAMETER_ENTRY           entries[NUM_SYSPARMDESCS];
+  MUTEX(lock);
+} PARAMETER_CACHE, *LPPARAMETER_CACHE;
+
+static LPPARAMETER_CACHE
+ParameterCache_Get(
+    LPSKYETEK_READER    lpReader
+    )
+{
+  return (LPPARAMETER_CACHE)SkyeTekReader_GetPrivate(lpReader, PRIVATE_PARAMETERS);
+}
+
+static unsigned long
+ParameterCache_DefaultTTL(
+    SKYETEK_SYSTEM_PARAMETER  parameter,
+    unsigned long             ttl
+    )
+{
+  switch(parameter)
+  {
+    /* Only a firmware upload changes these */
+    case SYS_SERIALNUMBER:
+    case SYS_FIRMWARE:
+    case SYS_HARDWARE:
+    case SYS_PRODUCT:
+      return SKYETEK_CACHE_FOREVER;
+    /* Inputs and radio state change on their own */
+    case SYS_PORT_VALUE:
+    case SYS_BOOTLOAD:
+    case SYS_CURRENT_FREQUENCY:
+      return 0;
+    default:
+      return ttl;
+  }
+}
+
+static LPPARAMETER_ENTRY
+ParameterCache_Find(
+    LPPARAMETER_CACHE         cache,
+    SKYETEK_SYSTEM_PARAMETER  parameter
+    )
+{
+  unsigned int ix;
+
+  for( ix = 0; ix < NUM_SYSPARMDESCS; ix++ )
+  {
+    if( cache->entries[ix].parameter == parameter )
+      return &cache->entries[ix];
+  }
+  return NULL;
+}
+
+/* Called with the lock held */
+static void
+ParameterCache_Drop(
+    LPPARAMETER_ENTRY   lpEntry
+    )
+{
+  if( lpEntry->lpData != NULL )
+  {
+    SkyeTek_FreeData(lpEntry->lpData);
+    lpEntry->lpData = NULL;
+  }
+}
+
+int
+SkyeTekReader_GetCachedParameter(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_SYSTEM_PARAMETER      parameter,
+    LPSKYETEK_DATA                *lpData
+    )
+{
+  LPPARAMETER_CACHE cache;
+  LPPARAMETER_ENTRY lpEntry;
+  LPSKYETEK_DATA lpCopy = NULL;
+
+  cache = ParameterCache_Get(lpReader);
+  if( cache == NULL || lpData == NULL )
+    return 0;
+
+  MUTEX_LOCK(&cache->lock);
+  lpEntry = ParameterCache_Find(cache, parameter);
+  if( lpEntry != NULL && lpEntry->lpData != NULL )
+  {
+    if( lpEntry->ttl != SKYETEK_CACHE_FOREVER &&
+        SKYETEK_GetTickCount() - lpEntry->fetched >= lpEntry->ttl )
+    {
+      ParameterCache_Drop(lpEntry);
+    }
+    else
+    {
+      lpCopy = SkyeTek_AllocateData(lpEntry->lpData->size);
+      if( lpCopy != NULL )
+        memcpy(lpCopy->data, lpEntry->lpData->data, lpEntry->lpData->size);
+    }
+  }
+  MUTEX_UNLOCK(&cache->lock);
+
+  if( lpCopy == NULL )
+    return 0;
+  *lpData = lpCopy;
+  return 1;
+}
+
+void
+SkyeTekReader_CacheParameter(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_SYSTEM_PARAMETER      parameter,
+    LPSKYETEK_DATA                lpData
+    )
+{
+  LPPARAMETER_CACHE cache;
+  LPPARAMETER_ENTRY lpEntry;
+  LPSKYETEK_DATA lpCopy;
+
+  if( lpData == NULL || lpData->size == 0 )
+    return;
+  cache = ParameterCache_Get(lpReader);
+  if( cache == NULL )
+    return;
+
+  MUTEX_LOCK(&cache->lock);
+  lpEntry = ParameterCache_Find(cache, parameter);
+  if( lpEntry != NULL && lpEntry->supported && lpEntry->ttl > 0 )
+  {
+    lpCopy = SkyeTek_AllocateData(lpData->size);
+    if( lpCopy != NULL )
+    {
+      memcpy(lpCopy->data, lpData->data, lpData->size);
+      ParameterCache_Drop(lpEntry);
+      lpEntry->lpData = lpCopy;
+      lpEntry->fetched = SKYETEK_GetTickCount();
+    }
+  }
+  MUTEX_UNLOCK(&cache->lock);
+}
+
+void
+SkyeTekReader_InvalidateParameter(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_SYSTEM_PARAMETER      parameter
+    )
+{
+  LPPARAMETER_CACHE cache;
+  LPPARAMETER_ENTRY lpEntry;
+
+  cache = ParameterCache_Get(lpReader);
+  if( cache == NULL )
+    return;
+  /* Bootload mode takes the reader away from its firmware */
+  if( parameter == SYS_BOOTLOAD )
+  {
+    SkyeTek_InvalidateParameterCache(lpReader);
+    return;
+  }
+  MUTEX_LOCK(&cache->lock);
+  lpEntry = ParameterCache_Find(cache, parameter);
+  if( lpEntry != NULL )
+    ParameterCache_Drop(lpEntry);
+  MUTEX_UNLOCK(&cache->lock);
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_EnableParameterCache(
+    LPSKYETEK_READER    lpReader,
+    unsigned long       ttl
+    )
+{
+  LPPARAMETER_CACHE cache;
+  LPPARAMETER_ENTRY lpEntry;
+  SKYETEK_ADDRESS addr;
+  unsigned int ix;
+
+  if( lpReader == NULL || lpReader->lpProtocol == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  /* Already on; apply the new time to live to the volatile parameters */
+  cache = ParameterCache_Get(lpReader);
+  if( cache != NULL )
+  {
+    MUTEX_LOCK(&cache->lock);
+    for( ix = 0; ix < NUM_SYSPARMDESCS; ix++ )
+    {
+      lpEntry = &cache->entries[ix];
+      lpEntry->ttl = ParameterCache_DefaultTTL(lpEntry->parameter, ttl);
+      if( lpEntry->ttl == 0 )
+        ParameterCache_Drop(lpEntry);
+    }
+    MUTEX_UNLOCK(&cache->lock);
+    return SKYETEK_SUCCESS;
+  }
+
+  cache = (LPPARAMETER_CACHE)malloc(sizeof(PARAMETER_CACHE));
+  if( cache == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  memset(cache, 0, sizeof(PARAMETER_CACHE));
+  for( ix = 0; ix < NUM_SYSPARMDESCS; ix++ )
+  {
+    lpEntry = &cache->entries[ix];
+    lpEntry->parameter = SysParmIds[ix].parameter;
+    lpEntry->supported = (STR_GetSystemAddrForParm(lpEntry->parameter, &addr,
+      lpReader->lpProtocol->version) == SKYETEK_SUCCESS);
+    lpEntry->ttl = ParameterCache_DefaultTTL(lpEntry->parameter, ttl);
+  }
+  MUTEX_CREATE(&cache->lock);
+  if( SkyeTekReader_SetPrivate(lpReader, PRIVATE_PARAMETERS, cache) != SKYETEK_SUCCESS )
+  {
+    MUTEX_DESTROY(&cache->lock);
+    free(cache);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_SetParameterTTL(
+    LPSKYETEK_READER            lpReader,
+    SKYETEK_SYSTEM_PARAMETER    parameter,
+    unsigned long               ttl
+    )
+{
+  LPPARAMETER_CACHE cache;
+  LPPARAMETER_ENTRY lpEntry;
+
+  cache = ParameterCache_Get(lpReader);
+  if( cache == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  MUTEX_LOCK(&cache->lock);
+  lpEntry = ParameterCache_Find(cache, parameter);
+  if( lpEntry != NULL )
+  {
+    lpEntry->ttl = ttl;
+    if( ttl == 0 )
+      ParameterCache_Drop(lpEntry);
+  }
+  MUTEX_UNLOCK(&cache->lock);
+  return (lpEntry != NULL) ? SKYETEK_SUCCESS : SKYETEK_INVALID_PARAMETER;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_PrefetchParameters(
+    LPSKYETEK_READER    lpReader,
+    unsigned int        *lpCount
+    )
+{
+  LPPARAMETER_CACHE cache;
+  SKYETEK_BATCH_OPERATION ops[NUM_SYSPARMDESCS];
+  SKYETEK_STATUS statuses[NUM_SYSPARMDESCS];
+  SKYETEK_STATUS status;
+  unsigned int ix, count = 0, read = 0;
+
+  if( lpCount != NULL )
+    *lpCount = 0;
+  cache = ParameterCache_Get(lpReader);
+  if( cache == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  /* Drop what is there so readers without pipelining go to the wire too */
+  memset(ops, 0, sizeof(ops));
+  MUTEX_LOCK(&cache->lock);
+  for( ix = 0; ix < NUM_SYSPARMDESCS; ix++ )
+  {
+    if( !cache->entries[ix].supported || cache->entries[ix].ttl == 0 )
+      continue;
+    ParameterCache_Drop(&cache->entries[ix]);
+    ops[count].command = BATCH_GET_SYSTEM_PARAMETER;
+    ops[count].parameter = cache->entries[ix].parameter;
+    count++;
+  }
+  MUTEX_UNLOCK(&cache->lock);
+  if( count == 0 )
+    return SKYETEK_SUCCESS;
+
+  status = SkyeTek_ExecuteBatch(lpReader, ops, count, statuses);
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( ops[ix].lpData == NULL )
+      continue;
+    if( status == SKYETEK_SUCCESS && statuses[ix] == SKYETEK_SUCCESS )
+    {
+      SkyeTekReader_CacheParameter(lpReader, ops[ix].parameter, ops[ix].lpData);
+      read++;
+    }
+    SkyeTek_FreeData(ops[ix].lpData);
+  }
+  if( lpCount != NULL )
+    *lpCount = read;
+  return status;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_InvalidateParameterCache(
+    LPSKYETEK_READER    lpReader
+    )
+{
+  LPPARAMETER_CACHE cache;
+  unsigned int ix;
+
+  cache = ParameterCache_Get(lpReader);
+  if( cache == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  MUTEX_LOCK(&cache->lock);
+  for( ix = 0; ix < NUM_SYSPARMDESCS; ix++ )
+    ParameterCache_Drop(&cache->entries[ix]);
+  MUTEX_UNLOCK(&cache->lock);
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API void
+SkyeTek_DisableParameterCache(
+    LPSKYETEK_READER    lpReader
+    )
+{
+  LPPARAMETER_CACHE cache;
+  unsigned int ix;
+
+  cache = (LPPARAMETER_CACHE)SkyeTekReader_TakePrivate(lpReader, PRIVATE_PARAMETERS);
+  if( cache == NULL )
+    return;
+  for( ix = 0; ix < NUM_SYSPARMDESCS; ix++ )
+    ParameterCache_Drop(&cache->entries[ix]);
+  MUTEX_DESTROY(&cache->lock);
+  free(cache);
+}
@@ -0,0 +1,336 @@
+/**
+ * SkyeTekPartition.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Partitioned inventory. The ID space is walked as a tree of TID mask
+ * prefixes, going deeper only where a partition is too dense for the
+ * reader, and the partitions are shared by every reader that covers
+ * the zone. Masks are whole bytes, so a partition is split into all
+ * 256 values of its next byte; a tag the reader did not return is still
+ * in one of them. A masked inventory that finds nothing ends on the
+ * timeout and succeeds, so only a real failure is retried or split.
+ */
+#include "../SkyeTekAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PARTITION_MAX_DEPTH   16          /* longest TID mask STPv3 sends */
+#define PARTITION_IDLE        10          /* ms a worker waits for other workers to split */
+#define PARTITION_WINDOW      0x7FFFFFFF  /* tags never depart from the merged set */
+#define PARTITION_RETRIES     2           /* times a failed partition is run again before it splits */
+
+typedef struct PARTITION
+{
+  unsigned char         prefix[PARTITION_MAX_DEPTH];
+  unsigned int          depth;
+  unsigned int          retries;
+} PARTITION, *LPPARTITION;
+
+typedef struct PARTITION_CONTEXT
+{
+  SKYETEK_TAGTYPE           tagType;
+  unsigned int              maxDepth;
+  unsigned int              splitThreshold;
+  LPPARTITION               queue;
+  unsigned int              head;
+  unsigned int              tail;
+  unsigned int              capacity;
+  unsigned int              busy;       /* partitions being inventoried */
+  LPSKYETEK_AGGREGATOR      lpAgg;
+  SKYETEK_PARTITION_STATS   stats;
+  SKYETEK_STATUS            status;
+  MUTEX(lock);
+} PARTITION_CONTEXT, *LPPARTITION_CONTEXT;
+
+typedef struct PARTITION_WORKER
+{
+  LPPARTITION_CONTEXT       ctx;
+  LPSKYETEK_READER          lpReader;
+} PARTITION_WORKER, *LPPARTITION_WORKER;
+
+/* Called with the lock held */
+static int
+Partition_Push(
+    LPPARTITION_CONTEXT   ctx,
+    LPPARTITION           lpPart
+    )
+{
+  LPPARTITION queue;
+  unsigned int capacity;
+
+  if( ctx->tail == ctx->capacity )
+  {
+    /* Reclaim the taken entries before growing */
+    if( ctx->head > 0 )
+    {
+      memmove(ctx->queue, ctx->queue + ctx->head, (ctx->tail - ctx->head) * sizeof(PARTITION));
+      ctx->tail -= ctx->head;
+      ctx->head = 0;
+    }
+    if( ctx->tail == ctx->capacity )
+    {
+      capacity = ctx->capacity ? ctx->capacity * 2 : 512;
+      queue = (LPPARTITION)realloc(ctx->queue, capacity * sizeof(PARTITION));
+      if( queue == NULL )
+        return 0;
+      ctx->queue = queue;
+      ctx->capacity = capacity;
+    }
+  }
+  memcpy(&ctx->queue[ctx->tail++], lpPart, sizeof(PARTITION));
+  return 1;
+}
+
+static SKYETEK_STATUS
+Partition_Merge(
+    LPPARTITION_CONTEXT   ctx,
+    LPSKYETEK_READER      lpReader,
+    LPSKYETEK_TAG_SET     lpSet
+    )
+{
+  SKYETEK_TAG_VIEW view;
+  SKYETEK_STATUS status;
+  unsigned int ix;
+
+  view.timestamp = SKYETEK_GetTickCount();
+  for( ix = 0; ix < lpSet->count; ix++ )
+  {
+    view.type = lpSet->tags[ix].type;
+    view.id = lpSet->tags[ix].id;
+    view.length = lpSet->tags[ix].length;
+    if( view.length == 0 )
+      continue;
+    status = SkyeTek_AggregateTag(ctx->lpAgg, lpReader, &view, 0, SKYETEK_NO_RSSI);
+    if( status != SKYETEK_SUCCESS )
+      return status;
+  }
+  return SKYETEK_SUCCESS;
+}
+
+/* Called with the lock held; queues the 256 sub-partitions of lpPart */
+static int
+Partition_Split(
+    LPPARTITION_CONTEXT   ctx,
+    LPPARTITION           lpPart
+    )
+{
+  PARTITION child;
+  unsigned int ix;
+
+  memcpy(&child, lpPart, sizeof(PARTITION));
+  child.depth = lpPart->depth + 1;
+  child.retries = 0;
+  for( ix = 0; ix < 256; ix++ )
+  {
+    child.prefix[lpPart->depth] = (unsigned char)ix;
+    if( !Partition_Push(ctx, &child) )
+      return 0;
+  }
+  ctx->stats.splits++;
+  return 1;
+}
+
+static void
+Partition_Inventory(
+    LPPARTITION_CONTEXT   ctx,
+    LPSKYETEK_READER      lpReader,
+    LPPARTITION           lpPart
+    )
+{
+  LPSKYETEK_TAG_SET lpSet = NULL;
+  SKYETEK_STATUS status, merged = SKYETEK_SUCCESS;
+  SKYETEK_ID mask;
+  unsigned int found = 0;
+  int pushed = 1;
+
+  mask.id = lpPart->prefix;
+  mask.length = lpPart->depth;
+  status = SkyeTek_GetTagSet(lpReader, ctx->tagType, (lpPart->depth > 0) ? &mask : NULL, &lpSet);
+  if( status == SKYETEK_SUCCESS )
+  {
+    found = lpSet->count;
+    merged = Partition_Merge(ctx, lpReader, lpSet);
+    SkyeTek_FreeTagSet(lpSet);
+  }
+
+  MUTEX_LOCK(&ctx->lock);
+  ctx->stats.partitions++;
+  if( merged != SKYETEK_SUCCESS )
+    ctx->status = merged;
+  if( status == SKYETEK_SUCCESS )
+  {
+    /* Too dense; the reader may have missed some of its tags */
+    if( ctx->splitThreshold > 0 && found >= ctx->splitThreshold &&
+        lpPart->depth < ctx->maxDepth )
+      pushed = Partition_Split(ctx, lpPart);
+  }
+  else if( lpPart->retries < PARTITION_RETRIES )
+  {
+    lpPart->retries++;
+    ctx->stats.retries++;
+    pushed = Partition_Push(ctx, lpPart);
+  }
+  else if( lpPart->depth < ctx->maxDepth )
+  {
+    /* Smaller partitions may get through where this one did not */
+    pushed = Partition_Split(ctx, lpPart);
+  }
+  else
+  {
+    ctx->stats.failures++;
+    ctx->stats.lastFailure = status;
+  }
+  if( !pushed )
+    ctx->status = SKYETEK_OUT_OF_MEMORY;
+  ctx->busy--;
+  MUTEX_UNLOCK(&ctx->lock);
+}
+
+static THREAD_RETURN
+Partition_Worker(
+    void      *user
+    )
+{
+  LPPARTITION_WORKER lpWorker = (LPPARTITION_WORKER)user;
+  LPPARTITION_CONTEXT ctx = lpWorker->ctx;
+  PARTITION part;
+  int have, done;
+
+  for(;;)
+  {
+    MUTEX_LOCK(&ctx->lock);
+    have = (ctx->head < ctx->tail && ctx->status == SKYETEK_SUCCESS);
+    if( have )
+    {
+      memcpy(&part, &ctx->queue[ctx->head++], sizeof(PARTITION));
+      ctx->busy++;
+    }
+    done = !have && ctx->busy == 0;
+    MUTEX_UNLOCK(&ctx->lock);
+
+    if( done )
+      break;
+    if( have )
+      Partition_Inventory(ctx, lpWorker->lpReader, &part);
+    else
+      SKYETEK_Sleep(PARTITION_IDLE);  /* another worker may still split */
+  }
+  return 0;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_GetTagSetPartitioned(
+    LPSKYETEK_READER            *lpReaders,
+    unsigned int                count,
+    SKYETEK_TAGTYPE             tagType,
+    unsigned int                maxDepth,
+    unsigned int                splitThreshold,
+    LPSKYETEK_TAG_SET           *lpSet,
+    LPSKYETEK_PARTITION_STATS   lpStats
+    )
+{
+  PARTITION_CONTEXT ctx;
+  PARTITION root;
+  LPPARTITION_WORKER workers = NULL;
+  THREAD(*threads) = NULL;
+  LPSKYETEK_TAG_STATS lpTags = NULL;
+  LPSKYETEK_TAG_SET lpNew = NULL;
+  SKYETEK_STATUS status;
+  unsigned int ix, started = 0, num = 0;
+
+  if( lpReaders == NULL || count == 0 || lpSet == NULL ||
+      maxDepth < 1 || maxDepth > PARTITION_MAX_DEPTH )
+    return SKYETEK_INVALID_PARAMETER;
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( lpReaders[ix] == NULL || lpReaders[ix]->internal == NULL )
+      return SKYETEK_INVALID_PARAMETER;
+  }
+
+  memset(&ctx, 0, sizeof(PARTITION_CONTEXT));
+  ctx.tagType = tagType;
+  ctx.maxDepth = maxDepth;
+  ctx.splitThreshold = splitThreshold;
+  ctx.status = SKYETEK_SUCCESS;
+  ctx.stats.lastFailure = SKYETEK_SUCCESS;
+  status = SkyeTek_CreateAggregator(WINDOW_PRESENCE, PARTITION_WINDOW, NULL, NULL, &ctx.lpAgg);
+  if( status != SKYETEK_SUCCESS )
+    return status;
+  workers = (LPPARTITION_WORKER)malloc(count * sizeof(PARTITION_WORKER));
+  memset(&root, 0, sizeof(PARTITION));
+  if( workers == NULL || !Partition_Push(&ctx, &root) )
+  {
+    status = SKYETEK_OUT_OF_MEMORY;
+    goto cleanup;
+  }
+  MUTEX_CREATE(&ctx.lock);
+
+  /* One worker per reader; the calling thread drives the first reader */
+  for( ix = 0; ix < count; ix++ )
+  {
+    workers[ix].ctx = &ctx;
+    workers[ix].lpReader = lpReaders[ix];
+  }
+  if( count > 1 )
+  {
+    threads = malloc((count - 1) * sizeof(*threads));
+    if( threads != NULL )
+    {
+      for( ix = 1; ix < count; ix++ )
+      {
+        if( !THREAD_CREATE(&threads[started], Partition_Worker, &workers[ix]) )
+          break;
+        started++;
+      }
+    }
+  }
+  Partition_Worker(&workers[0]);
+  for( ix = 0; ix < started; ix++ )
+    THREAD_JOIN(&threads[ix]);
+  MUTEX_DESTROY(&ctx.lock);
+
+  status = ctx.status;
+  if( status != SKYETEK_SUCCESS )
+    goto cleanup;
+
+  /* Copy the merged tags into one set */
+  num = ctx.lpAgg->count;
+  lpNew = (LPSKYETEK_TAG_SET)malloc(sizeof(SKYETEK_TAG_SET) + num * sizeof(SKYETEK_TAG_RECORD));
+  if( num > 0 )
+    lpTags = (LPSKYETEK_TAG_STATS)malloc(num * sizeof(SKYETEK_TAG_STATS));
+  if( lpNew == NULL || (num > 0 && lpTags == NULL) )
+  {
+    status = SKYETEK_OUT_OF_MEMORY;
+    goto cleanup;
+  }
+  lpNew->tags = (LPSKYETEK_TAG_RECORD)(lpNew + 1);
+  lpNew->capacity = num;
+  lpNew->count = 0;
+  if( num > 0 )
+    SkyeTek_GetAggregatedTags(ctx.lpAgg, lpTags, num, &lpNew->count);
+  for( ix = 0; ix < lpNew->count; ix++ )
+  {
+    lpNew->tags[ix].type = lpTags[ix].type;
+    lpNew->tags[ix].length = lpTags[ix].length;
+    memcpy(lpNew->tags[ix].id, lpTags[ix].id, lpTags[ix].length);
+  }
+  *lpSet = lpNew;
+  lpNew = NULL;
+  if( lpStats != NULL )
+    memcpy(lpStats, &ctx.stats, sizeof(SKYETEK_PARTITION_STATS));
+
+cleanup:
+  if( lpNew != NULL )
+    free(lpNew);
+  if( lpTags != NULL )
+    free(lpTags);
+  if( threads != NULL )
+    free(threads);
+  if( workers != NULL )
+    free(workers);
+  if( ctx.queue != NULL )
+    free(ctx.queue);
+  SkyeTek_FreeAggregator(ctx.lpAgg);
+  return status;
+}
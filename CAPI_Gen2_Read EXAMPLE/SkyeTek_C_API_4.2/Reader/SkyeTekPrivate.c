@@ -0,0 +1,127 @@
+/**
+ * SkyeTekPrivate.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * State the library keeps for a reader or its protocol between calls.
+ * It is held here, keyed on the owning struct, so the public structs
+ * keep their layout. Copies of a reader struct have none.
+ */
+#include "../SkyeTekAPI.h"
+#include "Reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct PRIVATE_ENTRY
+{
+  const void            *owner;
+  int                   kind;
+  void                  *data;
+} PRIVATE_ENTRY, *LPPRIVATE_ENTRY;
+
+static LPPRIVATE_ENTRY g_private = NULL;
+static unsigned int g_privateCount = 0;
+static unsigned int g_privateCapacity = 0;
+static STATIC_MUTEX(g_privateLock);
+
+/* Called with the lock held */
+static LPPRIVATE_ENTRY
+Private_Find(
+    const void    *owner,
+    int           kind
+    )
+{
+  unsigned int ix;
+  for( ix = 0; ix < g_privateCount; ix++ )
+  {
+    if( g_private[ix].owner == owner && g_private[ix].kind == kind )
+      return &g_private[ix];
+  }
+  return NULL;
+}
+
+void *
+SkyeTekReader_GetPrivate(
+    const void    *owner,
+    int           kind
+    )
+{
+  LPPRIVATE_ENTRY lpEntry;
+  void *data = NULL;
+
+  if( owner == NULL )
+    return NULL;
+  STATIC_MUTEX_LOCK(&g_privateLock);
+  lpEntry = Private_Find(owner, kind);
+  if( lpEntry != NULL )
+    data = lpEntry->data;
+  STATIC_MUTEX_UNLOCK(&g_privateLock);
+  return data;
+}
+
+SKYETEK_STATUS
+SkyeTekReader_SetPrivate(
+    const void    *owner,
+    int           kind,
+    void          *data
+    )
+{
+  LPPRIVATE_ENTRY lpEntry, entries;
+  unsigned int capacity;
+  SKYETEK_STATUS status = SKYETEK_SUCCESS;
+
+  if( owner == NULL || data == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  STATIC_MUTEX_LOCK(&g_privateLock);
+  lpEntry = Private_Find(owner, kind);
+  if( lpEntry == NULL && g_privateCount == g_privateCapacity )
+  {
+    capacity = g_privateCapacity ? g_privateCapacity * 2 : 16;
+    entries = (LPPRIVATE_ENTRY)realloc(g_private, capacity * sizeof(PRIVATE_ENTRY));
+    if( entries == NULL )
+      status = SKYETEK_OUT_OF_MEMORY;
+    else
+    {
+      g_private = entries;
+      g_privateCapacity = capacity;
+    }
+  }
+  if( status == SKYETEK_SUCCESS )
+  {
+    if( lpEntry == NULL )
+      lpEntry = &g_private[g_privateCount++];
+    lpEntry->owner = owner;
+    lpEntry->kind = kind;
+    lpEntry->data = data;
+  }
+  STATIC_MUTEX_UNLOCK(&g_privateLock);
+  return status;
+}
+
+void *
+SkyeTekReader_TakePrivate(
+    const void    *owner,
+    int           kind
+    )
+{
+  LPPRIVATE_ENTRY lpEntry;
+  void *data = NULL;
+
+  if( owner == NULL )
+    return NULL;
+  STATIC_MUTEX_LOCK(&g_privateLock);
+  lpEntry = Private_Find(owner, kind);
+  if( lpEntry != NULL )
+  {
+    data = lpEntry->data;
+    *lpEntry = g_private[--g_privateCount];
+  }
+  if( g_privateCount == 0 && g_private != NULL )
+  {
+    free(g_private);
+    g_private = NULL;
+    g_privateCapacity = 0;
+  }
+  STATIC_MUTEX_UNLOCK(&g_privateLock);
+  return data;
+}
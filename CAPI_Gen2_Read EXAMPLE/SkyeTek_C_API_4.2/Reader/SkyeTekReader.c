@@ -10,8 +10,10 @@
 #include "../Device/Device.h"
 #include "../Protocol/Protocol.h"
 #include "../Tag/TagFactory.h"
+#include "../Tag/Tag.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define SKYETEK_TIMEOUT 500
 
@@ -76,6 +78,62 @@ SkyeTekReader_SelectTags(
   return lppi->SelectTags(lpReader,tagType,SkyeTekReader_SelectTagsCallback,flags,(void *)&cd,2000);
 }
 
+typedef struct ST_VIEW_CALLBACK_DATA
+{
+  SKYETEK_TAG_VIEW_CALLBACK     callback;
+  void                          *user;
+} ST_VIEW_CALLBACK_DATA, *LPST_VIEW_CALLBACK_DATA;
+
+unsigned char 
+SkyeTekReader_SelectTagViewsCallback(
+    SKYETEK_TAGTYPE type,
+    LPSKYETEK_DATA lpData,
+    void  *user
+    )
+{
+  LPST_VIEW_CALLBACK_DATA lpCd;
+  SKYETEK_TAG_VIEW view;
+  
+  if( user == NULL )
+    return 0;
+
+  lpCd = (LPST_VIEW_CALLBACK_DATA)user;
+  if( lpData == NULL || lpData->data == NULL || lpData->size == 0 )
+    return lpCd->callback(NULL,lpCd->user);
+
+  view.type = type;
+  view.id = lpData->data;
+  view.length = lpData->size;
+  view.timestamp = SKYETEK_GetTickCount();
+  return lpCd->callback(&view,lpCd->user);
+}
+
+SKYETEK_STATUS 
+SkyeTekReader_SelectTagViews(
+    LPSKYETEK_READER            lpReader, 
+    SKYETEK_TAGTYPE             tagType, 
+    SKYETEK_TAG_VIEW_CALLBACK   callback, 
+    unsigned char               inv, 
+    unsigned char               loop, 
+    void                        *user
+    )
+{
+  LPPROTOCOLIMPL lppi;
+  PROTOCOL_FLAGS flags;
+  ST_VIEW_CALLBACK_DATA cd;
+
+  if( lpReader == NULL || lpReader->lpProtocol == NULL || lpReader->lpDevice == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  
+  flags.isInventory = inv;
+  flags.isLoop = loop;
+  cd.callback = callback;
+  cd.user = user;
+
+  lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  return lppi->SelectTags(lpReader,tagType,SkyeTekReader_SelectTagViewsCallback,flags,(void *)&cd,2000);
+}
+
 SKYETEK_STATUS 
 SkyeTekReader_GetTags(
     LPSKYETEK_READER   lpReader, 
@@ -205,6 +263,210 @@ cleanup:
   return status;
 }
 
+#define TAG_SET_INITIAL 32
+
+/* The records follow the set in the same block */
+static LPSKYETEK_TAG_SET
+SkyeTekReader_GrowTagSet(
+    LPSKYETEK_TAG_SET   lpSet,
+    unsigned int        capacity
+    )
+{
+  LPSKYETEK_TAG_SET lpNew;
+
+  lpNew = (LPSKYETEK_TAG_SET)realloc(lpSet, sizeof(SKYETEK_TAG_SET) + capacity * sizeof(SKYETEK_TAG_RECORD));
+  if( lpNew == NULL )
+    return NULL;
+  if( lpSet == NULL )
+    lpNew->count = 0;
+  lpNew->capacity = capacity;
+  lpNew->tags = (LPSKYETEK_TAG_RECORD)(lpNew + 1);
+  return lpNew;
+}
+
+typedef struct ST_TAG_SET_DATA
+{
+  LPSKYETEK_TAG_SET   lpSet;
+  SKYETEK_STATUS      status;
+} ST_TAG_SET_DATA, *LPST_TAG_SET_DATA;
+
+static unsigned char 
+SkyeTekReader_AddToTagSet(
+    SKYETEK_TAGTYPE type,
+    LPSKYETEK_DATA lpData,
+    void  *user
+    )
+{
+  LPST_TAG_SET_DATA lpSd = (LPST_TAG_SET_DATA)user;
+  LPSKYETEK_TAG_SET lpNew;
+  LPSKYETEK_TAG_RECORD lpRec;
+
+  if( lpData == NULL )
+    return 1;
+  if( lpSd->lpSet->count == lpSd->lpSet->capacity )
+  {
+    lpNew = SkyeTekReader_GrowTagSet(lpSd->lpSet, lpSd->lpSet->capacity * 2);
+    if( lpNew == NULL )
+    {
+      lpSd->status = SKYETEK_OUT_OF_MEMORY;
+      return 0;
+    }
+    lpSd->lpSet = lpNew;
+  }
+
+  lpRec = &lpSd->lpSet->tags[lpSd->lpSet->count++];
+  lpRec->type = type;
+  lpRec->length = lpData->size;
+  if( lpRec->length > SKYETEK_MAX_TAG_LENGTH )
+    lpRec->length = SKYETEK_MAX_TAG_LENGTH;
+  if( lpData->data != NULL && lpRec->length > 0 )
+    memcpy(lpRec->id, lpData->data, lpRec->length);
+  return 1;
+}
+
+SKYETEK_STATUS 
+SkyeTekReader_GetTagSet(
+    LPSKYETEK_READER   lpReader, 
+    SKYETEK_TAGTYPE    tagType, 
+    LPSKYETEK_ID       lpTagIdMask,
+    LPSKYETEK_TAG_SET  *lpSet
+    )
+{
+  LPPROTOCOLIMPL lppi;
+  ST_TAG_SET_DATA sd;
+  unsigned int num = 0;
+  unsigned int ix = 0;
+  LPTAGTYPE_ARRAY *tagTypes = NULL;
+  LPSKYETEK_DATA *lpData = NULL;
+  SKYETEK_STATUS status;
+
+  if( lpReader == NULL || lpReader->lpProtocol == NULL || lpReader->lpDevice == NULL || lpSet == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  sd.lpSet = SkyeTekReader_GrowTagSet(NULL, TAG_SET_INITIAL);
+  if( sd.lpSet == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  sd.status = SKYETEK_SUCCESS;
+
+  lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  if( lppi->InventoryTags != NULL )
+  {
+    status = lppi->InventoryTags(lpReader,tagType,lpTagIdMask,SkyeTekReader_AddToTagSet,&sd,5000);
+  }
+  else
+  {
+    /* Copy from the tag list of protocols that only return one */
+    if( lpTagIdMask != NULL )
+      status = lppi->GetTagsWithMask(lpReader,tagType,lpTagIdMask,&tagTypes,&lpData,&num,5000);
+    else
+      status = lppi->GetTags(lpReader,tagType,&tagTypes,&lpData,&num,5000);
+
+    /* On failure the protocol has already freed the lists */
+    if( status == SKYETEK_SUCCESS )
+    {
+      for( ix = 0; ix < num; ix++ )
+      {
+        if( sd.status == SKYETEK_SUCCESS )
+          SkyeTekReader_AddToTagSet(tagTypes[ix]->type, lpData[ix], &sd);
+        free(tagTypes[ix]);
+        SkyeTek_FreeData(lpData[ix]);
+      }
+      if( lpData != NULL )
+        free(lpData);
+      if( tagTypes != NULL )
+        free(tagTypes);
+    }
+  }
+
+  if( status == SKYETEK_SUCCESS )
+    status = sd.status;
+  if( status != SKYETEK_SUCCESS )
+  {
+    free(sd.lpSet);
+    return status;
+  }
+  *lpSet = sd.lpSet;
+  return SKYETEK_SUCCESS;
+}
+
+#define DWELL_SLICE   50    /* ms the select loop waits before checking the dwell */
+#define DWELL_TIMEOUT 2000  /* ms for a single inventory when the dwell is 0 */
+#define DWELL_INITIAL 64
+
+static unsigned char 
+SkyeTekReader_AddToDwell(
+    SKYETEK_TAGTYPE type,
+    LPSKYETEK_DATA lpData,
+    void  *user
+    )
+{
+  LPREADER_DWELL lpDwell = (LPREADER_DWELL)user;
+  LPSKYETEK_TAG_READ reads, lpRead;
+  unsigned int capacity;
+
+  if( lpData != NULL && lpData->data != NULL && lpData->size > 0 )
+  {
+    if( lpDwell->count == lpDwell->capacity )
+    {
+      capacity = lpDwell->capacity ? lpDwell->capacity * 2 : DWELL_INITIAL;
+      reads = (LPSKYETEK_TAG_READ)realloc(lpDwell->reads, capacity * sizeof(SKYETEK_TAG_READ));
+      if( reads == NULL )
+      {
+        lpDwell->full = 1;
+        return 0;
+      }
+      lpDwell->reads = reads;
+      lpDwell->capacity = capacity;
+    }
+    lpRead = &lpDwell->reads[lpDwell->count++];
+    lpRead->type = type;
+    lpRead->timestamp = SKYETEK_GetTickCount();
+    lpRead->length = lpData->size;
+    if( lpRead->length > SKYETEK_TAG_READ_ID_SIZE )
+      lpRead->length = SKYETEK_TAG_READ_ID_SIZE;
+    memcpy(lpRead->id, lpData->data, lpRead->length);
+  }
+  /* A single inventory runs until the reader says it is done */
+  if( !lpDwell->loop )
+    return 1;
+  return ((long)(SKYETEK_GetTickCount() - lpDwell->deadline) < 0);
+}
+
+SKYETEK_STATUS 
+SkyeTekReader_Dwell(
+    LPSKYETEK_READER   lpReader, 
+    SKYETEK_TAGTYPE    tagType, 
+    unsigned long      dwell,
+    LPREADER_DWELL     lpDwell
+    )
+{
+  LPPROTOCOLIMPL lppi;
+  PROTOCOL_FLAGS flags;
+  SKYETEK_STATUS status;
+  unsigned int timeout = DWELL_TIMEOUT;
+
+  if( lpReader == NULL || lpReader->lpProtocol == NULL || lpReader->lpDevice == NULL || lpDwell == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+
+  memset(&flags, 0, sizeof(PROTOCOL_FLAGS));
+  flags.isInventory = 1;
+  if( dwell > 0 )
+  {
+    flags.isLoop = 1;
+    timeout = (dwell < DWELL_SLICE) ? (unsigned int)dwell : DWELL_SLICE;
+  }
+  lpDwell->count = 0;
+  lpDwell->full = 0;
+  lpDwell->loop = flags.isLoop;
+  lpDwell->deadline = SKYETEK_GetTickCount() + dwell;
+
+  lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  status = lppi->SelectTags(lpReader,tagType,SkyeTekReader_AddToDwell,flags,lpDwell,timeout);
+  if( status == SKYETEK_SUCCESS && lpDwell->full )
+    status = SKYETEK_OUT_OF_MEMORY;
+  return status;
+}
+
 SKYETEK_STATUS 
 SkyeTekReader_FreeTags(
     LPSKYETEK_READER   lpReader, 
@@ -232,6 +494,7 @@ SkyeTekReader_StoreKey(
 {
   LPPROTOCOLIMPL lppi;
   SKYETEK_ADDRESS addr;
+  SKYETEK_STATUS status;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
     lpReader->lpDevice == NULL || lpKey == NULL || lpKey->lpData == NULL )
@@ -241,7 +504,10 @@ SkyeTekReader_StoreKey(
   addr.start = lpKey->number;
   addr.blocks = 1;
 
-  return lppi->StoreKey(lpReader,type,&addr,lpKey->lpData,SKYETEK_TIMEOUT);
+  status = lppi->StoreKey(lpReader,type,&addr,lpKey->lpData,SKYETEK_TIMEOUT);
+  SkyeTekReader_KeyStored(lpReader,type,lpKey->number,
+    (status == SKYETEK_SUCCESS) ? lpKey->lpData : NULL);
+  return status;
 }
 
 SKYETEK_STATUS 
@@ -252,6 +518,7 @@ SkyeTekReader_LoadKey(
 {
   LPPROTOCOLIMPL lppi;
   SKYETEK_ADDRESS addr;
+  SKYETEK_STATUS status;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
     lpReader->lpDevice == NULL || lpKey == NULL )
@@ -261,7 +528,9 @@ SkyeTekReader_LoadKey(
   addr.start = lpKey->number;
   addr.blocks = 1;
 
-  return lppi->LoadKey(lpReader,&addr,500);
+  status = lppi->LoadKey(lpReader,&addr,500);
+  SkyeTekReader_KeyLoaded(lpReader,(status == SKYETEK_SUCCESS) ? lpKey->number : -1);
+  return status;
 }
 
 SKYETEK_STATUS 
@@ -273,6 +542,8 @@ SkyeTekReader_LoadDefaults(
   if( lpReader == NULL || lpReader->lpProtocol == NULL || lpReader->lpDevice == NULL )
     return SKYETEK_INVALID_PARAMETER;
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  SkyeTek_InvalidateParameterCache(lpReader);
+  SkyeTekReader_InvalidateKeys(lpReader);
   return lppi->LoadDefaults(lpReader,SKYETEK_TIMEOUT);
 }
 
@@ -285,6 +556,8 @@ SkyeTekReader_ResetDevice(
   if( lpReader == NULL || lpReader->lpProtocol == NULL || lpReader->lpDevice == NULL )
     return SKYETEK_INVALID_PARAMETER;
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  SkyeTek_InvalidateParameterCache(lpReader);
+  SkyeTekReader_InvalidateKeys(lpReader);
   return lppi->ResetDevice(lpReader,2000);
 }
 
@@ -297,6 +570,8 @@ SkyeTekReader_Bootload(
   if( lpReader == NULL || lpReader->lpProtocol == NULL || lpReader->lpDevice == NULL )
     return SKYETEK_INVALID_PARAMETER;
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  SkyeTek_InvalidateParameterCache(lpReader);
+  SkyeTekReader_InvalidateKeys(lpReader);
   return lppi->Bootload(lpReader,100);
 }
 
@@ -431,6 +706,8 @@ SkyeTekReader_GetSystemParameter(
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
       lpReader->lpDevice == NULL || lpData == NULL )
     return SKYETEK_INVALID_PARAMETER;
+  if( SkyeTekReader_GetCachedParameter(lpReader,parameter,lpData) )
+    return SKYETEK_SUCCESS;
   
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   if( (st = STR_GetSystemAddrForParm(parameter,&addr,lpReader->lpProtocol->version)) != SKYETEK_SUCCESS )
@@ -438,8 +715,10 @@ SkyeTekReader_GetSystemParameter(
   if( parameter == SYS_OPTIMAL_POWER_C1G1 || parameter == SYS_OPTIMAL_POWER_C1G2 || 
     parameter == SYS_OPTIMAL_POWER_180006B || parameter == SYS_RSSI_VALUES )
     return lppi->GetSystemParameter(lpReader,&addr,lpData,10000);
-  else
-    return lppi->GetSystemParameter(lpReader,&addr,lpData,SKYETEK_TIMEOUT);
+  st = lppi->GetSystemParameter(lpReader,&addr,lpData,SKYETEK_TIMEOUT);
+  if( st == SKYETEK_SUCCESS )
+    SkyeTekReader_CacheParameter(lpReader,parameter,*lpData);
+  return st;
 }
 
 SKYETEK_STATUS 
@@ -458,6 +737,8 @@ SkyeTekReader_SetSystemParameter(
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   if( (st = STR_GetSystemAddrForParm(parameter,&addr,lpReader->lpProtocol->version)) != SKYETEK_SUCCESS )
     return st;
+  /* Dropped even if the set fails; the reader may have taken it */
+  SkyeTekReader_InvalidateParameter(lpReader,parameter);
   return lppi->SetSystemParameter(lpReader,&addr,lpData,SKYETEK_TIMEOUT);
 }
 
@@ -560,10 +841,36 @@ SkyeTekReader_UploadFirmware(
     )
 {
   LPPROTOCOLIMPL lppi;
+  SKYETEK_STATUS status;
+  if( lpReader == NULL || lpReader->lpProtocol == NULL || lpReader->lpDevice == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  status = lppi->UploadFirmware(lpReader,file,defaultsOnly,callback,user);
+  /* The reader restarts on the new firmware, even after a failed upload */
+  SkyeTek_InvalidateParameterCache(lpReader);
+  SkyeTekReader_InvalidateKeys(lpReader);
+  return status;
+}
+
+SKYETEK_STATUS 
+SkyeTekReader_UploadFirmwareImage(
+    LPSKYETEK_READER                      lpReader, 
+    LPSKYETEK_FIRMWARE_IMAGE              lpImage, 
+    unsigned char                         defaultsOnly,
+    SKYETEK_FIRMWARE_PROGRESS_CALLBACK    callback, 
+    void                                  *user
+    )
+{
+  LPPROTOCOLIMPL lppi;
+  SKYETEK_STATUS status;
   if( lpReader == NULL || lpReader->lpProtocol == NULL || lpReader->lpDevice == NULL )
     return SKYETEK_INVALID_PARAMETER;
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
-  return lppi->UploadFirmware(lpReader,file,defaultsOnly,callback,user);
+  status = lppi->UploadFirmwareImage(lpReader,lpImage,defaultsOnly,callback,user);
+  /* The reader restarts on the new firmware, even after a failed upload */
+  SkyeTek_InvalidateParameterCache(lpReader);
+  SkyeTekReader_InvalidateKeys(lpReader);
+  return status;
 }
 
 int
@@ -598,6 +905,25 @@ SkyeTekReader_CopyRIDToBuffer(
   }
 }
 
+void
+SkyeTekReader_ReleaseField(
+    LPSKYETEK_READER      lpReader,
+    LPSKYETEK_TAG         lpTag
+    )
+{
+  LPSKYETEK_TAG lpCopy;
+
+  if( lpReader == NULL || lpTag == NULL || lpTag->rf )
+    return;
+  /* A select with the field off; on a copy, so the caller's tag is untouched */
+  lpCopy = SkyeTek_DuplicateTag(lpTag);
+  if( lpCopy == NULL )
+    return;
+  lpCopy->rf = 0;
+  SkyeTek_SelectTag(lpReader, lpCopy);
+  SkyeTek_FreeTag(lpCopy);
+}
+
 SKYETEK_STATUS 
 SkyeTekReader_EnterPaymentScanMode(
     LPSKYETEK_READER     lpReader
@@ -625,6 +951,196 @@ SkyeTekReader_ScanPayments(
   return lppi->ScanPayments(lpReader, callback, user, SKYETEK_TIMEOUT);
 }
 
+SKYETEK_STATUS 
+SkyeTekReader_ExecuteBatch(
+    LPSKYETEK_READER             lpReader,
+    LPSKYETEK_BATCH_OPERATION    lpOps,
+    unsigned int                 count,
+    SKYETEK_STATUS               *lpStatus
+    )
+{
+  LPPROTOCOLIMPL lppi;
+  LPTAGIMPL lpti;
+  LPPROTOCOL_BATCH_ITEM lpItems;
+  LPSKYETEK_BATCH_OPERATION lpOp;
+  SKYETEK_STATUS st;
+  unsigned int ix;
+
+  if( lpReader == NULL || lpReader->lpProtocol == NULL || 
+      lpReader->lpProtocol->internal == NULL || lpReader->lpDevice == NULL || 
+      lpOps == NULL || lpStatus == NULL || count == 0 )
+    return SKYETEK_INVALID_PARAMETER;
+  lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+
+  /* Protocols that cannot pipeline run the operations one by one */
+  if( lppi->ExecuteBatch == NULL )
+  {
+    for( ix = 0; ix < count; ix++ )
+    {
+      lpOp = &lpOps[ix];
+      lpti = (lpOp->lpTag != NULL ? (LPTAGIMPL)lpOp->lpTag->internal : NULL);
+      switch(lpOp->command)
+      {
+        case BATCH_READ_TAG_DATA:
+          lpStatus[ix] = (lpti == NULL ? SKYETEK_INVALID_PARAMETER :
+            lpti->ReadTagData(lpReader,lpOp->lpTag,&lpOp->address,lpOp->encrypt,lpOp->hmac,&lpOp->lpData));
+          break;
+        case BATCH_WRITE_TAG_DATA:
+          lpStatus[ix] = (lpti == NULL ? SKYETEK_INVALID_PARAMETER :
+            lpti->WriteTagData(lpReader,lpOp->lpTag,&lpOp->address,lpOp->encrypt,lpOp->hmac,lpOp->lpData));
+          break;
+        case BATCH_LOCK_TAG_BLOCK:
+          lpStatus[ix] = (lpti == NULL ? SKYETEK_INVALID_PARAMETER :
+            lpti->LockTagBlock(lpReader,lpOp->lpTag,&lpOp->address,lpOp->lpData));
+          break;
+        case BATCH_GET_TAG_INFO:
+          if( lpti != NULL && Tag_GetCachedInfo(lpOp->lpTag,&lpOp->memory) )
+          {
+            lpStatus[ix] = SKYETEK_SUCCESS;
+            break;
+          }
+          lpStatus[ix] = (lpti == NULL ? SKYETEK_INVALID_PARAMETER :
+            lpti->GetTagInfo(lpReader,lpOp->lpTag,&lpOp->memory));
+          if( lpStatus[ix] == SKYETEK_SUCCESS )
+            Tag_CacheInfo(lpOp->lpTag,&lpOp->memory);
+          break;
+        case BATCH_SELECT_APPLICATION:
+          lpStatus[ix] = (lpOp->lpTag == NULL || lpOp->lpData == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->SelectApplication(lpReader,lpOp->lpTag,lpOp->lpData,500));
+          break;
+        case BATCH_GET_FILE_IDS:
+          lpStatus[ix] = (lpOp->lpTag == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->GetFileIDs(lpReader,lpOp->lpTag,&lpOp->lpData,500));
+          break;
+        case BATCH_GET_FILE_SETTINGS:
+          lpStatus[ix] = (lpOp->lpTag == NULL || lpOp->lpRequest == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->GetFileSettings(lpReader,lpOp->lpTag,lpOp->lpRequest,&lpOp->lpData,500));
+          break;
+        case BATCH_CREDIT_VALUE_FILE:
+          lpStatus[ix] = (lpOp->lpTag == NULL || lpOp->lpData == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->CreditValueFile(lpReader,lpOp->lpTag,lpOp->lpData,500));
+          break;
+        case BATCH_DEBIT_VALUE_FILE:
+          lpStatus[ix] = (lpOp->lpTag == NULL || lpOp->lpData == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->DebitValueFile(lpReader,lpOp->lpTag,lpOp->lpData,500));
+          break;
+        case BATCH_LIMITED_CREDIT_VALUE_FILE:
+          lpStatus[ix] = (lpOp->lpTag == NULL || lpOp->lpData == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->LimitedCreditValueFile(lpReader,lpOp->lpTag,lpOp->lpData,500));
+          break;
+        case BATCH_WRITE_RECORD:
+          lpStatus[ix] = (lpOp->lpTag == NULL || lpOp->lpData == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->WriteRecord(lpReader,lpOp->lpTag,&lpOp->address,lpOp->lpData,500));
+          break;
+        case BATCH_COMMIT_TRANSACTION:
+          lpStatus[ix] = (lpOp->lpTag == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->CommitTransaction(lpReader,lpOp->lpTag,500));
+          break;
+        case BATCH_ABORT_TRANSACTION:
+          lpStatus[ix] = (lpOp->lpTag == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->AbortTransaction(lpReader,lpOp->lpTag,500));
+          break;
+        case BATCH_ENABLE_EAS:
+          lpStatus[ix] = (lpOp->lpTag == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->EnableEAS(lpReader,lpOp->lpTag,300));
+          break;
+        case BATCH_DISABLE_EAS:
+          lpStatus[ix] = (lpOp->lpTag == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->DisableEAS(lpReader,lpOp->lpTag,300));
+          break;
+        case BATCH_WRITE_AFI:
+          lpStatus[ix] = (lpOp->lpTag == NULL || lpOp->lpData == NULL ? SKYETEK_INVALID_PARAMETER :
+            lppi->WriteAFI(lpReader,lpOp->lpTag,lpOp->lpData,300));
+          break;
+        case BATCH_GET_SYSTEM_PARAMETER:
+          lpStatus[ix] = SkyeTekReader_GetSystemParameter(lpReader,lpOp->parameter,&lpOp->lpData);
+          break;
+        case BATCH_SET_SYSTEM_PARAMETER:
+          lpStatus[ix] = SkyeTekReader_SetSystemParameter(lpReader,lpOp->parameter,lpOp->lpData);
+          break;
+        default:
+          lpStatus[ix] = SKYETEK_INVALID_PARAMETER;
+          break;
+      }
+    }
+    return SKYETEK_SUCCESS;
+  }
+
+  lpItems = (LPPROTOCOL_BATCH_ITEM)malloc(count*sizeof(PROTOCOL_BATCH_ITEM));
+  if( lpItems == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  memset(lpItems,0,count*sizeof(PROTOCOL_BATCH_ITEM));
+
+  /* Resolve addresses and timeouts the same way the single calls do */
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpOp = &lpOps[ix];
+    lpItems[ix].lpOp = lpOp;
+    lpItems[ix].timeout = SKYETEK_TIMEOUT;
+    switch(lpOp->command)
+    {
+      case BATCH_READ_TAG_DATA:
+      case BATCH_WRITE_TAG_DATA:
+      case BATCH_LOCK_TAG_BLOCK:
+        lpItems[ix].addr = lpOp->address;
+        lpItems[ix].timeout = lpOp->address.blocks * 5000;
+        break;
+      case BATCH_GET_TAG_INFO:
+        lpItems[ix].timeout = 1200;
+        break;
+      case BATCH_SELECT_APPLICATION:
+      case BATCH_GET_FILE_IDS:
+      case BATCH_GET_FILE_SETTINGS:
+      case BATCH_CREDIT_VALUE_FILE:
+      case BATCH_DEBIT_VALUE_FILE:
+      case BATCH_LIMITED_CREDIT_VALUE_FILE:
+      case BATCH_WRITE_RECORD:
+      case BATCH_COMMIT_TRANSACTION:
+      case BATCH_ABORT_TRANSACTION:
+        lpItems[ix].timeout = 500;
+        break;
+      case BATCH_ENABLE_EAS:
+      case BATCH_DISABLE_EAS:
+      case BATCH_WRITE_AFI:
+        lpItems[ix].timeout = 300;
+        break;
+      case BATCH_GET_SYSTEM_PARAMETER:
+      case BATCH_SET_SYSTEM_PARAMETER:
+        st = STR_GetSystemAddrForParm(lpOp->parameter,&lpItems[ix].addr,lpReader->lpProtocol->version);
+        if( st != SKYETEK_SUCCESS )
+        {
+          free(lpItems);
+          return st;
+        }
+        if( lpOp->command == BATCH_GET_SYSTEM_PARAMETER &&
+          (lpOp->parameter == SYS_OPTIMAL_POWER_C1G1 || lpOp->parameter == SYS_OPTIMAL_POWER_C1G2 || 
+          lpOp->parameter == SYS_OPTIMAL_POWER_180006B || lpOp->parameter == SYS_RSSI_VALUES) )
+          lpItems[ix].timeout = 10000;
+        break;
+      default:
+        break;
+    }
+  }
+
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( lpOps[ix].command == BATCH_SET_SYSTEM_PARAMETER )
+      SkyeTekReader_InvalidateParameter(lpReader,lpOps[ix].parameter);
+  }
+
+  st = lppi->ExecuteBatch(lpReader,lpItems,count,lpStatus);
+  free(lpItems);
+  if( st == SKYETEK_SUCCESS )
+  {
+    for( ix = 0; ix < count; ix++ )
+    {
+      if( lpOps[ix].command == BATCH_GET_TAG_INFO && lpStatus[ix] == SKYETEK_SUCCESS )
+        Tag_CacheInfo(lpOps[ix].lpTag,&lpOps[ix].memory);
+    }
+  }
+  return st;
+}
+
 READER_IMPL SkyetekReaderImpl = {
   SkyeTekReader_SelectTags,
   SkyeTekReader_GetTags,
@@ -643,11 +1159,15 @@ READER_IMPL SkyetekReaderImpl = {
   SkyeTekReader_EnableDebug,
   SkyeTekReader_DisableDebug,
   SkyeTekReader_UploadFirmware,
+  SkyeTekReader_UploadFirmwareImage,
   SkyeTekReader_GetDebugMessages,
   SkyeTekReader_DoesRIDMatch,
   SkyeTekReader_CopyRIDToBuffer,
   SkyeTekReader_EnterPaymentScanMode,
-  SkyeTekReader_ScanPayments
+  SkyeTekReader_ScanPayments,
+  SkyeTekReader_ExecuteBatch,
+  SkyeTekReader_SelectTagViews,
+  SkyeTekReader_GetTagSet
 };
 
 
@@ -544,6 +544,13 @@ SkyetekReaderFactory_FreeReader(
     return 0;
   if( lpReader->internal == &SkyetekReaderImpl )
   {
+    SkyeTek_DisableParameterCache(lpReader);
+    SkyeTekReader_FreeKeys(lpReader);
+    if( lpReader->lpProtocol != NULL )
+    {
+      free(SkyeTekReader_TakePrivate(lpReader->lpProtocol, PRIVATE_SELECTION));
+      free(lpReader->lpProtocol);
+    }
     free(lpReader);
     return 1;
   }
@@ -0,0 +1,281 @@
+/**
+ * SkyeTekReaderFleet.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Firmware upload to a set of readers in parallel. One validated
+ * image is shared by every upload; a fixed number of workers take
+ * the next reader until all of them are done.
+ */
+#include "../SkyeTekAPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLEET_BOOTLOAD_DELAY    2000  /* ms for the reader to enter the bootloader */
+#define FLEET_VERIFY_DELAY      500   /* ms between SYS_FIRMWARE attempts */
+#define FLEET_VERIFY_RETRIES    10
+
+typedef struct FLEET_CONTEXT
+{
+  LPSKYETEK_READER                  *lpReaders;
+  unsigned int                      count;
+  LPSKYETEK_FIRMWARE_IMAGE          lpImage;
+  LPSKYETEK_FIRMWARE_IMAGE          lpRollback;
+  unsigned int                      expectedFirmware;
+  SKYETEK_FIRMWARE_FLEET_CALLBACK   callback;
+  void                              *user;
+  LPSKYETEK_FIRMWARE_FLEET_RESULT   lpResults;
+  unsigned int                      next;
+  MUTEX(lock);
+} FLEET_CONTEXT, *LPFLEET_CONTEXT;
+
+typedef struct FLEET_JOB
+{
+  LPFLEET_CONTEXT                   ctx;
+  unsigned int                      index;
+} FLEET_JOB, *LPFLEET_JOB;
+
+static int
+Fleet_Progress(
+  LPSKYETEK_FIRMWARE_PROGRESS   lpProgress,
+  void                          *user
+  )
+{
+  LPFLEET_JOB job = (LPFLEET_JOB)user;
+  LPFLEET_CONTEXT ctx = job->ctx;
+  int ret = 1;
+
+  memcpy(&ctx->lpResults[job->index].progress, lpProgress, sizeof(SKYETEK_FIRMWARE_PROGRESS));
+  if( ctx->callback == NULL )
+    return 1;
+  MUTEX_LOCK(&ctx->lock);
+  ret = ctx->callback(ctx->lpReaders[job->index], lpProgress, ctx->user);
+  MUTEX_UNLOCK(&ctx->lock);
+  return ret;
+}
+
+/**
+ * Reads SYS_FIRMWARE. A reader created in bootload mode has no RID
+ * yet so the generic RID is used instead.
+ */
+static SKYETEK_STATUS
+Fleet_GetFirmware(
+  LPSKYETEK_READER    lpReader,
+  unsigned int        *firmware,
+  TCHAR               *str
+  )
+{
+  SKYETEK_READER tmpReader;
+  LPSKYETEK_DATA lpData = NULL;
+  SKYETEK_STATUS status;
+  TCHAR *tmp;
+  unsigned int ix;
+
+  memcpy(&tmpReader, lpReader, sizeof(SKYETEK_READER));
+  if( lpReader->isBootload )
+  {
+    tmpReader.id = SkyeTek_AllocateID(4);
+    if( tmpReader.id == NULL )
+      return SKYETEK_OUT_OF_MEMORY;
+    for( ix = 0; ix < 4; ix++ )
+      tmpReader.id->id[ix] = 0xFF;
+    tmpReader.sendRID = 1;
+  }
+
+  status = SkyeTek_GetSystemParameter(&tmpReader, SYS_FIRMWARE, &lpData);
+  if( lpReader->isBootload )
+    SkyeTek_FreeID(tmpReader.id);
+  if( status != SKYETEK_SUCCESS )
+    return status;
+  if( lpData == NULL || lpData->data == NULL || lpData->size == 0 )
+  {
+    SkyeTek_FreeData(lpData);
+    return SKYETEK_READER_PROTOCOL_ERROR;
+  }
+
+  *firmware = 0;
+  for( ix = 0; ix < lpData->size && ix < 4; ix++ )
+    *firmware = (*firmware << 8) | lpData->data[ix];
+  if( str != NULL && (tmp = SkyeTek_GetStringFromData(lpData)) != NULL )
+  {
+    _tcscpy(str, tmp);
+    SkyeTek_FreeString(tmp);
+  }
+  SkyeTek_FreeData(lpData);
+  return SKYETEK_SUCCESS;
+}
+
+static SKYETEK_STATUS
+Fleet_Upload(
+  LPSKYETEK_READER            lpReader,
+  LPSKYETEK_FIRMWARE_IMAGE    lpImage,
+  LPFLEET_JOB                 job
+  )
+{
+  SKYETEK_STATUS status;
+
+  if( !lpReader->isBootload )
+  {
+    status = SkyeTek_Bootload(lpReader);
+    if( status != SKYETEK_SUCCESS )
+      return status;
+    /* A rollback after a failed upload finds it still in the bootloader */
+    lpReader->isBootload = 1;
+    SKYETEK_Sleep(FLEET_BOOTLOAD_DELAY);
+  }
+  return SkyeTek_UploadFirmwareImage(lpReader, lpImage, 0, Fleet_Progress, job);
+}
+
+static SKYETEK_STATUS
+Fleet_Verify(
+  LPSKYETEK_READER                  lpReader,
+  unsigned int                      expectedFirmware,
+  LPSKYETEK_FIRMWARE_FLEET_RESULT   lpResult
+  )
+{
+  SKYETEK_STATUS status = SKYETEK_FAILURE;
+  TCHAR firmware[128];
+  unsigned int ix;
+
+  /* The reader takes a while to come back after the reset */
+  memset(firmware, 0, sizeof(firmware));
+  for( ix = 0; ix < FLEET_VERIFY_RETRIES; ix++ )
+  {
+    status = Fleet_GetFirmware(lpReader, &lpResult->firmwareAfter, firmware);
+    if( status == SKYETEK_SUCCESS )
+      break;
+    SKYETEK_Sleep(FLEET_VERIFY_DELAY);
+  }
+  if( status != SKYETEK_SUCCESS )
+    return status;
+  if( expectedFirmware != 0 && lpResult->firmwareAfter != expectedFirmware )
+    return SKYETEK_FAILURE;
+
+  /* The reader now runs the new firmware */
+  _tcscpy(lpReader->firmware, firmware);
+  lpReader->isBootload = 0;
+  return SKYETEK_SUCCESS;
+}
+
+static void
+Fleet_UpdateReader(
+  LPFLEET_CONTEXT   ctx,
+  unsigned int      index
+  )
+{
+  LPSKYETEK_READER lpReader = ctx->lpReaders[index];
+  LPSKYETEK_FIRMWARE_FLEET_RESULT lpResult = &ctx->lpResults[index];
+  FLEET_JOB job;
+
+  memset(lpResult, 0, sizeof(SKYETEK_FIRMWARE_FLEET_RESULT));
+  lpResult->lpReader = lpReader;
+  lpResult->verifyStatus = SKYETEK_FAILURE;
+  lpResult->rollbackStatus = SKYETEK_FAILURE;
+  if( lpReader == NULL || lpReader->internal == NULL )
+  {
+    lpResult->status = SKYETEK_INVALID_PARAMETER;
+    return;
+  }
+  job.ctx = ctx;
+  job.index = index;
+
+  if( !lpReader->isBootload )
+    Fleet_GetFirmware(lpReader, &lpResult->firmwareBefore, NULL);
+
+  lpResult->status = Fleet_Upload(lpReader, ctx->lpImage, &job);
+  if( lpResult->status == SKYETEK_SUCCESS )
+    lpResult->verifyStatus = Fleet_Verify(lpReader, ctx->expectedFirmware, lpResult);
+  lpResult->verified = (lpResult->verifyStatus == SKYETEK_SUCCESS);
+
+  if( lpResult->verified || ctx->lpRollback == NULL || lpResult->status == SKYETEK_FIRMWARE_CANCELED )
+    return;
+
+  /* Straggler; put the rollback image on it */
+  lpResult->rollbackStatus = Fleet_Upload(lpReader, ctx->lpRollback, &job);
+  if( lpResult->rollbackStatus == SKYETEK_SUCCESS )
+    lpResult->rollbackStatus = Fleet_Verify(lpReader, 0, lpResult);
+  lpResult->rolledBack = (lpResult->rollbackStatus == SKYETEK_SUCCESS);
+}
+
+static THREAD_RETURN
+Fleet_Worker(
+  void      *user
+  )
+{
+  LPFLEET_CONTEXT ctx = (LPFLEET_CONTEXT)user;
+  unsigned int ix;
+
+  for(;;)
+  {
+    MUTEX_LOCK(&ctx->lock);
+    ix = ctx->next++;
+    MUTEX_UNLOCK(&ctx->lock);
+    if( ix >= ctx->count )
+      break;
+    Fleet_UpdateReader(ctx, ix);
+  }
+  return 0;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_UploadFirmwareFleet(
+    LPSKYETEK_READER                      *lpReaders,
+    unsigned int                          count,
+    LPSKYETEK_FIRMWARE_IMAGE              lpImage,
+    LPSKYETEK_FIRMWARE_IMAGE              lpRollback,
+    unsigned int                          expectedFirmware,
+    unsigned int                          maxConcurrent,
+    SKYETEK_FIRMWARE_FLEET_CALLBACK       callback,
+    void                                  *user,
+    LPSKYETEK_FIRMWARE_FLEET_RESULT       lpResults
+    )
+{
+  FLEET_CONTEXT ctx;
+  THREAD(*threads) = NULL;
+  unsigned int ix, started = 0;
+  SKYETEK_STATUS status = SKYETEK_SUCCESS;
+
+  if( lpReaders == NULL || count == 0 || lpImage == NULL || lpResults == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  if( maxConcurrent == 0 || maxConcurrent > count )
+    maxConcurrent = count;
+
+  memset(&ctx, 0, sizeof(FLEET_CONTEXT));
+  ctx.lpReaders = lpReaders;
+  ctx.count = count;
+  ctx.lpImage = lpImage;
+  ctx.lpRollback = lpRollback;
+  ctx.expectedFirmware = expectedFirmware;
+  ctx.callback = callback;
+  ctx.user = user;
+  ctx.lpResults = lpResults;
+  MUTEX_CREATE(&ctx.lock);
+
+  /* The calling thread is one of the workers */
+  if( maxConcurrent > 1 )
+  {
+    threads = malloc((maxConcurrent - 1) * sizeof(*threads));
+    if( threads != NULL )
+    {
+      for( ix = 0; ix < maxConcurrent - 1; ix++ )
+      {
+        if( !THREAD_CREATE(&threads[started], Fleet_Worker, &ctx) )
+          break;
+        started++;
+      }
+    }
+  }
+  Fleet_Worker(&ctx);
+  for( ix = 0; ix < started; ix++ )
+    THREAD_JOIN(&threads[ix]);
+  if( threads != NULL )
+    free(threads);
+  MUTEX_DESTROY(&ctx.lock);
+
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( !lpResults[ix].verified )
+      status = SKYETEK_FAILURE;
+  }
+  return status;
+}
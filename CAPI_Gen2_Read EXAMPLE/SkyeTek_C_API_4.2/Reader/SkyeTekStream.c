@@ -0,0 +1,300 @@
+/**
+ * SkyeTekStream.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Streaming reads and writes of tag memories too large for one request.
+ * The transfer is split into chunks sized for the protocol, the reader
+ * and the tag, and the chunks go out a window at a time as one batch.
+ * A chunk that fails is sent again at half the size.
+ */
+#include "../SkyeTekAPI.h"
+#include "Reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STREAM_WINDOW       8       /* chunks per batch */
+#define STREAM_RETRIES      2       /* retries of a single block chunk */
+#define STREAM_V3_BYTES     2048    /* data of an STPv3 request */
+#define STREAM_V2_BYTES     512     /* data of an STPv2 ASCII request */
+#define STREAM_V2_BLOCKS    255     /* STPv2 block count is one byte */
+#define STREAM_SMALL_BYTES  256     /* M1, M2 and M8 buffers */
+
+static int
+Stream_IsGen2(
+    LPSKYETEK_TAG   lpTag
+    )
+{
+  return (lpTag->type & 0xFF00) == 0x8200;
+}
+
+/* Finds the block size and checks the range against the tag's memory */
+static SKYETEK_STATUS
+Stream_Geometry(
+    LPSKYETEK_READER    lpReader,
+    LPSKYETEK_TAG       lpTag,
+    LPSKYETEK_ADDRESS   lpAddr,
+    unsigned int        *lpBytesPerBlock
+    )
+{
+  SKYETEK_MEMORY mem;
+  SKYETEK_STATUS status;
+
+  memset(&mem, 0, sizeof(SKYETEK_MEMORY));
+  status = SkyeTek_GetTagInfo(lpReader, lpTag, &mem);
+  if( status != SKYETEK_SUCCESS || mem.bytesPerBlock == 0 )
+  {
+    /* Gen2 memory is words addressed by bank; there is nothing to check against */
+    if( !Stream_IsGen2(lpTag) || lpAddr->blocks == 0 )
+      return (status != SKYETEK_SUCCESS) ? status : SKYETEK_READER_PROTOCOL_ERROR;
+    *lpBytesPerBlock = 2;
+    return SKYETEK_SUCCESS;
+  }
+
+  if( lpAddr->blocks == 0 )
+  {
+    if( lpAddr->start < mem.startBlock || lpAddr->start > mem.maxBlock )
+      return SKYETEK_INVALID_ADDRESS;
+    lpAddr->blocks = mem.maxBlock - lpAddr->start + 1;
+  }
+  if( lpAddr->start < mem.startBlock || lpAddr->start > mem.maxBlock ||
+      lpAddr->blocks > mem.maxBlock - lpAddr->start + 1 )
+    return SKYETEK_INVALID_ADDRESS;
+  *lpBytesPerBlock = mem.bytesPerBlock;
+  return SKYETEK_SUCCESS;
+}
+
+/* Largest chunk the protocol, the reader and the tag will take */
+static unsigned int
+Stream_ChunkBlocks(
+    LPSKYETEK_READER    lpReader,
+    LPSKYETEK_TAG       lpTag,
+    unsigned int        bytesPerBlock
+    )
+{
+  unsigned int bytes, blocks, limit = 0;
+
+  if( lpReader->lpProtocol != NULL && lpReader->lpProtocol->version == 2 )
+    bytes = STREAM_V2_BYTES;
+  else
+    bytes = STREAM_V3_BYTES;
+  if( _tcscmp(lpReader->model, _T("M1")) == 0 ||
+      _tcscmp(lpReader->model, _T("M2")) == 0 ||
+      _tcscmp(lpReader->model, _T("M8")) == 0 )
+    bytes = STREAM_SMALL_BYTES;
+
+  switch( lpTag->type & 0xFF00 )
+  {
+    case 0x0100:    /* ISO 15693 read multiple blocks */
+      limit = 32;
+      break;
+    case 0x0200:    /* a MIFARE sector */
+      limit = 4;
+      break;
+    case 0x0300:
+      limit = 8;
+      break;
+    case 0x8200:    /* long Gen2 reads fail at range */
+      limit = 32;
+      break;
+  }
+
+  blocks = bytes / bytesPerBlock;
+  if( lpReader->lpProtocol != NULL && lpReader->lpProtocol->version == 2 && blocks > STREAM_V2_BLOCKS )
+    blocks = STREAM_V2_BLOCKS;
+  if( limit != 0 && blocks > limit )
+    blocks = limit;
+  return (blocks == 0) ? 1 : blocks;
+}
+
+/* Runs the transfer; lpBuffer is read into or written from */
+static SKYETEK_STATUS
+Stream_Run(
+    LPSKYETEK_READER            lpReader,
+    LPSKYETEK_TAG               lpTag,
+    SKYETEK_BATCH_COMMAND       command,
+    SKYETEK_ADDRESS             addr,
+    unsigned int                bytesPerBlock,
+    unsigned char               *lpBuffer,
+    SKYETEK_STREAM_CALLBACK     callback,
+    void                        *user,
+    LPSKYETEK_STREAM_PROGRESS   lpProgress
+    )
+{
+  SKYETEK_BATCH_OPERATION ops[STREAM_WINDOW];
+  SKYETEK_STATUS statuses[STREAM_WINDOW];
+  SKYETEK_DATA chunks[STREAM_WINDOW];
+  SKYETEK_TAG held;
+  SKYETEK_STATUS status = SKYETEK_SUCCESS;
+  unsigned int end = addr.start + addr.blocks;
+  unsigned int next = addr.start, block, chunk, num, ix, offset, retries = 0;
+  unsigned int failed;
+  int canceled = 0;
+
+  chunk = Stream_ChunkBlocks(lpReader, lpTag, bytesPerBlock);
+  memcpy(&held, lpTag, sizeof(SKYETEK_TAG));
+  held.rf = 1;
+
+  while( next < end && !canceled )
+  {
+    memset(ops, 0, sizeof(ops));
+    for( num = 0, block = next; num < STREAM_WINDOW && block < end; num++ )
+    {
+      ops[num].command = command;
+      ops[num].address.start = block;
+      ops[num].address.blocks = (end - block < chunk) ? end - block : chunk;
+      block += ops[num].address.blocks;
+      /* The field stays on until the last chunk of the transfer */
+      ops[num].lpTag = (block < end) ? &held : lpTag;
+      if( command == BATCH_WRITE_TAG_DATA )
+      {
+        chunks[num].data = lpBuffer + (ops[num].address.start - addr.start) * bytesPerBlock;
+        chunks[num].size = ops[num].address.blocks * bytesPerBlock;
+        ops[num].lpData = &chunks[num];
+      }
+    }
+
+    status = SkyeTek_ExecuteBatch(lpReader, ops, num, statuses);
+    lpProgress->requests += num;
+    if( status != SKYETEK_SUCCESS )
+      break;
+
+    /* Take the chunks in order up to the first that failed */
+    failed = 0;
+    for( ix = 0; ix < num && !canceled; ix++ )
+    {
+      status = statuses[ix];
+      if( status == SKYETEK_SUCCESS && command == BATCH_READ_TAG_DATA &&
+          (ops[ix].lpData == NULL || ops[ix].lpData->size < ops[ix].address.blocks * bytesPerBlock) )
+        status = SKYETEK_INVALID_MESSAGE_LENGTH;
+      if( status != SKYETEK_SUCCESS )
+      {
+        failed = ops[ix].address.blocks;
+        break;
+      }
+      if( command == BATCH_READ_TAG_DATA )
+      {
+        offset = (ops[ix].address.start - addr.start) * bytesPerBlock;
+        if( lpBuffer != NULL )
+          memcpy(lpBuffer + offset, ops[ix].lpData->data, ops[ix].address.blocks * bytesPerBlock);
+        if( callback != NULL && !callback(ops[ix].address.start, ops[ix].lpData->data,
+              ops[ix].address.blocks * bytesPerBlock, user) )
+          canceled = 1;
+      }
+      next += ops[ix].address.blocks;
+      lpProgress->blocks += ops[ix].address.blocks;
+      retries = 0;
+    }
+    if( command == BATCH_READ_TAG_DATA )
+    {
+      for( ix = 0; ix < num; ix++ )
+      {
+        if( ops[ix].lpData != NULL )
+          SkyeTek_FreeData(ops[ix].lpData);
+      }
+    }
+
+    /* Chunks after a failed one are sent again with it, at half the size */
+    if( failed )
+    {
+      if( failed > 1 )
+        chunk = failed / 2;
+      else if( ++retries > STREAM_RETRIES )
+        break;
+    }
+  }
+
+  /* The last chunk, sent with the caller's field setting, never went out */
+  if( next < end )
+    SkyeTekReader_ReleaseField(lpReader, lpTag);
+
+  lpProgress->nextBlock = next;
+  lpProgress->chunkBlocks = chunk;
+  lpProgress->status = status;
+  if( canceled )
+    return SKYETEK_FAILURE;
+  return status;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_ReadTagMemory(
+    LPSKYETEK_READER            lpReader,
+    LPSKYETEK_TAG               lpTag,
+    LPSKYETEK_ADDRESS           lpAddr,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    SKYETEK_STREAM_CALLBACK     callback,
+    void                        *user,
+    LPSKYETEK_STREAM_PROGRESS   lpProgress
+    )
+{
+  SKYETEK_STREAM_PROGRESS progress;
+  SKYETEK_ADDRESS addr;
+  SKYETEK_STATUS status;
+  unsigned int bytesPerBlock = 0;
+
+  if( lpReader == NULL || lpTag == NULL || (lpBuffer == NULL && callback == NULL) )
+    return SKYETEK_INVALID_PARAMETER;
+  if( lpProgress == NULL )
+    lpProgress = &progress;
+  memset(lpProgress, 0, sizeof(SKYETEK_STREAM_PROGRESS));
+
+  memset(&addr, 0, sizeof(SKYETEK_ADDRESS));
+  if( lpAddr != NULL )
+    addr = *lpAddr;
+  lpProgress->nextBlock = addr.start;
+  status = Stream_Geometry(lpReader, lpTag, &addr, &bytesPerBlock);
+  if( status == SKYETEK_SUCCESS && lpBuffer != NULL && size < addr.blocks * bytesPerBlock )
+    status = SKYETEK_INVALID_PARAMETER;
+  if( status != SKYETEK_SUCCESS )
+  {
+    lpProgress->status = status;
+    return status;
+  }
+  lpProgress->nextBlock = addr.start;
+  return Stream_Run(lpReader, lpTag, BATCH_READ_TAG_DATA, addr, bytesPerBlock,
+    lpBuffer, callback, user, lpProgress);
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_WriteTagMemory(
+    LPSKYETEK_READER            lpReader,
+    LPSKYETEK_TAG               lpTag,
+    LPSKYETEK_ADDRESS           lpAddr,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    LPSKYETEK_STREAM_PROGRESS   lpProgress
+    )
+{
+  SKYETEK_STREAM_PROGRESS progress;
+  SKYETEK_ADDRESS addr;
+  SKYETEK_STATUS status;
+  unsigned int bytesPerBlock = 0;
+
+  if( lpReader == NULL || lpTag == NULL || lpAddr == NULL || lpBuffer == NULL || size == 0 )
+    return SKYETEK_INVALID_PARAMETER;
+  if( lpProgress == NULL )
+    lpProgress = &progress;
+  memset(lpProgress, 0, sizeof(SKYETEK_STREAM_PROGRESS));
+
+  addr = *lpAddr;
+  lpProgress->nextBlock = addr.start;
+  status = Stream_Geometry(lpReader, lpTag, &addr, &bytesPerBlock);
+  if( status == SKYETEK_SUCCESS && lpAddr->blocks == 0 )
+  {
+    /* The data says how many blocks there are */
+    if( (size % bytesPerBlock) != 0 || size / bytesPerBlock > addr.blocks )
+      status = SKYETEK_INVALID_PARAMETER;
+    else
+      addr.blocks = size / bytesPerBlock;
+  }
+  else if( status == SKYETEK_SUCCESS && size != addr.blocks * bytesPerBlock )
+    status = SKYETEK_INVALID_PARAMETER;
+  if( status != SKYETEK_SUCCESS )
+  {
+    lpProgress->status = status;
+    return status;
+  }
+  return Stream_Run(lpReader, lpTag, BATCH_WRITE_TAG_DATA, addr, bytesPerBlock,
+    lpBuffer, NULL, NULL, lpProgress);
+}
@@ -0,0 +1,600 @@
+/**
+ * SkyeTekSupervisor.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Reader supervision. Link failures move a reader from online to
+ * degraded to offline; an offline reader has its device reopened with
+ * exponential backoff and its kept parameters written back once it
+ * answers again.
+ */
+#include "../SkyeTekAPI.h"
+#include "../Device/Device.h"
+#include "../Protocol/Protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SUPERVISOR_FAILURE_LIMIT  3
+#define SUPERVISOR_BACKOFF_MIN    250     /* ms before the first reconnect attempt */
+#define SUPERVISOR_BACKOFF_MAX    30000   /* ms between attempts at most */
+#define SUPERVISOR_POLL           50      /* ms between checks on the supervisor thread */
+
+#define SUPERVISOR_NONE           0
+#define SUPERVISOR_HEARTBEAT      1
+#define SUPERVISOR_RECONNECT      2
+
+SKYETEK_STATUS
+STR_GetSystemAddrForParm(
+  SKYETEK_SYSTEM_PARAMETER  parameter,
+  LPSKYETEK_ADDRESS         lpAddr,
+  unsigned int              version
+  );
+
+typedef struct SUPERVISOR_PARAMETER
+{
+  SKYETEK_SYSTEM_PARAMETER        parameter;
+  LPSKYETEK_DATA                  lpData;
+  struct SUPERVISOR_PARAMETER     *next;
+} SUPERVISOR_PARAMETER, *LPSUPERVISOR_PARAMETER;
+
+typedef struct SUPERVISOR_READER
+{
+  unsigned long                   lastGood;     /* SKYETEK_GetTickCount() of the last good call */
+  unsigned long                   lastCheck;    /* of the last heartbeat */
+  unsigned long                   nextAttempt;  /* of the next reconnect attempt */
+  unsigned long                   offline;      /* when the reader went offline */
+  LPSUPERVISOR_PARAMETER          lpParams;
+} SUPERVISOR_READER, *LPSUPERVISOR_READER;
+
+typedef struct SUPERVISOR_STATE
+{
+  LPSUPERVISOR_READER             readers;
+  SKYETEK_READER_STATE_CALLBACK   callback;
+  void                            *user;
+  volatile int                    stop;
+  int                             running;
+  THREAD(thread);
+  MUTEX(lock);
+} SUPERVISOR_STATE, *LPSUPERVISOR_STATE;
+
+/* Statuses that mean the reader did not answer, as opposed to a tag error */
+static int
+Supervisor_IsLinkFailure(
+    SKYETEK_STATUS    status
+    )
+{
+  switch( status )
+  {
+    case SKYETEK_TIMEOUT:
+    case SKYETEK_READER_IO_ERROR:
+    case SKYETEK_READER_PROTOCOL_ERROR:
+    case SKYETEK_INVALID_CRC:
+    case SKYETEK_INVALID_MESSAGE_LENGTH:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+static int
+Supervisor_Find(
+    LPSKYETEK_SUPERVISOR  lpSup,
+    LPSKYETEK_READER      lpReader
+    )
+{
+  unsigned int ix;
+
+  for( ix = 0; ix < lpSup->count; ix++ )
+  {
+    if( lpSup->lpHealth[ix].lpReader == lpReader )
+      return (int)ix;
+  }
+  return -1;
+}
+
+/* Called with the lock held */
+static void
+Supervisor_SetState(
+    LPSKYETEK_SUPERVISOR  lpSup,
+    unsigned int          ix,
+    SKYETEK_READER_STATE  state
+    )
+{
+  LPSUPERVISOR_STATE sup = (LPSUPERVISOR_STATE)lpSup->internal;
+  LPSKYETEK_READER_HEALTH lpHealth = &lpSup->lpHealth[ix];
+  SKYETEK_READER_STATE old = lpHealth->state;
+
+  if( old == state )
+    return;
+  lpHealth->state = state;
+  lpHealth->since = SKYETEK_GetTickCount();
+  if( sup->callback != NULL )
+    sup->callback(lpHealth->lpReader, old, state, sup->user);
+}
+
+/* Called with the lock held */
+static void
+Supervisor_Record(
+    LPSKYETEK_SUPERVISOR  lpSup,
+    unsigned int          ix,
+    SKYETEK_STATUS        status
+    )
+{
+  LPSUPERVISOR_STATE sup = (LPSUPERVISOR_STATE)lpSup->internal;
+  LPSKYETEK_READER_HEALTH lpHealth = &lpSup->lpHealth[ix];
+  LPSUPERVISOR_READER lpSr = &sup->readers[ix];
+  unsigned long now = SKYETEK_GetTickCount();
+
+  lpHealth->calls++;
+  lpHealth->lastStatus = status;
+  if( !Supervisor_IsLinkFailure(status) )
+  {
+    lpHealth->consecutive = 0;
+    lpSr->lastGood = now;
+    if( lpHealth->state == READER_DEGRADED )
+      Supervisor_SetState(lpSup, ix, READER_ONLINE);
+    return;
+  }
+
+  lpHealth->failures++;
+  lpHealth->consecutive++;
+  if( lpHealth->state == READER_ONLINE )
+    Supervisor_SetState(lpSup, ix, READER_DEGRADED);
+  if( lpHealth->state == READER_DEGRADED && lpHealth->consecutive >= lpSup->failureLimit )
+  {
+    lpSr->offline = now;
+    lpHealth->backoff = SUPERVISOR_BACKOFF_MIN;
+    lpSr->nextAttempt = now + lpHealth->backoff;
+    Supervisor_SetState(lpSup, ix, READER_OFFLINE);
+  }
+}
+
+static SKYETEK_STATUS
+Supervisor_Heartbeat(
+    LPSKYETEK_READER    lpReader
+    )
+{
+  LPSKYETEK_DATA lpData = NULL;
+  LPPROTOCOLIMPL lppi;
+  SKYETEK_ADDRESS addr;
+  SKYETEK_STATUS status;
+
+  /* Straight to the protocol; the parameter cache keeps the firmware */
+  if( lpReader->lpProtocol == NULL || lpReader->lpProtocol->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  status = STR_GetSystemAddrForParm(SYS_FIRMWARE, &addr, lpReader->lpProtocol->version);
+  if( status == SKYETEK_SUCCESS )
+    status = lppi->GetSystemParameter(lpReader, &addr, &lpData, SKYETEK_TIMEOUT);
+  if( lpData != NULL )
+    SkyeTek_FreeData(lpData);
+  return status;
+}
+
+static void
+Supervisor_FreeParams(
+    LPSUPERVISOR_PARAMETER    lpParams
+    )
+{
+  LPSUPERVISOR_PARAMETER lpNext;
+
+  for( ; lpParams != NULL; lpParams = lpNext )
+  {
+    lpNext = lpParams->next;
+    SkyeTek_FreeData(lpParams->lpData);
+    free(lpParams);
+  }
+}
+
+/* Called with the lock held; marks the reader recovering and copies
+   the parameters to write back, so the reconnect runs unlocked */
+static SKYETEK_STATUS
+Supervisor_BeginReconnect(
+    LPSKYETEK_SUPERVISOR    lpSup,
+    unsigned int            ix,
+    LPSUPERVISOR_PARAMETER  *lpCopies
+    )
+{
+  LPSUPERVISOR_STATE sup = (LPSUPERVISOR_STATE)lpSup->internal;
+  LPSUPERVISOR_PARAMETER lpParam, lpCopy, *lpTail = lpCopies;
+
+  *lpCopies = NULL;
+  for( lpParam = sup->readers[ix].lpParams; lpParam != NULL; lpParam = lpParam->next )
+  {
+    lpCopy = (LPSUPERVISOR_PARAMETER)malloc(sizeof(SUPERVISOR_PARAMETER));
+    if( lpCopy != NULL )
+    {
+      lpCopy->lpData = SkyeTek_AllocateData(lpParam->lpData->size);
+      if( lpCopy->lpData == NULL )
+      {
+        free(lpCopy);
+        lpCopy = NULL;
+      }
+    }
+    if( lpCopy == NULL )
+    {
+      Supervisor_FreeParams(*lpCopies);
+      *lpCopies = NULL;
+      return SKYETEK_OUT_OF_MEMORY;
+    }
+    SkyeTek_CopyData(lpCopy->lpData, lpParam->lpData);
+    lpCopy->parameter = lpParam->parameter;
+    lpCopy->next = NULL;
+    *lpTail = lpCopy;
+    lpTail = &lpCopy->next;
+  }
+  lpSup->lpHealth[ix].attempts++;
+  Supervisor_SetState(lpSup, ix, READER_RECOVERING);
+  return SKYETEK_SUCCESS;
+}
+
+/* Reopens the device and writes back lpParams; runs without the lock */
+static SKYETEK_STATUS
+Supervisor_Reconnect(
+    LPSKYETEK_READER        lpReader,
+    LPSUPERVISOR_PARAMETER  lpParams
+    )
+{
+  LPSKYETEK_DEVICE lpDevice = lpReader->lpDevice;
+  LPSUPERVISOR_PARAMETER lpParam;
+  LPDEVICEIMPL lpDI;
+  SKYETEK_STATUS status = SKYETEK_INVALID_PARAMETER;
+
+  if( lpDevice != NULL && lpDevice->internal != NULL )
+  {
+    lpDI = (LPDEVICEIMPL)lpDevice->internal;
+    lpDI->Flush(lpDevice);
+    lpDI->Close(lpDevice);
+    status = lpDI->Open(lpDevice);
+    if( status == SKYETEK_SUCCESS )
+      status = Supervisor_Heartbeat(lpReader);
+  }
+  /* It may be a different reader, or one that lost its settings */
+  SkyeTek_InvalidateParameterCache(lpReader);
+
+  /* Put back what was set before the reader went away */
+  for( lpParam = lpParams; lpParam != NULL && status == SKYETEK_SUCCESS; lpParam = lpParam->next )
+    status = SkyeTek_SetSystemParameter(lpReader, lpParam->parameter, lpParam->lpData);
+  return status;
+}
+
+/* Called with the lock held */
+static void
+Supervisor_EndReconnect(
+    LPSKYETEK_SUPERVISOR  lpSup,
+    unsigned int          ix,
+    SKYETEK_STATUS        status
+    )
+{
+  LPSUPERVISOR_STATE sup = (LPSUPERVISOR_STATE)lpSup->internal;
+  LPSKYETEK_READER_HEALTH lpHealth = &lpSup->lpHealth[ix];
+  LPSUPERVISOR_READER lpSr = &sup->readers[ix];
+  unsigned long now = SKYETEK_GetTickCount();
+
+  lpHealth->lastStatus = status;
+  if( status == SKYETEK_SUCCESS )
+  {
+    lpHealth->reconnects++;
+    lpHealth->downtime += now - lpSr->offline;
+    lpHealth->consecutive = 0;
+    lpHealth->backoff = 0;
+    lpSr->lastGood = now;
+    Supervisor_SetState(lpSup, ix, READER_ONLINE);
+  }
+  else
+  {
+    lpHealth->backoff *= 2;
+    if( lpHealth->backoff > SUPERVISOR_BACKOFF_MAX )
+      lpHealth->backoff = SUPERVISOR_BACKOFF_MAX;
+    lpSr->nextAttempt = now + lpHealth->backoff;
+    Supervisor_SetState(lpSup, ix, READER_OFFLINE);
+  }
+}
+
+static THREAD_RETURN
+Supervisor_Worker(
+    void      *user
+    )
+{
+  LPSKYETEK_SUPERVISOR lpSup = (LPSKYETEK_SUPERVISOR)user;
+  LPSUPERVISOR_STATE sup = (LPSUPERVISOR_STATE)lpSup->internal;
+
+  while( !sup->stop )
+  {
+    SkyeTek_CheckReaders(lpSup);
+    SKYETEK_Sleep(SUPERVISOR_POLL);
+  }
+  return 0;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_CreateSupervisor(
+    LPSKYETEK_READER                *lpReaders,
+    unsigned int                    count,
+    unsigned long                   interval,
+    unsigned int                    failureLimit,
+    SKYETEK_READER_STATE_CALLBACK   callback,
+    void                            *user,
+    LPSKYETEK_SUPERVISOR            *lpSupervisor
+    )
+{
+  LPSKYETEK_SUPERVISOR lpSup;
+  LPSUPERVISOR_STATE sup;
+  unsigned long now;
+  unsigned int ix;
+
+  if( lpReaders == NULL || count == 0 || lpSupervisor == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( lpReaders[ix] == NULL || lpReaders[ix]->internal == NULL )
+      return SKYETEK_INVALID_PARAMETER;
+  }
+
+  lpSup = (LPSKYETEK_SUPERVISOR)malloc(sizeof(SKYETEK_SUPERVISOR));
+  if( lpSup == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  memset(lpSup, 0, sizeof(SKYETEK_SUPERVISOR));
+  sup = (LPSUPERVISOR_STATE)malloc(sizeof(SUPERVISOR_STATE));
+  lpSup->lpHealth = (LPSKYETEK_READER_HEALTH)malloc(count * sizeof(SKYETEK_READER_HEALTH));
+  if( sup != NULL )
+  {
+    memset(sup, 0, sizeof(SUPERVISOR_STATE));
+    sup->readers = (LPSUPERVISOR_READER)malloc(count * sizeof(SUPERVISOR_READER));
+  }
+  if( sup == NULL || sup->readers == NULL || lpSup->lpHealth == NULL )
+  {
+    if( sup != NULL )
+      free(sup);
+    if( lpSup->lpHealth != NULL )
+      free(lpSup->lpHealth);
+    free(lpSup);
+    return SKYETEK_OUT_OF_MEMORY;
+  }
+
+  now = SKYETEK_GetTickCount();
+  memset(lpSup->lpHealth, 0, count * sizeof(SKYETEK_READER_HEALTH));
+  memset(sup->readers, 0, count * sizeof(SUPERVISOR_READER));
+  for( ix = 0; ix < count; ix++ )
+  {
+    lpSup->lpHealth[ix].lpReader = lpReaders[ix];
+    lpSup->lpHealth[ix].state = READER_ONLINE;
+    lpSup->lpHealth[ix].since = now;
+    lpSup->lpHealth[ix].lastStatus = SKYETEK_SUCCESS;
+    sup->readers[ix].lastGood = now;
+    sup->readers[ix].lastCheck = now;
+  }
+  sup->callback = callback;
+  sup->user = user;
+  MUTEX_CREATE(&sup->lock);
+  lpSup->count = count;
+  lpSup->interval = interval;
+  lpSup->failureLimit = failureLimit ? failureLimit : SUPERVISOR_FAILURE_LIMIT;
+  lpSup->internal = sup;
+  *lpSupervisor = lpSup;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_CheckReaders(
+    LPSKYETEK_SUPERVISOR    lpSupervisor
+    )
+{
+  LPSUPERVISOR_STATE sup;
+  LPSKYETEK_READER_HEALTH lpHealth;
+  LPSUPERVISOR_READER lpSr;
+  LPSUPERVISOR_PARAMETER lpParams = NULL;
+  SKYETEK_STATUS status;
+  unsigned long now;
+  unsigned int ix;
+  int action;
+
+  if( lpSupervisor == NULL || lpSupervisor->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  sup = (LPSUPERVISOR_STATE)lpSupervisor->internal;
+
+  /* The reader I/O runs unlocked; the lock only covers the health */
+  for( ix = 0; ix < lpSupervisor->count; ix++ )
+  {
+    lpHealth = &lpSupervisor->lpHealth[ix];
+    lpSr = &sup->readers[ix];
+    action = SUPERVISOR_NONE;
+    MUTEX_LOCK(&sup->lock);
+    now = SKYETEK_GetTickCount();
+    if( lpHealth->state == READER_OFFLINE )
+    {
+      if( (long)(now - lpSr->nextAttempt) >= 0 )
+      {
+        status = Supervisor_BeginReconnect(lpSupervisor, ix, &lpParams);
+        if( status == SKYETEK_SUCCESS )
+          action = SUPERVISOR_RECONNECT;
+      }
+    }
+    else if( lpHealth->state != READER_RECOVERING &&
+             (now - lpSr->lastGood) >= lpSupervisor->interval &&
+             (now - lpSr->lastCheck) >= lpSupervisor->interval )
+    {
+      lpSr->lastCheck = now;
+      action = SUPERVISOR_HEARTBEAT;
+    }
+    MUTEX_UNLOCK(&sup->lock);
+
+    if( action == SUPERVISOR_NONE )
+      continue;
+    if( action == SUPERVISOR_RECONNECT )
+    {
+      status = Supervisor_Reconnect(lpHealth->lpReader, lpParams);
+      Supervisor_FreeParams(lpParams);
+    }
+    else
+    {
+      status = Supervisor_Heartbeat(lpHealth->lpReader);
+    }
+
+    MUTEX_LOCK(&sup->lock);
+    if( action == SUPERVISOR_RECONNECT )
+      Supervisor_EndReconnect(lpSupervisor, ix, status);
+    else if( lpHealth->state != READER_OFFLINE && lpHealth->state != READER_RECOVERING )
+      Supervisor_Record(lpSupervisor, ix, status);
+    MUTEX_UNLOCK(&sup->lock);
+  }
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_StartSupervisor(
+    LPSKYETEK_SUPERVISOR    lpSupervisor
+    )
+{
+  LPSUPERVISOR_STATE sup;
+
+  if( lpSupervisor == NULL || lpSupervisor->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  sup = (LPSUPERVISOR_STATE)lpSupervisor->internal;
+  if( sup->running )
+    return SKYETEK_SUCCESS;
+  sup->stop = 0;
+  if( !THREAD_CREATE(&sup->thread, Supervisor_Worker, lpSupervisor) )
+    return SKYETEK_NOT_SUPPORTED;
+  sup->running = 1;
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API void
+SkyeTek_StopSupervisor(
+    LPSKYETEK_SUPERVISOR    lpSupervisor
+    )
+{
+  LPSUPERVISOR_STATE sup;
+
+  if( lpSupervisor == NULL || lpSupervisor->internal == NULL )
+    return;
+  sup = (LPSUPERVISOR_STATE)lpSupervisor->internal;
+  if( !sup->running )
+    return;
+  sup->stop = 1;
+  THREAD_JOIN(&sup->thread);
+  sup->running = 0;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_ReportReaderStatus(
+    LPSKYETEK_SUPERVISOR    lpSupervisor,
+    LPSKYETEK_READER        lpReader,
+    SKYETEK_STATUS          status
+    )
+{
+  LPSUPERVISOR_STATE sup;
+  int ix;
+
+  if( lpSupervisor == NULL || lpSupervisor->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  sup = (LPSUPERVISOR_STATE)lpSupervisor->internal;
+  ix = Supervisor_Find(lpSupervisor, lpReader);
+  if( ix < 0 )
+    return SKYETEK_INVALID_PARAMETER;
+
+  MUTEX_LOCK(&sup->lock);
+  /* An offline reader is left to the reconnect attempts */
+  if( lpSupervisor->lpHealth[ix].state != READER_OFFLINE &&
+      lpSupervisor->lpHealth[ix].state != READER_RECOVERING )
+    Supervisor_Record(lpSupervisor, (unsigned int)ix, status);
+  MUTEX_UNLOCK(&sup->lock);
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_SetSupervisedParameter(
+    LPSKYETEK_SUPERVISOR        lpSupervisor,
+    LPSKYETEK_READER            lpReader,
+    SKYETEK_SYSTEM_PARAMETER    parameter,
+    LPSKYETEK_DATA              lpData
+    )
+{
+  LPSUPERVISOR_STATE sup;
+  LPSUPERVISOR_PARAMETER lpParam;
+  LPSKYETEK_DATA lpCopy;
+  SKYETEK_STATUS status;
+  int ix;
+
+  if( lpSupervisor == NULL || lpSupervisor->internal == NULL ||
+      lpData == NULL || lpData->data == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  sup = (LPSUPERVISOR_STATE)lpSupervisor->internal;
+  ix = Supervisor_Find(lpSupervisor, lpReader);
+  if( ix < 0 )
+    return SKYETEK_INVALID_PARAMETER;
+
+  lpCopy = SkyeTek_AllocateData(lpData->size);
+  if( lpCopy == NULL )
+    return SKYETEK_OUT_OF_MEMORY;
+  SkyeTek_CopyData(lpCopy, lpData);
+
+  status = SkyeTek_SetSystemParameter(lpReader, parameter, lpData);
+  MUTEX_LOCK(&sup->lock);
+  if( lpSupervisor->lpHealth[ix].state != READER_OFFLINE &&
+      lpSupervisor->lpHealth[ix].state != READER_RECOVERING )
+    Supervisor_Record(lpSupervisor, (unsigned int)ix, status);
+  if( status == SKYETEK_SUCCESS )
+  {
+    for( lpParam = sup->readers[ix].lpParams; lpParam != NULL; lpParam = lpParam->next )
+    {
+      if( lpParam->parameter == parameter )
+        break;
+    }
+    if( lpParam == NULL )
+    {
+      lpParam = (LPSUPERVISOR_PARAMETER)malloc(sizeof(SUPERVISOR_PARAMETER));
+      if( lpParam != NULL )
+      {
+        lpParam->parameter = parameter;
+        lpParam->lpData = NULL;
+        lpParam->next = sup->readers[ix].lpParams;
+        sup->readers[ix].lpParams = lpParam;
+      }
+      else
+      {
+        status = SKYETEK_OUT_OF_MEMORY;
+      }
+    }
+    if( lpParam != NULL )
+    {
+      if( lpParam->lpData != NULL )
+        SkyeTek_FreeData(lpParam->lpData);
+      lpParam->lpData = lpCopy;
+      lpCopy = NULL;
+    }
+  }
+  MUTEX_UNLOCK(&sup->lock);
+
+  if( lpCopy != NULL )
+    SkyeTek_FreeData(lpCopy);
+  return status;
+}
+
+SKYETEK_API void
+SkyeTek_FreeSupervisor(
+    LPSKYETEK_SUPERVISOR    lpSupervisor
+    )
+{
+  LPSUPERVISOR_STATE sup;
+  unsigned int ix;
+
+  if( lpSupervisor == NULL )
+    return;
+  sup = (LPSUPERVISOR_STATE)lpSupervisor->internal;
+  if( sup != NULL )
+  {
+    SkyeTek_StopSupervisor(lpSupervisor);
+    for( ix = 0; ix < lpSupervisor->count; ix++ )
+    {
+      Supervisor_FreeParams(sup->readers[ix].lpParams);
+    }
+    MUTEX_DESTROY(&sup->lock);
+    free(sup->readers);
+    free(sup);
+  }
+  if( lpSupervisor->lpHealth != NULL )
+    free(lpSupervisor->lpHealth);
+  free(lpSupervisor);
+}
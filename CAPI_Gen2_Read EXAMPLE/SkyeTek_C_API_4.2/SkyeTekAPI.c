@@ -26,6 +26,7 @@
 #endif
 #else
 #include <unistd.h>
+#include <time.h>
 #endif
 
 /****************************************************
@@ -152,6 +153,20 @@ SkyeTek_CreateTag(
   return CreateTagImpl(type,lpId,lpTag);
 }
 
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_RetainTag(
+    const SKYETEK_TAG_VIEW  *lpView,
+    LPSKYETEK_TAG           *lpTag
+    )
+{
+  SKYETEK_ID id;
+  if( lpView == NULL || lpTag == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  id.id = (unsigned char *)lpView->id;
+  id.length = lpView->length;
+  return CreateTagImpl(lpView->type,&id,lpTag);
+}
+
 SKYETEK_API LPSKYETEK_TAG 
 SkyeTek_DuplicateTag(
     LPSKYETEK_TAG       lpTag
@@ -388,6 +403,23 @@ SkyeTek_SelectTags(
   return lpri->SelectTags(lpReader,tagType,callback,inv,loop,user);
 }
 
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_SelectTagViews(
+    LPSKYETEK_READER            lpReader, 
+    SKYETEK_TAGTYPE             tagType, 
+    SKYETEK_TAG_VIEW_CALLBACK   callback, 
+    unsigned char               inv, 
+    unsigned char               loop, 
+    void                        *user
+    )
+{
+  LPREADER_IMPL lpri;
+  if( lpReader == NULL || lpReader->internal == NULL || callback == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  lpri = (LPREADER_IMPL)lpReader->internal;
+  return lpri->SelectTagViews(lpReader,tagType,callback,inv,loop,user);
+}
+
 SKYETEK_API SKYETEK_STATUS 
 SkyeTek_GetTags(
     LPSKYETEK_READER   lpReader, 
@@ -435,6 +467,31 @@ SkyeTek_FreeTags(
   return lpri->FreeTags(lpReader,lpTags,count);
 }
 
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_GetTagSet(
+    LPSKYETEK_READER   lpReader, 
+    SKYETEK_TAGTYPE    tagType, 
+    LPSKYETEK_ID       lpTagIdMask,
+    LPSKYETEK_TAG_SET  *lpSet
+    )
+{
+  LPREADER_IMPL lpri;
+  if( lpReader == NULL || lpReader->internal == NULL || lpSet == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  lpri = (LPREADER_IMPL)lpReader->internal;
+  return lpri->GetTagSet(lpReader,tagType,lpTagIdMask,lpSet);
+}
+
+SKYETEK_API void 
+SkyeTek_FreeTagSet(
+    LPSKYETEK_TAG_SET  lpSet
+    )
+{
+  /* The records are in the same block */
+  if( lpSet != NULL )
+    free(lpSet);
+}
+
 SKYETEK_API SKYETEK_STATUS 
 SkyeTek_StoreKey(
     LPSKYETEK_READER     lpReader,
@@ -622,6 +679,37 @@ SkyeTek_UploadFirmware(
   return lpri->UploadFirmware(lpReader,file,defaultsOnly,callback,user);
 }
 
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_UploadFirmwareImage(
+    LPSKYETEK_READER                      lpReader, 
+    LPSKYETEK_FIRMWARE_IMAGE              lpImage, 
+    unsigned char                         defaultsOnly,
+    SKYETEK_FIRMWARE_PROGRESS_CALLBACK    callback, 
+    void                                  *user
+    )
+{
+  LPREADER_IMPL lpri;
+  if( lpReader == NULL || lpReader->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  lpri = (LPREADER_IMPL)lpReader->internal;
+  return lpri->UploadFirmwareImage(lpReader,lpImage,defaultsOnly,callback,user);
+}
+
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_ExecuteBatch(
+    LPSKYETEK_READER             lpReader,
+    LPSKYETEK_BATCH_OPERATION    lpOps,
+    unsigned int                 count,
+    SKYETEK_STATUS               *lpStatus
+    )
+{
+  LPREADER_IMPL lpri;
+  if( lpReader == NULL || lpReader->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  lpri = (LPREADER_IMPL)lpReader->internal;
+  return lpri->ExecuteBatch(lpReader,lpOps,count,lpStatus);
+}
+
 
 
 
@@ -777,11 +865,17 @@ SkyeTek_GetTagInfo(
     )
 {
   LPTAGIMPL lpti;
+  SKYETEK_STATUS status;
   if( lpReader == NULL || lpReader->internal == NULL || 
       lpTag == NULL || lpTag->internal == NULL )
     return SKYETEK_INVALID_PARAMETER;
   lpti = (LPTAGIMPL)lpTag->internal;
-  return lpti->GetTagInfo(lpReader,lpTag,lpMemory);
+  if( Tag_GetCachedInfo(lpTag,lpMemory) )
+    return SKYETEK_SUCCESS;
+  status = lpti->GetTagInfo(lpReader,lpTag,lpMemory);
+  if( status == SKYETEK_SUCCESS )
+    Tag_CacheInfo(lpTag,lpMemory);
+  return status;
 }
 
 SKYETEK_API SKYETEK_STATUS 
@@ -1267,6 +1361,45 @@ SkyeTek_ReadRecords(
   return lpti->ReadRecords(lpReader,lpTag,lpFile,lpAddr,lpData);
 }
 
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_ReadFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    SKYETEK_STREAM_CALLBACK     callback,
+    void                        *user,
+    unsigned int                *lpRead
+    )
+{
+  LPTAGIMPL lpti;
+  if( lpReader == NULL || lpReader->internal == NULL || 
+      lpTag == NULL || lpTag->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  lpti = (LPTAGIMPL)lpTag->internal;
+  return lpti->ReadFileStream(lpReader,lpTag,lpFile,lpBuffer,size,callback,user,lpRead);
+}
+
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_WriteFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned int                offset,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    unsigned int                *lpWritten
+    )
+{
+  LPTAGIMPL lpti;
+  if( lpReader == NULL || lpReader->internal == NULL || 
+      lpTag == NULL || lpTag->internal == NULL )
+    return SKYETEK_INVALID_PARAMETER;
+  lpti = (LPTAGIMPL)lpTag->internal;
+  return lpti->WriteFileStream(lpReader,lpTag,lpFile,offset,lpBuffer,size,lpWritten);
+}
+
 SKYETEK_API SKYETEK_STATUS 
 SkyeTek_WriteRecord(
     LPSKYETEK_READER     lpReader, 
@@ -1767,6 +1900,39 @@ SkyeTek_Debug(
 	gDebugger(gDbgMsg);
 }
 
+#ifdef WIN32
+CRITICAL_SECTION *
+SKYETEK_StaticMutex(
+  SKYETEK_STATIC_MUTEX  *m
+  )
+{
+  if( m->state != 2 )
+  {
+    /* One thread creates it; the others wait until it is ready */
+    if( InterlockedCompareExchange(&m->state, 1, 0) == 0 )
+    {
+      InitializeCriticalSection(&m->cs);
+      InterlockedExchange(&m->state, 2);
+    }
+    else
+    {
+      while( m->state != 2 )
+        Sleep(0);
+    }
+  }
+  return &m->cs;
+}
+#else
+unsigned long 
+SKYETEK_GetTickCount(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  /* Wraps like GetTickCount rather than overflowing a 32 bit time_t */
+  return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)(ts.tv_nsec / 1000000);
+}
+#endif
+
 /********************************************************************************
  * Raw Device 
  ********************************************************************************/
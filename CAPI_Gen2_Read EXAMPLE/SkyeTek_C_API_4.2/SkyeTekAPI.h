@@ -606,6 +606,424 @@ typedef struct SKYETEK_TRACK1
 	char                   serviceCode[3+1];
 } SKYETEK_TRACK1, *LPSKYETEK_TRACK1;
 
+typedef enum SKYETEK_BATCH_COMMAND
+{
+  BATCH_READ_TAG_DATA = 1,
+  BATCH_WRITE_TAG_DATA,
+  BATCH_GET_TAG_INFO,
+  BATCH_GET_SYSTEM_PARAMETER,
+  BATCH_SET_SYSTEM_PARAMETER,
+  BATCH_LOCK_TAG_BLOCK,       /* lpData holds the lock data */
+  BATCH_SELECT_APPLICATION,   /* DESFire; lpData holds the ASN.1 request */
+  BATCH_GET_FILE_IDS,         /* DESFire; the ASN.1 response goes to lpData */
+  BATCH_GET_FILE_SETTINGS,    /* DESFire; lpRequest in, the ASN.1 response to lpData */
+  BATCH_CREDIT_VALUE_FILE,    /* DESFire; lpData holds the ASN.1 request */
+  BATCH_DEBIT_VALUE_FILE,
+  BATCH_LIMITED_CREDIT_VALUE_FILE,
+  BATCH_WRITE_RECORD,
+  BATCH_COMMIT_TRANSACTION,   /* DESFire; no data */
+  BATCH_ABORT_TRANSACTION,
+  BATCH_ENABLE_EAS,           /* tag addressed by its ID; no data */
+  BATCH_DISABLE_EAS,
+  BATCH_WRITE_AFI             /* lpData holds the AFI */
+} SKYETEK_BATCH_COMMAND;
+
+typedef struct SKYETEK_BATCH_OPERATION
+{
+  SKYETEK_BATCH_COMMAND     command;
+  LPSKYETEK_TAG             lpTag;      /* tag commands only */
+  SKYETEK_ADDRESS           address;    /* tag data commands only */
+  SKYETEK_SYSTEM_PARAMETER  parameter;  /* system parameter commands only */
+  unsigned char             encrypt;
+  unsigned char             hmac;
+  LPSKYETEK_DATA            lpData;     /* input for write/set, output for read/get */
+  SKYETEK_MEMORY            memory;     /* output for BATCH_GET_TAG_INFO */
+  LPSKYETEK_DATA            lpRequest;  /* input for gets that take one */
+} SKYETEK_BATCH_OPERATION, *LPSKYETEK_BATCH_OPERATION;
+
+typedef struct SKYETEK_FIRMWARE_IMAGE
+{
+  TCHAR                 file[256];
+  unsigned int          version;      /* bootloader version required */
+  unsigned long         size;         /* size of the .shf file */
+  unsigned long         dataLength;   /* encrypted firmware bytes */
+  unsigned int          blocks;       /* encrypted firmware blocks */
+  unsigned int          defaults;     /* default system parameter records */
+  void                  *internal;
+} SKYETEK_FIRMWARE_IMAGE, *LPSKYETEK_FIRMWARE_IMAGE;
+
+typedef struct SKYETEK_FIRMWARE_PROGRESS
+{
+  unsigned int          percentComplete;
+  unsigned int          version;
+  unsigned long         bytesSent;          /* acknowledged by the bootloader */
+  unsigned long         bytesTotal;
+  unsigned int          blocksSent;
+  unsigned int          blocksTotal;
+  unsigned long         bytesPerSecond;
+  unsigned long         secondsRemaining;
+  unsigned int          resumes;            /* times the upload resumed after a timeout */
+} SKYETEK_FIRMWARE_PROGRESS, *LPSKYETEK_FIRMWARE_PROGRESS;
+
+typedef struct SKYETEK_FIRMWARE_FLEET_RESULT
+{
+  LPSKYETEK_READER            lpReader;
+  SKYETEK_STATUS              status;           /* status of the upload */
+  SKYETEK_STATUS              verifyStatus;     /* status of the SYS_FIRMWARE check */
+  SKYETEK_STATUS              rollbackStatus;   /* status of the rollback upload, if any */
+  unsigned int                firmwareBefore;   /* SYS_FIRMWARE before; 0 if in bootload */
+  unsigned int                firmwareAfter;    /* SYS_FIRMWARE after the reset */
+  unsigned char               verified;
+  unsigned char               rolledBack;
+  SKYETEK_FIRMWARE_PROGRESS   progress;         /* last progress reported */
+} SKYETEK_FIRMWARE_FLEET_RESULT, *LPSKYETEK_FIRMWARE_FLEET_RESULT;
+
+#define SKYETEK_TAG_READ_ID_SIZE  64
+
+typedef struct SKYETEK_TAG_READ
+{
+  SKYETEK_TAGTYPE       type;
+  unsigned long         timestamp;    /* SKYETEK_GetTickCount() when read */
+  unsigned int          length;       /* bytes used in id */
+  unsigned char         id[SKYETEK_TAG_READ_ID_SIZE];
+} SKYETEK_TAG_READ, *LPSKYETEK_TAG_READ;
+
+typedef struct SKYETEK_TAG_VIEW
+{
+  SKYETEK_TAGTYPE       type;
+  const unsigned char   *id;          /* valid only during the callback */
+  unsigned int          length;
+  unsigned long         timestamp;    /* SKYETEK_GetTickCount() when read */
+} SKYETEK_TAG_VIEW, *LPSKYETEK_TAG_VIEW;
+
+typedef struct SKYETEK_TAG_RECORD
+{
+  SKYETEK_TAGTYPE       type;
+  unsigned int          length;
+  unsigned char         id[SKYETEK_MAX_TAG_LENGTH];
+} SKYETEK_TAG_RECORD, *LPSKYETEK_TAG_RECORD;
+
+typedef struct SKYETEK_TAG_SET
+{
+  unsigned int          count;
+  unsigned int          capacity;
+  LPSKYETEK_TAG_RECORD  tags;         /* count records, allocated with the set */
+} SKYETEK_TAG_SET, *LPSKYETEK_TAG_SET;
+
+typedef struct SKYETEK_PARTITION_STATS
+{
+  unsigned int          partitions;   /* inventories run */
+  unsigned int          splits;       /* partitions split into sub-partitions */
+  unsigned int          retries;      /* failed partitions run again */
+  unsigned int          failures;     /* partitions at the longest mask that failed every retry */
+  SKYETEK_STATUS        lastFailure;
+} SKYETEK_PARTITION_STATS, *LPSKYETEK_PARTITION_STATS;
+
+typedef enum SKYETEK_WINDOW_MODE
+{
+  WINDOW_PRESENCE = 0,    /* a tag departs when it is not read for a window */
+  WINDOW_TUMBLING,        /* counts restart every window; a tag departs after a window without reads */
+  WINDOW_SLIDING          /* counts cover the last window; a tag departs when it is not read for a window */
+} SKYETEK_WINDOW_MODE;
+
+typedef enum SKYETEK_TAG_EVENT
+{
+  TAG_ARRIVED = 1,
+  TAG_DEPARTED
+} SKYETEK_TAG_EVENT;
+
+#define SKYETEK_NO_RSSI   (-32768)
+
+typedef struct SKYETEK_TAG_STATS
+{
+  SKYETEK_TAGTYPE       type;
+  unsigned int          length;
+  unsigned char         id[SKYETEK_TAG_READ_ID_SIZE];
+  unsigned long         reads;        /* reads in the current window */
+  unsigned long         totalReads;   /* reads since the tag arrived */
+  unsigned long         firstSeen;    /* SKYETEK_GetTickCount() of the first read */
+  unsigned long         lastSeen;     /* SKYETEK_GetTickCount() of the last read */
+  LPSKYETEK_READER      lpReader;     /* reader of the last read */
+  unsigned int          antenna;      /* antenna of the last read */
+  int                   rssi;         /* RSSI of the last read or SKYETEK_NO_RSSI */
+} SKYETEK_TAG_STATS, *LPSKYETEK_TAG_STATS;
+
+typedef struct SKYETEK_AGGREGATOR
+{
+  SKYETEK_WINDOW_MODE   mode;
+  unsigned long         window;       /* milliseconds */
+  unsigned int          count;        /* tags present */
+  void                  *internal;
+} SKYETEK_AGGREGATOR, *LPSKYETEK_AGGREGATOR;
+
+typedef struct SKYETEK_INVENTORY_STATS
+{
+  unsigned long         reads;        /* tag reads queued */
+  unsigned long         dropped;      /* tag reads lost because the queue was full */
+  unsigned long         restarts;     /* select loops that ended and were started again */
+  unsigned int          queued;       /* tag reads waiting to be drained */
+  SKYETEK_STATUS        lastStatus;   /* status of the last select loop */
+} SKYETEK_INVENTORY_STATS, *LPSKYETEK_INVENTORY_STATS;
+
+typedef struct SKYETEK_INVENTORY
+{
+  LPSKYETEK_READER      lpReader;
+  SKYETEK_TAGTYPE       tagType;
+  unsigned int          queueSize;    /* tag reads the queue holds */
+  void                  *internal;
+} SKYETEK_INVENTORY, *LPSKYETEK_INVENTORY;
+
+typedef struct SKYETEK_TUNING_RANGE
+{
+  unsigned char         min;
+  unsigned char         max;
+  unsigned char         step;         /* change tried per cycle; 0 leaves the parameter alone */
+} SKYETEK_TUNING_RANGE, *LPSKYETEK_TUNING_RANGE;
+
+typedef struct SKYETEK_TUNING
+{
+  unsigned char         tagPopulation;  /* SYS_TAG_POPULATION */
+  unsigned char         commandRetry;   /* SYS_COMMAND_RETRY */
+  unsigned char         powerLevel;     /* SYS_POWER_LEVEL */
+} SKYETEK_TUNING, *LPSKYETEK_TUNING;
+
+typedef struct SKYETEK_CONTROLLER_CYCLE
+{
+  SKYETEK_TUNING        tuning;       /* settings the cycle ran with */
+  SKYETEK_STATUS        status;       /* status of the inventory */
+  unsigned int          tags;         /* unique tags read */
+  unsigned int          newTags;      /* tags not read in the minute before */
+  unsigned long         duration;     /* milliseconds */
+  unsigned long         yield;        /* unique tags per 1000 seconds */
+} SKYETEK_CONTROLLER_CYCLE, *LPSKYETEK_CONTROLLER_CYCLE;
+
+typedef struct SKYETEK_CONTROLLER
+{
+  LPSKYETEK_READER      lpReader;
+  SKYETEK_TAGTYPE       tagType;
+  SKYETEK_TUNING        best;         /* settings with the highest yield so far */
+  unsigned long         bestYield;
+  unsigned int          cycles;
+  unsigned int          timeouts;     /* cycles that timed out */
+  void                  *internal;
+} SKYETEK_CONTROLLER, *LPSKYETEK_CONTROLLER;
+
+typedef struct SKYETEK_ANTENNA_PORT
+{
+  unsigned char         port;         /* value written to SYS_MUX_CONTROL */
+  unsigned int          weight;       /* dwells per round; 0 counts as 1 */
+  unsigned long         dwell;        /* milliseconds per dwell */
+} SKYETEK_ANTENNA_PORT, *LPSKYETEK_ANTENNA_PORT;
+
+typedef struct SKYETEK_ANTENNA_STATS
+{
+  unsigned char         port;
+  unsigned long         reads;        /* tag reads on this port */
+  unsigned long         dwells;       /* dwells run */
+  unsigned long         skipped;      /* dwells skipped because the port was idle */
+  unsigned int          idleDwells;   /* dwells in a row without a read */
+  unsigned long         lastRead;     /* SKYETEK_GetTickCount() of the last read */
+  SKYETEK_STATUS        lastStatus;   /* status of the last switch or inventory */
+} SKYETEK_ANTENNA_STATS, *LPSKYETEK_ANTENNA_STATS;
+
+typedef struct SKYETEK_ANTENNA_SCHEDULER
+{
+  LPSKYETEK_READER      lpReader;
+  SKYETEK_TAGTYPE       tagType;
+  unsigned int          count;        /* ports */
+  LPSKYETEK_ANTENNA_PORT  lpPorts;
+  LPSKYETEK_ANTENNA_STATS lpStats;    /* one per port */
+  unsigned int          idleSkip;     /* idle dwells before a port is skipped; 0 never skips */
+  unsigned long         rounds;
+  void                  *internal;
+} SKYETEK_ANTENNA_SCHEDULER, *LPSKYETEK_ANTENNA_SCHEDULER;
+
+typedef struct SKYETEK_ORCHESTRATOR_MEMBER
+{
+  LPSKYETEK_READER      lpReader;
+  SKYETEK_TAGTYPE       tagType;
+  unsigned int          group;        /* readers in the same group transmit at the same time */
+  unsigned int          priority;     /* slots per frame; 0 counts as 1 */
+} SKYETEK_ORCHESTRATOR_MEMBER, *LPSKYETEK_ORCHESTRATOR_MEMBER;
+
+typedef struct SKYETEK_READER_THROUGHPUT
+{
+  LPSKYETEK_READER      lpReader;
+  unsigned long         reads;        /* tag reads */
+  unsigned long         slots;        /* slots transmitted in */
+  unsigned long         airTime;      /* milliseconds spent transmitting */
+  unsigned long         rate;         /* reads per 1000 seconds of air time */
+  SKYETEK_STATUS        lastStatus;   /* status of the last slot */
+} SKYETEK_READER_THROUGHPUT, *LPSKYETEK_READER_THROUGHPUT;
+
+typedef struct SKYETEK_ORCHESTRATOR
+{
+  unsigned int                  count;      /* readers */
+  LPSKYETEK_ORCHESTRATOR_MEMBER lpMembers;
+  LPSKYETEK_READER_THROUGHPUT   lpStats;    /* one per reader */
+  unsigned long                 slotTime;   /* milliseconds per slot */
+  unsigned long                 guardTime;  /* milliseconds of silence between slots */
+  unsigned long                 frames;
+  void                          *internal;
+} SKYETEK_ORCHESTRATOR, *LPSKYETEK_ORCHESTRATOR;
+
+typedef enum SKYETEK_READER_STATE
+{
+  READER_ONLINE = 0,
+  READER_DEGRADED,        /* recent calls failed; still in use */
+  READER_OFFLINE,         /* waiting for the next reconnect attempt */
+  READER_RECOVERING       /* reopening the device */
+} SKYETEK_READER_STATE;
+
+typedef struct SKYETEK_READER_HEALTH
+{
+  LPSKYETEK_READER      lpReader;
+  SKYETEK_READER_STATE  state;
+  unsigned long         calls;        /* heartbeats and reported calls */
+  unsigned long         failures;     /* of those, the ones that failed */
+  unsigned int          consecutive;  /* failures in a row */
+  unsigned long         reconnects;   /* successful reconnects */
+  unsigned long         attempts;     /* reconnect attempts */
+  unsigned long         downtime;     /* milliseconds spent offline in total */
+  unsigned long         since;        /* SKYETEK_GetTickCount() of the last state change */
+  unsigned long         backoff;      /* milliseconds until the next attempt */
+  SKYETEK_STATUS        lastStatus;
+} SKYETEK_READER_HEALTH, *LPSKYETEK_READER_HEALTH;
+
+typedef struct SKYETEK_SUPERVISOR
+{
+  unsigned int            count;          /* readers */
+  LPSKYETEK_READER_HEALTH lpHealth;       /* one per reader */
+  unsigned long           interval;       /* milliseconds between heartbeats */
+  unsigned int            failureLimit;   /* failures in a row before a reader is offline */
+  void                    *internal;
+} SKYETEK_SUPERVISOR, *LPSKYETEK_SUPERVISOR;
+
+#define SKYETEK_CACHE_FOREVER   0xFFFFFFFF  /* parameter TTL: keep until invalidated */
+
+typedef enum SKYETEK_GEN2_BANK
+{
+  GEN2_BANK_RESERVED = 0,   /* kill and access passwords */
+  GEN2_BANK_EPC,
+  GEN2_BANK_TID,
+  GEN2_BANK_USER
+} SKYETEK_GEN2_BANK;
+
+typedef struct SKYETEK_BANK_RANGE
+{
+  SKYETEK_GEN2_BANK     bank;
+  unsigned int          start;    /* first word */
+  unsigned int          words;
+  unsigned int          offset;   /* output: byte offset of the range in the data */
+  SKYETEK_STATUS        status;   /* output: status of the read that covered it */
+} SKYETEK_BANK_RANGE, *LPSKYETEK_BANK_RANGE;
+
+typedef struct SKYETEK_ENCODE_JOB
+{
+  LPSKYETEK_TAG         lpTag;
+  SKYETEK_ADDRESS       address;      /* where the payload goes */
+  LPSKYETEK_DATA        lpPayload;    /* address.blocks whole blocks */
+  unsigned char         lock;         /* lock the blocks once they verify */
+  LPSKYETEK_DATA        lpLockData;   /* lock data; required if lock is set */
+} SKYETEK_ENCODE_JOB, *LPSKYETEK_ENCODE_JOB;
+
+typedef struct SKYETEK_ENCODE_RESULT
+{
+  SKYETEK_STATUS        writeStatus;  /* last write */
+  SKYETEK_STATUS        verifyStatus; /* last verify; SKYETEK_TAG_DATA_INTEGRITY_CHECK_FAILED on a mismatch */
+  SKYETEK_STATUS        lockStatus;   /* SKYETEK_SUCCESS if no lock was asked for */
+  unsigned int          retries;      /* blocks written again */
+  unsigned char         verified;
+  unsigned char         locked;
+  unsigned long         elapsed;      /* milliseconds from the first write to the end of the job */
+} SKYETEK_ENCODE_RESULT, *LPSKYETEK_ENCODE_RESULT;
+
+typedef struct SKYETEK_STREAM_PROGRESS
+{
+  unsigned int          nextBlock;    /* first block not transferred; start here to resume */
+  unsigned int          blocks;       /* blocks transferred */
+  unsigned int          chunkBlocks;  /* blocks per request at the end */
+  unsigned int          requests;     /* requests sent, with the ones sent again */
+  SKYETEK_STATUS        status;       /* status of the last request */
+} SKYETEK_STREAM_PROGRESS, *LPSKYETEK_STREAM_PROGRESS;
+
+typedef struct SKYETEK_TAG_GEOMETRY
+{
+  SKYETEK_TAGTYPE       type;         /* a type naming one IC, not an auto detect type */
+  unsigned int          startBlock;
+  unsigned int          maxBlock;
+  unsigned int          bytesPerBlock;
+} SKYETEK_TAG_GEOMETRY, *LPSKYETEK_TAG_GEOMETRY;
+
+typedef struct SKYETEK_DESFIRE_FILE
+{
+  unsigned char           id;
+  SKYETEK_STATUS          status;       /* of getting its settings */
+  SKYETEK_FILE_SETTINGS   settings;
+  unsigned int            fileSize;     /* data files */
+  unsigned int            lowerLimit;   /* value files */
+  unsigned int            upperLimit;
+  unsigned int            limitedCreditValue;
+  unsigned char           limitedCreditEnabled;
+  unsigned int            recordSize;   /* record files */
+  unsigned int            maxRecords;
+  unsigned int            numRecords;
+} SKYETEK_DESFIRE_FILE, *LPSKYETEK_DESFIRE_FILE;
+
+typedef struct SKYETEK_DESFIRE_APP
+{
+  unsigned char           aid[3];
+  SKYETEK_STATUS          status;       /* of selecting it and listing its files */
+  unsigned int            fileCount;
+  LPSKYETEK_DESFIRE_FILE  lpFiles;
+} SKYETEK_DESFIRE_APP, *LPSKYETEK_DESFIRE_APP;
+
+typedef struct SKYETEK_DESFIRE_SNAPSHOT
+{
+  unsigned int            appCount;
+  LPSKYETEK_DESFIRE_APP   lpApps;
+} SKYETEK_DESFIRE_SNAPSHOT, *LPSKYETEK_DESFIRE_SNAPSHOT;
+
+typedef enum SKYETEK_DESFIRE_OP
+{
+  DESFIRE_OP_CREDIT = 1,
+  DESFIRE_OP_DEBIT,
+  DESFIRE_OP_LIMITED_CREDIT,
+  DESFIRE_OP_WRITE_RECORD
+} SKYETEK_DESFIRE_OP;
+
+typedef struct SKYETEK_DESFIRE_OPERATION
+{
+  SKYETEK_DESFIRE_OP      op;
+  unsigned char           fileId;
+  unsigned int            amount;       /* value operations */
+  unsigned int            offset;       /* record writes */
+  LPSKYETEK_DATA          lpData;
+  SKYETEK_STATUS          status;       /* output */
+} SKYETEK_DESFIRE_OPERATION, *LPSKYETEK_DESFIRE_OPERATION;
+
+typedef struct SKYETEK_DESFIRE_TRANSACTION
+{
+  SKYETEK_STATUS          status;       /* SKYETEK_SUCCESS if committed */
+  unsigned int            failed;       /* first operation that failed, or the count */
+  unsigned char           committed;
+  SKYETEK_STATUS          selectStatus;
+  SKYETEK_STATUS          commitStatus; /* of the commit, or the abort */
+  unsigned long           elapsed;      /* milliseconds */
+} SKYETEK_DESFIRE_TRANSACTION, *LPSKYETEK_DESFIRE_TRANSACTION;
+
+typedef struct SKYETEK_CRYPTO_SESSION
+{
+  LPSKYETEK_READER      lpReader;
+  unsigned char         encrypt;      /* applied to every read and write */
+  unsigned char         hmac;
+  unsigned int          keyStores;    /* key stores sent */
+  unsigned int          keyLoads;     /* key loads sent */
+  unsigned int          authentications;
+  unsigned int          retries;      /* operations sent again after authenticating */
+  void                  *internal;
+} SKYETEK_CRYPTO_SESSION, *LPSKYETEK_CRYPTO_SESSION;
+
 
 /****************************************************
  * CALLBACKS 
@@ -623,6 +1041,80 @@ typedef unsigned char
     void            *user
     );
 
+/**
+ * Tag select callback that allocates nothing. The view and the ID it
+ * points to belong to the caller and are only valid until the callback
+ * returns; use SkyeTek_RetainTag() to keep the tag.
+ * @param lpView Tag selected, or NULL when no tag was read before the timeout
+ * @param user User data
+ * @return 0 to stop inventory/loop, 1 to continue
+ */ 
+typedef unsigned char 
+(*SKYETEK_TAG_VIEW_CALLBACK)(
+    const SKYETEK_TAG_VIEW  *lpView, 
+    void                    *user
+    );
+
+/**
+ * Tag aggregator callback. Called with the aggregator locked, so it
+ * must not call back into the same aggregator.
+ * @param event TAG_ARRIVED or TAG_DEPARTED
+ * @param lpStats Tag that arrived or departed
+ * @param user User data
+ */ 
+typedef void 
+(*SKYETEK_TAG_EVENT_CALLBACK)(
+    SKYETEK_TAG_EVENT         event,
+    const SKYETEK_TAG_STATS   *lpStats, 
+    void                      *user
+    );
+
+/**
+ * Antenna scheduler callback. Called with the reads of a dwell while
+ * the multiplexer switches to the next port, so it must not use the
+ * reader.
+ * @param port Port the tag was read on
+ * @param lpRead Tag read
+ * @param user User data
+ * @return 0 to stop the round, 1 to continue
+ */ 
+typedef unsigned char 
+(*SKYETEK_ANTENNA_READ_CALLBACK)(
+    unsigned char             port,
+    const SKYETEK_TAG_READ    *lpRead, 
+    void                      *user
+    );
+
+/**
+ * Orchestrator callback. Reads arrive in time order across readers.
+ * @param lpReader Reader that read the tag
+ * @param lpRead Tag read
+ * @param user User data
+ * @return 0 to stop the frame, 1 to continue
+ */ 
+typedef unsigned char 
+(*SKYETEK_ORCHESTRATOR_READ_CALLBACK)(
+    LPSKYETEK_READER          lpReader,
+    const SKYETEK_TAG_READ    *lpRead, 
+    void                      *user
+    );
+
+/**
+ * Supervisor callback. Called when a reader changes state, with the
+ * supervisor locked, so it must not call back into the same supervisor.
+ * @param lpReader Reader that changed state
+ * @param oldState State before
+ * @param newState State now
+ * @param user User data
+ */ 
+typedef void 
+(*SKYETEK_READER_STATE_CALLBACK)(
+    LPSKYETEK_READER          lpReader,
+    SKYETEK_READER_STATE      oldState,
+    SKYETEK_READER_STATE      newState,
+    void                      *user
+    );
+
 /**
  * Firmware upload callback. Called everytime a block is successfully written.
  * @param percentComplete Percent of upload completed
@@ -637,6 +1129,34 @@ typedef int
     void            *user
     );
 
+/**
+ * Firmware upload progress callback. Called every time a block is
+ * acknowledged by the bootloader and on every stage of the upload.
+ * @param lpProgress Progress, throughput and estimated time remaining
+ * @param user User data
+ * @return Zero if the user canceled, one to continue
+ */
+typedef int 
+(*SKYETEK_FIRMWARE_PROGRESS_CALLBACK)(
+    LPSKYETEK_FIRMWARE_PROGRESS   lpProgress,
+    void                          *user
+    );
+
+/**
+ * Fleet firmware upload callback. Calls are serialized so the
+ * callback does not have to be thread safe.
+ * @param lpReader Reader the progress is for
+ * @param lpProgress Progress of the upload to that reader
+ * @param user User data
+ * @return Zero to cancel the upload to this reader, one to continue
+ */
+typedef int 
+(*SKYETEK_FIRMWARE_FLEET_CALLBACK)(
+    LPSKYETEK_READER              lpReader,
+    LPSKYETEK_FIRMWARE_PROGRESS   lpProgress,
+    void                          *user
+    );
+
 /**
  * Payment scan mode callback. This is called by the API every time
  * a payment line is received by the reader when it is in payment
@@ -655,6 +1175,23 @@ typedef unsigned char
  * Debug output callback. Called by API to report debugging messages.
  * @param msg Message to write to debugger
  */
+/**
+ * Tag memory stream callback. Called with each chunk of a streaming
+ * read, in block order.
+ * @param block First block of the chunk; the byte offset for DESFire files
+ * @param data Data of the chunk
+ * @param size Size of the data in bytes
+ * @param user User data
+ * @return Zero to stop the read, one to continue
+ */
+typedef int 
+(*SKYETEK_STREAM_CALLBACK)(
+    unsigned int    block,
+    unsigned char   *data,
+    unsigned int    size,
+    void            *user
+    );
+
 typedef void 
 (*SKYETEK_DEBUG_CALLBACK)(
     TCHAR *msg
@@ -834,6 +1371,192 @@ SkyeTek_SelectTags(
     void                        *user
     );
 
+/** 
+ * Same as SkyeTek_SelectTags() but passes each tag as a read-only view
+ * on the stack, so nothing is allocated per tag.
+ * @param lpReader Reader to execute this command on.
+ * @param tagType Select only a specific tag type. 
+ * @param callback Function to call when a tag is found. The return of this
+ * function determines when this call completes if in loop mode (0 to stop, 1 to continue)
+ * @param inv true(1) indicates the reader should run in inventory/anti-collision mode
+ * @param loop Run reader in loop mode, reader will continually scan for
+ * tags in its field. 
+ * @param user User data to pass to callback along with tag
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_SelectTagViews(
+    LPSKYETEK_READER            lpReader, 
+    SKYETEK_TAGTYPE             tagType, 
+    SKYETEK_TAG_VIEW_CALLBACK   callback, 
+    unsigned char               inv, 
+    unsigned char               loop, 
+    void                        *user
+    );
+
+/**
+ * Starts reading tags continuously on a thread of its own. The thread
+ * runs the select loop and queues every tag read; nothing the caller
+ * does delays the reader. When the queue is full new reads are dropped
+ * and counted. No other commands may be sent to the reader until
+ * SkyeTek_StopInventory() is called.
+ * @param lpReader Reader to read tags with
+ * @param tagType Select only a specific tag type
+ * @param inv true(1) to run in inventory/anti-collision mode
+ * @param queueSize Tag reads the queue holds; rounded up to a power of two, 0 for the default
+ * @param lpInventory Receives the inventory; free with SkyeTek_StopInventory()
+ * @return SKYETEK_NOT_SUPPORTED if the platform has no threads
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_StartInventory(
+    LPSKYETEK_READER            lpReader, 
+    SKYETEK_TAGTYPE             tagType, 
+    unsigned char               inv, 
+    unsigned int                queueSize,
+    LPSKYETEK_INVENTORY         *lpInventory
+    );
+
+/**
+ * Takes the queued tag reads, oldest first, without waiting.
+ * @param lpInventory Inventory started with SkyeTek_StartInventory()
+ * @param lpReads Array that receives the tag reads
+ * @param max Number of entries in lpReads
+ * @param count Receives the number of tag reads copied
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_PollInventory(
+    LPSKYETEK_INVENTORY         lpInventory,
+    LPSKYETEK_TAG_READ          lpReads,
+    unsigned int                max,
+    unsigned int                *count
+    );
+
+/**
+ * Takes the queued tag reads, waiting for at least one to arrive.
+ * @param lpInventory Inventory started with SkyeTek_StartInventory()
+ * @param lpReads Array that receives the tag reads
+ * @param max Number of entries in lpReads
+ * @param count Receives the number of tag reads copied
+ * @param timeout Milliseconds to wait
+ * @return SKYETEK_TIMEOUT if nothing was read in time
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_WaitInventory(
+    LPSKYETEK_INVENTORY         lpInventory,
+    LPSKYETEK_TAG_READ          lpReads,
+    unsigned int                max,
+    unsigned int                *count,
+    unsigned int                timeout
+    );
+
+/**
+ * Gets the read and drop counters of an inventory.
+ * @param lpInventory Inventory started with SkyeTek_StartInventory()
+ * @param lpStats Receives the counters
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_GetInventoryStats(
+    LPSKYETEK_INVENTORY         lpInventory,
+    LPSKYETEK_INVENTORY_STATS   lpStats
+    );
+
+/**
+ * Stops the select loop, waits for the thread to finish and frees
+ * the inventory. Tag reads still queued are discarded.
+ * @param lpInventory Inventory started with SkyeTek_StartInventory()
+ */
+SKYETEK_API void 
+SkyeTek_StopInventory(
+    LPSKYETEK_INVENTORY         lpInventory
+    );
+
+/**
+ * Creates a tag aggregator. It keeps one entry per tag type and ID
+ * with read counts and first/last-seen times, and reports tags as
+ * they arrive and depart. Memory follows the number of tags present.
+ * Reads from several readers may be fed to the same aggregator.
+ * @param mode How reads are counted and when a tag departs
+ * @param window Window or presence timeout in milliseconds
+ * @param callback Function to call when a tag arrives or departs; may be NULL
+ * @param user User data passed to callback
+ * @param lpAggregator Receives the aggregator; free with SkyeTek_FreeAggregator()
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_CreateAggregator(
+    SKYETEK_WINDOW_MODE           mode,
+    unsigned long                 window,
+    SKYETEK_TAG_EVENT_CALLBACK    callback,
+    void                          *user,
+    LPSKYETEK_AGGREGATOR          *lpAggregator
+    );
+
+/**
+ * Adds one tag read.
+ * @param lpAggregator Aggregator to add to
+ * @param lpReader Reader that read the tag; may be NULL
+ * @param lpView Tag read, as passed to a SKYETEK_TAG_VIEW_CALLBACK
+ * @param antenna Antenna the tag was read on
+ * @param rssi Signal strength or SKYETEK_NO_RSSI
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_AggregateTag(
+    LPSKYETEK_AGGREGATOR          lpAggregator,
+    LPSKYETEK_READER              lpReader,
+    const SKYETEK_TAG_VIEW        *lpView,
+    unsigned int                  antenna,
+    int                           rssi
+    );
+
+/**
+ * Adds a batch of tag reads taken from an inventory.
+ * @param lpAggregator Aggregator to add to
+ * @param lpReader Reader that read the tags; may be NULL
+ * @param lpReads Tag reads from SkyeTek_PollInventory() or SkyeTek_WaitInventory()
+ * @param count Number of tag reads
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_AggregateTagReads(
+    LPSKYETEK_AGGREGATOR          lpAggregator,
+    LPSKYETEK_READER              lpReader,
+    const SKYETEK_TAG_READ        *lpReads,
+    unsigned int                  count
+    );
+
+/**
+ * Reports the tags that departed by the given time. Adding reads does
+ * this too; call it when no reads are arriving.
+ * @param lpAggregator Aggregator to update
+ * @param now Current SKYETEK_GetTickCount()
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_AdvanceAggregator(
+    LPSKYETEK_AGGREGATOR          lpAggregator,
+    unsigned long                 now
+    );
+
+/**
+ * Copies out the tags that are present.
+ * @param lpAggregator Aggregator to read
+ * @param lpStats Array that receives the tags
+ * @param max Number of entries in lpStats
+ * @param count Receives the number of tags copied
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_GetAggregatedTags(
+    LPSKYETEK_AGGREGATOR          lpAggregator,
+    LPSKYETEK_TAG_STATS           lpStats,
+    unsigned int                  max,
+    unsigned int                  *count
+    );
+
+/**
+ * Frees an aggregator. No departed events are reported.
+ * @param lpAggregator Aggregator to free
+ */
+SKYETEK_API void 
+SkyeTek_FreeAggregator(
+    LPSKYETEK_AGGREGATOR          lpAggregator
+    );
+
 /** 
  * Gets the list of tags that the reader has detected. 
  * @param lpReader Reader to execute this command on.
@@ -883,6 +1606,606 @@ SkyeTek_FreeTags(
     unsigned short    count
     );
 
+/** 
+ * Gets the list of tags that the reader has detected as one block of
+ * fixed-size records with the IDs stored inline. Unlike
+ * SkyeTek_GetTags() nothing is allocated per tag.
+ * @param lpReader Reader to execute this command on.
+ * @param tagType Select only a specific tag type. 
+ * @param lpTagIdMask Mask for TID matching, as in SkyeTek_GetTagsWithMask(); NULL for none
+ * @param lpSet Receives the tags; free with SkyeTek_FreeTagSet()
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_GetTagSet(
+    LPSKYETEK_READER   lpReader, 
+    SKYETEK_TAGTYPE    tagType, 
+    LPSKYETEK_ID       lpTagIdMask,
+    LPSKYETEK_TAG_SET  *lpSet
+    );
+
+/**
+ * Frees the tags returned from SkyeTek_GetTagSet().
+ * @param lpSet Tags to free
+ */
+SKYETEK_API void 
+SkyeTek_FreeTagSet(
+    LPSKYETEK_TAG_SET  lpSet
+    );
+
+/** 
+ * Inventories a dense population by splitting the ID space on TID
+ * mask prefixes. A partition that returns at least splitThreshold tags
+ * is split into 256 partitions, one for each value of its next byte,
+ * down to maxDepth bytes. A partition that fails is run again, then
+ * split the same way. The partitions are spread over all
+ * the readers given, which should cover the same zone, and the tags
+ * are merged into one set without duplicates. Requires a reader that
+ * supports TID masks (M9).
+ * @param lpReaders Readers covering the zone; each must be on its own device
+ * @param count Number of readers
+ * @param tagType Select only a specific tag type. 
+ * @param maxDepth Longest mask in bytes; 1 to 16
+ * @param splitThreshold Tags returned by a partition that make it split; 0 to never split
+ * @param lpSet Receives the tags; free with SkyeTek_FreeTagSet()
+ * @param lpStats Receives the partition counts; may be NULL. Tags
+ *        from partitions that failed may be missing only when failures is not 0.
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_GetTagSetPartitioned(
+    LPSKYETEK_READER            *lpReaders, 
+    unsigned int                count,
+    SKYETEK_TAGTYPE             tagType, 
+    unsigned int                maxDepth,
+    unsigned int                splitThreshold,
+    LPSKYETEK_TAG_SET           *lpSet,
+    LPSKYETEK_PARTITION_STATS   lpStats
+    );
+
+/**
+ * Runs one command on every tag of an inventoried set. The commands go
+ * out as one batch, each addressed to its tag by ID, with the RF field
+ * held on until the last.
+ * @param lpReader Reader to execute this command on.
+ * @param lpSet Tags from SkyeTek_GetTagSet() or SkyeTek_GetTagSetPartitioned()
+ * @param command BATCH_ENABLE_EAS, BATCH_DISABLE_EAS or BATCH_WRITE_AFI
+ * @param lpData The AFI for BATCH_WRITE_AFI; NULL otherwise
+ * @param lpBitmap Receives a bit per tag, set if the command succeeded on
+ *        it; bit 0 of byte 0 is the first tag. Must hold (count+7)/8 bytes.
+ * @param lpSucceeded Receives the number of tags the command succeeded on; may be NULL
+ * @return SKYETEK_SUCCESS if the batch ran; check the bitmap for each tag
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_ApplyToTagSet(
+    LPSKYETEK_READER            lpReader,
+    LPSKYETEK_TAG_SET           lpSet,
+    SKYETEK_BATCH_COMMAND       command,
+    LPSKYETEK_DATA              lpData,
+    unsigned char               *lpBitmap,
+    unsigned int                *lpSucceeded
+    );
+
+/**
+ * Inventories the tags matching a mask and runs one command on all of
+ * them, as SkyeTek_ApplyToTagSet() does.
+ * @param lpReader Reader to execute this command on.
+ * @param tagType Select only a specific tag type. 
+ * @param lpTagIdMask Mask for TID matching, as in SkyeTek_GetTagsWithMask(); NULL for none
+ * @param command BATCH_ENABLE_EAS, BATCH_DISABLE_EAS or BATCH_WRITE_AFI
+ * @param lpData The AFI for BATCH_WRITE_AFI; NULL otherwise
+ * @param lpSet Receives the tags found; free with SkyeTek_FreeTagSet()
+ * @param lpBitmap Receives the bitmap of tags the command succeeded on;
+ *        it is allocated, free it with SkyeTek_FreeData()
+ * @param lpSucceeded Receives the number of tags the command succeeded on; may be NULL
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_ApplyToTags(
+    LPSKYETEK_READER            lpReader,
+    SKYETEK_TAGTYPE             tagType,
+    LPSKYETEK_ID                lpTagIdMask,
+    SKYETEK_BATCH_COMMAND       command,
+    LPSKYETEK_DATA              lpData,
+    LPSKYETEK_TAG_SET           *lpSet,
+    LPSKYETEK_DATA              *lpBitmap,
+    unsigned int                *lpSucceeded
+    );
+
+/**
+ * Creates an inventory controller. Each cycle it inventories with the
+ * current settings, measures the unique tags per second and moves one
+ * of SYS_TAG_POPULATION, SYS_COMMAND_RETRY or SYS_POWER_LEVEL a step
+ * toward a higher yield, staying within the ranges given. It starts
+ * from the reader's current settings.
+ * @param lpReader Reader to tune
+ * @param tagType Select only a specific tag type. 
+ * @param lpPopulation Range for SYS_TAG_POPULATION; NULL leaves it alone
+ * @param lpRetry Range for SYS_COMMAND_RETRY; NULL leaves it alone
+ * @param lpPower Range for SYS_POWER_LEVEL; NULL leaves it alone
+ * @param lpController Receives the controller; free with SkyeTek_FreeController()
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_CreateController(
+    LPSKYETEK_READER            lpReader,
+    SKYETEK_TAGTYPE             tagType,
+    LPSKYETEK_TUNING_RANGE      lpPopulation,
+    LPSKYETEK_TUNING_RANGE      lpRetry,
+    LPSKYETEK_TUNING_RANGE      lpPower,
+    LPSKYETEK_CONTROLLER        *lpController
+    );
+
+/**
+ * Runs one inventory cycle and adjusts the settings for the next one.
+ * A cycle that fails or times out counts as a zero yield.
+ * @param lpController Controller to run
+ * @param lpCycle Receives the results of the cycle; may be NULL
+ * @param lpSet Receives the tags read; may be NULL. Free with SkyeTek_FreeTagSet()
+ * @return SKYETEK_SUCCESS unless a setting could not be written to the reader
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_RunControllerCycle(
+    LPSKYETEK_CONTROLLER        lpController,
+    LPSKYETEK_CONTROLLER_CYCLE  lpCycle,
+    LPSKYETEK_TAG_SET           *lpSet
+    );
+
+/**
+ * Frees the controller. The reader keeps the settings last written;
+ * see lpController->best for the ones to keep.
+ * @param lpController Controller to free
+ */
+SKYETEK_API void 
+SkyeTek_FreeController(
+    LPSKYETEK_CONTROLLER        lpController
+    );
+
+/**
+ * Creates an antenna scheduler for a reader with a multiplexer. Each
+ * round interleaves the ports in proportion to their weights. A port
+ * that has read nothing for idleSkip dwells is only tried once every
+ * idleSkip rounds until it reads a tag again.
+ * @param lpReader Reader with the multiplexer
+ * @param tagType Select only a specific tag type. 
+ * @param lpPorts Ports to schedule; copied
+ * @param count Number of ports
+ * @param idleSkip Idle dwells before a port is skipped; 0 never skips
+ * @param lpScheduler Receives the scheduler; free with SkyeTek_FreeAntennaScheduler()
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_CreateAntennaScheduler(
+    LPSKYETEK_READER              lpReader,
+    SKYETEK_TAGTYPE               tagType,
+    LPSKYETEK_ANTENNA_PORT        lpPorts,
+    unsigned int                  count,
+    unsigned int                  idleSkip,
+    LPSKYETEK_ANTENNA_SCHEDULER   *lpScheduler
+    );
+
+/**
+ * Runs one round over the ports. The switch to the next port is sent
+ * while the reads of the last dwell are passed to the callback. The
+ * multiplexer is not switched between dwells on the same port.
+ * @param lpScheduler Scheduler to run
+ * @param callback Function to call with each tag read and its port
+ * @param user User data passed to callback
+ * @return SKYETEK_SUCCESS if at least one dwell ran; see lpStats for each port
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_RunAntennaRound(
+    LPSKYETEK_ANTENNA_SCHEDULER   lpScheduler,
+    SKYETEK_ANTENNA_READ_CALLBACK callback,
+    void                          *user
+    );
+
+/**
+ * Frees the scheduler.
+ * @param lpScheduler Scheduler to free
+ */
+SKYETEK_API void 
+SkyeTek_FreeAntennaScheduler(
+    LPSKYETEK_ANTENNA_SCHEDULER   lpScheduler
+    );
+
+/**
+ * Creates an orchestrator that shares the air between nearby readers
+ * in time slots. Only readers of one group transmit in a slot; a
+ * frame gives each reader as many slots as its priority. Each reader
+ * must be on its own device.
+ * @param lpMembers Readers with their groups and priorities; copied
+ * @param count Number of readers
+ * @param slotTime Milliseconds per slot; must not be 0
+ * @param guardTime Milliseconds of silence between slots
+ * @param lpOrchestrator Receives the orchestrator; free with SkyeTek_FreeOrchestrator()
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_CreateOrchestrator(
+    LPSKYETEK_ORCHESTRATOR_MEMBER   lpMembers,
+    unsigned int                    count,
+    unsigned long                   slotTime,
+    unsigned long                   guardTime,
+    LPSKYETEK_ORCHESTRATOR          *lpOrchestrator
+    );
+
+/**
+ * Runs one frame. The readers of a slot inventory in parallel and
+ * their reads are merged in time order before the next slot starts.
+ * @param lpOrchestrator Orchestrator to run
+ * @param callback Function to call with each tag read
+ * @param user User data passed to callback
+ * @return SKYETEK_SUCCESS if at least one reader ran; see lpStats for each reader
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_RunOrchestratorFrame(
+    LPSKYETEK_ORCHESTRATOR              lpOrchestrator,
+    SKYETEK_ORCHESTRATOR_READ_CALLBACK  callback,
+    void                                *user
+    );
+
+/**
+ * Frees the orchestrator. The readers are not freed.
+ * @param lpOrchestrator Orchestrator to free
+ */
+SKYETEK_API void 
+SkyeTek_FreeOrchestrator(
+    LPSKYETEK_ORCHESTRATOR          lpOrchestrator
+    );
+
+/**
+ * Creates a supervisor for a set of readers. Each check sends a
+ * SYS_FIRMWARE heartbeat to readers that have not reported a good call
+ * within the interval. A reader that fails failureLimit times in a row
+ * goes offline and its device is reopened with exponential backoff;
+ * once it answers again the parameters set with
+ * SkyeTek_SetSupervisedParameter() are written back.
+ * @param lpReaders Readers to supervise
+ * @param count Number of readers
+ * @param interval Milliseconds between heartbeats
+ * @param failureLimit Failures in a row before a reader goes offline; 0 for 3
+ * @param callback Function to call on state changes; may be NULL
+ * @param user User data passed to callback
+ * @param lpSupervisor Receives the supervisor; free with SkyeTek_FreeSupervisor()
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_CreateSupervisor(
+    LPSKYETEK_READER                *lpReaders,
+    unsigned int                    count,
+    unsigned long                   interval,
+    unsigned int                    failureLimit,
+    SKYETEK_READER_STATE_CALLBACK   callback,
+    void                            *user,
+    LPSKYETEK_SUPERVISOR            *lpSupervisor
+    );
+
+/**
+ * Runs the heartbeats and reconnect attempts that are due. Call it
+ * from the thread that uses the readers, or use
+ * SkyeTek_StartSupervisor() for readers nothing else uses.
+ * @param lpSupervisor Supervisor to run
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_CheckReaders(
+    LPSKYETEK_SUPERVISOR    lpSupervisor
+    );
+
+/**
+ * Runs SkyeTek_CheckReaders() on a thread of its own until
+ * SkyeTek_StopSupervisor() or SkyeTek_FreeSupervisor().
+ * @param lpSupervisor Supervisor to start
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_StartSupervisor(
+    LPSKYETEK_SUPERVISOR    lpSupervisor
+    );
+
+/**
+ * Stops the supervisor thread.
+ * @param lpSupervisor Supervisor to stop
+ */
+SKYETEK_API void 
+SkyeTek_StopSupervisor(
+    LPSKYETEK_SUPERVISOR    lpSupervisor
+    );
+
+/**
+ * Reports the status of a call the application made on a reader. A
+ * good call stands in for a heartbeat.
+ * @param lpSupervisor Supervisor of the reader
+ * @param lpReader Reader the call was made on
+ * @param status Status the call returned
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_ReportReaderStatus(
+    LPSKYETEK_SUPERVISOR    lpSupervisor,
+    LPSKYETEK_READER        lpReader,
+    SKYETEK_STATUS          status
+    );
+
+/**
+ * Sets a system parameter on a reader and keeps it so it can be
+ * written back after a reconnect.
+ * @param lpSupervisor Supervisor of the reader
+ * @param lpReader Reader to set the parameter on
+ * @param parameter Parameter to set
+ * @param lpData Value to set; copied
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_SetSupervisedParameter(
+    LPSKYETEK_SUPERVISOR        lpSupervisor,
+    LPSKYETEK_READER            lpReader,
+    SKYETEK_SYSTEM_PARAMETER    parameter,
+    LPSKYETEK_DATA              lpData
+    );
+
+/**
+ * Stops and frees the supervisor. The readers are not freed.
+ * @param lpSupervisor Supervisor to free
+ */
+SKYETEK_API void 
+SkyeTek_FreeSupervisor(
+    LPSKYETEK_SUPERVISOR    lpSupervisor
+    );
+
+/**
+ * Turns on the system parameter cache of a reader. Values read with
+ * SkyeTek_GetSystemParameter() are kept and handed back until their
+ * time to live runs out. The serial number, firmware, hardware and
+ * product are kept until the cache is invalidated; the user port
+ * value, bootload mode and current frequency are never kept. Setting
+ * a parameter drops it from the cache, and SkyeTek_LoadDefaults(),
+ * SkyeTek_ResetDevice() and SkyeTek_Bootload() drop everything.
+ * @param lpReader Reader to cache the parameters of
+ * @param ttl Milliseconds the other parameters are kept; 0 to keep only the fixed ones
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_EnableParameterCache(
+    LPSKYETEK_READER    lpReader,
+    unsigned long       ttl
+    );
+
+/**
+ * Sets how long one parameter is kept in the cache.
+ * @param lpReader Reader with the cache enabled
+ * @param parameter Parameter to set the time to live of
+ * @param ttl Milliseconds to keep it; 0 never to keep it, SKYETEK_CACHE_FOREVER
+ *        to keep it until the cache is invalidated
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_SetParameterTTL(
+    LPSKYETEK_READER            lpReader,
+    SKYETEK_SYSTEM_PARAMETER    parameter,
+    unsigned long               ttl
+    );
+
+/**
+ * Reads every cached parameter the reader supports in one batch,
+ * pipelined on STPv3 readers. Call it after the reader is opened.
+ * Parameters the reader rejects are left out.
+ * @param lpReader Reader with the cache enabled
+ * @param lpCount Receives the number of parameters read; may be NULL
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_PrefetchParameters(
+    LPSKYETEK_READER    lpReader,
+    unsigned int        *lpCount
+    );
+
+/**
+ * Drops every value in the cache; the next reads go to the reader.
+ * @param lpReader Reader with the cache enabled
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_InvalidateParameterCache(
+    LPSKYETEK_READER    lpReader
+    );
+
+/**
+ * Turns off and frees the system parameter cache of a reader. Do not
+ * call it while another thread uses the reader.
+ * @param lpReader Reader to stop caching the parameters of
+ */
+SKYETEK_API void 
+SkyeTek_DisableParameterCache(
+    LPSKYETEK_READER    lpReader
+    );
+
+/**
+ * Reads several ranges of Gen2 tag memory in one sequence. Ranges in
+ * the same bank that touch or overlap are read together, and the reads
+ * go out back to back with the RF field left on so the tag stays
+ * selected between them. The ranges are laid out one after the other
+ * in the returned data in the order given.
+ * @param lpReader Reader to read the tag with
+ * @param lpTag Tag to read
+ * @param lpRanges Ranges to read; offset and status are filled in
+ * @param count Number of ranges
+ * @param lpData Receives the data of every range; free with SkyeTek_FreeData().
+ *        Ranges that could not be read are zero.
+ * @return SKYETEK_SUCCESS if the reads ran; check the status of each range
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_ReadTagBanks(
+    LPSKYETEK_READER        lpReader,
+    LPSKYETEK_TAG           lpTag,
+    LPSKYETEK_BANK_RANGE    lpRanges,
+    unsigned int            count,
+    LPSKYETEK_DATA          *lpData
+    );
+
+/**
+ * Writes, verifies and locks a stream of tags. Jobs are batched so the
+ * next job's write goes out while the current verify is parsed. Blocks
+ * that read back wrong are written again, from the first bad block to
+ * the last, up to maxRetries times; a job is locked in the batch after
+ * the one it verified in, and only if it verified.
+ * @param lpReader Reader to encode with
+ * @param lpJobs Jobs to run, in order
+ * @param count Number of jobs
+ * @param maxRetries Rewrites of the bad blocks of a job at most
+ * @param lpResults Array of count entries that receives the result of each job
+ * @return SKYETEK_SUCCESS if every job ran; check lpResults for each job
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_EncodeTags(
+    LPSKYETEK_READER          lpReader,
+    LPSKYETEK_ENCODE_JOB      lpJobs,
+    unsigned int              count,
+    unsigned int              maxRetries,
+    LPSKYETEK_ENCODE_RESULT   lpResults
+    );
+
+/**
+ * Reads a tag memory of any size. The block size and the memory range
+ * come from SkyeTek_GetTagInfo(); the read is split into chunks sized
+ * for the protocol, the reader model and the tag type, and the chunks
+ * are sent as a batch. A chunk that fails is read again at half the
+ * size. If the read stops part way, lpProgress->nextBlock is where to
+ * start it again.
+ * @param lpReader Reader to read with
+ * @param lpTag Tag to read
+ * @param lpAddr Blocks to read; NULL or zero blocks reads to the end of the memory
+ * @param lpBuffer Buffer that receives the data, or NULL to only use the callback
+ * @param size Size of the buffer in bytes
+ * @param callback Called with each chunk in order, or NULL
+ * @param user User data passed to the callback
+ * @param lpProgress Receives how far the read got; may be NULL
+ * @return SKYETEK_SUCCESS if every block was read, SKYETEK_FAILURE if the callback stopped it
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_ReadTagMemory(
+    LPSKYETEK_READER            lpReader,
+    LPSKYETEK_TAG               lpTag,
+    LPSKYETEK_ADDRESS           lpAddr,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    SKYETEK_STREAM_CALLBACK     callback,
+    void                        *user,
+    LPSKYETEK_STREAM_PROGRESS   lpProgress
+    );
+
+/**
+ * Writes a tag memory of any size, chunked and batched as
+ * SkyeTek_ReadTagMemory() reads it.
+ * @param lpReader Reader to write with
+ * @param lpTag Tag to write
+ * @param lpAddr Blocks to write; zero blocks takes the count from the size
+ * @param lpBuffer Data to write, whole blocks
+ * @param size Size of the data in bytes
+ * @param lpProgress Receives how far the write got; may be NULL
+ * @return SKYETEK_SUCCESS if every block was written
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_WriteTagMemory(
+    LPSKYETEK_READER            lpReader,
+    LPSKYETEK_TAG               lpTag,
+    LPSKYETEK_ADDRESS           lpAddr,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    LPSKYETEK_STREAM_PROGRESS   lpProgress
+    );
+
+/**
+ * Seeds the tag info cache. SkyeTek_GetTagInfo() answers from this
+ * cache, shared by all readers, once it has seen a tag of the same IC;
+ * seeding saves the first round trip as well.
+ * @param lpTable Geometry to seed, or NULL for the table shipped with the API
+ * @param count Number of entries in lpTable
+ * @return SKYETEK_INVALID_PARAMETER if an entry has an auto detect or EPC type
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_SeedTagInfoCache(
+    LPSKYETEK_TAG_GEOMETRY    lpTable,
+    unsigned int              count
+    );
+
+/**
+ * Drops everything in the tag info cache, seeded or seen.
+ */
+SKYETEK_API void 
+SkyeTek_ClearTagInfoCache(void);
+
+/**
+ * Turns the tag info cache on or off. It is on by default.
+ * @param enable Zero to always ask the tag, non-zero to use the cache
+ */
+SKYETEK_API void 
+SkyeTek_EnableTagInfoCache(
+    unsigned char   enable
+    );
+
+/**
+ * Reads the directory of a DESFire card: its applications, their files
+ * and the settings of each file. The applications are selected and
+ * their files listed in one batch, and the file settings read in a
+ * second, so the walk takes three exchanges with the reader.
+ * @param lpReader Reader to execute this command on.
+ * @param lpTag DESFire tag to read
+ * @param lpSnapshot Receives the snapshot; free it with SkyeTek_FreeDesfireSnapshot()
+ * @return SKYETEK_SUCCESS if the application list was read; check the
+ * status of each application and file
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_GetDesfireSnapshot(
+    LPSKYETEK_READER              lpReader,
+    LPSKYETEK_TAG                 lpTag,
+    LPSKYETEK_DESFIRE_SNAPSHOT    *lpSnapshot
+    );
+
+/**
+ * Frees a snapshot.
+ * @param lpSnapshot Snapshot to free
+ */
+SKYETEK_API void 
+SkyeTek_FreeDesfireSnapshot(
+    LPSKYETEK_DESFIRE_SNAPSHOT    lpSnapshot
+    );
+
+/**
+ * Serializes a snapshot so it can be stored and compared with
+ * SkyeTek_DiffDesfireSnapshot() when the card is seen again.
+ * @param lpSnapshot Snapshot to serialize
+ * @param lpData Receives the serialized snapshot; it is allocated.
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_SerializeDesfireSnapshot(
+    LPSKYETEK_DESFIRE_SNAPSHOT    lpSnapshot,
+    LPSKYETEK_DATA                *lpData
+    );
+
+/**
+ * Compares a snapshot with one serialized earlier.
+ * @param lpSnapshot Snapshot of the card now
+ * @param lpPrevious Serialized snapshot of the card before
+ * @param lpChanged Receives the number of applications added, removed or changed; 0 if the card is unchanged
+ * @return SKYETEK_INVALID_PARAMETER if lpPrevious is not a serialized snapshot
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_DiffDesfireSnapshot(
+    LPSKYETEK_DESFIRE_SNAPSHOT    lpSnapshot,
+    LPSKYETEK_DATA                lpPrevious,
+    unsigned int                  *lpChanged
+    );
+
+/**
+ * Runs value and record operations on the files of one DESFire
+ * application as one transaction. The requests are encoded together
+ * and sent as one batch, then the transaction is committed if every
+ * operation succeeded and aborted if any failed.
+ * @param lpReader Reader to execute this command on.
+ * @param lpTag DESFire tag
+ * @param lpApp Application to select first, or NULL for the selected one
+ * @param lpOps Operations in the order to run them; the status of each is set
+ * @param count Number of operations
+ * @param lpResult Receives the outcome of the transaction
+ * @return SKYETEK_SUCCESS if the transaction was committed
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_ExecuteDesfireTransaction(
+    LPSKYETEK_READER                lpReader,
+    LPSKYETEK_TAG                   lpTag,
+    LPSKYETEK_ID                    lpApp,
+    LPSKYETEK_DESFIRE_OPERATION     lpOps,
+    unsigned int                    count,
+    LPSKYETEK_DESFIRE_TRANSACTION   lpResult
+    );
+
 
 /** 
  * Stores the key on the reader.
@@ -1042,6 +2365,105 @@ SkyeTek_UploadFirmware(
     void                                  *user
     );
 
+/**
+ * Opens and validates a SkyeTek Hex File. The file is mapped into
+ * memory and every block is checked before anything is sent, so
+ * a bad file is rejected before the reader enters the bootloader.
+ * The image can be uploaded to any number of readers.
+ * @param file Path to the SkyeTek Hex File
+ * @param lpImage Receives the image; free with SkyeTek_CloseFirmwareImage()
+ * @return SKYETEK_FIRMWARE_BAD_FILE if the file is not valid
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_OpenFirmwareImage(
+    TCHAR                         *file,
+    LPSKYETEK_FIRMWARE_IMAGE      *lpImage
+    );
+
+/**
+ * Closes an image opened with SkyeTek_OpenFirmwareImage().
+ * @param lpImage Image to close
+ */
+SKYETEK_API void 
+SkyeTek_CloseFirmwareImage(
+    LPSKYETEK_FIRMWARE_IMAGE      lpImage
+    );
+
+/**
+ * Uploads a firmware image to the reader. The next block is framed
+ * while the current one is being acknowledged and, if the bootloader
+ * stops responding, the upload resumes from the last acknowledged
+ * block instead of starting over.
+ * @param lpReader Reader to execute this command on.
+ * @param lpImage Image opened with SkyeTek_OpenFirmwareImage()
+ * @param defaultsOnly Set to 1 to have it load the default EEPROM settings only
+ *        and not load the firmware code
+ * @param callback Function to call with progress updates
+ * @param user User data passed to callback
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_UploadFirmwareImage(
+    LPSKYETEK_READER                      lpReader, 
+    LPSKYETEK_FIRMWARE_IMAGE              lpImage, 
+    unsigned char                         defaultsOnly,
+    SKYETEK_FIRMWARE_PROGRESS_CALLBACK    callback, 
+    void                                  *user
+    );
+
+/**
+ * Uploads one firmware image to a set of readers in parallel. The
+ * image is opened and validated once and shared by all uploads.
+ * Readers that are not in bootload mode are sent to the bootloader
+ * first. After the reset SYS_FIRMWARE is read back from every reader
+ * and, when given, compared to expectedFirmware. Readers that fail
+ * are rolled back with lpRollback if one is given, otherwise they
+ * are only reported in lpResults.
+ * @param lpReaders Readers to update; each must be on its own device
+ * @param count Number of readers
+ * @param lpImage Image opened with SkyeTek_OpenFirmwareImage()
+ * @param lpRollback Image to upload to readers that fail; may be NULL
+ * @param expectedFirmware SYS_FIRMWARE value expected after the update; 0 to skip the comparison
+ * @param maxConcurrent Most uploads at the same time; 0 for all of them
+ * @param callback Function to call with progress updates; may be NULL
+ * @param user User data passed to callback
+ * @param lpResults Array of count entries that receives the result for each reader
+ * @return SKYETEK_SUCCESS if every reader was updated and verified
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_UploadFirmwareFleet(
+    LPSKYETEK_READER                      *lpReaders,
+    unsigned int                          count,
+    LPSKYETEK_FIRMWARE_IMAGE              lpImage,
+    LPSKYETEK_FIRMWARE_IMAGE              lpRollback,
+    unsigned int                          expectedFirmware,
+    unsigned int                          maxConcurrent,
+    SKYETEK_FIRMWARE_FLEET_CALLBACK       callback,
+    void                                  *user,
+    LPSKYETEK_FIRMWARE_FLEET_RESULT       lpResults
+    );
+
+/**
+ * Executes a batch of operations on the reader back to back.
+ * On STPv3 readers the next request frame is built while the
+ * reader is busy and sent before the previous response is parsed,
+ * so the host side work overlaps with the wire. Other readers
+ * run the operations one after the other.
+ * Data returned by read/get operations is placed in lpData of the
+ * operation and must be freed with SkyeTek_FreeData().
+ * @param lpReader Reader to execute the operations on
+ * @param lpOps Array of operations
+ * @param count Number of operations in the array
+ * @param lpStatus Array of count entries that receives the status of each operation
+ * @return SKYETEK_SUCCESS if the batch ran; check lpStatus for each operation
+ */
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_ExecuteBatch(
+    LPSKYETEK_READER             lpReader,
+    LPSKYETEK_BATCH_OPERATION    lpOps,
+    unsigned int                 count,
+    SKYETEK_STATUS               *lpStatus
+    );
+
 
 
 
@@ -1064,6 +2486,19 @@ SkyeTek_CreateTag(
     LPSKYETEK_TAG       *lpTag
     );
 
+/**
+ * Creates a tag from a view passed to a SKYETEK_TAG_VIEW_CALLBACK so
+ * it can be kept after the callback returns.
+ * @param lpView The view to copy
+ * @param lpTag Pointer to tag pointer to fill. Free with SkyeTek_FreeTag().
+ * @return Status 
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_RetainTag(
+    const SKYETEK_TAG_VIEW  *lpView,
+    LPSKYETEK_TAG           *lpTag
+    );
+
 /**
  * Creates a new tag duplicate of the tag passed in
  * @param lpTag Pointer to tag to duplicate
@@ -1691,6 +3126,51 @@ SkyeTek_WriteRecord(
     LPSKYETEK_DATA       lpData
     );
 
+/**
+ * Reads a whole data file or record file, as many bytes per request
+ * as a frame holds. Only the records in the file are read.
+ * @param lpReader Reader to execute this command on.
+ * @param lpTag Tag to read the file off
+ * @param lpFile File to read
+ * @param lpBuffer Buffer that receives the file, or NULL to only use the callback
+ * @param size Size of the buffer in bytes
+ * @param callback Called with each part of the file in order, with its byte offset; may be NULL
+ * @param user User data passed to the callback
+ * @param lpRead Receives the number of bytes read, so far if the read stopped; may be NULL
+ * @return SKYETEK_SUCCESS if the whole file was read, SKYETEK_FAILURE if the callback stopped it
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_ReadFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    SKYETEK_STREAM_CALLBACK     callback,
+    void                        *user,
+    unsigned int                *lpRead    );
+
+/**
+ * Writes data of any size to a data file, as many bytes per request
+ * as a frame holds.
+ * @param lpReader Reader to execute this command on.
+ * @param lpTag Tag to write the file on
+ * @param lpFile File to write
+ * @param offset Byte offset in the file to write at
+ * @param lpBuffer Data to write
+ * @param size Size of the data in bytes
+ * @param lpWritten Receives the number of bytes written, so far if the write stopped; may be NULL
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_WriteFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned int                offset,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    unsigned int                *lpWritten    );
+
 /** 
  * Commits the outstanding transaction. All fill calls are
  * transactional and require either a commit or an abort 
@@ -1921,6 +3401,85 @@ SkyeTek_SetupSecureMemoryTag(
 		int                       useKeyDerivationFunction
     );
 
+/**
+ * Creates a crypto session. The key is stored in the reader slot given
+ * by its number, unless the reader already holds it there, and loaded
+ * when the first tag is authenticated. The session keeps the RF field
+ * on so the tag stays authenticated, and authenticates it again only
+ * when an operation on it fails. The reader holds authentication for
+ * one tag at a time, so operations should be grouped by tag; going
+ * back to an earlier tag authenticates it again.
+ * @param lpReader Reader to execute commands on
+ * @param type Tag type the key is stored for
+ * @param lpKey Key; its number is the reader slot and lpData, if set,
+ *        is stored there. It is copied. Tags are authenticated at its
+ *        address, and reads and writes outside the sector there fail
+ *        even after authenticating again.
+ * @param encrypt Encrypt the data of every read and write
+ * @param hmac HMAC the data of every read and write
+ * @param lpSession Receives the session; free with SkyeTek_FreeCryptoSession()
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_CreateCryptoSession(
+    LPSKYETEK_READER          lpReader,
+    SKYETEK_TAGTYPE           type,
+    LPSKYETEK_KEY             lpKey,
+    unsigned char             encrypt,
+    unsigned char             hmac,
+    LPSKYETEK_CRYPTO_SESSION  *lpSession
+    );
+
+/**
+ * Reads tag data with the session's key and flags.
+ * @param lpSession Session to read in
+ * @param lpTag Tag to read; it is authenticated if the session has not yet
+ * @param lpAddr Address to read
+ * @param lpData Receives the data; it is allocated
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_CryptoSessionRead(
+    LPSKYETEK_CRYPTO_SESSION  lpSession,
+    LPSKYETEK_TAG             lpTag,
+    LPSKYETEK_ADDRESS         lpAddr,
+    LPSKYETEK_DATA            *lpData
+    );
+
+/**
+ * Writes tag data with the session's key and flags.
+ * @param lpSession Session to write in
+ * @param lpTag Tag to write; it is authenticated if the session has not yet
+ * @param lpAddr Address to write
+ * @param lpData Data to write
+ */
+SKYETEK_API SKYETEK_STATUS 
+SkyeTek_CryptoSessionWrite(
+    LPSKYETEK_CRYPTO_SESSION  lpSession,
+    LPSKYETEK_TAG             lpTag,
+    LPSKYETEK_ADDRESS         lpAddr,
+    LPSKYETEK_DATA            lpData
+    );
+
+/**
+ * Forgets that a tag was authenticated, such as when it has left the
+ * field. NULL forgets whichever tag was.
+ * @param lpSession Session
+ * @param lpTag Tag to forget, or NULL
+ */
+SKYETEK_API void 
+SkyeTek_CryptoSessionForgetTag(
+    LPSKYETEK_CRYPTO_SESSION  lpSession,
+    LPSKYETEK_TAG             lpTag
+    );
+
+/**
+ * Frees a crypto session. The reader keeps the key.
+ * @param lpSession Session to free
+ */
+SKYETEK_API void 
+SkyeTek_FreeCryptoSession(
+    LPSKYETEK_CRYPTO_SESSION  lpSession
+    );
+
 
 /**
  * Sends data over the air interface
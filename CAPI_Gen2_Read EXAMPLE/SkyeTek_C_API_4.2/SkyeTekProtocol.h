@@ -227,6 +227,22 @@ STPV3_WriteRequest(
     unsigned int         timeout
     );
 
+/**
+ * This writes a request that has already been built with
+ * STPV3_BuildRequest to the given device. This allows the next
+ * request to be built while the reader is still busy.
+ * @param device The device to write the request to
+ * @param req Pointer to the built request structure
+ * @param timeout Timeout in milliseconds for the write operation
+ * @return Results of writing the request 
+ */
+SKYETEK_API SKYETEK_STATUS 
+STPV3_SendRequest( 
+    LPSKYETEK_DEVICE     device, 
+    LPSTPV3_REQUEST      req,
+    unsigned int         timeout
+    );
+
 /**
  * Reads the response from the device.
  * @param device The device to read from
@@ -28,6 +28,7 @@ DesfireTag_AuthenticateTag(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   SKYETEK_ADDRESS addr;
   st_asn1_context context;
   int64 w;
@@ -38,25 +39,24 @@ DesfireTag_AuthenticateTag(
       lpKey == NULL || lpKey->lpData->data == NULL || lpKey->lpData->size == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpKey->number;
   st_asn1_write_integer(context,w);
   st_asn1_write_octet_string(context, lpKey->lpData->data, lpKey->lpData->size);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
   
   memset(&addr,0,sizeof(SKYETEK_ADDRESS));
 
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->AuthenticateTag(lpReader,lpTag,&addr,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -74,8 +74,10 @@ DesfireTag_GetApplicationIDs(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataR = NULL;
-  LPSKYETEK_DATA lpData;
   st_asn1_context context;
+  st_asn1_context_storage storage;
+  unsigned char *p;
+  size_t len;
   unsigned int num = 0, ix = 0;
   
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -96,21 +98,18 @@ DesfireTag_GetApplicationIDs(
     return SKYETEK_SUCCESS;
   }
   
-  lpData = SkyeTek_AllocateData(lpDataR->size);
-  if( lpData == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
 
   /* First count them */
   st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
   st_asn1_start_sequence(context);
   while(st_asn1_peek(context) == ST_OCTET_STRING) 
   {
-    st_asn1_read_octet_string(context, lpData->data, &lpData->size);
+    if( !st_asn1_read_octet_string_view(context, &p, &len) )
+      break;
     num++;
   }
   st_asn1_finish_sequence(context);
-  SkyeTek_FreeData(lpData);
 
   /* Allocate ID memory */
   *ids = (LPSKYETEK_ID *)malloc(num * sizeof(LPSKYETEK_ID));
@@ -155,6 +154,7 @@ DesfireTag_SelectApplication(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -163,19 +163,18 @@ DesfireTag_SelectApplication(
       lpId->id == NULL || lpId->length == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_write_octet_string(context, lpId->id, lpId->length);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->SelectApplication(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -205,6 +204,7 @@ DesfireTag_CreateApplication(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
   int i;
@@ -215,12 +215,7 @@ DesfireTag_CreateApplication(
       lpId->id == NULL || lpId->length == 0 || lpSettings == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   st_asn1_write_octet_string(context, lpId->id, lpId->length);
   st_asn1_start_sequence(context);
@@ -238,12 +233,16 @@ DesfireTag_CreateApplication(
   w = lpSettings->numKeys;
   st_asn1_write_integer(context,w);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->CreateApplication(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -257,6 +256,7 @@ DesfireTag_DeleteApplication(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -265,19 +265,18 @@ DesfireTag_DeleteApplication(
       lpId->id == NULL || lpId->length == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_write_octet_string(context, lpId->id, lpId->length);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->DeleteApplication(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -296,6 +295,7 @@ DesfireTag_GetFileIDs(
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   unsigned int num = 0, ix = 0;
   int64 w;
 
@@ -315,7 +315,7 @@ DesfireTag_GetFileIDs(
     return SKYETEK_SUCCESS;
   }
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
 
   /* First count them */
   st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
@@ -415,6 +415,7 @@ DesfireTag_CreateDataFile(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -426,12 +427,7 @@ DesfireTag_CreateDataFile(
        lpSettings->type != BACKUP_DATA_FILE) )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
@@ -462,12 +458,16 @@ DesfireTag_CreateDataFile(
   st_asn1_finish_context_specific(context, 1);
 
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->CreateFile(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -482,6 +482,7 @@ DesfireTag_CreateValueFile(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
   int i;
@@ -493,12 +494,7 @@ DesfireTag_CreateValueFile(
       lpSettings->type != VALUE_FILE  )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
@@ -538,12 +534,16 @@ DesfireTag_CreateValueFile(
   st_asn1_finish_context_specific(context, 2);
 
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->CreateFile(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -558,6 +558,7 @@ DesfireTag_CreateRecordFile(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -568,12 +569,7 @@ DesfireTag_CreateRecordFile(
       (lpSettings->type != LINEAR_RECORD_FILE  && lpSettings->type != CYCLICAL_RECORD_FILE))
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
@@ -607,12 +603,16 @@ DesfireTag_CreateRecordFile(
   st_asn1_finish_context_specific(context, 3);
 
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->CreateFile(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -664,8 +664,10 @@ DesfireTag_GetCommonFileSettings(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   unsigned int num = 0, ix = 0;
   int64 w;
 
@@ -675,20 +677,19 @@ DesfireTag_GetCommonFileSettings(
       lpFile->id == NULL || lpFile->length == 0 || lpSettings == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->GetFileSettings(lpReader,lpTag,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   
   if( status != SKYETEK_SUCCESS )
     return status;
@@ -704,7 +705,7 @@ DesfireTag_GetCommonFileSettings(
   //       readWriteAccess ENUMERATED 
   //       changeAccess ENUMERATED }
   */
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
   st_asn1_start_sequence(context);
   st_asn1_read_enumerated(context, &w);
@@ -740,8 +741,10 @@ DesfireTag_GetDataFileSettings(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   unsigned int num = 0, ix = 0;
   int64 w;
   int typ;
@@ -752,27 +755,26 @@ DesfireTag_GetDataFileSettings(
       lpFile->id == NULL || lpFile->length == 0 || lpSettings == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->GetFileSettings(lpReader,lpTag,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   
   if( status != SKYETEK_SUCCESS )
     return status;
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_READER_PROTOCOL_ERROR;
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
   st_asn1_start_sequence(context);
   st_asn1_read_enumerated(context, &w);
@@ -823,8 +825,10 @@ DesfireTag_GetValueFileSettings(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   unsigned int num = 0, ix = 0;
   int64 w;
   int typ, i;
@@ -835,27 +839,26 @@ DesfireTag_GetValueFileSettings(
       lpFile->id == NULL || lpFile->length == 0 || lpSettings == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->GetFileSettings(lpReader,lpTag,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   
   if( status != SKYETEK_SUCCESS )
     return status;
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_READER_PROTOCOL_ERROR;
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
   st_asn1_start_sequence(context);
   st_asn1_read_enumerated(context, &w);
@@ -916,8 +919,10 @@ DesfireTag_GetRecordFileSettings(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   unsigned int num = 0, ix = 0;
   int64 w;
   int typ;
@@ -928,27 +933,26 @@ DesfireTag_GetRecordFileSettings(
       lpFile->id == NULL || lpFile->length == 0 || lpSettings == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->GetFileSettings(lpReader,lpTag,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   
   if( status != SKYETEK_SUCCESS )
     return status;
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_READER_PROTOCOL_ERROR;
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
   st_asn1_start_sequence(context);
   st_asn1_read_enumerated(context, &w);
@@ -1006,6 +1010,7 @@ DesfireTag_ChangeFileSettings(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -1015,12 +1020,7 @@ DesfireTag_ChangeFileSettings(
       lpFile->id == NULL || lpFile->length == 0 || lpSettings == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
@@ -1037,12 +1037,16 @@ DesfireTag_ChangeFileSettings(
   st_asn1_write_enumerated(context, w);
   st_asn1_finish_sequence(context);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->ChangeFileSettings(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1067,9 +1071,13 @@ DesfireTag_ReadFile(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   SKYETEK_ADDRESS addr;
   st_asn1_context context;
+  st_asn1_context_storage storage;
+  unsigned char *p;
+  size_t len;
   int64 w;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -1078,44 +1086,45 @@ DesfireTag_ReadFile(
       lpFile->id == NULL || lpFile->length == 0 || lpAddr == NULL || lpData == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
   w = lpAddr->start;
   st_asn1_write_integer(context,w);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   memset(&addr,0,sizeof(SKYETEK_ADDRESS));
 
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->ReadFile(lpReader,lpTag,&addr,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   
   if( status != SKYETEK_SUCCESS )
     return status;
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_READER_PROTOCOL_ERROR;
   
-  *lpData = SkyeTek_AllocateData(lpDataR->size);
-  if( *lpData == NULL )
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_DECODE,lpDataR->data,lpDataR->size);
+  if( !st_asn1_read_octet_string_view(context, &p, &len) )
   {
+    st_asn1_free_context(&context);
     SkyeTek_FreeData(lpDataR);
-    return SKYETEK_OUT_OF_MEMORY;
+    return SKYETEK_READER_PROTOCOL_ERROR;
   }
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
-  st_asn1_read_octet_string(context, (*lpData)->data, &(*lpData)->size);
   st_asn1_free_context(&context);
-  SkyeTek_FreeData(lpDataR);
+
+  /* Hand back the response with the contents moved to the front */
+  memmove(lpDataR->data, p, len);
+  lpDataR->size = (unsigned int)len;
+  *lpData = lpDataR;
   return SKYETEK_SUCCESS;
 }
     	
@@ -1140,6 +1149,7 @@ DesfireTag_WriteFile(
   SKYETEK_STATUS status;
   SKYETEK_ADDRESS addr;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -1150,12 +1160,7 @@ DesfireTag_WriteFile(
       lpData == NULL || lpData->data == NULL || lpData->size == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
@@ -1163,14 +1168,18 @@ DesfireTag_WriteFile(
   st_asn1_write_integer(context,w);
   st_asn1_write_octet_string(context,lpData->data,lpData->size);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   memset(&addr,0,sizeof(SKYETEK_ADDRESS));
 
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->WriteFile(lpReader,lpTag,&addr,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1187,6 +1196,7 @@ DesfireTag_DeleteFile(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -1196,20 +1206,19 @@ DesfireTag_DeleteFile(
       lpFile->id == NULL || lpFile->length == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   w = lpFile->id[0];
   st_asn1_write_integer(context, w);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->DeleteFile(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1223,6 +1232,7 @@ DesfireTag_ClearFile(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -1232,20 +1242,19 @@ DesfireTag_ClearFile(
       lpFile->id == NULL || lpFile->length == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   w = lpFile->id[0];
   st_asn1_write_integer(context, w);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->ClearFile(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1263,6 +1272,7 @@ DesfireTag_CreditValueFile(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -1272,24 +1282,23 @@ DesfireTag_CreditValueFile(
       lpFile->id == NULL || lpFile->length == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context, w);
   w = amount;
   st_asn1_write_integer(context, w);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->CreditValueFile(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1304,6 +1313,7 @@ DesfireTag_DebitValueFile(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -1313,24 +1323,23 @@ DesfireTag_DebitValueFile(
       lpFile->id == NULL || lpFile->length == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context, w);
   w = amount;
   st_asn1_write_integer(context, w);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->DebitValueFile(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1345,6 +1354,7 @@ DesfireTag_LimitedCreditValueFile(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -1354,24 +1364,23 @@ DesfireTag_LimitedCreditValueFile(
       lpFile->id == NULL || lpFile->length == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context, w);
   w = amount;
   st_asn1_write_integer(context, w);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->LimitedCreditValueFile(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1389,8 +1398,10 @@ DesfireTag_GetValue(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   int64 w;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -1399,27 +1410,26 @@ DesfireTag_GetValue(
       lpFile->id == NULL || lpFile->length == 0 || value == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->GetValue(lpReader,lpTag,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   
   if( status != SKYETEK_SUCCESS )
     return status;
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_READER_PROTOCOL_ERROR;
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
   st_asn1_read_integer(context, &w);
   *value = (unsigned int)w;
@@ -1450,8 +1460,12 @@ DesfireTag_ReadRecords(
   SKYETEK_STATUS status;
   SKYETEK_ADDRESS addr;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
+  unsigned char *p;
+  size_t len;
   int64 w;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -1460,43 +1474,44 @@ DesfireTag_ReadRecords(
       lpFile->id == NULL || lpFile->length == 0 || lpAddr == NULL || lpData == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
   w = lpAddr->start;
   st_asn1_write_integer(context,w);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
 
   memset(&addr,0,sizeof(SKYETEK_ADDRESS));
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->ReadRecords(lpReader,lpTag,&addr,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   
   if( status != SKYETEK_SUCCESS )
     return status;
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_READER_PROTOCOL_ERROR;
   
-  *lpData = SkyeTek_AllocateData(lpDataR->size);
-  if( *lpData == NULL )
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_DECODE,lpDataR->data,lpDataR->size);
+  if( !st_asn1_read_octet_string_view(context, &p, &len) )
   {
+    st_asn1_free_context(&context);
     SkyeTek_FreeData(lpDataR);
-    return SKYETEK_OUT_OF_MEMORY;
+    return SKYETEK_READER_PROTOCOL_ERROR;
   }
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
-  st_asn1_read_octet_string(context, (*lpData)->data, &(*lpData)->size);
   st_asn1_free_context(&context);
-  SkyeTek_FreeData(lpDataR);
+
+  /* Hand back the response with the contents moved to the front */
+  memmove(lpDataR->data, p, len);
+  lpDataR->size = (unsigned int)len;
+  *lpData = lpDataR;
   return SKYETEK_SUCCESS;
 }
   
@@ -1521,6 +1536,7 @@ DesfireTag_WriteRecord(
   SKYETEK_STATUS status;
   SKYETEK_ADDRESS addr;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -1531,12 +1547,7 @@ DesfireTag_WriteRecord(
       lpData == NULL || lpData->data == NULL || lpData->size == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpFile->id[0];
   st_asn1_write_integer(context,w);
@@ -1544,13 +1555,274 @@ DesfireTag_WriteRecord(
   st_asn1_write_integer(context,w);
   st_asn1_write_octet_string(context,lpData->data,lpData->size);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   memset(&addr,0,sizeof(SKYETEK_ADDRESS));
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->WriteRecord(lpReader,lpTag,&addr,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
+  return status;
+}
+
+/* The file id, offset and ASN.1 headers around the data of a write */
+#define DESFIRE_FRAME_OVERHEAD 16
+
+/* Data bytes a request can carry in the reader's protocol */
+static unsigned int
+DesfireTag_FrameSize(
+    LPSKYETEK_READER     lpReader
+    )
+{
+  if( lpReader->lpProtocol->version == 2 )
+    return 1024 - DESFIRE_FRAME_OVERHEAD;
+  return 2048 - DESFIRE_FRAME_OVERHEAD;
+}
+
+/*
+// Reads the settings of a data or record file with the stream's request.
+// Returns the size of the file in bytes and, for a record file, the size
+// of a record; recordSize is 0 for a data file.
+*/
+static SKYETEK_STATUS
+DesfireTag_StreamSettings(
+    LPSKYETEK_READER     lpReader,
+    LPSKYETEK_TAG        lpTag,
+    LPSKYETEK_ID         lpFile,
+    LPTAG_REQUEST        lpReq,
+    st_asn1_context      decode,
+    unsigned int         *lpSize,
+    unsigned int         *lpRecordSize
+    )
+{
+  LPPROTOCOLIMPL lppi;
+  SKYETEK_STATUS status;
+  LPSKYETEK_DATA lpDataS;
+  LPSKYETEK_DATA lpDataR = NULL;
+  st_asn1_context context;
+  int64 w, records;
+  int typ;
+
+  context = GenericTag_RestartRequest(lpReq);
+  w = lpFile->id[0];
+  st_asn1_write_integer(context,w);
+  lpDataS = GenericTag_FinishRequest(lpReq);
+  if( lpDataS == NULL )
+    return lpReq->status;
+
+  lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  status = lppi->GetFileSettings(lpReader,lpTag,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
+  if( status != SKYETEK_SUCCESS )
+    return status;
+  if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
+    return SKYETEK_READER_PROTOCOL_ERROR;
+
+  /* type, comm and the access rights come first */
+  st_asn1_init(decode, ST_ASN1_DECODE,lpDataR->data,lpDataR->size);
+  st_asn1_start_sequence(decode);
+  st_asn1_read_enumerated(decode, &w);
+  st_asn1_read_enumerated(decode, &w);
+  st_asn1_start_sequence(decode);
+  while( st_asn1_peek(decode) == ST_ENUMERATED )
+    st_asn1_read_enumerated(decode, &w);
+  st_asn1_finish_sequence(decode);
+
+  typ = st_asn1_peek(decode);
+  if( -typ == 1 )
+  {
+    st_asn1_start_context_specific(decode, 1);
+    st_asn1_start_sequence(decode);
+    st_asn1_read_integer(decode, &w);
+    *lpSize = (unsigned int)w;
+    *lpRecordSize = 0;
+  }
+  else if( -typ == 3 )
+  {
+    st_asn1_start_context_specific(decode, 3);
+    st_asn1_start_sequence(decode);
+    st_asn1_read_integer(decode, &w);
+    *lpRecordSize = (unsigned int)w;
+    st_asn1_read_integer(decode, &records);
+    st_asn1_read_integer(decode, &records);
+    *lpSize = (unsigned int)(records * w);
+  }
+  else
+  {
+    SkyeTek_FreeData(lpDataR);
+    return SKYETEK_INVALID_FILE_TYPE;
+  }
+  SkyeTek_FreeData(lpDataR);
+  if( st_asn1_finalize(decode) < 0 || (typ == -3 && *lpRecordSize == 0) )
+    return SKYETEK_READER_PROTOCOL_ERROR;
+  return SKYETEK_SUCCESS;
+}
+
+/*
+// Pages through a data file with ReadFile, or a record file with
+// ReadRecords, reusing one request buffer and context throughout.
+// Each request asks for everything from the offset on; the reader
+// sends back as much as fits in a frame.
+*/
+SKYETEK_STATUS 
+DesfireTag_ReadFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    SKYETEK_STREAM_CALLBACK     callback,
+    void                        *user,
+    unsigned int                *lpRead
+    )
+{
+  LPPROTOCOLIMPL lppi;
+  SKYETEK_STATUS status;
+  SKYETEK_ADDRESS addr;
+  LPSKYETEK_DATA lpDataS;
+  LPSKYETEK_DATA lpDataR;
+  TAG_REQUEST req;
+  st_asn1_context context, decode;
+  st_asn1_context_storage storage;
+  unsigned int total = 0, recordSize = 0, done = 0;
+  unsigned char *p;
+  size_t len;
+  int64 w;
+
+  if( lpRead != NULL )
+    *lpRead = 0;
+  if( lpReader == NULL || lpReader->lpProtocol == NULL || 
+      lpReader->lpProtocol->internal == NULL ||
+      lpReader->lpDevice == NULL || lpTag == NULL || lpFile == NULL ||
+      lpFile->id == NULL || lpFile->length == 0 || (lpBuffer == NULL && callback == NULL) )
+    return SKYETEK_INVALID_PARAMETER;
+
+  GenericTag_StartRequest(&req);
+  st_asn1_allocate_context_ext(&decode, &storage, sizeof(storage));
+  status = DesfireTag_StreamSettings(lpReader,lpTag,lpFile,&req,decode,&total,&recordSize);
+  if( status == SKYETEK_SUCCESS && lpBuffer != NULL && size < total )
+    status = SKYETEK_INVALID_PARAMETER;
+
+  memset(&addr,0,sizeof(SKYETEK_ADDRESS));
+  lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  while( status == SKYETEK_SUCCESS && done < total )
+  {
+    context = GenericTag_RestartRequest(&req);
+    st_asn1_start_sequence(context);
+    w = lpFile->id[0];
+    st_asn1_write_integer(context,w);
+    w = (recordSize == 0) ? done : done / recordSize;
+    st_asn1_write_integer(context,w);
+    st_asn1_finish_sequence(context);
+    lpDataS = GenericTag_FinishRequest(&req);
+    if( lpDataS == NULL )
+    {
+      status = req.status;
+      break;
+    }
+
+    lpDataR = NULL;
+    if( recordSize == 0 )
+      status = lppi->ReadFile(lpReader,lpTag,&addr,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
+    else
+      status = lppi->ReadRecords(lpReader,lpTag,&addr,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
+    if( status != SKYETEK_SUCCESS )
+      break;
+    if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
+    {
+      status = SKYETEK_READER_PROTOCOL_ERROR;
+      break;
+    }
+
+    st_asn1_init(decode, ST_ASN1_DECODE,lpDataR->data,lpDataR->size);
+    if( !st_asn1_read_octet_string_view(decode, &p, &len) || len == 0 ||
+        (recordSize != 0 && (len % recordSize) != 0) )
+    {
+      SkyeTek_FreeData(lpDataR);
+      status = SKYETEK_READER_PROTOCOL_ERROR;
+      break;
+    }
+    if( len > total - done )
+      len = total - done;
+    if( lpBuffer != NULL )
+      memcpy(lpBuffer + done, p, len);
+    if( callback != NULL && !callback(done, p, (unsigned int)len, user) )
+      status = SKYETEK_FAILURE;
+    SkyeTek_FreeData(lpDataR);
+    done += (unsigned int)len;
+  }
+
+  st_asn1_free_context(&decode);
+  GenericTag_FreeRequest(&req);
+  if( lpRead != NULL )
+    *lpRead = done;
+  return status;
+}
+
+/*
+// Writes a data file a frame at a time with WriteFile, reusing one
+// request buffer and context throughout.
+*/
+SKYETEK_STATUS 
+DesfireTag_WriteFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned int                offset,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    unsigned int                *lpWritten
+    )
+{
+  LPPROTOCOLIMPL lppi;
+  SKYETEK_STATUS status = SKYETEK_SUCCESS;
+  SKYETEK_ADDRESS addr;
+  LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
+  st_asn1_context context;
+  unsigned int frame, chunk, done = 0;
+  int64 w;
+
+  if( lpWritten != NULL )
+    *lpWritten = 0;
+  if( lpReader == NULL || lpReader->lpProtocol == NULL || 
+      lpReader->lpProtocol->internal == NULL ||
+      lpReader->lpDevice == NULL || lpTag == NULL || lpFile == NULL ||
+      lpFile->id == NULL || lpFile->length == 0 || lpBuffer == NULL || size == 0 )
+    return SKYETEK_INVALID_PARAMETER;
+
+  frame = DesfireTag_FrameSize(lpReader);
+  memset(&addr,0,sizeof(SKYETEK_ADDRESS));
+  lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
+  GenericTag_StartRequest(&req);
+  while( done < size )
+  {
+    chunk = (size - done < frame) ? size - done : frame;
+    context = GenericTag_RestartRequest(&req);
+    st_asn1_start_sequence(context);
+    w = lpFile->id[0];
+    st_asn1_write_integer(context,w);
+    w = offset + done;
+    st_asn1_write_integer(context,w);
+    st_asn1_write_octet_string(context,lpBuffer + done,chunk);
+    st_asn1_finish_sequence(context);
+    lpDataS = GenericTag_FinishRequest(&req);
+    if( lpDataS == NULL )
+    {
+      status = req.status;
+      break;
+    }
+    status = lppi->WriteFile(lpReader,lpTag,&addr,lpDataS,DESFIRE_TIMEOUT);
+    if( status != SKYETEK_SUCCESS )
+      break;
+    done += chunk;
+  }
+  GenericTag_FreeRequest(&req);
+  if( lpWritten != NULL )
+    *lpWritten = done;
   return status;
 }
 
@@ -1597,8 +1869,10 @@ DesfireTag_GetKeyVersion(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   int64 w;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -1606,27 +1880,26 @@ DesfireTag_GetKeyVersion(
       lpReader->lpDevice == NULL || lpTag == NULL || lpKey == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   w = lpKey->number;
   st_asn1_write_integer(context,w);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->GetKeyVersion(lpReader,lpTag,lpDataS,&lpDataR,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   
   if( status != SKYETEK_SUCCESS )
     return status;
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_READER_PROTOCOL_ERROR;
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
   st_asn1_read_integer(context, &w);
   lpKey->version = (unsigned char)w;
@@ -1655,6 +1928,7 @@ DesfireTag_ChangeKey(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -1664,12 +1938,7 @@ DesfireTag_ChangeKey(
       lpNewKey->lpData->data == NULL || lpNewKey->lpData->size == 0 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = lpNewKey->number;
   st_asn1_write_integer(context,w);
@@ -1680,12 +1949,16 @@ DesfireTag_ChangeKey(
       lpCurrentKey->lpData->data != NULL && lpCurrentKey->lpData->size > 0 )
     st_asn1_write_octet_string(context,lpCurrentKey->lpData->data,lpCurrentKey->lpData->size);
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
  
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->ChangeKey(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1722,6 +1995,7 @@ DesfireTag_GetApplicationKeySettings(
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   int64 w;
   int i, typ;
 
@@ -1738,7 +2012,7 @@ DesfireTag_GetApplicationKeySettings(
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_READER_PROTOCOL_ERROR;
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_DECODE,lpDataR->data,lpDataR->size);
   st_asn1_start_sequence(context);
   typ = st_asn1_peek(context);
@@ -1782,6 +2056,7 @@ DesfireTag_GetMasterKeySettings(
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   int64 w;
   int i, typ;
 
@@ -1798,7 +2073,7 @@ DesfireTag_GetMasterKeySettings(
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_READER_PROTOCOL_ERROR;
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_DECODE,lpDataR->data,lpDataR->size);
   
   st_asn1_start_sequence(context);
@@ -1854,6 +2129,7 @@ DesfireTag_ChangeApplicationKeySettings(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
   int i;
@@ -1863,12 +2139,7 @@ DesfireTag_ChangeApplicationKeySettings(
       lpReader->lpDevice == NULL || lpTag == NULL || lpSettings == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_context_specific(context, 1);
   st_asn1_start_sequence(context);
   w = lpSettings->accessRights;
@@ -1883,12 +2154,16 @@ DesfireTag_ChangeApplicationKeySettings(
   st_asn1_write_boolean(context,i);
   st_asn1_finish_sequence(context);
   st_asn1_finish_context_specific(context, 1);  
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
 
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->ChangeKeySettings(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1913,6 +2188,7 @@ DesfireTag_ChangeMasterKeySettings(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int i;
 
@@ -1921,12 +2197,7 @@ DesfireTag_ChangeMasterKeySettings(
       lpReader->lpDevice == NULL || lpTag == NULL || lpSettings == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_context_specific(context, 2);
   st_asn1_start_sequence(context);
   i = lpSettings->isConfigFrozen;
@@ -1939,12 +2210,16 @@ DesfireTag_ChangeMasterKeySettings(
   st_asn1_write_boolean(context,i);
   st_asn1_finish_sequence(context);
   st_asn1_finish_context_specific(context, 2);  
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
 
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->ChangeKeySettings(lpReader,lpTag,lpDataS,DESFIRE_TIMEOUT);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -2035,6 +2310,8 @@ TAGIMPL DesfireTagImpl = {
   DesfireTag_GetValue,
   DesfireTag_ReadRecords,
   DesfireTag_WriteRecord,
+  DesfireTag_ReadFileStream,
+  DesfireTag_WriteFileStream,
   DesfireTag_CommitTransaction,
   DesfireTag_AbortTransaction,
   GenericTag_EnableEAS,
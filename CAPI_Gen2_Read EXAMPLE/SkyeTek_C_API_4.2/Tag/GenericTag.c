@@ -6,10 +6,61 @@
  */
 #include "Tag.h"
 #include "../Protocol/Protocol.h"
+#include "GenericTag.h"
 #include "../Protocol/asn1.h"
 
 #define GENERIC_TIMEOUT 300
 
+st_asn1_context
+GenericTag_StartRequest(
+    LPTAG_REQUEST        lpRequest
+    )
+{
+  st_asn1_allocate_context_ext(&lpRequest->context, &lpRequest->storage, sizeof(lpRequest->storage));
+  st_asn1_init_growable(lpRequest->context, lpRequest->buffer, sizeof(lpRequest->buffer));
+  return lpRequest->context;
+}
+
+st_asn1_context
+GenericTag_RestartRequest(
+    LPTAG_REQUEST        lpRequest
+    )
+{
+  st_asn1_rewind(lpRequest->context);
+  return lpRequest->context;
+}
+
+LPSKYETEK_DATA
+GenericTag_FinishRequest(
+    LPTAG_REQUEST        lpRequest
+    )
+{
+  int len;
+
+  len = st_asn1_finalize(lpRequest->context);
+  if( len < 0 )
+  {
+    if( st_asn1_out_of_memory(lpRequest->context) )
+      lpRequest->status = SKYETEK_OUT_OF_MEMORY;
+    else
+      lpRequest->status = SKYETEK_INVALID_PARAMETER;
+    return NULL;
+  }
+  lpRequest->status = SKYETEK_SUCCESS;
+  memset(&lpRequest->data, 0, sizeof(SKYETEK_DATA));
+  lpRequest->data.data = st_asn1_get_data(lpRequest->context);
+  lpRequest->data.size = (unsigned int)len;
+  return &lpRequest->data;
+}
+
+void
+GenericTag_FreeRequest(
+    LPTAG_REQUEST        lpRequest
+    )
+{
+  st_asn1_free_context(&lpRequest->context);
+}
+
 SKYETEK_STATUS 
 GenericTag_SelectTag(
     LPSKYETEK_READER     lpReader,
@@ -653,6 +704,37 @@ GenericTag_WriteRecord(
   return SKYETEK_NOT_SUPPORTED;
 }
 
+SKYETEK_STATUS 
+GenericTag_ReadFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    SKYETEK_STREAM_CALLBACK     callback,
+    void                        *user,
+    unsigned int                *lpRead
+    )
+{
+  /* Only supported in Desfire */
+  return SKYETEK_NOT_SUPPORTED;
+}
+
+SKYETEK_STATUS 
+GenericTag_WriteFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned int                offset,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    unsigned int                *lpWritten
+    )
+{
+  /* Only supported in Desfire */
+  return SKYETEK_NOT_SUPPORTED;
+}
+
 SKYETEK_STATUS 
 GenericTag_CommitTransaction(
     LPSKYETEK_READER     lpReader, 
@@ -878,6 +960,7 @@ GenericTag_InitializeSecureMemoryTag(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -887,12 +970,7 @@ GenericTag_InitializeSecureMemoryTag(
       lpKeyHMAC == NULL || lpKeyHMAC->lpData == NULL || lpKeyHMAC->lpData->data == NULL || lpKeyHMAC->lpData->size < 1 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(2048);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = hmac;
   st_asn1_write_enumerated(context,w);
@@ -919,12 +997,16 @@ GenericTag_InitializeSecureMemoryTag(
 		st_asn1_write_boolean(context, 1);
 
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
 
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->InitializeSecureMemoryTag(lpReader,lpTag,lpDataS,10000);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -940,6 +1022,7 @@ GenericTag_SetupSecureMemoryTag(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -948,12 +1031,7 @@ GenericTag_SetupSecureMemoryTag(
       lpKeyHMAC == NULL || lpKeyHMAC->lpData == NULL || lpKeyHMAC->lpData->data == NULL || lpKeyHMAC->lpData->size < 1 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   if( lpKeyHMAC->name != NULL && _tcslen(lpKeyHMAC->name) > 0) {
     st_asn1_start_context_specific(context, 1);
@@ -974,12 +1052,16 @@ GenericTag_SetupSecureMemoryTag(
 		st_asn1_write_boolean(context, 1);
 
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
 
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->SetupSecureMemoryTag(lpReader,lpTag,lpDataS,10000);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -1009,8 +1091,12 @@ GenericTag_InterfaceSend(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
+  unsigned char *p;
+  size_t len;
   int64 w;
   
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -1020,12 +1106,7 @@ GenericTag_InterfaceSend(
       lpRecvData == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(2048);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = intf;
   st_asn1_write_enumerated(context,w);
@@ -1040,16 +1121,18 @@ GenericTag_InterfaceSend(
     st_asn1_finish_context_specific(context, 1);
   }
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
   
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->InterfaceSend(lpReader,lpTag,lpDataS,&lpDataR,GENERIC_TIMEOUT);
+  GenericTag_FreeRequest(&req);
   if( status != SKYETEK_SUCCESS )
-  {
-    SkyeTek_FreeData(lpDataS);
     return status;
-  }
   if( lpDataR == NULL  )
     return SKYETEK_SUCCESS;
   if( lpDataR->data == NULL || lpDataR->size == 0 )
@@ -1058,13 +1141,20 @@ GenericTag_InterfaceSend(
     return SKYETEK_SUCCESS;
   }
   
-  *lpRecvData = SkyeTek_AllocateData(lpDataR->size);
-  if( *lpRecvData == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
-  st_asn1_read_octet_string(context, (*lpRecvData)->data, &(*lpRecvData)->size);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_DECODE,lpDataR->data,lpDataR->size);
+  if( !st_asn1_read_octet_string_view(context, &p, &len) )
+  {
+    st_asn1_free_context(&context);
+    SkyeTek_FreeData(lpDataR);
+    return SKYETEK_READER_PROTOCOL_ERROR;
+  }
   st_asn1_free_context(&context);
+
+  /* Hand back the response with the contents moved to the front */
+  memmove(lpDataR->data, p, len);
+  lpDataR->size = (unsigned int)len;
+  *lpRecvData = lpDataR;
   
   return SKYETEK_SUCCESS;
 }
@@ -1111,6 +1201,7 @@ GenericTag_InitiatePayment(
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   int64 w;
   size_t len;
   int l;
@@ -1135,7 +1226,7 @@ GenericTag_InitiatePayment(
     return SKYETEK_SUCCESS;
   }
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
 
   st_asn1_start_sequence(context);
@@ -1170,6 +1261,7 @@ GenericTag_InitiatePayment(
   l = st_asn1_finalize(context);
   
   st_asn1_free_context(&context);
+  SkyeTek_FreeData(lpDataR);
 
   lpPaymentSystem->track1Length = 0;
   lpPaymentSystem->track2Length = 0;
@@ -1207,8 +1299,10 @@ GenericTag_ComputePayment(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
   int64 w;
   int l;
   size_t len;
@@ -1219,12 +1313,7 @@ GenericTag_ComputePayment(
       lpPaymentSystem == NULL)
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(128);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   if (transaction != 0) {
     st_asn1_start_context_specific(context, 1);
@@ -1235,16 +1324,18 @@ GenericTag_ComputePayment(
     st_asn1_finish_context_specific(context, 1);
   }
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
   
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->ComputePayment(lpReader,lpTag,lpDataS,&lpDataR,GENERIC_TIMEOUT);
+  GenericTag_FreeRequest(&req);
   if( status != SKYETEK_SUCCESS )
-  {
-    SkyeTek_FreeData(lpDataS);
     return status;
-  }
   if( lpDataR == NULL  )
     return SKYETEK_SUCCESS;
   if( lpDataR->data == NULL || lpDataR->size == 0 )
@@ -1253,7 +1344,7 @@ GenericTag_ComputePayment(
     return SKYETEK_SUCCESS;
   }
   
-  st_asn1_allocate_context(&context);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
   st_asn1_init(context, ST_ASN1_DECODE,lpDataR->data,lpDataR->size);
 
   st_asn1_start_sequence(context);
@@ -1285,6 +1376,7 @@ GenericTag_ComputePayment(
   l = st_asn1_finalize(context);
   
   st_asn1_free_context(&context);
+  SkyeTek_FreeData(lpDataR);
 
   if (l > 0)
     return SKYETEK_SUCCESS;
@@ -1335,6 +1427,8 @@ TAGIMPL GenericTagImpl = {
   GenericTag_GetValue,
   GenericTag_ReadRecords,
   GenericTag_WriteRecord,
+  GenericTag_ReadFileStream,
+  GenericTag_WriteFileStream,
   GenericTag_CommitTransaction,
   GenericTag_AbortTransaction,
   GenericTag_EnableEAS,
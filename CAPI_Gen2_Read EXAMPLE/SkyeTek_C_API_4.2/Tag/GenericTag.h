@@ -7,10 +7,48 @@
 #ifndef GENERIC_TAG_H
 #define GENERIC_TAG_H
 
+#include "../Protocol/asn1.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Most requests fit here; larger ones spill to the heap */
+#define TAG_REQUEST_SIZE 256
+
+/* An ASN.1 request encoded on the stack */
+typedef struct TAG_REQUEST
+{
+  st_asn1_context           context;
+  st_asn1_context_storage   storage;
+  SKYETEK_DATA              data;
+  SKYETEK_STATUS            status;     /* why GenericTag_FinishRequest() failed */
+  unsigned char             buffer[TAG_REQUEST_SIZE];
+} TAG_REQUEST, *LPTAG_REQUEST;
+
+st_asn1_context
+GenericTag_StartRequest(
+    LPTAG_REQUEST        lpRequest
+    );
+
+/* Starts another request in the same buffer and context */
+st_asn1_context
+GenericTag_RestartRequest(
+    LPTAG_REQUEST        lpRequest
+    );
+
+/* Returns the encoded request, sized to fit, or NULL if encoding failed;
+   lpRequest->status then says why */
+LPSKYETEK_DATA
+GenericTag_FinishRequest(
+    LPTAG_REQUEST        lpRequest
+    );
+
+void
+GenericTag_FreeRequest(
+    LPTAG_REQUEST        lpRequest
+    );
+
 /* Tag functions */
 SKYETEK_STATUS 
 GenericTag_SelectTag(
@@ -333,6 +371,27 @@ GenericTag_WriteRecord(
     LPSKYETEK_DATA       lpData
     );
 
+SKYETEK_STATUS 
+GenericTag_ReadFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    SKYETEK_STREAM_CALLBACK     callback,
+    void                        *user,
+    unsigned int                *lpRead    );
+
+SKYETEK_STATUS 
+GenericTag_WriteFileStream(
+    LPSKYETEK_READER            lpReader, 
+    LPSKYETEK_TAG               lpTag, 
+    LPSKYETEK_ID                lpFile,
+    unsigned int                offset,
+    unsigned char               *lpBuffer,
+    unsigned int                size,
+    unsigned int                *lpWritten    );
+
 SKYETEK_STATUS 
 GenericTag_CommitTransaction(
     LPSKYETEK_READER     lpReader, 
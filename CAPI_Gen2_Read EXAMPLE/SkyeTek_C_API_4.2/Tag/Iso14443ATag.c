@@ -42,6 +42,7 @@ Iso14443ATag_InitializeSecureMemoryTag(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
   int64 w;
 
@@ -51,12 +52,7 @@ Iso14443ATag_InitializeSecureMemoryTag(
       lpKeyHMAC == NULL || lpKeyHMAC->lpData == NULL || lpKeyHMAC->lpData->data == NULL || lpKeyHMAC->lpData->size < 1 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(2048);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = hmac;
   st_asn1_write_enumerated(context,w);
@@ -83,12 +79,16 @@ Iso14443ATag_InitializeSecureMemoryTag(
 		st_asn1_write_boolean(context, 1);
 	
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
 
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->InitializeSecureMemoryTag(lpReader,lpTag,lpDataS,10000);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -113,6 +113,7 @@ Iso14443ATag_SetupSecureMemoryTag(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   st_asn1_context context;
 
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -121,12 +122,7 @@ Iso14443ATag_SetupSecureMemoryTag(
       lpKeyHMAC == NULL || lpKeyHMAC->lpData == NULL || lpKeyHMAC->lpData->data == NULL || lpKeyHMAC->lpData->size < 1 )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   if( lpKeyHMAC->name != NULL && _tcslen(lpKeyHMAC->name) > 0) {
     st_asn1_start_context_specific(context, 1);
@@ -147,12 +143,16 @@ Iso14443ATag_SetupSecureMemoryTag(
 		st_asn1_write_boolean(context, 1);
 	
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
 
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->SetupSecureMemoryTag(lpReader,lpTag,lpDataS,10000);
-  SkyeTek_FreeData(lpDataS);
+  GenericTag_FreeRequest(&req);
   return status;
 }
 
@@ -189,8 +189,12 @@ Iso14443ATag_TransportSend(
   LPPROTOCOLIMPL lppi;
   SKYETEK_STATUS status;
   LPSKYETEK_DATA lpDataS;
+  TAG_REQUEST req;
   LPSKYETEK_DATA lpDataR = NULL;
   st_asn1_context context;
+  st_asn1_context_storage storage;
+  unsigned char *p;
+  size_t len;
   int64 w;
   
   if( lpReader == NULL || lpReader->lpProtocol == NULL || 
@@ -202,12 +206,7 @@ Iso14443ATag_TransportSend(
       lpRecvData == NULL )
     return SKYETEK_INVALID_PARAMETER;
 
-  lpDataS = SkyeTek_AllocateData(1024);
-  if( lpDataS == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataS->data,lpDataS->size);
+  context = GenericTag_StartRequest(&req);
   st_asn1_start_sequence(context);
   w = transport;
   st_asn1_write_enumerated(context,w);
@@ -226,26 +225,35 @@ Iso14443ATag_TransportSend(
     st_asn1_finish_context_specific(context, 1);
   }
   st_asn1_finish_sequence(context);
-	lpDataS->size = st_asn1_finalize(context);
-  st_asn1_free_context(&context);
+  lpDataS = GenericTag_FinishRequest(&req);
+  if( lpDataS == NULL )
+  {
+    GenericTag_FreeRequest(&req);
+    return req.status;
+  }
   
   lppi = (LPPROTOCOLIMPL)lpReader->lpProtocol->internal;
   status = lppi->InterfaceSend(lpReader,lpTag,lpDataS,&lpDataR,5000);
+  GenericTag_FreeRequest(&req);
   if( status != SKYETEK_SUCCESS )
-  {
-    SkyeTek_FreeData(lpDataS);
     return status;
-  }
   if( lpDataR == NULL || lpDataR->data == NULL || lpDataR->size == 0 )
     return SKYETEK_SUCCESS;
   
-  *lpRecvData = SkyeTek_AllocateData(lpDataR->size);
-  if( *lpRecvData == NULL )
-    return SKYETEK_OUT_OF_MEMORY;
-  st_asn1_allocate_context(&context);
-  st_asn1_init(context, ST_ASN1_ENCODE,lpDataR->data,lpDataR->size);
-  st_asn1_read_octet_string(context, (*lpRecvData)->data, &(*lpRecvData)->size);
+  st_asn1_allocate_context_ext(&context, &storage, sizeof(storage));
+  st_asn1_init(context, ST_ASN1_DECODE,lpDataR->data,lpDataR->size);
+  if( !st_asn1_read_octet_string_view(context, &p, &len) )
+  {
+    st_asn1_free_context(&context);
+    SkyeTek_FreeData(lpDataR);
+    return SKYETEK_READER_PROTOCOL_ERROR;
+  }
   st_asn1_free_context(&context);
+
+  /* Hand back the response with the contents moved to the front */
+  memmove(lpDataR->data, p, len);
+  lpDataR->size = (unsigned int)len;
+  *lpRecvData = lpDataR;
   
   return SKYETEK_SUCCESS;
 }
@@ -293,6 +301,8 @@ TAGIMPL Iso14443ATagImpl = {
   GenericTag_GetValue,
   GenericTag_ReadRecords,
   GenericTag_WriteRecord,
+  GenericTag_ReadFileStream,
+  GenericTag_WriteFileStream,
   GenericTag_CommitTransaction,
   GenericTag_AbortTransaction,
   GenericTag_EnableEAS,
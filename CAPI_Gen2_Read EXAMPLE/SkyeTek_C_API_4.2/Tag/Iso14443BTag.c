@@ -71,6 +71,8 @@ TAGIMPL Iso14443BTagImpl = {
   GenericTag_GetValue,
   GenericTag_ReadRecords,
   GenericTag_WriteRecord,
+  GenericTag_ReadFileStream,
+  GenericTag_WriteFileStream,
   GenericTag_CommitTransaction,
   GenericTag_AbortTransaction,
   GenericTag_EnableEAS,
@@ -337,6 +337,29 @@ typedef struct TAGIMPL
         LPSKYETEK_DATA       lpData
         );
 
+    SKYETEK_STATUS 
+    (*ReadFileStream)(
+        LPSKYETEK_READER            lpReader, 
+        LPSKYETEK_TAG               lpTag, 
+        LPSKYETEK_ID                lpFile,
+        unsigned char               *lpBuffer,
+        unsigned int                size,
+        SKYETEK_STREAM_CALLBACK     callback,
+        void                        *user,
+        unsigned int                *lpRead
+        );
+
+    SKYETEK_STATUS 
+    (*WriteFileStream)(
+        LPSKYETEK_READER            lpReader, 
+        LPSKYETEK_TAG               lpTag, 
+        LPSKYETEK_ID                lpFile,
+        unsigned int                offset,
+        unsigned char               *lpBuffer,
+        unsigned int                size,
+        unsigned int                *lpWritten
+        );
+
     SKYETEK_STATUS 
     (*CommitTransaction)(
         LPSKYETEK_READER     lpReader, 
@@ -696,6 +719,21 @@ LPTAGTYPEDESC GetTagTypeDescription(unsigned int index);
  */
 unsigned char TagBlockToByte(SKYETEK_TAGTYPE type);
 
+/**
+ * Looks up the memory geometry of a tag in the tag info cache
+ * @param lpTag Tag to look up
+ * @param lpMemory Receives the geometry if it is cached
+ * @return 1 if it was cached, 0 if not
+ */
+int Tag_GetCachedInfo(LPSKYETEK_TAG lpTag, LPSKYETEK_MEMORY lpMemory);
+
+/**
+ * Keeps the memory geometry a tag reported in the tag info cache
+ * @param lpTag Tag the geometry is for
+ * @param lpMemory Geometry from GetTagInfo
+ */
+void Tag_CacheInfo(LPSKYETEK_TAG lpTag, LPSKYETEK_MEMORY lpMemory);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,227 @@
+/**
+ * TagInfoCache.c
+ * (c) 2004 - 2006 SkyeTek, Inc. All Rights Reserved.
+ *
+ * Process wide cache of tag memory geometry. The block layout of a tag
+ * is fixed by its IC, so GetTagInfo answers are kept by tag type and,
+ * for ISO 15693, the manufacturer and IC bytes of the UID. Types that
+ * do not pin down the IC are not cached.
+ */
+#include "../SkyeTekAPI.h"
+#include "Tag.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAGINFO_ENTRIES   64
+
+typedef struct TAGINFO_ENTRY
+{
+  SKYETEK_TAGTYPE       type;
+  unsigned char         ic[2];      /* UID manufacturer and IC bytes */
+  unsigned char         hasIc;
+  unsigned int          startBlock;
+  unsigned int          maxBlock;
+  unsigned int          bytesPerBlock;
+} TAGINFO_ENTRY, *LPTAGINFO_ENTRY;
+
+static TAGINFO_ENTRY g_tagInfo[TAGINFO_ENTRIES];
+static unsigned int g_tagInfoCount = 0;
+static unsigned int g_tagInfoNext = 0;    /* entry to replace when full */
+static unsigned char g_tagInfoEnabled = 1;
+static STATIC_MUTEX(g_tagInfoLock);
+
+/* Geometry from the data sheets, loaded by SkyeTek_SeedTagInfoCache(NULL,0) */
+static SKYETEK_TAG_GEOMETRY g_tagInfoTable[] = {
+  { ISO_MIFARE_ULTRALIGHT, 0, 15, 4 },
+  { MIFARE_1K, 0, 63, 16 },
+  { MIFARE_4K, 0, 255, 16 },
+  { TAGIT_HF1_STANDARD, 0, 7, 4 },
+  { TAGIT_HF1_PLUS, 0, 63, 4 },
+  { LRI512, 0, 15, 4 },
+  { LRI2K, 0, 63, 4 },
+  { MB89R118, 0, 249, 8 }
+};
+
+#define NUM_TAGINFO_TABLE sizeof(g_tagInfoTable)/sizeof(SKYETEK_TAG_GEOMETRY)
+
+static void
+TagInfo_Lock(void)
+{
+  STATIC_MUTEX_LOCK(&g_tagInfoLock);
+}
+
+static void
+TagInfo_Unlock(void)
+{
+  STATIC_MUTEX_UNLOCK(&g_tagInfoLock);
+}
+
+/* Fills in the key of a tag; returns 0 if its geometry cannot be cached */
+static int
+TagInfo_Key(
+    LPSKYETEK_TAG       lpTag,
+    LPTAGINFO_ENTRY     lpKey
+    )
+{
+  memset(lpKey, 0, sizeof(TAGINFO_ENTRY));
+  lpKey->type = lpTag->type;
+
+  /* 15693 UIDs are E0, manufacturer, IC; the IC tells variants of a type apart */
+  if( (lpTag->type & 0xFF00) == 0x0100 && lpTag->id != NULL &&
+      lpTag->id->id != NULL && lpTag->id->length == 8 && lpTag->id->id[0] == 0xE0 )
+  {
+    lpKey->ic[0] = lpTag->id->id[1];
+    lpKey->ic[1] = lpTag->id->id[2];
+    lpKey->hasIc = 1;
+    return 1;
+  }
+
+  /* Auto detect types cover many ICs, and EPC types do not tell the
+     user memory size of the IC apart */
+  if( (lpTag->type & 0x000F) == 0 || (lpTag->type & 0x8000) )
+    return 0;
+  return 1;
+}
+
+static LPTAGINFO_ENTRY
+TagInfo_Find(
+    LPTAGINFO_ENTRY     lpKey
+    )
+{
+  unsigned int ix;
+  for( ix = 0; ix < g_tagInfoCount; ix++ )
+  {
+    if( g_tagInfo[ix].type == lpKey->type && g_tagInfo[ix].hasIc == lpKey->hasIc &&
+        (!lpKey->hasIc || memcmp(g_tagInfo[ix].ic, lpKey->ic, 2) == 0) )
+      return &g_tagInfo[ix];
+  }
+  return NULL;
+}
+
+static void
+TagInfo_Store(
+    LPTAGINFO_ENTRY     lpKey,
+    unsigned int        startBlock,
+    unsigned int        maxBlock,
+    unsigned int        bytesPerBlock
+    )
+{
+  LPTAGINFO_ENTRY lpEntry = TagInfo_Find(lpKey);
+
+  if( lpEntry == NULL )
+  {
+    if( g_tagInfoCount < TAGINFO_ENTRIES )
+    {
+      lpEntry = &g_tagInfo[g_tagInfoCount++];
+    }
+    else
+    {
+      lpEntry = &g_tagInfo[g_tagInfoNext];
+      g_tagInfoNext = (g_tagInfoNext + 1) % TAGINFO_ENTRIES;
+    }
+    memcpy(lpEntry, lpKey, sizeof(TAGINFO_ENTRY));
+  }
+  lpEntry->startBlock = startBlock;
+  lpEntry->maxBlock = maxBlock;
+  lpEntry->bytesPerBlock = bytesPerBlock;
+}
+
+int
+Tag_GetCachedInfo(
+    LPSKYETEK_TAG       lpTag,
+    LPSKYETEK_MEMORY    lpMemory
+    )
+{
+  TAGINFO_ENTRY key;
+  LPTAGINFO_ENTRY lpEntry;
+  int found = 0;
+
+  if( lpTag == NULL || lpMemory == NULL || !TagInfo_Key(lpTag, &key) )
+    return 0;
+  TagInfo_Lock();
+  lpEntry = g_tagInfoEnabled ? TagInfo_Find(&key) : NULL;
+  if( lpEntry == NULL && g_tagInfoEnabled && key.hasIc && (key.type & 0x000F) != 0 )
+  {
+    /* A seeded entry for the type */
+    key.hasIc = 0;
+    lpEntry = TagInfo_Find(&key);
+  }
+  if( lpEntry != NULL )
+  {
+    lpMemory->startBlock = lpEntry->startBlock;
+    lpMemory->maxBlock = lpEntry->maxBlock;
+    lpMemory->bytesPerBlock = lpEntry->bytesPerBlock;
+    found = 1;
+  }
+  TagInfo_Unlock();
+  return found;
+}
+
+void
+Tag_CacheInfo(
+    LPSKYETEK_TAG       lpTag,
+    LPSKYETEK_MEMORY    lpMemory
+    )
+{
+  TAGINFO_ENTRY key;
+
+  if( lpTag == NULL || lpMemory == NULL || lpMemory->bytesPerBlock == 0 ||
+      !TagInfo_Key(lpTag, &key) )
+    return;
+  TagInfo_Lock();
+  if( g_tagInfoEnabled )
+    TagInfo_Store(&key, lpMemory->startBlock, lpMemory->maxBlock, lpMemory->bytesPerBlock);
+  TagInfo_Unlock();
+}
+
+SKYETEK_API SKYETEK_STATUS
+SkyeTek_SeedTagInfoCache(
+    LPSKYETEK_TAG_GEOMETRY    lpTable,
+    unsigned int              count
+    )
+{
+  TAGINFO_ENTRY key;
+  unsigned int ix;
+
+  if( lpTable == NULL )
+  {
+    lpTable = g_tagInfoTable;
+    count = NUM_TAGINFO_TABLE;
+  }
+  for( ix = 0; ix < count; ix++ )
+  {
+    if( (lpTable[ix].type & 0x000F) == 0 || (lpTable[ix].type & 0x8000) ||
+        lpTable[ix].bytesPerBlock == 0 || lpTable[ix].maxBlock < lpTable[ix].startBlock )
+      return SKYETEK_INVALID_PARAMETER;
+  }
+
+  TagInfo_Lock();
+  for( ix = 0; ix < count; ix++ )
+  {
+    memset(&key, 0, sizeof(TAGINFO_ENTRY));
+    key.type = lpTable[ix].type;
+    TagInfo_Store(&key, lpTable[ix].startBlock, lpTable[ix].maxBlock, lpTable[ix].bytesPerBlock);
+  }
+  TagInfo_Unlock();
+  return SKYETEK_SUCCESS;
+}
+
+SKYETEK_API void
+SkyeTek_ClearTagInfoCache(void)
+{
+  TagInfo_Lock();
+  g_tagInfoCount = 0;
+  g_tagInfoNext = 0;
+  TagInfo_Unlock();
+}
+
+SKYETEK_API void
+SkyeTek_EnableTagInfoCache(
+    unsigned char   enable
+    )
+{
+  TagInfo_Lock();
+  g_tagInfoEnabled = enable;
+  TagInfo_Unlock();
+}
@@ -0,0 +1,10 @@
+/************************************************************\
+    THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+    ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+    THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+    PARTICULAR PURPOSE.
+
+  Copyright  2006  SkyeTek Inc.  All Rights Reserved.
+
+/***************************************************************/
+#include "stdafx.h"
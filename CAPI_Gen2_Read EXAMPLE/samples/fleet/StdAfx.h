@@ -0,0 +1,24 @@
+/************************************************************\
+    THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+    ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+    THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+    PARTICULAR PURPOSE.
+
+  Copyright  2006  SkyeTek Inc.  All Rights Reserved.
+
+/***************************************************************/
+#if !defined(AFX_STDAFX_H__BDADE964_5450_4735_BDFF_0664C444B14A__INCLUDED_)
+#define AFX_STDAFX_H__BDADE964_5450_4735_BDFF_0664C444B14A__INCLUDED_
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#define WIN32_LEAN_AND_MEAN		// Exclude rarely-used stuff from Windows headers
+
+#include <stdio.h>
+
+//{{AFX_INSERT_LOCATION}}
+// Microsoft Visual C++ will insert additional declarations immediately before the previous line.
+
+#endif // !defined(AFX_STDAFX_H__BDADE964_5450_4735_BDFF_0664C444B14A__INCLUDED_)
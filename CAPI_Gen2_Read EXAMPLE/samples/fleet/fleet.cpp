@@ -0,0 +1,154 @@
+/************************************************************\
+    THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+    ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+    THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+    PARTICULAR PURPOSE.
+
+  Copyright  2006  SkyeTek Inc.  All Rights Reserved.
+
+/***************************************************************/
+
+#include "stdafx.h"
+#include <stdlib.h>
+#include <string.h>
+#include "SkyeTekAPI.h"
+#include "SkyeTekProtocol.h"
+
+// Updates the firmware on several readers at once:
+//   fleet [-j jobs] [-e firmware] [-r rollback.shf] image.shf port [port ...]
+// -j limits the number of uploads running at the same time, -e is the
+// SYS_FIRMWARE value (hex) the readers must report afterwards and -r is
+// the image put back on readers that fail.
+
+#define MAX_READERS 64
+
+int progress(LPSKYETEK_READER lpReader, LPSKYETEK_FIRMWARE_PROGRESS lpProgress, void *user)
+{
+  printf("%s: %3d%%  %lu/%lu bytes  %lu B/s  %lus left\n", lpReader->friendly,
+    lpProgress->percentComplete, lpProgress->bytesSent, lpProgress->bytesTotal,
+    lpProgress->bytesPerSecond, lpProgress->secondsRemaining);
+  return 1;
+}
+
+void usage()
+{
+  printf("usage: fleet [-j jobs] [-e firmware] [-r rollback.shf] image.shf port [port ...]\n");
+}
+
+int main(int argc, char* argv[])
+{
+  SKYETEK_STATUS st;
+  LPSKYETEK_DEVICE lpDevices[MAX_READERS];
+  LPSKYETEK_READER lpReaders[MAX_READERS];
+  SKYETEK_FIRMWARE_FLEET_RESULT results[MAX_READERS];
+  LPSKYETEK_FIRMWARE_IMAGE lpImage = NULL, lpRollback = NULL;
+  SKYETEK_SERIAL_SETTINGS settings;
+  unsigned int jobs = 0, expected = 0, count = 0, i = 0;
+  char *rollback = NULL;
+  int ix = 1, ret = 0;
+
+  for( ; ix < argc && argv[ix][0] == '-'; ix += 2 )
+  {
+    if( ix + 1 >= argc )
+    {
+      usage();
+      return 0;
+    }
+    if( strcmp(argv[ix],"-j") == 0 )
+      jobs = (unsigned int)strtoul(argv[ix+1], NULL, 10);
+    else if( strcmp(argv[ix],"-e") == 0 )
+      expected = (unsigned int)strtoul(argv[ix+1], NULL, 16);
+    else if( strcmp(argv[ix],"-r") == 0 )
+      rollback = argv[ix+1];
+    else
+    {
+      usage();
+      return 0;
+    }
+  }
+  if( argc - ix < 2 )
+  {
+    usage();
+    return 0;
+  }
+
+  // the image is validated once, before any reader is touched
+  st = SkyeTek_OpenFirmwareImage(argv[ix], &lpImage);
+  if( st != SKYETEK_SUCCESS )
+  {
+    printf("error: could not open %s: %s\n", argv[ix], SkyeTek_GetStatusMessage(st));
+    return 0;
+  }
+  printf("%s: %lu bytes in %d blocks\n", argv[ix], lpImage->dataLength, lpImage->blocks);
+  if( rollback != NULL )
+  {
+    st = SkyeTek_OpenFirmwareImage(rollback, &lpRollback);
+    if( st != SKYETEK_SUCCESS )
+    {
+      printf("error: could not open %s: %s\n", rollback, SkyeTek_GetStatusMessage(st));
+      SkyeTek_CloseFirmwareImage(lpImage);
+      return 0;
+    }
+  }
+
+  memset(&settings,0,sizeof(SKYETEK_SERIAL_SETTINGS));
+  settings.baudRate = 38400;
+  settings.dataBits = 8;
+  settings.parity = NONE;
+  settings.stopBits = ONE;
+
+  // find a reader on every port
+  for( ix++; ix < argc && count < MAX_READERS; ix++ )
+  {
+    lpDevices[count] = NULL;
+    lpReaders[count] = NULL;
+    st = SkyeTek_CreateDevice(argv[ix], &lpDevices[count]);
+    if( st == SKYETEK_SUCCESS )
+      st = SkyeTek_OpenDevice(lpDevices[count]);
+    if( st == SKYETEK_SUCCESS )
+      st = SkyeTek_SetSerialOptions(lpDevices[count], &settings);
+    if( st == SKYETEK_SUCCESS )
+      st = SkyeTek_CreateReader(lpDevices[count], &lpReaders[count]);
+    if( st != SKYETEK_SUCCESS )
+    {
+      printf("error: no reader on %s: %s\n", argv[ix], SkyeTek_GetStatusMessage(st));
+      SkyeTek_FreeDevice(lpDevices[count]);
+      continue;
+    }
+    printf("%s: %s firmware %s\n", argv[ix], lpReaders[count]->friendly, lpReaders[count]->firmware);
+    count++;
+  }
+
+  if( count > 0 )
+  {
+    st = SkyeTek_UploadFirmwareFleet(lpReaders, count, lpImage, lpRollback,
+      expected, jobs, progress, NULL, results);
+    ret = (st == SKYETEK_SUCCESS);
+
+    printf("\n");
+    for( i = 0; i < count; i++ )
+    {
+      printf("%s: %s", results[i].lpReader->friendly,
+        results[i].verified ? "updated" : "FAILED");
+      if( results[i].status != SKYETEK_SUCCESS )
+        printf(" (upload: %s)", SkyeTek_GetStatusMessage(results[i].status));
+      else
+        printf(" firmware %08X -> %08X", results[i].firmwareBefore, results[i].firmwareAfter);
+      if( results[i].rolledBack )
+        printf(" rolled back");
+      if( results[i].progress.resumes > 0 )
+        printf(" %d resumes", results[i].progress.resumes);
+      printf("\n");
+    }
+  }
+
+  for( i = 0; i < count; i++ )
+  {
+    SkyeTek_FreeReader(lpReaders[i]);
+    SkyeTek_FreeDevice(lpDevices[i]);
+  }
+  SkyeTek_CloseFirmwareImage(lpImage);
+  SkyeTek_CloseFirmwareImage(lpRollback);
+  printf("done\n");
+  return ret;
+}